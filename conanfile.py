@@ -0,0 +1,24 @@
+#Anything can be here. Look for more libraries via conan search -r=all library_name
+#Also you can check libs via https://conan.io/center
+from conans import ConanFile
+
+
+class CoolProjectConan(ConanFile):
+    settings = "os", "compiler", "build_type", "arch"
+    requires = (
+        "magnum/2020.06",
+        "magnum-extras/2020.06",
+        "magnum-integration/2020.06",
+        "magnum-plugins/2020.06",
+        "spdlog/1.9.2",
+    )
+    default_options = {
+        "magnum:shared_plugins": False,
+        "magnum-plugins:shared_plugins": False,
+    }
+    generators = "cmake"
+
+    def configure(self):
+        #Headless modes, Windows and macOS have no EGL (see main.cpp)
+        if self.settings.os not in ("Windows", "Macos"):
+            self.options["magnum"].with_windowlesseglapplication = True
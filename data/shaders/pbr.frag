@@ -0,0 +1,261 @@
+#define BASIC_MODE 0
+#define ALBEDO_MODE 1
+#define ROUGHNESS_MODE 2
+#define METALLIC_MODE 3
+#define NORMAL_MODE 4
+#define AO_MODE 5
+
+in vec2 frag_tex_coord;
+in mat3 frag_TBN;
+in vec3 frag_pos;
+#ifdef INSTANCED
+flat in vec3 frag_material_factors;
+#else
+const vec3 frag_material_factors = vec3(1.0);
+#endif
+#ifdef MATERIAL_TABLE
+flat in uint frag_material_id;
+#define MATERIAL_ID frag_material_id
+#endif
+out vec4 fragment_color;
+
+const float PI = 3.14159265;
+
+struct Surface
+{
+    vec3 normal;
+    vec3 view;
+    vec3 diffuse_color;
+    vec3 f0;
+    float alpha; //GGX, roughness squared
+};
+
+#ifdef IMAGE_BASED_LIGHTING
+layout(std140, binding = 2) uniform EnvironmentUniforms
+{
+    vec4 sh_irradiance[9];
+    float specular_max_lod;
+    float environment_intensity;
+};
+
+uniform samplerCube specular_environment;
+uniform sampler2D brdf_lut;
+
+//Irradiance / pi around a world space normal
+vec3 sh_irradiance_at(vec3 n)
+{
+    vec3 result = sh_irradiance[0].rgb
+        + sh_irradiance[1].rgb * n.y + sh_irradiance[2].rgb * n.z + sh_irradiance[3].rgb * n.x
+        + sh_irradiance[4].rgb * (n.x * n.y) + sh_irradiance[5].rgb * (n.y * n.z)
+        + sh_irradiance[6].rgb * (3.0 * n.z * n.z - 1.0) + sh_irradiance[7].rgb * (n.x * n.z)
+        + sh_irradiance[8].rgb * (n.x * n.x - n.y * n.y);
+    return max(result, vec3(0.0));
+}
+
+//GGX, Smith-Schlick visibility and Schlick Fresnel, the same model the
+//prefiltered environment and the LUT integrate. Scaled by pi so a
+//white Lambert surface reflects the light color like the basic path.
+vec3 shade(Surface surface, vec3 L)
+{
+    float NdotL = max(dot(surface.normal, L), 0.0);
+    if (NdotL <= 0.0)
+    {
+        return vec3(0.0);
+    }
+
+    vec3 H = normalize(L + surface.view);
+    float NdotV = max(dot(surface.normal, surface.view), 1.0e-4);
+    float NdotH = max(dot(surface.normal, H), 0.0);
+    float VdotH = max(dot(surface.view, H), 0.0);
+
+    float alpha2 = surface.alpha * surface.alpha;
+    float d = NdotH * NdotH * (alpha2 - 1.0) + 1.0;
+    float distribution = alpha2 / (PI * d * d);
+    float k = surface.alpha * 0.5;
+    float visibility = 0.25 / ((NdotL * (1.0 - k) + k) * (NdotV * (1.0 - k) + k));
+    vec3 fresnel = surface.f0 + (1.0 - surface.f0) * pow(1.0 - VdotH, 5.0);
+
+    vec3 diffuse = (1.0 - fresnel) * surface.diffuse_color;
+    return (diffuse + PI * distribution * visibility * fresnel) * NdotL;
+}
+#else
+vec3 shade(Surface surface, vec3 L)
+{
+    return surface.diffuse_color * max(dot(surface.normal, L), 0.0);
+}
+#endif
+
+#if defined(POINT_LIGHTS) || defined(CLUSTERED_LIGHTS)
+struct Light
+{
+    vec4 position_range;
+    vec4 color;
+    vec4 direction;
+};
+
+layout(std430, binding = 2) readonly buffer Lights
+{
+    Light lights[];
+};
+
+//Incoming radiance and direction, windowed inverse square falloff
+//that reaches zero at the range
+vec3 light_radiance(Light light, out vec3 L)
+{
+    vec3 to_light = light.position_range.xyz - frag_pos;
+    float distance_squared = dot(to_light, to_light);
+    L = to_light * inversesqrt(max(distance_squared, 1.0e-8));
+
+    float falloff = distance_squared / (light.position_range.w * light.position_range.w);
+    float window = clamp(1.0 - falloff * falloff, 0.0, 1.0);
+    float attenuation = window * window / (distance_squared + 1.0);
+    float spot = smoothstep(light.direction.w, light.color.w, dot(-L, light.direction.xyz));
+
+    return light.color.rgb * (attenuation * spot);
+}
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+layout(std430, binding = 3) readonly buffer ClusterRanges
+{
+    uvec2 cluster_ranges[]; //offset into light_indices, count
+};
+
+layout(std430, binding = 4) readonly buffer LightIndices
+{
+    uint light_index_count;
+    uint light_indices[];
+};
+#endif
+
+#ifdef PARALLAX_OCCLUSION
+//Steps through depth layers until the ray from the eye drops below
+//the height field, PARALLAX_MIN/MAX_STEPS and PARALLAX_REFINE come
+//from the quality tier. Gradients of the original UV keep the mip
+//selection stable inside the loop.
+vec2 parallax_occlusion(vec2 uv, vec3 view_tangent)
+{
+    vec2 uv_dx = dFdx(uv);
+    vec2 uv_dy = dFdy(uv);
+
+    //Grazing angles need more layers
+    float steps = mix(float(PARALLAX_MAX_STEPS), float(PARALLAX_MIN_STEPS), clamp(view_tangent.z, 0.0, 1.0));
+    float layer = 1.0 / steps;
+    vec2 shift = view_tangent.xy / max(view_tangent.z, 0.1) * MATERIAL_HEIGHT_FACTOR * PARALLAX_SCALE * layer;
+
+    vec2 current = uv;
+    float layer_depth = 0.0;
+    float surface_depth = 1.0 - textureGrad(HEIGHT_TEXTURE, MATERIAL_UV(current), uv_dx, uv_dy).HEIGHT_CHANNEL;
+    for (int i = 0; i < PARALLAX_MAX_STEPS && layer_depth < surface_depth; ++i)
+    {
+        current -= shift;
+        layer_depth += layer;
+        surface_depth = 1.0 - textureGrad(HEIGHT_TEXTURE, MATERIAL_UV(current), uv_dx, uv_dy).HEIGHT_CHANNEL;
+    }
+
+    #if PARALLAX_REFINE
+    //Intersect the segment between the last two layers
+    vec2 previous = current + shift;
+    float after = surface_depth - layer_depth;
+    float before = 1.0 - textureGrad(HEIGHT_TEXTURE, MATERIAL_UV(previous), uv_dx, uv_dy).HEIGHT_CHANNEL - (layer_depth - layer);
+    current = mix(current, previous, clamp(after / (after - before), 0.0, 1.0));
+    #endif
+
+    return current;
+}
+#endif
+
+void main()
+{
+    const float gamma = 2.2;
+
+    #ifdef PARALLAX_OCCLUSION
+    vec2 uv = parallax_occlusion(frag_tex_coord, normalize(transpose(frag_TBN) * normalize(-frag_pos)));
+    #else
+    vec2 uv = frag_tex_coord;
+    #endif
+
+    vec4 albedo = texture(ALBEDO_TEXTURE, MATERIAL_UV(uv)) * albedo_factor * frag_material_factors.x;
+    #ifdef MATERIAL_TABLE
+    albedo.rgb *= materials[MATERIAL_ID].albedo_tint.rgb;
+    #endif
+
+    #ifdef PACKED_MATERIAL
+    //One fetch for everything but albedo and normal
+    vec4 ormh = texture(ORMH_TEXTURE, MATERIAL_UV(uv));
+    float roughness = ormh.g * roughness_factor * frag_material_factors.y;
+    float metallic = ormh.b * metallic_factor * frag_material_factors.z;
+    vec3 ao = vec3(ormh.r) * ao_factor;
+    #else
+    float roughness = texture(ROUGHNESS_TEXTURE, MATERIAL_UV(uv)).r * roughness_factor * frag_material_factors.y;
+    float metallic = texture(METALLIC_TEXTURE, MATERIAL_UV(uv)).r * metallic_factor * frag_material_factors.z;
+    vec3 ao = vec3(texture(AO_TEXTURE, MATERIAL_UV(uv)).r) * ao_factor;
+    #endif
+
+    //Only XY are stored (BC5/RG8), Z is always positive in tangent space
+    vec3 normal;
+    normal.xy = texture(NORMAL_TEXTURE, MATERIAL_UV(uv)).rg * 2.0 - vec2(1.0);
+    normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
+    normal = normalize(frag_TBN * normal) * (gl_FrontFacing ? 1.0 : -1.0) * normal_factor;
+
+    //RENDER_MODE is defined per permutation, the other modes are compiled out
+    #if RENDER_MODE == ROUGHNESS_MODE
+    fragment_color = vec4(vec3(roughness), 1.0);
+    #elif RENDER_MODE == METALLIC_MODE
+    fragment_color = vec4(vec3(metallic), 1.0);
+    #elif RENDER_MODE == NORMAL_MODE
+    fragment_color = vec4(normal * 0.5 + 0.5, 1.0);
+    #elif RENDER_MODE == AO_MODE
+    fragment_color = vec4(ao, 1.0);
+    #elif RENDER_MODE == ALBEDO_MODE
+    fragment_color = albedo;
+    #else
+    Surface surface;
+    surface.normal = normal;
+    surface.view = normalize(-frag_pos);
+    #ifdef IMAGE_BASED_LIGHTING
+    surface.diffuse_color = albedo.rgb * (1.0 - metallic);
+    surface.f0 = mix(vec3(0.04), albedo.rgb, metallic);
+    surface.alpha = max(roughness * roughness, 0.002);
+
+    //The environment is in world space, everything else in view space
+    mat3 view_to_world = transpose(mat3(view_matrix));
+    float NdotV = max(dot(normal, surface.view), 1.0e-4);
+    vec2 split_sum = texture(brdf_lut, vec2(NdotV, roughness)).rg;
+    vec3 prefiltered = textureLod(specular_environment, view_to_world * reflect(-surface.view, normal),
+        roughness * specular_max_lod).rgb;
+    vec3 environment = sh_irradiance_at(view_to_world * normal) * surface.diffuse_color
+        + prefiltered * (surface.f0 * split_sum.x + split_sum.y);
+
+    fragment_color = vec4(environment * ao * environment_intensity
+        + light_color * shade(surface, normalize(-light_direction)) * ao, albedo.a);
+    #else
+    surface.diffuse_color = albedo.rgb;
+    float NdotL = max(dot(normal, normalize(-light_direction)), 0.1);
+    fragment_color = (0.1 + NdotL * vec4(light_color, 1.0) * vec4(ao, 1.0) * 0.9) * albedo;
+    #endif
+
+    vec3 local = vec3(0.0);
+    vec3 L;
+    #if defined(POINT_LIGHTS)
+    for (uint i = 0u; i < light_count; ++i)
+    {
+        local += light_radiance(lights[i], L) * shade(surface, L);
+    }
+    #elif defined(CLUSTERED_LIGHTS)
+    //Screen tile from the pixel, exponential depth slice from the view depth
+    uvec3 cell = uvec3(uvec2(gl_FragCoord.xy * cluster_params.xy),
+        uint(max(log(-frag_pos.z) * cluster_params.z - cluster_params.w, 0.0)));
+    cell = min(cell, cluster_grid.xyz - uvec3(1u));
+    uvec2 range = cluster_ranges[cell.x + cluster_grid.x * (cell.y + cluster_grid.y * cell.z)];
+    for (uint i = 0u; i < range.y; ++i)
+    {
+        local += light_radiance(lights[light_indices[range.x + i]], L) * shade(surface, L);
+    }
+    #endif
+    fragment_color.rgb += local * ao;
+    #endif
+
+    fragment_color.rgb = pow(fragment_color.rgb, vec3(1.0 / gamma));
+    //fragment_color = vec4(normal, 1.0);
+}
@@ -0,0 +1,123 @@
+#ifdef PACKED_POSITIONS
+layout(location = 0) in vec4 packed_position; //snorm16
+#define VERTEX_POSITION (packed_position.xyz * position_scale)
+#else
+layout(location = 0) in vec3 position;
+#define VERTEX_POSITION position
+#endif
+layout(location = 1) in vec2 tex_coord;
+
+#ifdef PACKED_VERTICES
+//snorm16 octahedral directions, the tangent has the bitangent sign in z
+layout(location = 3) in vec4 packed_tangent;
+layout(location = 5) in vec2 packed_normal;
+
+vec3 octahedral_decode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+    return normalize(v);
+}
+
+#define VERTEX_NORMAL octahedral_decode(packed_normal)
+#define VERTEX_TANGENT4 vec4(octahedral_decode(packed_tangent.xy), packed_tangent.z)
+#else
+layout(location = 3) in vec4 tangent4;
+layout(location = 5) in vec3 normal;
+#define VERTEX_NORMAL normal
+#define VERTEX_TANGENT4 tangent4
+#endif
+
+#ifdef TESSELLATED
+//Undisplaced, the evaluation stage displaces
+out vec3 vertex_pos;
+out vec3 vertex_tangent;
+out vec3 vertex_bitangent;
+out vec3 vertex_normal;
+out vec2 vertex_tex_coord;
+out vec3 vertex_material_factors;
+#else
+out vec2 frag_tex_coord;
+out mat3 frag_TBN;
+out vec3 frag_pos;
+#endif
+
+#ifdef INSTANCED
+struct InstanceData
+{
+    mat4 model_matrix;
+    vec4 normal_matrix[3];
+    vec4 factors;
+};
+
+layout(std430, binding = 0) readonly buffer Instances
+{
+    InstanceData instances[];
+};
+
+layout(std430, binding = 1) readonly buffer InstanceIndices
+{
+    uint instance_indices[];
+};
+
+#ifndef TESSELLATED
+flat out vec3 frag_material_factors;
+#endif
+#endif
+
+#ifdef MATERIAL_TABLE
+flat out uint frag_material_id;
+#define MATERIAL_ID material_id
+#endif
+
+void main()
+{
+    #ifdef INSTANCED
+    InstanceData instance = instances[instance_indices[instance_offset + uint(gl_InstanceID)]];
+    mat3 instance_normal_matrix = mat3(instance.normal_matrix[0].xyz, instance.normal_matrix[1].xyz, instance.normal_matrix[2].xyz);
+    mat3 object_normal_matrix = normal_matrix * instance_normal_matrix;
+    mat4 object_matrix = model_matrix * instance.model_matrix;
+    vec3 material_factors = instance.factors.xyz;
+    #ifdef MATERIAL_TABLE
+    uint material_id = uint(instance.factors.w);
+    material_factors.yz *= vec2(materials[material_id].roughness_factor, materials[material_id].metallic_factor);
+    frag_material_id = material_id;
+    #endif
+    #else
+    mat3 object_normal_matrix = normal_matrix;
+    mat4 object_matrix = model_matrix;
+    vec3 material_factors = vec3(1.0);
+    #endif
+
+    vec4 vertex_tangent4 = VERTEX_TANGENT4;
+    vec3 N = normalize(object_normal_matrix * VERTEX_NORMAL);
+    vec3 T = normalize(object_normal_matrix * vertex_tangent4.xyz);
+    vec3 B = normalize(vertex_tangent4.w * cross(N, T));
+
+    mat4 mv_matrix = view_matrix * object_matrix;
+    vec4 pos = mv_matrix * vec4(VERTEX_POSITION, 1.0);
+
+    #if defined(TESSELLATED)
+    vertex_pos = pos.xyz;
+    vertex_tangent = T;
+    vertex_bitangent = B;
+    vertex_normal = N;
+    vertex_tex_coord = tex_coord;
+    vertex_material_factors = material_factors;
+    gl_Position = pos;
+    #else
+    frag_TBN = mat3(T, B, N);
+    #ifdef PARALLAX_OCCLUSION
+    //The fragment shader traces the height field instead
+    frag_pos = pos.xyz;
+    #else
+    frag_pos = pos.xyz + N * textureLod(HEIGHT_TEXTURE, MATERIAL_UV(tex_coord), 0.0).HEIGHT_CHANNEL * MATERIAL_HEIGHT_FACTOR;
+    #endif
+    gl_Position = proj_matrix * vec4(frag_pos, 1.0);
+    frag_tex_coord = tex_coord;
+    #ifdef INSTANCED
+    frag_material_factors = material_factors;
+    #endif
+    #endif
+}
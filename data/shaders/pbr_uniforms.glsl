@@ -0,0 +1,120 @@
+//Shared by all stages, block members are visible as plain globals so
+//the shader bodies don't care which variant they're in
+
+#ifdef UNIFORM_BUFFERS
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 view_matrix;
+    mat4 proj_matrix;
+    vec3 light_direction;
+    vec3 light_color;
+    uint light_count;
+    uvec4 cluster_grid;
+    vec4 cluster_params;
+    vec2 viewport_size;
+    float tessellation_pixels;
+};
+
+layout(std140, binding = 1) uniform ObjectUniforms
+{
+    mat4 model_matrix;
+    mat3 normal_matrix;
+    float albedo_factor;
+    float roughness_factor;
+    float metallic_factor;
+    float normal_factor;
+    float ao_factor;
+    float height_factor;
+    uint instance_offset;
+    float position_scale;
+};
+#else
+uniform mat4 view_matrix;
+uniform mat4 proj_matrix;
+uniform vec3 light_direction = vec3(0.0, -0.5, -0.5);
+uniform vec3 light_color = vec3(1.0);
+uniform uint light_count = 0u;
+uniform uvec4 cluster_grid = uvec4(1u);
+uniform vec4 cluster_params = vec4(0.0);
+uniform vec2 viewport_size = vec2(1024.0);
+uniform float tessellation_pixels = 8.0;
+
+uniform mat4 model_matrix;
+uniform mat3 normal_matrix;
+uniform float albedo_factor = 1.0;
+uniform float roughness_factor = 1.0;
+uniform float metallic_factor = 1.0;
+uniform float normal_factor = 1.0;
+uniform float ao_factor = 1.0;
+uniform float height_factor = 0.5;
+uniform uint instance_offset = 0u;
+uniform float position_scale = 1.0;
+#endif
+
+#ifdef MATERIAL_TABLE
+struct Material
+{
+    vec4 albedo_tint;
+    float roughness_factor;
+    float metallic_factor;
+    float height_factor;
+    uint texture_set;
+    uvec2 handles[6];
+};
+
+layout(std430, binding = 6) readonly buffer Materials
+{
+    Material materials[];
+};
+
+//MATERIAL_ID is defined by each stage
+#define MATERIAL_HEIGHT_FACTOR (height_factor * materials[MATERIAL_ID].height_factor)
+#else
+#define MATERIAL_HEIGHT_FACTOR height_factor
+#endif
+
+//Material maps are sampled through these, so the stages don't care
+//whether they are plain textures, array layers or bindless handles
+#ifdef TEXTURE_ARRAYS
+#define MATERIAL_SAMPLER sampler2DArray
+#define MATERIAL_UV(uv) vec3(uv, float(materials[MATERIAL_ID].texture_set))
+#else
+#define MATERIAL_SAMPLER sampler2D
+#define MATERIAL_UV(uv) (uv)
+#endif
+
+#ifdef BINDLESS_TEXTURES
+#define ALBEDO_TEXTURE sampler2D(materials[MATERIAL_ID].handles[0])
+#define NORMAL_TEXTURE sampler2D(materials[MATERIAL_ID].handles[1])
+#define ROUGHNESS_TEXTURE sampler2D(materials[MATERIAL_ID].handles[2])
+#define METALLIC_TEXTURE sampler2D(materials[MATERIAL_ID].handles[3])
+#define AO_TEXTURE sampler2D(materials[MATERIAL_ID].handles[4])
+#define HEIGHT_MAP_TEXTURE sampler2D(materials[MATERIAL_ID].handles[5])
+#define ORMH_TEXTURE sampler2D(materials[MATERIAL_ID].handles[2])
+#else
+uniform MATERIAL_SAMPLER albedo_texture;
+uniform MATERIAL_SAMPLER normal_texture;
+#define ALBEDO_TEXTURE albedo_texture
+#define NORMAL_TEXTURE normal_texture
+#ifdef PACKED_MATERIAL
+uniform MATERIAL_SAMPLER ormh_texture;
+#define ORMH_TEXTURE ormh_texture
+#else
+uniform MATERIAL_SAMPLER roughness_texture;
+uniform MATERIAL_SAMPLER metallic_texture;
+uniform MATERIAL_SAMPLER ao_texture;
+uniform MATERIAL_SAMPLER height_texture;
+#define ROUGHNESS_TEXTURE roughness_texture
+#define METALLIC_TEXTURE metallic_texture
+#define AO_TEXTURE ao_texture
+#define HEIGHT_MAP_TEXTURE height_texture
+#endif
+#endif
+
+#ifdef PACKED_MATERIAL
+#define HEIGHT_TEXTURE ORMH_TEXTURE
+#define HEIGHT_CHANNEL a
+#else
+#define HEIGHT_TEXTURE HEIGHT_MAP_TEXTURE
+#define HEIGHT_CHANNEL r
+#endif
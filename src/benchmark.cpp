@@ -0,0 +1,855 @@
+#include "benchmark.hpp"
+#include <Magnum/GL/Context.h>
+#include <Magnum/GL/Extensions.h>
+#include <Magnum/GL/Framebuffer.h>
+#include <Magnum/GL/PipelineStatisticsQuery.h>
+#include <Magnum/GL/Renderer.h>
+#include <Magnum/GL/TimeQuery.h>
+#include <Magnum/Image.h>
+#include <Magnum/Math/Constants.h>
+#include <Magnum/PixelFormat.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <sstream>
+#include "json.hpp"
+#include "memory_tracker.hpp"
+#include "offscreen_target.hpp"
+#include "profiler.hpp"
+
+namespace
+{
+    //Queries are read back this many frames after they were issued so the
+    //CPU doesn't wait for the GPU every frame
+    constexpr std::size_t QueryLatency = 3;
+
+    enum Pass : std::size_t
+    {
+        ClearPass,
+        ScenePass,
+        PostPass, //resolve, anti-aliasing and upscale, empty without post processing
+        PassCount
+    };
+
+    const char* const pass_names[PassCount]{ "clear", "scene", "post" };
+
+    struct Summary
+    {
+        double mean = 0.0;
+        double min = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    //Nearest-rank percentiles
+    Summary summarize(std::vector<double> values)
+    {
+        Summary summary;
+        if (values.empty())
+        {
+            return summary;
+        }
+
+        std::sort(values.begin(), values.end());
+        const auto percentile = [&](double p)
+        {
+            const std::size_t rank = std::size_t(std::ceil(p / 100.0 * values.size()));
+            return values[std::max<std::size_t>(rank, 1) - 1];
+        };
+
+        double sum = 0.0;
+        for (double value : values)
+        {
+            sum += value;
+        }
+
+        summary.mean = sum / values.size();
+        summary.min = values.front();
+        summary.p50 = percentile(50.0);
+        summary.p95 = percentile(95.0);
+        summary.p99 = percentile(99.0);
+        summary.max = values.back();
+        return summary;
+    }
+
+    void write_summary(std::ostream& out, const Summary& summary)
+    {
+        out << "{ \"mean\": " << summary.mean << ", \"min\": " << summary.min
+            << ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95
+            << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << " }";
+    }
+
+    void write_config(std::ostream& out, const Vector2i& resolution, const std::vector<std::pair<std::string, std::string>>& settings,
+        std::initializer_list<std::pair<const char*, std::size_t>> counts)
+    {
+        out << "  \"config\": {\n";
+        for (const auto& [key, value] : counts)
+        {
+            out << "    " << json_string(key) << ": " << value << ",\n";
+        }
+        out << "    \"width\": " << resolution.x() << ",\n";
+        out << "    \"height\": " << resolution.y() << ",\n";
+        for (const auto& [key, value] : settings)
+        {
+            out << "    " << json_string(key) << ": " << json_string(value) << ",\n";
+        }
+        out << "    \"gl_vendor\": " << json_string(GL::Context::current().vendorString()) << ",\n";
+        out << "    \"gl_renderer\": " << json_string(GL::Context::current().rendererString()) << ",\n";
+        out << "    \"gl_version\": " << json_string(GL::Context::current().versionString()) << "\n";
+        out << "  },\n";
+    }
+
+    bool write_report(const std::string& json, const std::string& output)
+    {
+        if (output == "-")
+        {
+            std::cout << json;
+            return true;
+        }
+
+        std::ofstream file{ output };
+        file << json;
+        if (!file)
+        {
+            spdlog::error("Can't write {}", output);
+            return false;
+        }
+
+        spdlog::info("  report written to {}", output);
+        return true;
+    }
+}
+
+double image_psnr(const Image2D& image, const Image2D& reference)
+{
+    constexpr double MaxPsnr = 100.0;
+
+    const Containers::ArrayView<const char> a = image.data();
+    const Containers::ArrayView<const char> b = reference.data();
+    double squared_error = 0.0;
+    std::size_t samples = 0;
+    for (std::size_t i = 0; i + 4 <= std::min(a.size(), b.size()); i += 4)
+    {
+        for (std::size_t channel = 0; channel != 3; ++channel)
+        {
+            const double difference = double(UnsignedByte(a[i + channel])) - double(UnsignedByte(b[i + channel]));
+            squared_error += difference * difference;
+        }
+        samples += 3;
+    }
+
+    if (samples == 0 || squared_error == 0.0)
+    {
+        return MaxPsnr;
+    }
+    return std::min(10.0 * std::log10(255.0 * 255.0 * samples / squared_error), MaxPsnr);
+}
+
+SceneFrame benchmark_frame(std::size_t frame)
+{
+    //A fixed 60 Hz timeline, the light orbits once every 240 frames
+    SceneFrame scene_frame;
+    scene_frame.time = frame / 60.0;
+
+    const float angle = Constants::tau() * float(frame % 240) / 240.0f;
+    scene_frame.light_direction = Vector3{ 2.0f * std::cos(angle), std::sin(angle), -1.0f }.normalized();
+    return scene_frame;
+}
+
+bool run_benchmark(DemoScene& scene, const BenchmarkConfig& config)
+{
+    OffscreenTarget target{ config.resolution };
+    if (!target.bind())
+    {
+        return false;
+    }
+
+    Containers::Optional<PostProcess> post;
+    if (config.post_process)
+    {
+        post.emplace(config.resolution, *config.post_process);
+    }
+
+    std::vector<std::array<GL::TimeQuery, PassCount>> queries;
+    for (std::size_t i = 0; i != QueryLatency; ++i)
+    {
+        queries.push_back({ GL::TimeQuery{ GL::TimeQuery::Target::TimeElapsed }, GL::TimeQuery{ GL::TimeQuery::Target::TimeElapsed },
+            GL::TimeQuery{ GL::TimeQuery::Target::TimeElapsed } });
+    }
+
+    //Shader invocations of the scene pass show where displacement moves the work
+    constexpr std::size_t StatisticCount = 3;
+    const std::array<GL::PipelineStatisticsQuery::Target, StatisticCount> statistic_targets{
+        GL::PipelineStatisticsQuery::Target::VertexShaderInvocations,
+        GL::PipelineStatisticsQuery::Target::TessellationEvaluationShaderInvocations,
+        GL::PipelineStatisticsQuery::Target::FragmentShaderInvocations
+    };
+    const char* const statistic_names[StatisticCount]{ "vertex_invocations", "tess_eval_invocations", "fragment_invocations" };
+
+    const bool pipeline_statistics = GL::Context::current().isExtensionSupported<GL::Extensions::ARB::pipeline_statistics_query>();
+    std::vector<std::array<GL::PipelineStatisticsQuery, StatisticCount>> statistic_queries;
+    if (pipeline_statistics)
+    {
+        for (std::size_t i = 0; i != QueryLatency; ++i)
+        {
+            statistic_queries.push_back({ GL::PipelineStatisticsQuery{ statistic_targets[0] },
+                GL::PipelineStatisticsQuery{ statistic_targets[1] }, GL::PipelineStatisticsQuery{ statistic_targets[2] } });
+        }
+    }
+    else
+    {
+        spdlog::info("ARB_pipeline_statistics_query not supported, no shader invocation counts");
+    }
+
+    std::vector<double> cpu_ms;
+    std::vector<double> frame_ms;
+    std::array<std::vector<double>, PassCount> gpu_ms;
+    std::array<double, StatisticCount> statistic_sum{};
+    std::vector<double> gpu_total_ms;
+    std::vector<double> cull_ms;
+    std::vector<double> streaming_ms;
+    std::vector<double> render_scales;
+    double visible_sum = 0.0;
+    double vertex_sum = 0.0;
+    double vertex_byte_sum = 0.0;
+    double draw_call_sum = 0.0;
+    double fence_wait_sum = 0.0;
+    GLStateCounters gl_sum;
+
+    const auto collect = [&](std::size_t frame)
+    {
+        double total = 0.0;
+        for (std::size_t pass = 0; pass != PassCount; ++pass)
+        {
+            const double ms = queries[frame % QueryLatency][pass].result<UnsignedLong>() / 1.0e6;
+            total += ms;
+            if (frame >= config.warmup_frames)
+            {
+                gpu_ms[pass].push_back(ms);
+            }
+        }
+
+        if (frame >= config.warmup_frames)
+        {
+            gpu_total_ms.push_back(total);
+            for (std::size_t i = 0; pipeline_statistics && i != StatisticCount; ++i)
+            {
+                statistic_sum[i] += double(statistic_queries[frame % QueryLatency][i].result<UnsignedLong>());
+            }
+        }
+    };
+
+    const std::size_t frame_count = config.warmup_frames + config.frames;
+    spdlog::info("Benchmark: {} frames (+{} warmup) at {}x{}", config.frames, config.warmup_frames,
+        config.resolution.x(), config.resolution.y());
+
+    const auto run_start = std::chrono::steady_clock::now();
+    auto last_frame_start = run_start;
+    auto recorded_start = run_start;
+
+    for (std::size_t frame = 0; frame != frame_count; ++frame)
+    {
+        //Reusing the slot means waiting for the frame QueryLatency ago
+        if (frame >= QueryLatency)
+        {
+            collect(frame - QueryLatency);
+        }
+
+        const auto frame_start = std::chrono::steady_clock::now();
+        if (frame == config.warmup_frames)
+        {
+            recorded_start = frame_start;
+        }
+        else if (frame > config.warmup_frames)
+        {
+            frame_ms.push_back(std::chrono::duration<double, std::milli>(frame_start - last_frame_start).count());
+        }
+        last_frame_start = frame_start;
+
+        auto& frame_queries = queries[frame % QueryLatency];
+
+        frame_queries[ClearPass].begin();
+        target.framebuffer.clear(GL::FramebufferClear::Color | GL::FramebufferClear::Depth);
+        frame_queries[ClearPass].end();
+
+        frame_queries[ScenePass].begin();
+        for (std::size_t i = 0; pipeline_statistics && i != StatisticCount; ++i)
+        {
+            statistic_queries[frame % QueryLatency][i].begin();
+        }
+        if (post)
+        {
+            post->begin_frame();
+            SceneFrame scene_frame = benchmark_frame(frame);
+            scene_frame.jitter = post->jitter();
+            scene.draw(scene_frame, post->render_size());
+        }
+        else
+        {
+            scene.draw(benchmark_frame(frame), config.resolution);
+        }
+        for (std::size_t i = 0; pipeline_statistics && i != StatisticCount; ++i)
+        {
+            statistic_queries[frame % QueryLatency][i].end();
+        }
+        frame_queries[ScenePass].end();
+
+        frame_queries[PostPass].begin();
+        if (post)
+        {
+            post->end_frame(target.framebuffer, scene.reprojection());
+        }
+        frame_queries[PostPass].end();
+
+        if (frame >= config.warmup_frames)
+        {
+            cpu_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count());
+
+            const SceneStats& stats = scene.stats();
+            cull_ms.push_back(stats.cull_ms);
+            visible_sum += stats.visible_instances;
+            vertex_sum += stats.vertices;
+            vertex_byte_sum += stats.vertex_bytes;
+            draw_call_sum += stats.draw_calls;
+            fence_wait_sum += stats.fence_wait_ms;
+            gl_sum.buffer_binds += stats.gl.buffer_binds;
+            gl_sum.buffer_binds_skipped += stats.gl.buffer_binds_skipped;
+            streaming_ms.push_back(stats.streaming.update_ms);
+            if (post)
+            {
+                render_scales.push_back(post->stats().render_scale);
+            }
+        }
+
+        if (FrameProfiler* const profiler = FrameProfiler::current())
+        {
+            profiler->end_frame();
+        }
+    }
+
+    GL::Renderer::finish();
+    const auto run_end = std::chrono::steady_clock::now();
+    if (frame_count > config.warmup_frames)
+    {
+        frame_ms.push_back(std::chrono::duration<double, std::milli>(run_end - last_frame_start).count());
+    }
+
+    for (std::size_t frame = frame_count > QueryLatency ? frame_count - QueryLatency : 0; frame != frame_count; ++frame)
+    {
+        collect(frame);
+    }
+
+    const double recorded_ms = std::chrono::duration<double, std::milli>(run_end - recorded_start).count();
+    const Summary cpu = summarize(cpu_ms);
+    const Summary wall = summarize(frame_ms);
+    const Summary gpu = summarize(gpu_total_ms);
+
+    std::ostringstream json;
+    json << "{\n";
+    write_config(json, config.resolution, config.settings, { { "frames", config.frames }, { "warmup_frames", config.warmup_frames } });
+    json << "  \"total_ms\": " << recorded_ms << ",\n";
+    json << "  \"fps\": " << (recorded_ms > 0.0 ? config.frames * 1000.0 / recorded_ms : 0.0) << ",\n";
+    json << "  \"cpu_ms\": ";
+    write_summary(json, cpu);
+    json << ",\n  \"frame_ms\": ";
+    write_summary(json, wall);
+    json << ",\n  \"gpu_ms\": ";
+    write_summary(json, gpu);
+    json << ",\n  \"passes\": {\n";
+    for (std::size_t pass = 0; pass != PassCount; ++pass)
+    {
+        json << "    " << json_string(pass_names[pass]) << ": ";
+        write_summary(json, summarize(gpu_ms[pass]));
+        json << (pass + 1 != PassCount ? ",\n" : "\n");
+    }
+    json << "  },\n";
+    const double recorded_frames = std::max<double>(config.frames, 1.0);
+    json << "  \"scene\": { \"visible_instances\": " << visible_sum / recorded_frames
+        << ", \"vertices\": " << vertex_sum / recorded_frames
+        << ", \"vertex_bytes\": " << vertex_byte_sum / recorded_frames
+        << ", \"draw_calls\": " << draw_call_sum / recorded_frames
+        << ", \"lights\": " << scene.stats().lights
+        << ", \"materials\": " << scene.stats().materials
+        << ", \"fence_wait_ms\": " << fence_wait_sum / recorded_frames << ", \"cull_ms\": ";
+    write_summary(json, summarize(cull_ms));
+    json << " },\n";
+    if (pipeline_statistics)
+    {
+        json << "  \"pipeline\": { ";
+        for (std::size_t i = 0; i != StatisticCount; ++i)
+        {
+            json << json_string(statistic_names[i]) << ": " << statistic_sum[i] / recorded_frames << (i + 1 != StatisticCount ? ", " : " },\n");
+        }
+    }
+    json << "  \"gl_state\": { \"buffer_binds\": " << gl_sum.buffer_binds / recorded_frames
+        << ", \"buffer_binds_skipped\": " << gl_sum.buffer_binds_skipped / recorded_frames << " }";
+    if (scene.streams_textures())
+    {
+        //Totals over the whole run, warmup included
+        const TextureStreamingStats& streaming = scene.stats().streaming;
+        json << ",\n  \"texture_streaming\": { \"resident_bytes\": " << streaming.resident_bytes
+            << ", \"budget_bytes\": " << streaming.budget_bytes
+            << ", \"pending_requests\": " << streaming.pending_requests
+            << ", \"uploaded_levels\": " << streaming.uploaded_levels
+            << ", \"uploaded_bytes\": " << streaming.uploaded_bytes
+            << ", \"evicted_levels\": " << streaming.evicted_levels
+            << ", \"stalls\": " << streaming.stalls
+            << ", \"budget_stalls\": " << streaming.budget_stalls << ", \"update_ms\": ";
+        write_summary(json, summarize(streaming_ms));
+        json << " }";
+    }
+    if (post)
+    {
+        const PostProcessOptions& post_options = post->options();
+        json << ",\n  \"post_process\": { \"antialiasing\": " << json_string(antialiasing_name(post_options.antialiasing))
+            << ", \"msaa_samples\": " << post_options.msaa_samples
+            << ", \"dynamic_resolution\": " << (post_options.dynamic_resolution ? "true" : "false") << ", \"render_scale\": ";
+        write_summary(json, summarize(render_scales));
+        json << " }";
+    }
+    json << ",\n  \"memory\": ";
+    write_memory_json(json, memory_report(), "  ");
+    json << "\n}\n";
+
+    spdlog::info("  {:.0f} visible instances, {:.0f} vertices per frame on average", visible_sum / recorded_frames, vertex_sum / recorded_frames);
+    spdlog::info("  cpu p50 {:.3f} / p95 {:.3f} / p99 {:.3f} ms, gpu p50 {:.3f} / p95 {:.3f} / p99 {:.3f} ms, {:.1f} fps",
+        cpu.p50, cpu.p95, cpu.p99, gpu.p50, gpu.p95, gpu.p99, recorded_ms > 0.0 ? config.frames * 1000.0 / recorded_ms : 0.0);
+
+    return write_report(json.str(), config.output);
+}
+
+bool run_stress_test(DemoScene& scene, const StressConfig& config)
+{
+    OffscreenTarget target{ config.resolution };
+    if (!target.bind())
+    {
+        return false;
+    }
+
+    GL::TimeQuery query{ GL::TimeQuery::Target::TimeElapsed };
+
+    struct Step
+    {
+        std::size_t instances;
+        Summary frame;
+        Summary gpu;
+        std::size_t visible_instances; //last frame
+        std::size_t vertices;
+    };
+    std::vector<Step> steps;
+
+    //Every frame is finished before the next one starts so the wall time
+    //covers both CPU submission and GPU execution
+    const auto measure = [&](std::size_t instances)
+    {
+        scene.set_instance_count(instances);
+
+        std::vector<double> frame_ms;
+        std::vector<double> gpu_ms;
+        for (std::size_t frame = 0; frame != config.warmup_frames + config.frames_per_step; ++frame)
+        {
+            const auto frame_start = std::chrono::steady_clock::now();
+
+            query.begin();
+            target.framebuffer.clear(GL::FramebufferClear::Color | GL::FramebufferClear::Depth);
+            scene.draw(benchmark_frame(frame), config.resolution);
+            query.end();
+            GL::Renderer::finish();
+
+            if (frame >= config.warmup_frames)
+            {
+                frame_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count());
+                gpu_ms.push_back(query.result<UnsignedLong>() / 1.0e6);
+            }
+        }
+
+        const Step step{ instances, summarize(frame_ms), summarize(gpu_ms), scene.stats().visible_instances, scene.stats().vertices };
+        spdlog::info("  {:>8} instances: frame p50 {:.3f} ms, p95 {:.3f} ms, gpu p50 {:.3f} ms",
+            instances, step.frame.p50, step.frame.p95, step.gpu.p50);
+        steps.push_back(step);
+        return step.frame.p50 <= config.frame_budget_ms;
+    };
+
+    spdlog::info("Stress test: growing the instance count until p50 frame time exceeds {:.2f} ms", config.frame_budget_ms);
+
+    //Double until the budget is crossed, then bisect down to ~5% resolution
+    std::size_t within_budget = 0;
+    std::size_t over_budget = 0;
+    for (std::size_t instances = 1; instances <= config.max_instances; instances *= 2)
+    {
+        if (!measure(instances))
+        {
+            over_budget = instances;
+            break;
+        }
+        within_budget = instances;
+    }
+
+    while (over_budget != 0 && over_budget - within_budget > std::max<std::size_t>(within_budget / 20, 1))
+    {
+        const std::size_t instances = within_budget + (over_budget - within_budget) / 2;
+        if (measure(instances))
+        {
+            within_budget = instances;
+        }
+        else
+        {
+            over_budget = instances;
+        }
+    }
+
+    if (over_budget == 0)
+    {
+        spdlog::warn("  still within budget at the {} instance limit", within_budget);
+    }
+    spdlog::info("  {} instances fit into {:.2f} ms", within_budget, config.frame_budget_ms);
+
+    std::ostringstream json;
+    json << "{\n";
+    write_config(json, config.resolution, config.settings, { { "frames_per_step", config.frames_per_step },
+        { "warmup_frames", config.warmup_frames }, { "max_instances", config.max_instances } });
+    json << "  \"frame_budget_ms\": " << config.frame_budget_ms << ",\n";
+    json << "  \"max_instances_within_budget\": " << within_budget << ",\n";
+    json << "  \"budget_reached\": " << (over_budget != 0 ? "true" : "false") << ",\n";
+    json << "  \"steps\": [\n";
+    for (std::size_t i = 0; i != steps.size(); ++i)
+    {
+        json << "    { \"instances\": " << steps[i].instances << ", \"frame_ms\": ";
+        write_summary(json, steps[i].frame);
+        json << ", \"gpu_ms\": ";
+        write_summary(json, steps[i].gpu);
+        json << ", \"visible_instances\": " << steps[i].visible_instances << ", \"vertices\": " << steps[i].vertices;
+        json << (i + 1 != steps.size() ? " },\n" : " }\n");
+    }
+    json << "  ]\n";
+    json << "}\n";
+
+    return write_report(json.str(), config.output);
+}
+
+bool run_light_sweep(DemoScene& scene, const LightSweepConfig& config)
+{
+    OffscreenTarget target{ config.resolution };
+    if (!target.bind())
+    {
+        return false;
+    }
+
+    GL::TimeQuery query{ GL::TimeQuery::Target::TimeElapsed };
+
+    struct Step
+    {
+        LightingMode mode;
+        std::size_t lights;
+        Summary frame;
+        Summary gpu;
+    };
+    std::vector<Step> steps;
+
+    const std::pair<LightingMode, const char*> modes[]{ { LightingMode::Clustered, "clustered" }, { LightingMode::Naive, "naive" } };
+
+    spdlog::info("Light sweep: 1 to {} lights, clustered and naive", config.max_lights);
+
+    for (const auto& [mode, name] : modes)
+    {
+        for (std::size_t lights = 1; lights <= config.max_lights; lights *= 2)
+        {
+            scene.set_lights(mode, lights);
+
+            //Finished every frame, like the stress test
+            std::vector<double> frame_ms;
+            std::vector<double> gpu_ms;
+            for (std::size_t frame = 0; frame != config.warmup_frames + config.frames_per_step; ++frame)
+            {
+                const auto frame_start = std::chrono::steady_clock::now();
+
+                query.begin();
+                target.framebuffer.clear(GL::FramebufferClear::Color | GL::FramebufferClear::Depth);
+                scene.draw(benchmark_frame(frame), config.resolution);
+                query.end();
+                GL::Renderer::finish();
+
+                if (frame >= config.warmup_frames)
+                {
+                    frame_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count());
+                    gpu_ms.push_back(query.result<UnsignedLong>() / 1.0e6);
+                }
+            }
+
+            const Step step{ mode, lights, summarize(frame_ms), summarize(gpu_ms) };
+            spdlog::info("  {:>9} {:>5} lights: frame p50 {:.3f} ms, gpu p50 {:.3f} ms", name, lights, step.frame.p50, step.gpu.p50);
+            steps.push_back(step);
+
+            if (step.frame.p50 > config.max_frame_ms)
+            {
+                spdlog::warn("  {} lighting over {:.0f} ms, skipping larger counts", name, config.max_frame_ms);
+                break;
+            }
+        }
+    }
+
+    std::ostringstream json;
+    json << "{\n";
+    write_config(json, config.resolution, config.settings, { { "frames_per_step", config.frames_per_step },
+        { "warmup_frames", config.warmup_frames }, { "max_lights", config.max_lights } });
+    json << "  \"steps\": [\n";
+    for (std::size_t i = 0; i != steps.size(); ++i)
+    {
+        json << "    { \"lighting\": " << json_string(steps[i].mode == LightingMode::Clustered ? "clustered" : "naive")
+            << ", \"lights\": " << steps[i].lights << ", \"frame_ms\": ";
+        write_summary(json, steps[i].frame);
+        json << ", \"gpu_ms\": ";
+        write_summary(json, steps[i].gpu);
+        json << (i + 1 != steps.size() ? " },\n" : " }\n");
+    }
+    json << "  ]\n";
+    json << "}\n";
+
+    return write_report(json.str(), config.output);
+}
+
+bool run_aa_sweep(DemoScene& scene, const AaSweepConfig& config)
+{
+    OffscreenTarget target{ config.resolution };
+    if (!target.bind())
+    {
+        return false;
+    }
+
+    GL::TimeQuery query{ GL::TimeQuery::Target::TimeElapsed };
+
+    struct Step
+    {
+        std::string name;
+        PostProcessOptions options;
+        Summary frame;
+        Summary gpu;
+        double psnr;
+    };
+
+    const auto step_options = [](AntiAliasing antialiasing, Int msaa_samples, float render_scale)
+    {
+        PostProcessOptions options;
+        options.antialiasing = antialiasing;
+        options.msaa_samples = msaa_samples;
+        options.render_scale = render_scale;
+        return options;
+    };
+
+    //The reference goes first, every other step is compared to its last frame
+    std::vector<Step> steps{
+        { "reference", step_options(AntiAliasing::None, 8, 2.0f) },
+        { "none", step_options(AntiAliasing::None, 1, 1.0f) },
+        { "msaa2", step_options(AntiAliasing::None, 2, 1.0f) },
+        { "msaa4", step_options(AntiAliasing::None, 4, 1.0f) },
+        { "msaa8", step_options(AntiAliasing::None, 8, 1.0f) },
+        { "fxaa", step_options(AntiAliasing::Fxaa, 1, 1.0f) },
+        { "taa", step_options(AntiAliasing::Taa, 1, 1.0f) },
+        { "fxaa_75", step_options(AntiAliasing::Fxaa, 1, 0.75f) },
+        { "taa_75", step_options(AntiAliasing::Taa, 1, 0.75f) },
+        { "fxaa_50", step_options(AntiAliasing::Fxaa, 1, 0.5f) }
+    };
+
+    spdlog::info("AA sweep: {} configurations, PSNR against 8x MSAA at twice the resolution", steps.size() - 1);
+
+    Image2D reference{ PixelFormat::RGBA8Unorm };
+    for (Step& step : steps)
+    {
+        PostProcess post{ config.resolution, step.options };
+
+        //Finished every frame, like the stress test
+        std::vector<double> frame_ms;
+        std::vector<double> gpu_ms;
+        for (std::size_t frame = 0; frame != config.warmup_frames + config.frames_per_step; ++frame)
+        {
+            const auto frame_start = std::chrono::steady_clock::now();
+
+            query.begin();
+            post.begin_frame();
+            SceneFrame scene_frame = benchmark_frame(frame);
+            scene_frame.jitter = post.jitter();
+            scene.draw(scene_frame, post.render_size());
+            post.end_frame(target.framebuffer, scene.reprojection());
+            query.end();
+            GL::Renderer::finish();
+
+            if (frame >= config.warmup_frames)
+            {
+                frame_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count());
+                gpu_ms.push_back(query.result<UnsignedLong>() / 1.0e6);
+            }
+        }
+
+        step.options = post.options();
+        step.frame = summarize(frame_ms);
+        step.gpu = summarize(gpu_ms);
+
+        Image2D image = target.framebuffer.read({ {}, config.resolution }, { PixelFormat::RGBA8Unorm });
+        if (reference.data().empty())
+        {
+            reference = std::move(image);
+            step.psnr = image_psnr(reference, reference);
+        }
+        else
+        {
+            step.psnr = image_psnr(image, reference);
+        }
+
+        spdlog::info("  {:>9}: frame p50 {:.3f} ms, gpu p50 {:.3f} ms, PSNR {:.2f} dB", step.name, step.frame.p50, step.gpu.p50, step.psnr);
+    }
+
+    std::ostringstream json;
+    json << "{\n";
+    write_config(json, config.resolution, config.settings, { { "frames_per_step", config.frames_per_step },
+        { "warmup_frames", config.warmup_frames } });
+    json << "  \"steps\": [\n";
+    for (std::size_t i = 0; i != steps.size(); ++i)
+    {
+        json << "    { \"name\": " << json_string(steps[i].name)
+            << ", \"antialiasing\": " << json_string(antialiasing_name(steps[i].options.antialiasing))
+            << ", \"msaa_samples\": " << steps[i].options.msaa_samples
+            << ", \"render_scale\": " << steps[i].options.render_scale
+            << ", \"psnr_db\": " << steps[i].psnr << ", \"frame_ms\": ";
+        write_summary(json, steps[i].frame);
+        json << ", \"gpu_ms\": ";
+        write_summary(json, steps[i].gpu);
+        json << (i + 1 != steps.size() ? " },\n" : " }\n");
+    }
+    json << "  ]\n";
+    json << "}\n";
+
+    return write_report(json.str(), config.output);
+}
+
+bool run_shader_reload_test(DemoScene& scene, const ShaderReloadConfig& config)
+{
+    OffscreenTarget target{ config.resolution };
+    if (!target.bind())
+    {
+        return false;
+    }
+
+    PBRShaderLibrary& shaders = scene.shader_library();
+
+    enum class Rebuild
+    {
+        None,
+        Blocking,
+        Background
+    };
+
+    struct Phase
+    {
+        const char* name;
+        Rebuild rebuild;
+        std::size_t rebuilds = 0;
+        ShaderLibraryStats stats; //of the phase alone
+        Summary frame;
+    };
+
+    std::vector<Phase> phases{ { "steady", Rebuild::None }, { "blocking", Rebuild::Blocking }, { "background", Rebuild::Background } };
+
+    //Every render mode once so the phases start with the same programs
+    for (int mode = 0; mode != PBRShader::RENDER_MODE_COUNT; ++mode)
+    {
+        SceneFrame frame = benchmark_frame(0);
+        frame.render_mode = mode;
+        scene.draw(frame, config.resolution);
+    }
+    shaders.finish();
+
+    spdlog::info("Shader reload test: {} permutations rebuilt every {} frames, {}", shaders.size(), config.rebuild_interval,
+        shader_compile_mode_name(shaders.compile_mode()));
+
+    for (Phase& phase : phases)
+    {
+        const ShaderLibraryStats before = shaders.stats();
+
+        //Finished every frame, like the stress test
+        std::vector<double> frame_ms;
+        for (std::size_t frame = 0; frame != config.warmup_frames + config.frames_per_phase; ++frame)
+        {
+            const auto frame_start = std::chrono::steady_clock::now();
+            const bool recorded = frame >= config.warmup_frames;
+
+            if (recorded && phase.rebuild != Rebuild::None && (frame - config.warmup_frames) % config.rebuild_interval == 0)
+            {
+                shaders.rebuild();
+                ++phase.rebuilds;
+                if (phase.rebuild == Rebuild::Blocking)
+                {
+                    shaders.finish();
+                }
+            }
+
+            target.framebuffer.clear(GL::FramebufferClear::Color | GL::FramebufferClear::Depth);
+            scene.draw(benchmark_frame(frame), config.resolution);
+            GL::Renderer::finish();
+
+            if (recorded)
+            {
+                frame_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count());
+            }
+        }
+
+        //Rebuilds still running belong to this phase
+        shaders.finish();
+
+        const ShaderLibraryStats& after = shaders.stats();
+        phase.stats.builds = after.builds - before.builds;
+        phase.stats.failed_builds = after.failed_builds - before.failed_builds;
+        phase.stats.swaps = after.swaps - before.swaps;
+        phase.stats.compile_ms = after.compile_ms - before.compile_ms;
+        phase.stats.link_ms = after.link_ms - before.link_ms;
+        phase.frame = summarize(frame_ms);
+
+        const double builds = double(std::max<std::size_t>(phase.stats.builds, 1));
+        spdlog::info("  {:>10}: {} rebuilds, {} programs swapped, {} failed, compile {:.2f} / link {:.2f} ms per program, "
+            "frame p50 {:.3f} / p99 {:.3f} / max {:.3f} ms", phase.name, phase.rebuilds, phase.stats.swaps, phase.stats.failed_builds,
+            phase.stats.compile_ms / builds, phase.stats.link_ms / builds, phase.frame.p50, phase.frame.p99, phase.frame.max);
+    }
+
+    const Summary& steady = phases[0].frame;
+    const Phase& background = phases[2];
+    const double spike_limit_ms = std::max(steady.max, config.spike_factor * steady.p99);
+    const bool passed = background.frame.max <= spike_limit_ms && background.stats.swaps != 0 && background.stats.failed_builds == 0;
+    spdlog::info("  background rebuilds: worst frame {:.3f} ms against a limit of {:.3f} ms, {}", background.frame.max, spike_limit_ms,
+        passed ? "no spikes" : "FAILED");
+
+    std::ostringstream json;
+    json << "{\n";
+    write_config(json, config.resolution, config.settings, { { "frames_per_phase", config.frames_per_phase },
+        { "warmup_frames", config.warmup_frames }, { "rebuild_interval", config.rebuild_interval }, { "permutations", shaders.size() } });
+    json << "  \"shader_compile\": " << json_string(shader_compile_mode_name(shaders.compile_mode())) << ",\n";
+    json << "  \"max_compile_ms\": " << shaders.stats().max_compile_ms << ",\n";
+    json << "  \"max_link_ms\": " << shaders.stats().max_link_ms << ",\n";
+    json << "  \"phases\": [\n";
+    for (std::size_t i = 0; i != phases.size(); ++i)
+    {
+        const Phase& phase = phases[i];
+        const double builds = double(std::max<std::size_t>(phase.stats.builds, 1));
+        json << "    { \"name\": " << json_string(phase.name)
+            << ", \"rebuilds\": " << phase.rebuilds
+            << ", \"programs_built\": " << phase.stats.builds
+            << ", \"programs_swapped\": " << phase.stats.swaps
+            << ", \"failed_builds\": " << phase.stats.failed_builds
+            << ", \"compile_ms_mean\": " << phase.stats.compile_ms / builds
+            << ", \"link_ms_mean\": " << phase.stats.link_ms / builds << ", \"frame_ms\": ";
+        write_summary(json, phase.frame);
+        json << (i + 1 != phases.size() ? " },\n" : " }\n");
+    }
+    json << "  ],\n";
+    json << "  \"spike_limit_ms\": " << spike_limit_ms << ",\n";
+    json << "  \"passed\": " << (passed ? "true" : "false") << "\n";
+    json << "}\n";
+
+    return write_report(json.str(), config.output) && passed;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector2.h>
+#include <Corrade/Containers/Optional.h>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+#include "demo_scene.hpp"
+#include "post_process.hpp"
+
+using namespace Magnum;
+
+struct BenchmarkConfig
+{
+    std::size_t frames = 500;
+    std::size_t warmup_frames = 50; //rendered but not recorded
+    Vector2i resolution{ 1024, 1024 };
+    std::string output = "benchmark.json"; //"-" for stdout
+    std::vector<std::pair<std::string, std::string>> settings; //copied into the report as is
+    //Scene drawn into a post process target and resolved into the output,
+    //otherwise straight into the output
+    Containers::Optional<PostProcessOptions> post_process;
+};
+
+//Renders the scripted scene into an offscreen framebuffer and writes CPU and
+//per-pass GPU frame time percentiles as JSON. Needs a current GL context.
+bool run_benchmark(DemoScene& scene, const BenchmarkConfig& config);
+
+struct StressConfig
+{
+    double frame_budget_ms = 1000.0 / 60.0;
+    std::size_t frames_per_step = 30;
+    std::size_t warmup_frames = 5;
+    std::size_t max_instances = std::size_t{ 1 } << 20;
+    Vector2i resolution{ 1024, 1024 };
+    std::string output = "stress.json"; //"-" for stdout
+    std::vector<std::pair<std::string, std::string>> settings;
+};
+
+//Grows the sphere count of a grid scene until the median frame time
+//crosses the budget and reports the largest count that still fits
+bool run_stress_test(DemoScene& scene, const StressConfig& config);
+
+struct LightSweepConfig
+{
+    std::size_t max_lights = 4096; //powers of two from 1
+    std::size_t frames_per_step = 30;
+    std::size_t warmup_frames = 5;
+    //A lighting mode stops growing once its median frame takes longer
+    double max_frame_ms = 500.0;
+    Vector2i resolution{ 1024, 1024 };
+    std::string output = "light_sweep.json"; //"-" for stdout
+    std::vector<std::pair<std::string, std::string>> settings;
+};
+
+//Frame time over the light count for the clustered and the naive loop
+bool run_light_sweep(DemoScene& scene, const LightSweepConfig& config);
+
+struct AaSweepConfig
+{
+    std::size_t frames_per_step = 60; //enough for the TAA history to settle
+    std::size_t warmup_frames = 10;
+    Vector2i resolution{ 1024, 1024 };
+    std::string output = "aa_sweep.json"; //"-" for stdout
+    std::vector<std::pair<std::string, std::string>> settings;
+};
+
+//Frame time and PSNR of the last frame against a supersampled reference for
+//each anti-aliasing mode, MSAA count and render scale
+bool run_aa_sweep(DemoScene& scene, const AaSweepConfig& config);
+
+struct ShaderReloadConfig
+{
+    std::size_t frames_per_phase = 300;
+    std::size_t warmup_frames = 30; //rendered but not recorded, per phase
+    std::size_t rebuild_interval = 60; //frames between rebuilds of every shader permutation
+    //The background phase passes if no frame takes longer than the steady
+    //phase's worst one or this times its p99, whichever is more
+    double spike_factor = 2.0;
+    Vector2i resolution{ 1024, 1024 };
+    std::string output = "shader_reload.json"; //"-" for stdout
+    std::vector<std::pair<std::string, std::string>> settings;
+};
+
+//Renders the benchmark script three times: without rebuilds, rebuilding
+//every shader permutation and waiting for it like a synchronous compile
+//would, and rebuilding them in the background while the previous programs
+//keep drawing. Fails if the background phase has a frame time spike the
+//steady one doesn't, or if any rebuild failed.
+bool run_shader_reload_test(DemoScene& scene, const ShaderReloadConfig& config);
+
+//Frame script shared by every benchmark run, depends only on the frame index
+SceneFrame benchmark_frame(std::size_t frame);
+
+//Over the RGB channels of two RGBA8 images of the same size, capped at 100 dB
+//for identical ones so reports stay valid JSON
+double image_psnr(const Image2D& image, const Image2D& reference);
@@ -0,0 +1,862 @@
+#include "block_compression.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+    //16 texels of a 4x4 block, both as bytes and as planar floats
+    struct Block
+    {
+        unsigned char texels[16][4];
+        alignas(32) float channel[4][16];
+    };
+
+    using Bc4Fit = unsigned int (*)(const unsigned char* values, const int* palette, unsigned char* indices);
+    using ColorFit = float (*)(const Block& block, const float (*palette)[4], int palette_size, int channels, unsigned char* indices);
+
+    struct Kernels
+    {
+        Bc4Fit bc4_fit;
+        ColorFit color_fit;
+    };
+
+    /* Nearest palette entry search, the part every encoder spends its time in */
+
+    unsigned int bc4_fit_scalar(const unsigned char* values, const int* palette, unsigned char* indices)
+    {
+        unsigned int error = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = std::numeric_limits<int>::max();
+            for (int k = 0; k < 8; ++k)
+            {
+                const int d = std::abs(values[i] - palette[k]);
+                if (d < best)
+                {
+                    best = d;
+                    indices[i] = static_cast<unsigned char>(k);
+                }
+            }
+            error += unsigned(best * best);
+        }
+
+        return error;
+    }
+
+    float color_fit_scalar(const Block& block, const float (*palette)[4], int palette_size, int channels, unsigned char* indices)
+    {
+        float error = 0.0f;
+        for (int i = 0; i < 16; ++i)
+        {
+            float best = std::numeric_limits<float>::max();
+            for (int k = 0; k < palette_size; ++k)
+            {
+                float d = 0.0f;
+                for (int c = 0; c < channels; ++c)
+                {
+                    const float delta = block.channel[c][i] - palette[k][c];
+                    d += delta * delta;
+                }
+
+                if (d < best)
+                {
+                    best = d;
+                    indices[i] = static_cast<unsigned char>(k);
+                }
+            }
+            error += best;
+        }
+
+        return error;
+    }
+
+#ifdef DEMO_SIMD_X86
+    unsigned int bc4_fit_sse2(const unsigned char* values, const int* palette, unsigned char* indices)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+        const __m128i v_lo = _mm_unpacklo_epi8(v, zero);
+        const __m128i v_hi = _mm_unpackhi_epi8(v, zero);
+
+        __m128i best_lo = _mm_set1_epi16(0x7fff);
+        __m128i best_hi = best_lo;
+        __m128i index_lo = zero;
+        __m128i index_hi = zero;
+
+        for (int k = 0; k < 8; ++k)
+        {
+            const __m128i p = _mm_set1_epi16(short(palette[k]));
+            const __m128i kk = _mm_set1_epi16(short(k));
+
+            const __m128i d_lo = _mm_max_epi16(_mm_sub_epi16(v_lo, p), _mm_sub_epi16(p, v_lo));
+            const __m128i d_hi = _mm_max_epi16(_mm_sub_epi16(v_hi, p), _mm_sub_epi16(p, v_hi));
+            const __m128i closer_lo = _mm_cmplt_epi16(d_lo, best_lo);
+            const __m128i closer_hi = _mm_cmplt_epi16(d_hi, best_hi);
+
+            best_lo = _mm_min_epi16(d_lo, best_lo);
+            best_hi = _mm_min_epi16(d_hi, best_hi);
+            index_lo = _mm_or_si128(_mm_and_si128(closer_lo, kk), _mm_andnot_si128(closer_lo, index_lo));
+            index_hi = _mm_or_si128(_mm_and_si128(closer_hi, kk), _mm_andnot_si128(closer_hi, index_hi));
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), _mm_packus_epi16(index_lo, index_hi));
+
+        __m128i sum = _mm_add_epi32(_mm_madd_epi16(best_lo, best_lo), _mm_madd_epi16(best_hi, best_hi));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+        return unsigned(_mm_cvtsi128_si32(sum));
+    }
+
+    DEMO_TARGET_AVX2 unsigned int bc4_fit_avx2(const unsigned char* values, const int* palette, unsigned char* indices)
+    {
+        const __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values)));
+
+        __m256i best = _mm256_set1_epi16(0x7fff);
+        __m256i index = _mm256_setzero_si256();
+
+        for (int k = 0; k < 8; ++k)
+        {
+            const __m256i p = _mm256_set1_epi16(short(palette[k]));
+            const __m256i d = _mm256_abs_epi16(_mm256_sub_epi16(v, p));
+            const __m256i closer = _mm256_cmpgt_epi16(best, d);
+
+            best = _mm256_min_epi16(d, best);
+            index = _mm256_blendv_epi8(index, _mm256_set1_epi16(short(k)), closer);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices),
+            _mm_packus_epi16(_mm256_castsi256_si128(index), _mm256_extracti128_si256(index, 1)));
+
+        const __m256i squares = _mm256_madd_epi16(best, best);
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(squares), _mm256_extracti128_si256(squares, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+        return unsigned(_mm_cvtsi128_si32(sum));
+    }
+
+    float color_fit_sse2(const Block& block, const float (*palette)[4], int palette_size, int channels, unsigned char* indices)
+    {
+        __m128 total = _mm_setzero_ps();
+
+        for (int group = 0; group < 16; group += 4)
+        {
+            __m128 best = _mm_set1_ps(std::numeric_limits<float>::max());
+            __m128 index = _mm_setzero_ps();
+
+            for (int k = 0; k < palette_size; ++k)
+            {
+                __m128 d = _mm_setzero_ps();
+                for (int c = 0; c < channels; ++c)
+                {
+                    const __m128 delta = _mm_sub_ps(_mm_load_ps(block.channel[c] + group), _mm_set1_ps(palette[k][c]));
+                    d = _mm_add_ps(d, _mm_mul_ps(delta, delta));
+                }
+
+                const __m128 closer = _mm_cmplt_ps(d, best);
+                best = _mm_min_ps(d, best);
+                index = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps(float(k))), _mm_andnot_ps(closer, index));
+            }
+
+            total = _mm_add_ps(total, best);
+
+            alignas(16) std::int32_t group_indices[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(group_indices), _mm_cvtps_epi32(index));
+            for (int i = 0; i < 4; ++i)
+            {
+                indices[group + i] = static_cast<unsigned char>(group_indices[i]);
+            }
+        }
+
+        alignas(16) float sums[4];
+        _mm_store_ps(sums, total);
+        return sums[0] + sums[1] + sums[2] + sums[3];
+    }
+
+    DEMO_TARGET_AVX2 float color_fit_avx2(const Block& block, const float (*palette)[4], int palette_size, int channels, unsigned char* indices)
+    {
+        __m256 total = _mm256_setzero_ps();
+
+        for (int group = 0; group < 16; group += 8)
+        {
+            __m256 best = _mm256_set1_ps(std::numeric_limits<float>::max());
+            __m256 index = _mm256_setzero_ps();
+
+            for (int k = 0; k < palette_size; ++k)
+            {
+                __m256 d = _mm256_setzero_ps();
+                for (int c = 0; c < channels; ++c)
+                {
+                    const __m256 delta = _mm256_sub_ps(_mm256_load_ps(block.channel[c] + group), _mm256_set1_ps(palette[k][c]));
+                    d = _mm256_fmadd_ps(delta, delta, d);
+                }
+
+                const __m256 closer = _mm256_cmp_ps(d, best, _CMP_LT_OQ);
+                best = _mm256_min_ps(d, best);
+                index = _mm256_blendv_ps(index, _mm256_set1_ps(float(k)), closer);
+            }
+
+            total = _mm256_add_ps(total, best);
+
+            alignas(32) std::int32_t group_indices[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(group_indices), _mm256_cvtps_epi32(index));
+            for (int i = 0; i < 8; ++i)
+            {
+                indices[group + i] = static_cast<unsigned char>(group_indices[i]);
+            }
+        }
+
+        alignas(32) float sums[8];
+        _mm256_store_ps(sums, total);
+        return sums[0] + sums[1] + sums[2] + sums[3] + sums[4] + sums[5] + sums[6] + sums[7];
+    }
+#endif
+
+    Kernels select_kernels()
+    {
+        switch (simd_level())
+        {
+#ifdef DEMO_SIMD_X86
+            case SimdLevel::AVX2:
+                return { bc4_fit_avx2, color_fit_avx2 };
+            case SimdLevel::SSE2:
+                return { bc4_fit_sse2, color_fit_sse2 };
+#endif
+            default:
+                return { bc4_fit_scalar, color_fit_scalar };
+        }
+    }
+
+    void fetch_block(const unsigned char* pixels, int width, int height, std::size_t channels, int bx, int by, Block& block)
+    {
+        for (int y = 0; y < 4; ++y)
+        {
+            const int sy = std::min(by * 4 + y, height - 1);
+            for (int x = 0; x < 4; ++x)
+            {
+                const int sx = std::min(bx * 4 + x, width - 1);
+                const unsigned char* src = pixels + (std::size_t(sy) * width + sx) * channels;
+                unsigned char* texel = block.texels[y * 4 + x];
+
+                texel[0] = src[0];
+                texel[1] = channels >= 2 ? src[1] : src[0];
+                texel[2] = channels >= 3 ? src[2] : src[0];
+                texel[3] = channels >= 4 ? src[3] : 255;
+
+                for (int c = 0; c < 4; ++c)
+                {
+                    block.channel[c][y * 4 + x] = texel[c];
+                }
+            }
+        }
+    }
+
+    /* Endpoint selection shared by BC1 and BC7 */
+
+    void bounding_box_endpoints(const Block& block, int channels, float* lo, float* hi)
+    {
+        float mean[4]{};
+        for (int c = 0; c < channels; ++c)
+        {
+            lo[c] = *std::min_element(block.channel[c], block.channel[c] + 16);
+            hi[c] = *std::max_element(block.channel[c], block.channel[c] + 16);
+            for (int i = 0; i < 16; ++i)
+            {
+                mean[c] += block.channel[c][i] / 16.0f;
+            }
+        }
+
+        //The box diagonal runs from lo to hi, flip the channels that are
+        //anti-correlated with green so the diagonal follows the data
+        for (int c = 0; c < channels; ++c)
+        {
+            if (c == 1)
+            {
+                continue;
+            }
+
+            float covariance = 0.0f;
+            for (int i = 0; i < 16; ++i)
+            {
+                covariance += (block.channel[c][i] - mean[c]) * (block.channel[1][i] - mean[1]);
+            }
+
+            if (covariance < 0.0f)
+            {
+                std::swap(lo[c], hi[c]);
+            }
+        }
+    }
+
+    void principal_axis_endpoints(const Block& block, int channels, float* lo, float* hi)
+    {
+        float mean[4]{};
+        for (int c = 0; c < channels; ++c)
+        {
+            for (int i = 0; i < 16; ++i)
+            {
+                mean[c] += block.channel[c][i] / 16.0f;
+            }
+        }
+
+        float covariance[4][4]{};
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int a = 0; a < channels; ++a)
+            {
+                for (int b = a; b < channels; ++b)
+                {
+                    covariance[a][b] += (block.channel[a][i] - mean[a]) * (block.channel[b][i] - mean[b]);
+                }
+            }
+        }
+
+        for (int a = 0; a < channels; ++a)
+        {
+            for (int b = 0; b < a; ++b)
+            {
+                covariance[a][b] = covariance[b][a];
+            }
+        }
+
+        //Power iteration, converges quickly for the dominant axis
+        float axis[4]{ 1.0f, 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+            float next[4]{};
+            float length = 0.0f;
+            for (int a = 0; a < channels; ++a)
+            {
+                for (int b = 0; b < channels; ++b)
+                {
+                    next[a] += covariance[a][b] * axis[b];
+                }
+                length += next[a] * next[a];
+            }
+
+            if (length < 1.0e-12f)
+            {
+                break;
+            }
+
+            length = 1.0f / std::sqrt(length);
+            for (int a = 0; a < channels; ++a)
+            {
+                axis[a] = next[a] * length;
+            }
+        }
+
+        float length = 0.0f;
+        for (int c = 0; c < channels; ++c)
+        {
+            length += axis[c] * axis[c];
+        }
+        length = std::sqrt(length);
+        for (int c = 0; c < channels; ++c)
+        {
+            axis[c] /= length;
+        }
+
+        float t_min = std::numeric_limits<float>::max();
+        float t_max = -std::numeric_limits<float>::max();
+        for (int i = 0; i < 16; ++i)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < channels; ++c)
+            {
+                t += (block.channel[c][i] - mean[c]) * axis[c];
+            }
+            t_min = std::min(t_min, t);
+            t_max = std::max(t_max, t);
+        }
+
+        for (int c = 0; c < channels; ++c)
+        {
+            lo[c] = std::clamp(mean[c] + axis[c] * t_min, 0.0f, 255.0f);
+            hi[c] = std::clamp(mean[c] + axis[c] * t_max, 0.0f, 255.0f);
+        }
+    }
+
+    //Solves for the two endpoints that minimize the error given fixed
+    //interpolation weights, where weight[i] is the fraction of `a` in texel i
+    bool least_squares_endpoints(const Block& block, int channels, const float* weight, float* a, float* b)
+    {
+        float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+        float ax[4]{}, bx[4]{};
+        for (int i = 0; i < 16; ++i)
+        {
+            const float wa = weight[i];
+            const float wb = 1.0f - wa;
+            aa += wa * wa;
+            bb += wb * wb;
+            ab += wa * wb;
+            for (int c = 0; c < channels; ++c)
+            {
+                ax[c] += wa * block.channel[c][i];
+                bx[c] += wb * block.channel[c][i];
+            }
+        }
+
+        const float determinant = aa * bb - ab * ab;
+        if (std::abs(determinant) < 1.0e-6f)
+        {
+            return false;
+        }
+
+        for (int c = 0; c < channels; ++c)
+        {
+            a[c] = std::clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.0f, 255.0f);
+            b[c] = std::clamp((aa * bx[c] - ab * ax[c]) / determinant, 0.0f, 255.0f);
+        }
+
+        return true;
+    }
+
+    /* BC4 */
+
+    void bc4_palette(int e0, int e1, int* palette)
+    {
+        palette[0] = e0;
+        palette[1] = e1;
+        for (int k = 2; k < 8; ++k)
+        {
+            palette[k] = ((8 - k) * e0 + (k - 1) * e1 + 3) / 7;
+        }
+    }
+
+    void encode_bc4(const unsigned char* values, CompressionQuality quality, const Kernels& kernels, unsigned char* out)
+    {
+        const int lo = *std::min_element(values, values + 16);
+        const int hi = *std::max_element(values, values + 16);
+
+        std::memset(out, 0, 8);
+        out[0] = static_cast<unsigned char>(hi);
+        out[1] = static_cast<unsigned char>(lo);
+        if (lo == hi)
+        {
+            return;
+        }
+
+        int palette[8];
+        unsigned char indices[16];
+        unsigned char candidate[16];
+
+        bc4_palette(hi, lo, palette);
+        unsigned int best_error = kernels.bc4_fit(values, palette, indices);
+
+        //Pulling the endpoints inwards often lines the 7 steps up better
+        const int radius = quality == CompressionQuality::Fast ? 0 : quality == CompressionQuality::Normal ? 2 : 6;
+        for (int d0 = 0; d0 <= radius && best_error != 0; ++d0)
+        {
+            for (int d1 = 0; d1 <= radius; ++d1)
+            {
+                const int e0 = hi - d0;
+                const int e1 = lo + d1;
+                if ((d0 == 0 && d1 == 0) || e0 <= e1)
+                {
+                    continue;
+                }
+
+                bc4_palette(e0, e1, palette);
+                const unsigned int error = kernels.bc4_fit(values, palette, candidate);
+                if (error < best_error)
+                {
+                    best_error = error;
+                    out[0] = static_cast<unsigned char>(e0);
+                    out[1] = static_cast<unsigned char>(e1);
+                    std::memcpy(indices, candidate, sizeof(indices));
+                }
+            }
+        }
+
+        std::uint64_t bits = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            bits |= std::uint64_t(indices[i]) << (3 * i);
+        }
+
+        for (int b = 0; b < 6; ++b)
+        {
+            out[2 + b] = static_cast<unsigned char>(bits >> (8 * b));
+        }
+    }
+
+    /* BC1 */
+
+    std::uint16_t pack_565(const float* color)
+    {
+        const int r = std::clamp(int(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+        const int g = std::clamp(int(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+        const int b = std::clamp(int(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+        return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    void unpack_565(std::uint16_t value, float* color)
+    {
+        const int r = (value >> 11) & 31;
+        const int g = (value >> 5) & 63;
+        const int b = value & 31;
+        color[0] = float((r << 3) | (r >> 2));
+        color[1] = float((g << 2) | (g >> 4));
+        color[2] = float((b << 3) | (b >> 2));
+        color[3] = 255.0f;
+    }
+
+    float bc1_try(const Block& block, const Kernels& kernels, const float* a, const float* b,
+        std::uint16_t& c0, std::uint16_t& c1, unsigned char* indices)
+    {
+        c0 = pack_565(a);
+        c1 = pack_565(b);
+        if (c0 < c1)
+        {
+            std::swap(c0, c1);
+        }
+
+        //Equal endpoints select the 3 color mode, index 0 is still c0
+        if (c0 == c1)
+        {
+            float palette[1][4];
+            unpack_565(c0, palette[0]);
+            return kernels.color_fit(block, palette, 1, 3, indices);
+        }
+
+        float palette[4][4];
+        unpack_565(c0, palette[0]);
+        unpack_565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = std::floor((2.0f * palette[0][c] + palette[1][c]) / 3.0f + 0.5f);
+            palette[3][c] = std::floor((palette[0][c] + 2.0f * palette[1][c]) / 3.0f + 0.5f);
+        }
+
+        return kernels.color_fit(block, palette, 4, 3, indices);
+    }
+
+    void encode_bc1(const Block& block, CompressionQuality quality, const Kernels& kernels, unsigned char* out)
+    {
+        float lo[4], hi[4];
+        if (quality == CompressionQuality::Fast)
+        {
+            bounding_box_endpoints(block, 3, lo, hi);
+
+            //Inset the box a bit, the extremes are rarely worth the precision
+            for (int c = 0; c < 3; ++c)
+            {
+                const float inset = (hi[c] - lo[c]) / 16.0f;
+                lo[c] += inset;
+                hi[c] -= inset;
+            }
+        }
+        else
+        {
+            principal_axis_endpoints(block, 3, lo, hi);
+        }
+
+        std::uint16_t c0, c1;
+        unsigned char indices[16];
+        float best_error = bc1_try(block, kernels, hi, lo, c0, c1, indices);
+
+        if (quality == CompressionQuality::High && c0 != c1)
+        {
+            static constexpr float Weights[4]{ 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+            for (int iteration = 0; iteration < 2; ++iteration)
+            {
+                float weight[16];
+                for (int i = 0; i < 16; ++i)
+                {
+                    weight[i] = Weights[indices[i]];
+                }
+
+                float a[4], b[4];
+                if (!least_squares_endpoints(block, 3, weight, a, b))
+                {
+                    break;
+                }
+
+                std::uint16_t d0, d1;
+                unsigned char candidate[16];
+                const float error = bc1_try(block, kernels, a, b, d0, d1, candidate);
+                if (error >= best_error)
+                {
+                    break;
+                }
+
+                best_error = error;
+                c0 = d0;
+                c1 = d1;
+                std::memcpy(indices, candidate, sizeof(indices));
+                if (c0 == c1)
+                {
+                    break;
+                }
+            }
+        }
+
+        std::uint32_t bits = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            bits |= std::uint32_t(indices[i]) << (2 * i);
+        }
+
+        out[0] = static_cast<unsigned char>(c0);
+        out[1] = static_cast<unsigned char>(c0 >> 8);
+        out[2] = static_cast<unsigned char>(c1);
+        out[3] = static_cast<unsigned char>(c1 >> 8);
+        for (int b = 0; b < 4; ++b)
+        {
+            out[4 + b] = static_cast<unsigned char>(bits >> (8 * b));
+        }
+    }
+
+    /* BC7, mode 6: one subset, 7.7.7.7 endpoints with a p-bit each, 4-bit indices */
+
+    constexpr int Bc7Weights[16]{ 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    struct Bc7Endpoints
+    {
+        int q[2][4]; //7-bit
+        int p[2];
+    };
+
+    int quantize_7(float value, int p)
+    {
+        return std::clamp(int(std::floor((value - p) / 2.0f + 0.5f)), 0, 127);
+    }
+
+    float bc7_try(const Block& block, const Kernels& kernels, const float* a, const float* b, int pa, int pb,
+        Bc7Endpoints& endpoints, unsigned char* indices)
+    {
+        int full[2][4];
+        for (int c = 0; c < 4; ++c)
+        {
+            endpoints.q[0][c] = quantize_7(a[c], pa);
+            endpoints.q[1][c] = quantize_7(b[c], pb);
+            full[0][c] = (endpoints.q[0][c] << 1) | pa;
+            full[1][c] = (endpoints.q[1][c] << 1) | pb;
+        }
+        endpoints.p[0] = pa;
+        endpoints.p[1] = pb;
+
+        float palette[16][4];
+        for (int k = 0; k < 16; ++k)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                palette[k][c] = float(((64 - Bc7Weights[k]) * full[0][c] + Bc7Weights[k] * full[1][c] + 32) >> 6);
+            }
+        }
+
+        return kernels.color_fit(block, palette, 16, 4, indices);
+    }
+
+    //Picks the p-bit that quantizes an endpoint with the smallest error
+    int best_p_bit(const float* endpoint)
+    {
+        float error[2]{};
+        for (int p = 0; p < 2; ++p)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                const float delta = endpoint[c] - float((quantize_7(endpoint[c], p) << 1) | p);
+                error[p] += delta * delta;
+            }
+        }
+
+        return error[1] < error[0] ? 1 : 0;
+    }
+
+    float bc7_fit_endpoints(const Block& block, CompressionQuality quality, const Kernels& kernels,
+        const float* a, const float* b, Bc7Endpoints& endpoints, unsigned char* indices)
+    {
+        if (quality == CompressionQuality::Fast)
+        {
+            return bc7_try(block, kernels, a, b, best_p_bit(a), best_p_bit(b), endpoints, indices);
+        }
+
+        float best_error = std::numeric_limits<float>::max();
+        for (int p = 0; p < 4; ++p)
+        {
+            Bc7Endpoints candidate_endpoints;
+            unsigned char candidate[16];
+            const float error = bc7_try(block, kernels, a, b, p & 1, p >> 1, candidate_endpoints, candidate);
+            if (error < best_error)
+            {
+                best_error = error;
+                endpoints = candidate_endpoints;
+                std::memcpy(indices, candidate, 16);
+            }
+        }
+
+        return best_error;
+    }
+
+    struct BitWriter
+    {
+        unsigned char* out;
+        int position = 0;
+
+        void write(unsigned int value, int bits)
+        {
+            for (int i = 0; i < bits; ++i, ++position)
+            {
+                if ((value >> i) & 1)
+                {
+                    out[position >> 3] |= static_cast<unsigned char>(1 << (position & 7));
+                }
+            }
+        }
+    };
+
+    void encode_bc7(const Block& block, CompressionQuality quality, const Kernels& kernels, unsigned char* out)
+    {
+        float lo[4], hi[4];
+        if (quality == CompressionQuality::Fast)
+        {
+            bounding_box_endpoints(block, 4, lo, hi);
+        }
+        else
+        {
+            principal_axis_endpoints(block, 4, lo, hi);
+        }
+
+        Bc7Endpoints endpoints;
+        unsigned char indices[16];
+        float best_error = bc7_fit_endpoints(block, quality, kernels, lo, hi, endpoints, indices);
+
+        if (quality == CompressionQuality::High)
+        {
+            for (int iteration = 0; iteration < 2 && best_error > 0.0f; ++iteration)
+            {
+                float weight[16];
+                for (int i = 0; i < 16; ++i)
+                {
+                    weight[i] = 1.0f - Bc7Weights[indices[i]] / 64.0f;
+                }
+
+                float a[4], b[4];
+                if (!least_squares_endpoints(block, 4, weight, a, b))
+                {
+                    break;
+                }
+
+                Bc7Endpoints candidate_endpoints;
+                unsigned char candidate[16];
+                const float error = bc7_fit_endpoints(block, quality, kernels, a, b, candidate_endpoints, candidate);
+                if (error >= best_error)
+                {
+                    break;
+                }
+
+                best_error = error;
+                endpoints = candidate_endpoints;
+                std::memcpy(indices, candidate, sizeof(indices));
+            }
+        }
+
+        //The anchor index has an implicit zero MSB
+        if (indices[0] & 8)
+        {
+            std::swap(endpoints.q[0], endpoints.q[1]);
+            std::swap(endpoints.p[0], endpoints.p[1]);
+            for (unsigned char& index : indices)
+            {
+                index = static_cast<unsigned char>(15 - index);
+            }
+        }
+
+        std::memset(out, 0, 16);
+        BitWriter writer{ out };
+        writer.write(1 << 6, 7);
+        for (int c = 0; c < 4; ++c)
+        {
+            writer.write(unsigned(endpoints.q[0][c]), 7);
+            writer.write(unsigned(endpoints.q[1][c]), 7);
+        }
+        writer.write(unsigned(endpoints.p[0]), 1);
+        writer.write(unsigned(endpoints.p[1]), 1);
+        writer.write(indices[0], 3);
+        for (int i = 1; i < 16; ++i)
+        {
+            writer.write(indices[i], 4);
+        }
+    }
+}
+
+std::size_t block_bytes(BlockFormat format)
+{
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+std::size_t compressed_size(BlockFormat format, int width, int height)
+{
+    return std::size_t((width + 3) / 4) * std::size_t((height + 3) / 4) * block_bytes(format);
+}
+
+const char* block_format_name(BlockFormat format)
+{
+    switch (format)
+    {
+        case BlockFormat::BC1:
+            return "BC1";
+        case BlockFormat::BC4:
+            return "BC4";
+        case BlockFormat::BC5:
+            return "BC5";
+        case BlockFormat::BC7:
+        default:
+            return "BC7";
+    }
+}
+
+void compress_image(const unsigned char* pixels, int width, int height, std::size_t channels,
+    BlockFormat format, CompressionQuality quality, unsigned char* out, ThreadPool& pool)
+{
+    const Kernels kernels = select_kernels();
+    const int blocks_x = (width + 3) / 4;
+    const int blocks_y = (height + 3) / 4;
+    const std::size_t bytes = block_bytes(format);
+
+    //Whole block rows per task, small mips end up in a single task
+    const std::size_t grain = std::max(1, 64 / blocks_x);
+
+    pool.parallel_for(std::size_t(blocks_y), grain, [&](std::size_t begin, std::size_t end, std::size_t)
+    {
+        Block block;
+        unsigned char values[16];
+
+        for (std::size_t by = begin; by < end; ++by)
+        {
+            for (int bx = 0; bx < blocks_x; ++bx)
+            {
+                fetch_block(pixels, width, height, channels, bx, int(by), block);
+                unsigned char* dst = out + (by * blocks_x + bx) * bytes;
+
+                switch (format)
+                {
+                    case BlockFormat::BC1:
+                        encode_bc1(block, quality, kernels, dst);
+                        break;
+                    case BlockFormat::BC4:
+                    case BlockFormat::BC5:
+                        for (int c = 0; c < (format == BlockFormat::BC5 ? 2 : 1); ++c)
+                        {
+                            for (int i = 0; i < 16; ++i)
+                            {
+                                values[i] = block.texels[i][c];
+                            }
+                            encode_bc4(values, quality, kernels, dst + 8 * c);
+                        }
+                        break;
+                    case BlockFormat::BC7:
+                        encode_bc7(block, quality, kernels, dst);
+                        break;
+                }
+            }
+        }
+    });
+}
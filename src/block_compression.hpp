@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include "thread_pool.hpp"
+
+enum class BlockFormat
+{
+    BC1, //RGB, 4 bpp
+    BC4, //R, 4 bpp
+    BC5, //RG, 8 bpp
+    BC7 //RGBA, 8 bpp, mode 6 only
+};
+
+//Fast: bounding box endpoints. Normal: principal axis endpoints and a small
+//endpoint search. High: adds least-squares endpoint refinement.
+enum class CompressionQuality
+{
+    Fast,
+    Normal,
+    High
+};
+
+//Bytes per 4x4 block
+std::size_t block_bytes(BlockFormat format);
+
+std::size_t compressed_size(BlockFormat format, int width, int height);
+
+const char* block_format_name(BlockFormat format);
+
+//Encodes a tightly packed 8-bit image with 1..4 channels. BC4 reads the first
+//channel and BC5 the first two. BC1 and BC7 read RGB(A), a missing green or
+//blue channel repeats red and a missing alpha is opaque. Block rows are split
+//across the pool, `out` has to hold compressed_size() bytes.
+void compress_image(const unsigned char* pixels, int width, int height, std::size_t channels,
+    BlockFormat format, CompressionQuality quality, unsigned char* out, ThreadPool& pool);
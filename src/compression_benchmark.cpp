@@ -0,0 +1,79 @@
+#include "compression_benchmark.hpp"
+#include "block_compression.hpp"
+#include "mip_chain.hpp"
+#include "simd.hpp"
+#include <Magnum/PixelFormat.h>
+#include <Magnum/Trade/ImageData.h>
+#include <spdlog/spdlog.h>
+#include <chrono>
+#include <cstring>
+
+bool run_compression_benchmark(TextureLoader& loader, ThreadPool& pool, const std::vector<TextureSpec>& specs)
+{
+    std::vector<Containers::Optional<Trade::ImageData2D>> images = loader.decode(specs);
+
+    //Level 0 of a mip chain is a tightly packed copy, which is what the encoder takes
+    std::vector<MipLevel> sources;
+    std::vector<std::size_t> channels;
+    for (auto& image : images)
+    {
+        if (!image || image->isCompressed() || !supports_mip_generation(image->format()))
+        {
+            spdlog::error("Can't benchmark with an unsupported image");
+            return false;
+        }
+
+        MipLevel packed{ image->size(), Containers::Array<char>{ Containers::NoInit, std::size_t(image->size().product()) * image->pixelSize() } };
+        const std::size_t row_size = std::size_t(image->size().x()) * image->pixelSize();
+        const std::size_t alignment = std::size_t(image->storage().alignment());
+        const std::size_t row_stride = (row_size + alignment - 1) / alignment * alignment;
+        for (Int y = 0; y < image->size().y(); ++y)
+        {
+            std::memcpy(packed.data.data() + y * row_size, image->data().data() + y * row_stride, row_size);
+        }
+
+        channels.push_back(image->pixelSize());
+        sources.push_back(std::move(packed));
+        image = Containers::NullOpt;
+    }
+
+    const SimdLevel best_level = simd_level();
+    spdlog::info("Block compression benchmark, {} maps, {} threads, up to {}", sources.size(), pool.size() + 1, simd_level_name(best_level));
+
+    const BlockFormat formats[]{ BlockFormat::BC1, BlockFormat::BC4, BlockFormat::BC5, BlockFormat::BC7 };
+    const CompressionQuality qualities[]{ CompressionQuality::Fast, CompressionQuality::Normal, CompressionQuality::High };
+    const char* quality_names[]{ "fast", "normal", "high" };
+
+    for (Int level = Int(SimdLevel::Scalar); level <= Int(best_level); ++level)
+    {
+        set_simd_level_limit(SimdLevel(level));
+
+        for (BlockFormat format : formats)
+        {
+            for (std::size_t q = 0; q < 3; ++q)
+            {
+                double input_mb = 0.0;
+                std::size_t output_bytes = 0;
+                const auto start = std::chrono::steady_clock::now();
+
+                for (std::size_t i = 0; i != sources.size(); ++i)
+                {
+                    const MipLevel& source = sources[i];
+                    Containers::Array<char> out{ Containers::NoInit, compressed_size(format, source.size.x(), source.size.y()) };
+                    compress_image(reinterpret_cast<const unsigned char*>(source.data.data()), source.size.x(), source.size.y(),
+                        channels[i], format, qualities[q], reinterpret_cast<unsigned char*>(out.data()), pool);
+
+                    input_mb += source.size.product() * 4 / 1.0e6;
+                    output_bytes += out.size();
+                }
+
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                spdlog::info("  {:6} {} {:6}: {:8.1f} MB/s ({:.1f}x smaller than RGBA8)", simd_level_name(SimdLevel(level)),
+                    block_format_name(format), quality_names[q], input_mb / seconds, input_mb * 1.0e6 / output_bytes);
+            }
+        }
+    }
+
+    set_simd_level_limit(best_level);
+    return true;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <vector>
+#include "texture_loader.hpp"
+#include "thread_pool.hpp"
+
+//Encodes the base level of every map with each block format, quality and
+//SIMD level and logs the throughput in MB of RGBA8 input per second
+bool run_compression_benchmark(TextureLoader& loader, ThreadPool& pool, const std::vector<TextureSpec>& specs);
@@ -0,0 +1,56 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+template<class T>
+class ConcurrentQueue
+{
+public:
+    void push(T value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            items.push_back(std::move(value));
+        }
+        condition.notify_one();
+    }
+
+    bool try_pop(T& value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pop_locked(value);
+    }
+
+    template<class Rep, class Period>
+    bool pop_for(T& value, const std::chrono::duration<Rep, Period>& timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait_for(lock, timeout, [this] { return !items.empty(); });
+        return pop_locked(value);
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+private:
+    bool pop_locked(T& value)
+    {
+        if (items.empty())
+        {
+            return false;
+        }
+
+        value = std::move(items.front());
+        items.pop_front();
+        return true;
+    }
+
+    std::deque<T> items;
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+};
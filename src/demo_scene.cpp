@@ -0,0 +1,875 @@
+#include "demo_scene.hpp"
+#include <Magnum/GL/Renderer.h>
+#include <Magnum/Math/Constants.h>
+#include <Magnum/GlmIntegration/Integration.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <Corrade/Containers/ArrayView.h>
+#include <Corrade/Containers/Optional.h>
+#include <Corrade/Utility/Assert.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include "hash.hpp"
+#include "profiler.hpp"
+
+namespace
+{
+    //Sphere radius plus the largest height displacement
+    constexpr float InstanceRadius = 1.5f;
+    constexpr float InstanceSpacing = 3.0f;
+
+    //The single sphere is scaled up and seen from further away
+    constexpr float SingleSphereScale = 5.0f;
+    constexpr float SingleSphereDistance = 20.0f;
+
+    //Surface over UV area of the UV sphere is 4 pi r^2 over 1, so this many
+    //radii per unit of UV
+    constexpr float SphereUvDensity = 3.5449077f;
+
+    //Coarse patches for the tessellator, it replaces the LOD chain
+    constexpr UnsignedInt TessellationBaseRings = 16;
+
+    std::vector<UnsignedInt> lod_rings(const SceneOptions& options)
+    {
+        if (options.displacement == DisplacementMode::Tessellation)
+        {
+            return { TessellationBaseRings };
+        }
+        return options.lod ? std::vector<UnsignedInt>{ 128, 64, 32, 16 } : std::vector<UnsignedInt>{ 128 };
+    }
+
+    //Roughly how many light spheres overlap any point of the scene
+    constexpr float LightOverlap = 8.0f;
+
+    PBRShader::Flags shader_flags(MaterialLayout layout, const SceneOptions& options, bool image_based_lighting, PBRShader::Flags material_flags)
+    {
+        PBRShader::Flags flags = material_flags;
+        if (layout == MaterialLayout::Packed)
+        {
+            flags |= PBRShader::Flag::PackedMaterial;
+        }
+        if (options.grid && options.instancing)
+        {
+            flags |= PBRShader::Flag::Instanced;
+        }
+        if (options.uniform_buffers)
+        {
+            flags |= PBRShader::Flag::UniformBuffers;
+        }
+        if (options.vertex_format != VertexFormat::Float)
+        {
+            flags |= PBRShader::Flag::PackedVertices;
+        }
+        if (options.vertex_format == VertexFormat::PackedPositions)
+        {
+            flags |= PBRShader::Flag::PackedPositions;
+        }
+        if (options.displacement == DisplacementMode::Tessellation)
+        {
+            flags |= PBRShader::Flag::Tessellated;
+        }
+        else if (options.displacement == DisplacementMode::Parallax)
+        {
+            flags |= PBRShader::Flag::ParallaxOcclusion;
+        }
+        if (options.lighting == LightingMode::Naive)
+        {
+            flags |= PBRShader::Flag::PointLights;
+        }
+        else if (options.lighting == LightingMode::Clustered)
+        {
+            flags |= PBRShader::Flag::ClusteredLights;
+        }
+        if (image_based_lighting)
+        {
+            flags |= PBRShader::Flag::ImageBasedLighting;
+        }
+        return flags;
+    }
+
+    //Deterministic value in [0, 1] per instance and channel
+    float instance_random(std::size_t index, std::uint64_t channel)
+    {
+        return (fnv1a64(&index, sizeof(index), 14695981039346656037ull ^ channel) & 0xffff) / 65535.0f;
+    }
+
+    std::size_t align_up(std::size_t value, std::size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    std::size_t uniform_alignment()
+    {
+        return std::size_t(GL::Buffer::uniformOffsetAlignment());
+    }
+
+    std::size_t storage_alignment()
+    {
+        return std::size_t(GL::Buffer::shaderStorageOffsetAlignment());
+    }
+}
+
+SceneCamera scene_camera(double time, const Vector2i& viewport_size, float grid_radius)
+{
+    const float aspect = viewport_size.x() / float(viewport_size.y());
+    const float fov = glm::radians(45.0f);
+
+    glm::mat4 model = glm::rotate(glm::mat4(1.0), glm::radians(float(SceneRotationSpeed * time)), glm::vec3(0, 1, 0));
+    float distance = SingleSphereDistance;
+    float near_plane = 0.01f;
+    float far_plane = 100.0f;
+    if (grid_radius > 0.0f)
+    {
+        //Back off until the whole grid fits the vertical field of view
+        distance = grid_radius / std::sin(fov * 0.5f);
+        near_plane = std::max(distance - grid_radius, 0.01f);
+        far_plane = distance + grid_radius;
+    }
+    else
+    {
+        model = model * glm::scale(glm::mat4(1.0), glm::vec3(SingleSphereScale));
+    }
+
+    SceneCamera camera;
+    camera.model = Matrix4{ model };
+    camera.view = Matrix4{ glm::lookAt(glm::vec3(0.0, 0.0, distance), glm::vec3(0.0), glm::vec3(0.0, 1.0, 0.0)) };
+    camera.projection = Matrix4{ glm::perspective(fov, aspect, near_plane, far_plane) };
+    camera.distance = distance;
+    camera.near_plane = near_plane;
+    camera.far_plane = far_plane;
+    return camera;
+}
+
+DemoScene::DemoScene(MaterialLayout layout, std::vector<GL::Texture2D>&& textures, const SceneOptions& options):
+    DemoScene{ layout, std::move(textures), nullptr, options }
+{
+}
+
+DemoScene::DemoScene(MaterialLayout layout, TextureStreamer& streamer, const SceneOptions& options):
+    DemoScene{ layout, {}, &streamer, options }
+{
+}
+
+DemoScene::DemoScene(MaterialLayout layout, std::vector<GL::Texture2D>&& textures, TextureStreamer* streamer, const SceneOptions& options):
+    layout{ layout },
+    options{ options },
+    shaders{ options.shaders },
+    lod_chain{ lod_rings(options), 4.0f, options.vertex_format, options.optimize_indices },
+    textures{ std::move(textures) },
+    streamer{ streamer }
+{
+    CORRADE_INTERNAL_ASSERT((streamer ? streamer->size() : this->textures.size()) == (layout == MaterialLayout::Packed ? 3 : 6));
+
+    //The loaders label textures with their source path
+    texture_memory.reserve(this->textures.size());
+    for (std::size_t i = 0; i != this->textures.size(); ++i)
+    {
+        std::string name = this->textures[i].label();
+        if (name.empty())
+        {
+            name = "material texture " + std::to_string(i);
+        }
+        texture_memory.emplace_back(MemoryCategory::Texture, std::move(name), texture_memory_bytes(this->textures[i]));
+    }
+
+    //Until set_lights() adds some
+    this->options.lighting = LightingMode::Directional;
+
+    if (options.displacement == DisplacementMode::Tessellation)
+    {
+        for (std::size_t i = 0; i != lod_chain.size(); ++i)
+        {
+            lod_chain.level(i).mesh.setPrimitive(GL::MeshPrimitive::Patches);
+        }
+    }
+
+    shaders.set_state_cache(&state_cache);
+    if (!shaders.loaded())
+    {
+        //Nothing can be drawn, whoever created the scene checks
+        //shader_library().loaded() and drops it
+        return;
+    }
+    shaders.preload(shader_flags(layout, this->options, bool(environment), material_flags()), options.parallax_quality);
+    shader = shaders.get(shader_flags(layout, this->options, bool(environment), material_flags()), 0, options.parallax_quality);
+
+    if (options.grid)
+    {
+        set_instance_count(1);
+    }
+    else if (options.uniform_buffers)
+    {
+        create_frame_ring();
+    }
+}
+
+void DemoScene::create_frame_ring()
+{
+    //Frame block, one object block per draw and the visible index list.
+    //Instanced grids draw a batch per LOD level and material state.
+    std::size_t material_states = 1;
+    if (material_library && material_library->binding() == MaterialBinding::Loose)
+    {
+        material_states = material_library->texture_set_count();
+    }
+    else if (material_library && material_library->binding() == MaterialBinding::Bindless)
+    {
+        material_states = material_library->size();
+    }
+    const std::size_t draws = !options.grid ? 1 : options.instancing ? lod_chain.size() * material_states : instances;
+    const std::size_t capacity = align_up(sizeof(PBRShader::FrameUniforms), uniform_alignment())
+        + draws * align_up(sizeof(PBRShader::ObjectUniforms), uniform_alignment())
+        + (options.grid && options.instancing ? instances * sizeof(std::uint32_t) + storage_alignment() : 0);
+
+    frame_ring = Containers::pointer<FrameRing>(capacity);
+}
+
+void DemoScene::set_instance_count(std::size_t count)
+{
+    CORRADE_ASSERT(options.grid, "DemoScene: instance count needs a grid scene", );
+
+    const std::size_t side = std::max<std::size_t>(std::size_t(std::ceil(std::cbrt(double(count)))), 1);
+    const float offset = (side - 1) * InstanceSpacing * 0.5f;
+
+    instance_data.assign(count, {});
+    bounds.resize(count);
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        const Vector3 position{ (i % side) * InstanceSpacing - offset,
+            (i / side % side) * InstanceSpacing - offset,
+            (i / (side * side)) * InstanceSpacing - offset };
+
+        const Matrix4 model = Matrix4::translation(position) * Matrix4::rotationY(Rad(instance_random(i, 0) * Constants::tau()));
+        const Matrix3x3 normal = model.normalMatrix();
+
+        PBRShader::InstanceData& data = instance_data[i];
+        data.model_matrix = model;
+        for (std::size_t c = 0; c != 3; ++c)
+        {
+            data.normal_matrix[c] = Vector4{ normal[c], 0.0f };
+        }
+        data.factors = Vector4{ 0.6f + 0.4f * instance_random(i, 1), 0.3f + 0.7f * instance_random(i, 2), instance_random(i, 3),
+            float(instance_material(i)) };
+
+        bounds.x[i] = position.x();
+        bounds.y[i] = position.y();
+        bounds.z[i] = position.z();
+        bounds.radius[i] = InstanceRadius;
+    }
+
+    visible.resize(count);
+    near_distance.resize(count);
+    visible_lod.resize(count);
+    sorted_indices.resize(count);
+    render_queue.reserve(count);
+
+    //Without culling and LOD every frame draws all spheres in order
+    std::iota(sorted_indices.begin(), sorted_indices.end(), 0u);
+
+    if (options.instancing)
+    {
+        instance_buffer.setData(instance_data, GL::BufferUsage::StaticDraw);
+        instance_index_buffer.setData(sorted_indices, GL::BufferUsage::DynamicDraw);
+        instance_memory = TrackedAllocation{ MemoryCategory::Buffer, "grid instances",
+            instance_data.size() * sizeof(PBRShader::InstanceData) + sorted_indices.size() * sizeof(std::uint32_t) };
+        state_cache.invalidate();
+    }
+
+    instances = count;
+    scene_radius = offset * std::sqrt(3.0f) + InstanceRadius;
+
+    if (options.uniform_buffers)
+    {
+        create_frame_ring();
+    }
+
+    spdlog::info("Grid scene: {} spheres, {}", count, options.instancing ? "instanced" : "one draw per sphere");
+}
+
+std::uint32_t DemoScene::instance_material(std::size_t index) const
+{
+    if (!material_library)
+    {
+        return 0;
+    }
+    const std::size_t count = material_library->size();
+    return std::uint32_t(std::min(std::size_t(instance_random(index, 4) * count), count - 1));
+}
+
+void DemoScene::set_materials(std::size_t count, std::size_t texture_sets, MaterialBinding binding)
+{
+    CORRADE_ASSERT(options.grid && options.instancing && !streamer && options.displacement != DisplacementMode::Tessellation,
+        "DemoScene: materials need an instanced grid without texture streaming or tessellation", );
+
+    if (binding == MaterialBinding::Bindless && !bindless_textures_supported())
+    {
+        spdlog::warn("ARB_bindless_texture isn't supported, using texture arrays");
+        binding = MaterialBinding::Arrays;
+    }
+
+    material_library = nullptr;
+    if (count != 0)
+    {
+        material_library = Containers::pointer<MaterialLibrary>(layout, textures, count, texture_sets, binding);
+    }
+
+    for (std::size_t i = 0; i != instance_data.size(); ++i)
+    {
+        instance_data[i].factors.w() = float(instance_material(i));
+    }
+    instance_buffer.setData(instance_data, GL::BufferUsage::StaticDraw);
+    state_cache.invalidate();
+
+    if (options.uniform_buffers)
+    {
+        create_frame_ring();
+    }
+
+    shaders.preload(shader_flags(layout, options, bool(environment), material_flags()), options.parallax_quality);
+}
+
+PBRShader::Flags DemoScene::material_flags() const
+{
+    return material_library ? material_library->shader_flags() : PBRShader::Flags{};
+}
+
+std::uint32_t DemoScene::material_state(std::uint32_t instance) const
+{
+    const std::uint32_t material = std::uint32_t(instance_data[instance].factors.w());
+    switch (material_library->binding())
+    {
+    case MaterialBinding::Loose:
+        return material_library->texture_set(material);
+    case MaterialBinding::Bindless:
+        return material;
+    case MaterialBinding::Arrays:
+        break;
+    }
+    return 0;
+}
+
+void DemoScene::set_mesh(MeshAsset&& mesh)
+{
+    CORRADE_ASSERT(!options.grid, "DemoScene: imported meshes replace the single sphere", );
+
+    mesh_asset = std::move(mesh);
+    if (options.displacement == DisplacementMode::Tessellation)
+    {
+        mesh_asset->mesh.setPrimitive(GL::MeshPrimitive::Patches);
+    }
+}
+
+void DemoScene::set_environment(IblResources&& resources)
+{
+    environment = std::move(resources);
+    shaders.preload(shader_flags(layout, options, bool(environment), material_flags()), options.parallax_quality);
+}
+
+void DemoScene::set_lights(LightingMode mode, std::size_t count)
+{
+    options.lighting = count == 0 ? LightingMode::Directional : mode;
+
+    const float extent = scene_radius * 1.2f;
+    const float volume = 8.0f * extent * extent * extent;
+    const float range = std::cbrt(LightOverlap * volume / std::max<std::size_t>(count, 1) * 3.0f / (4.0f * Constants::pi()));
+    //About unit brightness at half the range
+    const float intensity = 0.25f * range * range;
+    const float cos_outer = std::cos(float(Rad(Deg(35.0f))));
+    const float cos_inner = std::cos(float(Rad(Deg(25.0f))));
+
+    lights.assign(count, {});
+    view_lights.resize(count);
+    light_memory = TrackedAllocation{ MemoryCategory::Buffer, "lights", count * sizeof(PBRShader::Light) };
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        const Vector3 position = (Vector3{ instance_random(i, 10), instance_random(i, 11), instance_random(i, 12) } * 2.0f - Vector3{ 1.0f }) * extent;
+        const Vector3 color = Vector3{ 0.4f } + 0.6f * Vector3{ instance_random(i, 13), instance_random(i, 14), instance_random(i, 15) };
+
+        PBRShader::Light& light = lights[i];
+        light.position_range = Vector4{ position, range };
+        if (i % 4 == 3)
+        {
+            //Spot lights point at the scene center
+            const Vector3 direction = position.isZero() ? Vector3{ 0.0f, -1.0f, 0.0f } : -position.normalized();
+            light.color = Vector4{ color * intensity, cos_inner };
+            light.direction = Vector4{ direction, cos_outer };
+        }
+        else
+        {
+            light.color = Vector4{ color * intensity, -1.0f };
+            light.direction = Vector4{ 0.0f, 0.0f, -1.0f, -2.0f };
+        }
+    }
+
+    if (options.lighting == LightingMode::Clustered && !light_clusters)
+    {
+        light_clusters = Containers::pointer<LightClusters>();
+    }
+
+    shaders.preload(shader_flags(layout, options, bool(environment), material_flags()), options.parallax_quality);
+
+    spdlog::info("{} lights, range {:.2f}, {}", count, range,
+        options.lighting == LightingMode::Clustered ? "clustered" : options.lighting == LightingMode::Naive ? "naive loop" : "none");
+}
+
+void DemoScene::update_lights(const Matrix4& view, const Matrix4& projection, float near_plane, float far_plane, const Vector2i& viewport_size)
+{
+    ProfileZone zone{ "light update" };
+
+    //Lights stay put in world space while the spheres rotate
+    for (std::size_t i = 0; i != lights.size(); ++i)
+    {
+        const PBRShader::Light& light = lights[i];
+        PBRShader::Light& view_light = view_lights[i];
+        view_light.position_range = Vector4{ view.transformPoint(light.position_range.xyz()), light.position_range.w() };
+        view_light.color = light.color;
+        view_light.direction = Vector4{ view.transformVector(light.direction.xyz()), light.direction.w() };
+    }
+
+    //Orphaned every frame, no waiting on draws still reading the last one
+    light_buffer.setData(view_lights, GL::BufferUsage::StreamDraw);
+
+    if (options.lighting == LightingMode::Clustered)
+    {
+        GpuZone gpu_zone{ "light culling" };
+        light_clusters->cull(light_buffer, lights.size(), projection, near_plane, far_plane, viewport_size, state_cache);
+    }
+}
+
+void DemoScene::bind_material(std::size_t texture_set)
+{
+    const auto texture = [&](std::size_t index) -> GL::Texture2D&
+    {
+        return texture_set == 0 ? material_texture(index) : material_library->texture(texture_set, index);
+    };
+
+    if (layout == MaterialLayout::Packed)
+    {
+        shader->bind_albedo_texture(texture(0))
+            .bind_normal_texture(texture(1))
+            .bind_ormh_texture(texture(2));
+    }
+    else
+    {
+        shader->bind_albedo_texture(texture(0))
+            .bind_ao_texture(texture(1))
+            .bind_metallic_texture(texture(2))
+            .bind_normal_texture(texture(3))
+            .bind_roughness_texture(texture(4))
+            .bind_height_texture(texture(5));
+    }
+}
+
+void DemoScene::set_object_state(const Matrix4& model, const Matrix3x3& normal, const Vector3& factors, UnsignedInt instance_offset, float position_scale)
+{
+    if (!options.uniform_buffers)
+    {
+        shader->set_model_matrix(model)
+            .set_normal_matrix(normal)
+            .set_albedo_factor(factors.x())
+            .set_roughness_factor(factors.y())
+            .set_metallic_factor(factors.z())
+            .set_position_scale(position_scale);
+        if (options.grid && options.instancing)
+        {
+            shader->set_instance_offset(instance_offset);
+        }
+        return;
+    }
+
+    FrameRing::Allocation allocation;
+    CORRADE_INTERNAL_ASSERT_OUTPUT(frame_ring->allocate(sizeof(PBRShader::ObjectUniforms), uniform_alignment(), allocation));
+
+    PBRShader::ObjectUniforms uniforms;
+    uniforms.model_matrix = model;
+    for (std::size_t c = 0; c != 3; ++c)
+    {
+        uniforms.normal_matrix[c] = Vector4{ normal[c], 0.0f };
+    }
+    uniforms.albedo_factor = factors.x();
+    uniforms.roughness_factor = factors.y();
+    uniforms.metallic_factor = factors.z();
+    uniforms.normal_factor = 1.0f;
+    uniforms.ao_factor = 1.0f;
+    uniforms.height_factor = SceneHeightFactor;
+    uniforms.instance_offset = instance_offset;
+    uniforms.position_scale = position_scale;
+
+    //Write-combined memory, one sequential copy
+    std::memcpy(allocation.data, &uniforms, sizeof(uniforms));
+    shader->bind_object_uniforms(frame_ring->buffer(), allocation.offset);
+}
+
+void DemoScene::draw(const SceneFrame& frame, const Vector2i& viewport_size)
+{
+    ProfileZone zone{ "scene" };
+    GpuZone gpu_zone{ "scene" };
+
+    //Profile zones of the straight-line stages, one at a time
+    Containers::Optional<ProfileZone> stage{ Containers::InPlaceInit, "matrix setup" };
+
+    const SceneCamera camera = scene_camera(frame.time, viewport_size, options.grid ? scene_radius : 0.0f);
+    const glm::mat4 model{ camera.model };
+    glm::mat4 proj{ camera.projection };
+    const glm::mat4 view{ camera.view };
+    const float distance = camera.distance;
+    const float near_plane = camera.near_plane;
+    const float far_plane = camera.far_plane;
+
+    const Matrix4 current_clip_from_object{ proj * view * model };
+    previous_clip_from_object = drawn ? clip_from_object : current_clip_from_object;
+    clip_from_object = current_clip_from_object;
+    drawn = true;
+
+    if (frame.jitter != Vector2{})
+    {
+        const Vector2 offset = 2.0f * frame.jitter / Vector2{ viewport_size };
+        proj = glm::translate(glm::mat4(1.0), glm::vec3(offset.x(), offset.y(), 0.0f)) * proj;
+    }
+
+    //Pixels per world unit at a view depth of 1
+    const float projection_scale = proj[1][1] * viewport_size.y() * 0.5f;
+
+    //Rebuilt programs that linked take over from here
+    stage.emplace("shader updates");
+    shaders.update();
+    stage = Containers::NullOpt;
+
+    shader = shaders.get(shader_flags(layout, options, bool(environment), material_flags()), frame.render_mode, options.parallax_quality);
+
+    frame_stats = {};
+    if (!shader)
+    {
+        //Fixing the files rebuilds it with hot reload, until then the
+        //frame stays empty
+        if (!missing_shader_reported)
+        {
+            spdlog::error("No linked shader for render mode {}, skipping the scene", frame.render_mode);
+            missing_shader_reported = true;
+        }
+        return;
+    }
+    missing_shader_reported = false;
+    state_cache.reset_counters();
+
+    //Levels requested during the last frame
+    if (streamer)
+    {
+        streamer->update();
+    }
+
+    const bool local_lights = options.lighting != LightingMode::Directional;
+    if (local_lights)
+    {
+        update_lights(Matrix4(view), Matrix4(proj), near_plane, far_plane, viewport_size);
+        frame_stats.lights = lights.size();
+    }
+
+    stage.emplace("uniform upload");
+
+    if (frame_ring)
+    {
+        frame_ring->begin_frame();
+        frame_stats.fence_wait_ms = frame_ring->wait_ms();
+
+        FrameRing::Allocation allocation;
+        CORRADE_INTERNAL_ASSERT_OUTPUT(frame_ring->allocate(sizeof(PBRShader::FrameUniforms), uniform_alignment(), allocation));
+
+        PBRShader::FrameUniforms uniforms;
+        uniforms.view_matrix = Matrix4(view);
+        uniforms.proj_matrix = Matrix4(proj);
+        uniforms.light_direction = frame.light_direction;
+        uniforms.direction_padding = 0.0f;
+        uniforms.light_color = Vector3{ 1.0f };
+        uniforms.light_count = UnsignedInt(lights.size());
+        if (light_clusters)
+        {
+            uniforms.cluster_grid = light_clusters->grid();
+            uniforms.cluster_params = light_clusters->params();
+        }
+        uniforms.viewport_size = Vector2{ viewport_size };
+        uniforms.tessellation_pixels = options.tessellation_pixels;
+        uniforms.padding = 0.0f;
+        std::memcpy(allocation.data, &uniforms, sizeof(uniforms));
+
+        shader->bind_frame_uniforms(frame_ring->buffer(), allocation.offset);
+    }
+    else
+    {
+        shader->set_view_matrix(Matrix4(view))
+            .set_proj_matrix(Matrix4(proj))
+            .set_light_direction(frame.light_direction);
+        if (options.lighting == LightingMode::Naive)
+        {
+            shader->set_light_count(UnsignedInt(lights.size()));
+        }
+        else if (options.lighting == LightingMode::Clustered)
+        {
+            shader->set_cluster_grid(light_clusters->grid(), light_clusters->params());
+        }
+        if (options.displacement == DisplacementMode::Tessellation)
+        {
+            shader->set_tessellation(Vector2{ viewport_size }, options.tessellation_pixels);
+        }
+    }
+
+    if (options.displacement == DisplacementMode::Tessellation)
+    {
+        GL::Renderer::setPatchVertexCount(3);
+    }
+
+    if (material_library)
+    {
+        //Loose texture sets are bound per batch
+        material_library->bind(*shader);
+        frame_stats.materials = material_library->size();
+    }
+    else
+    {
+        bind_material();
+    }
+    if (environment)
+    {
+        shader->bind_environment(environment->specular, environment->brdf_lut, environment->uniforms);
+    }
+    if (local_lights)
+    {
+        shader->bind_light_buffer(light_buffer);
+        if (options.lighting == LightingMode::Clustered)
+        {
+            shader->bind_cluster_buffers(light_clusters->ranges(), light_clusters->indices());
+        }
+    }
+
+    stage = Containers::NullOpt;
+
+    const Matrix4 object_model{ model };
+    const Matrix3x3 object_normal = Matrix4(view * model).normalMatrix();
+
+    //Pixels per unit of UV where the surface comes closest, the streaming demand
+    float uv_pixels = 0.0f;
+    stage.emplace("draw calls");
+    Containers::Optional<GpuZone> gpu_stage{ Containers::InPlaceInit, "scene draws" };
+    if (mesh_asset)
+    {
+        uv_pixels = mesh_asset->uv_density / mesh_asset->radius * SingleSphereScale * projection_scale
+            / std::max(distance - SingleSphereScale, near_plane);
+
+        //Bounding sphere onto the unit sphere
+        const Matrix4 fit = Matrix4::scaling(Vector3{ 1.0f / mesh_asset->radius }) * Matrix4::translation(-mesh_asset->center);
+        set_object_state(object_model * fit, object_normal, frame.material_factors, 0, mesh_asset->position_scale);
+        shader->draw(mesh_asset->mesh);
+
+        frame_stats.visible_instances = 1;
+        frame_stats.vertices = mesh_asset->vertex_count;
+        frame_stats.draw_calls = 1;
+    }
+    else if (!options.grid)
+    {
+        uv_pixels = SphereUvDensity * SingleSphereScale * projection_scale / std::max(distance - SingleSphereScale, near_plane);
+
+        LodLevel& level = lod_chain.level(lod_chain.select(SingleSphereScale * projection_scale / distance));
+        set_object_state(object_model, object_normal, frame.material_factors, 0, level.position_scale);
+        shader->draw(level.mesh);
+
+        frame_stats.visible_instances = 1;
+        frame_stats.vertices = level.vertex_count;
+        frame_stats.draw_calls = 1;
+    }
+    else
+    {
+        const std::size_t visible_count = prepare_visible(Matrix4(proj * view * model), near_plane, projection_scale);
+        frame_stats.visible_instances = visible_count;
+        uv_pixels = grid_uv_pixels;
+
+        if (options.instancing)
+        {
+            draw_instanced(visible_count, object_model, object_normal);
+        }
+        else
+        {
+            draw_objects(object_model, object_normal);
+        }
+    }
+    gpu_stage = Containers::NullOpt;
+    stage = Containers::NullOpt;
+
+    if (frame_ring)
+    {
+        frame_ring->end_frame();
+    }
+
+    if (streamer)
+    {
+        for (std::size_t i = 0; i != streamer->size(); ++i)
+        {
+            streamer->request(i, uv_pixels);
+        }
+        frame_stats.streaming = streamer->stats();
+    }
+
+    frame_stats.vertex_bytes = frame_stats.vertices * vertex_stride(lod_chain.vertex_format());
+    frame_stats.gl = state_cache.counters();
+}
+
+std::size_t DemoScene::prepare_visible(const Matrix4& clip_from_grid, float near_plane, float projection_scale)
+{
+    batches.clear();
+
+    if (!options.culling && lod_chain.size() == 1 && !material_library)
+    {
+        //Identity order from set_instance_count(), the near plane touches the grid
+        batches.push_back({ 0, instances, 0, 0 });
+        grid_uv_pixels = SphereUvDensity * projection_scale / near_plane;
+        return instances;
+    }
+
+    ProfileZone zone{ "culling" };
+    const auto start = std::chrono::steady_clock::now();
+
+    //Sphere positions are static in grid space, so cull there with the
+    //planes of the full clip transform
+    const Frustum frustum = extract_frustum(clip_from_grid);
+    std::size_t visible_count;
+    if (options.culling)
+    {
+        visible_count = cull_spheres(frustum, bounds, visible.data(), near_distance.data());
+    }
+    else
+    {
+        const Vector4& plane = frustum.planes[Frustum::Near];
+        for (std::size_t i = 0; i != instances; ++i)
+        {
+            visible[i] = std::uint32_t(i);
+            near_distance[i] = plane.x() * bounds.x[i] + plane.y() * bounds.y[i] + plane.z() * bounds.z[i] + plane.w();
+        }
+        visible_count = instances;
+    }
+
+    //Counting sort by LOD level, or sort keys with materials
+    level_offsets.assign(lod_chain.size() + 1, 0);
+    render_queue.clear();
+    float closest = Constants::inf();
+    for (std::size_t i = 0; i != visible_count; ++i)
+    {
+        const float depth = std::max(near_distance[i] + near_plane, near_plane);
+        closest = std::min(closest, std::max(depth - bounds.radius[visible[i]], near_plane));
+        const std::size_t lod = lod_chain.select(bounds.radius[visible[i]] * projection_scale / depth);
+        if (material_library)
+        {
+            //One program per frame, nearest first within a batch
+            render_queue.push(make_sort_key(0, material_state(visible[i]), std::uint32_t(lod), depth), visible[i]);
+        }
+        else
+        {
+            visible_lod[i] = std::uint8_t(lod);
+            ++level_offsets[lod + 1];
+        }
+    }
+
+    grid_uv_pixels = visible_count != 0 ? SphereUvDensity * projection_scale / closest : 0.0f;
+
+    if (material_library)
+    {
+        render_queue.sort();
+        const std::vector<RenderQueue::Item>& items = render_queue.items();
+        for (std::size_t k = 0; k != items.size(); ++k)
+        {
+            sorted_indices[k] = items[k].index;
+            //Depth is in the low 32 bits, anything above it breaks a batch
+            if (k == 0 || items[k].key >> 32 != items[k - 1].key >> 32)
+            {
+                batches.push_back({ k, 0, sort_key_mesh(items[k].key), sort_key_material(items[k].key) });
+            }
+            ++batches.back().count;
+        }
+    }
+    else
+    {
+        std::partial_sum(level_offsets.begin(), level_offsets.end(), level_offsets.begin());
+        std::vector<std::size_t> cursor(level_offsets.begin(), level_offsets.end() - 1);
+        for (std::size_t i = 0; i != visible_count; ++i)
+        {
+            sorted_indices[cursor[visible_lod[i]]++] = visible[i];
+        }
+        for (std::size_t lod = 0; lod != lod_chain.size(); ++lod)
+        {
+            if (level_offsets[lod + 1] != level_offsets[lod])
+            {
+                batches.push_back({ level_offsets[lod], level_offsets[lod + 1] - level_offsets[lod], lod, 0 });
+            }
+        }
+    }
+
+    frame_stats.cull_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return visible_count;
+}
+
+void DemoScene::draw_instanced(std::size_t visible_count, const Matrix4& model, const Matrix3x3& normal)
+{
+    if (visible_count == 0)
+    {
+        return;
+    }
+
+    shader->bind_instance_buffer(instance_buffer);
+
+    const bool identity = !options.culling && lod_chain.size() == 1 && !material_library;
+    if (identity)
+    {
+        shader->bind_instance_index_buffer(instance_index_buffer);
+    }
+    else if (frame_ring)
+    {
+        FrameRing::Allocation allocation;
+        CORRADE_INTERNAL_ASSERT_OUTPUT(frame_ring->allocate(visible_count * sizeof(std::uint32_t), storage_alignment(), allocation));
+        std::memcpy(allocation.data, sorted_indices.data(), allocation.size);
+        shader->bind_instance_index_buffer(frame_ring->buffer(), allocation.offset, allocation.size);
+    }
+    else
+    {
+        //Implicitly synchronizes with draws still reading the previous list
+        instance_index_buffer.setSubData(0, Containers::arrayView(sorted_indices.data(), visible_count));
+        shader->bind_instance_index_buffer(instance_index_buffer);
+    }
+
+    const bool loose_materials = material_library && material_library->binding() == MaterialBinding::Loose;
+    for (const DrawBatch& batch : batches)
+    {
+        if (loose_materials)
+        {
+            bind_material(batch.material_state);
+        }
+
+        LodLevel& level = lod_chain.level(batch.lod);
+        level.mesh.setInstanceCount(Int(batch.count));
+        set_object_state(model, normal, Vector3{ 1.0f }, UnsignedInt(batch.offset), level.position_scale);
+        shader->draw(level.mesh);
+
+        frame_stats.vertices += batch.count * level.vertex_count;
+        ++frame_stats.draw_calls;
+    }
+}
+
+void DemoScene::draw_objects(const Matrix4& model, const Matrix3x3& normal)
+{
+    for (const DrawBatch& batch : batches)
+    {
+        LodLevel& level = lod_chain.level(batch.lod);
+        for (std::size_t k = batch.offset; k != batch.offset + batch.count; ++k)
+        {
+            const PBRShader::InstanceData& data = instance_data[sorted_indices[k]];
+            const Matrix3x3 instance_normal{ data.normal_matrix[0].xyz(), data.normal_matrix[1].xyz(), data.normal_matrix[2].xyz() };
+
+            set_object_state(model * data.model_matrix, normal * instance_normal, data.factors.xyz(), 0, level.position_scale);
+            shader->draw(level.mesh);
+
+            frame_stats.vertices += level.vertex_count;
+            ++frame_stats.draw_calls;
+        }
+    }
+}
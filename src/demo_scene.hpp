@@ -0,0 +1,261 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/Texture.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/Math/Vector2.h>
+#include <Magnum/Math/Vector3.h>
+#include <Corrade/Containers/Optional.h>
+#include <Corrade/Containers/Pointer.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "frame_ring.hpp"
+#include "frustum_culling.hpp"
+#include "gl_state_cache.hpp"
+#include "ibl.hpp"
+#include "light_clusters.hpp"
+#include "material_library.hpp"
+#include "material_packer.hpp"
+#include "memory_tracker.hpp"
+#include "mesh_import.hpp"
+#include "mesh_lod.hpp"
+#include "pbr_shader.hpp"
+#include "render_queue.hpp"
+#include "shader_library.hpp"
+#include "texture_streamer.hpp"
+
+using namespace Magnum;
+
+//Degrees the scene turns around Y per second of SceneFrame::time
+constexpr double SceneRotationSpeed = 40.0;
+
+//Everything that changes from frame to frame. The interactive loop fills it
+//from the clock and the cursor, the benchmark from a fixed script.
+struct SceneFrame
+{
+    double time = 0.0; //seconds, drives the rotation
+    Vector3 light_direction{ 0.0f, -0.5f, -0.5f };
+    int render_mode = 0;
+    Vector3 material_factors{ 1.0f }; //albedo, roughness and metallic of the single object, grids keep their own
+    Vector2 jitter; //subpixel projection offset in viewport pixels, for TAA
+};
+
+//View space units the height map displaces by, matches the defaults of the
+//non-block uniforms
+constexpr float SceneHeightFactor = 0.5f;
+
+//The fixed camera and the turning scene at a point in time, unjittered
+struct SceneCamera
+{
+    Matrix4 model; //with the single sphere's scale
+    Matrix4 view;
+    Matrix4 projection;
+    float distance; //of the camera from the origin
+    float near_plane;
+    float far_plane;
+};
+
+//`grid_radius` is the bounding radius of a grid scene, 0 for the single sphere
+SceneCamera scene_camera(double time, const Vector2i& viewport_size, float grid_radius = 0.0f);
+
+//How fragments find the point and spot lights
+enum class LightingMode
+{
+    Directional, //no local lights, only the directional one
+    Naive, //every fragment loops over every light
+    Clustered //every fragment loops over the lights binned into its froxel
+};
+
+//Where the height map displaces the surface
+enum class DisplacementMode
+{
+    Vertex, //per vertex of the pre-tessellated LOD spheres
+    Tessellation, //per vertex the tessellator generates on a coarse sphere
+    Parallax //not at all, parallax occlusion mapping in the fragment shader
+};
+
+struct SceneOptions
+{
+    bool grid = false; //a grid of spheres (set_instance_count()) instead of the single big one
+    bool instancing = true; //draw the grid with instanced calls, otherwise one draw per sphere
+    bool lod = true; //pick the sphere tessellation from the projected size
+    bool culling = true; //frustum cull grid spheres on the CPU
+    bool uniform_buffers = true; //per-frame state in std140 blocks from a FrameRing instead of setUniform()
+    ShaderLibraryOptions shaders; //sources, binary cache, compile mode and hot reload
+    LightingMode lighting = LightingMode::Clustered; //once set_lights() adds any
+    VertexFormat vertex_format = VertexFormat::Packed;
+    bool optimize_indices = true; //reorder sphere indices for the post-transform cache
+    DisplacementMode displacement = DisplacementMode::Vertex;
+    float tessellation_pixels = 8.0f; //target projected edge length
+    PBRShader::ParallaxQuality parallax_quality = PBRShader::ParallaxQuality::Medium;
+};
+
+//Filled by every draw()
+struct SceneStats
+{
+    std::size_t visible_instances = 0;
+    std::size_t vertices = 0;
+    std::size_t vertex_bytes = 0; //vertices times the vertex stride
+    std::size_t draw_calls = 0;
+    std::size_t lights = 0;
+    std::size_t materials = 0; //in the material table, 0 without one
+    double cull_ms = 0.0; //culling plus LOD selection and sorting
+    double fence_wait_ms = 0.0; //waiting for a FrameRing segment
+    GLStateCounters gl;
+    TextureStreamingStats streaming; //with a TextureStreamer
+};
+
+//The rotating, height-displaced PBR sphere, or a rotating grid of them drawn
+//with one instanced call per LOD level or one call per sphere. Textures are
+//in the order of the material specs: albedo, ao, metallic, normal,
+//roughness, height for the separate layout and albedo, normal, ORMH for the
+//packed one.
+class DemoScene
+{
+public:
+    explicit DemoScene(MaterialLayout layout, std::vector<GL::Texture2D>&& textures, const SceneOptions& options = {});
+
+    //Binds the streamer's textures, in the same order, updates it at the
+    //start of every frame and reports the frame's texture demand to it
+    explicit DemoScene(MaterialLayout layout, TextureStreamer& streamer, const SceneOptions& options = {});
+
+    //Lays the spheres out in a cube-shaped grid with varying material
+    //factors and uploads them. Grid scenes only.
+    void set_instance_count(std::size_t count);
+
+    std::size_t instance_count() const
+    {
+        return instances;
+    }
+
+    //Draws an imported mesh in place of the single sphere, scaled to the same
+    //size. Its vertex format has to be SceneOptions::vertex_format.
+    void set_mesh(MeshAsset&& mesh);
+
+    //Lights the scene with the environment on top of the directional light,
+    //switching to the Cook-Torrance shader permutations
+    void set_environment(IblResources&& resources);
+
+    //Scatters point lights and every fourth one a spot light through the
+    //scene bounds, call after set_instance_count(). The range shrinks as the
+    //count grows so about the same number of lights reach any point, like a
+    //larger level with more lights would.
+    void set_lights(LightingMode mode, std::size_t count);
+
+    //Gives every grid sphere one of `count` materials from a MaterialLibrary,
+    //0 goes back to the scene's maps alone. Visible spheres are then drawn
+    //in the order of their sort keys, one instanced call per run of equal
+    //mesh and material state. Needs an instanced grid without texture
+    //streaming or tessellation.
+    void set_materials(std::size_t count, std::size_t texture_sets, MaterialBinding binding);
+
+    std::size_t light_count() const
+    {
+        return lights.size();
+    }
+
+    //Draws into the currently bound framebuffer, doesn't clear it
+    void draw(const SceneFrame& frame, const Vector2i& viewport_size);
+
+    //Maps the last frame's unjittered clip space to the one before it. The
+    //camera is fixed and the scene turns as a whole, so one matrix covers
+    //every pixel and no velocity buffer is needed.
+    Matrix4 reprojection() const
+    {
+        return previous_clip_from_object * clip_from_object.inverted();
+    }
+
+    const SceneStats& stats() const
+    {
+        return frame_stats;
+    }
+
+    bool streams_textures() const
+    {
+        return streamer != nullptr;
+    }
+
+    //draw() updates it first thing, programs it swaps out or rebuilds
+    //synchronously are only safe to drop between frames
+    PBRShaderLibrary& shader_library()
+    {
+        return shaders;
+    }
+
+private:
+    DemoScene(MaterialLayout layout, std::vector<GL::Texture2D>&& textures, TextureStreamer* streamer, const SceneOptions& options);
+
+    GL::Texture2D& material_texture(std::size_t index)
+    {
+        return streamer ? streamer->texture(index) : textures[index];
+    }
+
+    //`texture_set` other than 0 needs a Loose material library
+    void bind_material(std::size_t texture_set = 0);
+    PBRShader::Flags material_flags() const;
+    std::uint32_t instance_material(std::size_t index) const;
+    //What a draw has to share: the texture set with Loose binding, the
+    //material with Bindless and nothing with Arrays
+    std::uint32_t material_state(std::uint32_t instance) const;
+    void set_object_state(const Matrix4& model, const Matrix3x3& normal, const Vector3& factors, UnsignedInt instance_offset, float position_scale);
+    std::size_t prepare_visible(const Matrix4& clip_from_grid, float near_plane, float projection_scale);
+    void draw_instanced(std::size_t visible_count, const Matrix4& model, const Matrix3x3& normal);
+    void draw_objects(const Matrix4& model, const Matrix3x3& normal);
+    void create_frame_ring();
+    void update_lights(const Matrix4& view, const Matrix4& projection, float near_plane, float far_plane, const Vector2i& viewport_size);
+
+    MaterialLayout layout;
+    SceneOptions options;
+    PBRShaderLibrary shaders;
+    PBRShader* shader = nullptr; //permutation for the current render mode, null if it failed to build
+    bool missing_shader_reported = false; //logged once until a program is there again
+    SphereLodChain lod_chain;
+    Containers::Optional<MeshAsset> mesh_asset; //replaces the single sphere
+    Containers::Optional<IblResources> environment; //image-based lighting when set
+    std::vector<GL::Texture2D> textures;
+    std::vector<TrackedAllocation> texture_memory;
+    TextureStreamer* streamer = nullptr; //owns the textures instead if set
+    float grid_uv_pixels = 0.0f; //pixels per unit of UV on the closest visible grid sphere
+    Matrix4 clip_from_object; //unjittered, of the last frame
+    Matrix4 previous_clip_from_object;
+    bool drawn = false;
+    GLStateCache state_cache;
+    Containers::Pointer<FrameRing> frame_ring; //with uniform_buffers
+
+    std::vector<PBRShader::Light> lights; //world space
+    std::vector<PBRShader::Light> view_lights;
+    GL::Buffer light_buffer{ GL::Buffer::TargetHint::ShaderStorage };
+    TrackedAllocation light_memory;
+    Containers::Pointer<LightClusters> light_clusters; //LightingMode::Clustered
+
+    std::vector<PBRShader::InstanceData> instance_data;
+    GL::Buffer instance_buffer{ GL::Buffer::TargetHint::ShaderStorage };
+    GL::Buffer instance_index_buffer{ GL::Buffer::TargetHint::ShaderStorage };
+    TrackedAllocation instance_memory;
+    Containers::Pointer<MaterialLibrary> material_library;
+    std::size_t instances = 1;
+    float scene_radius = 5.5f; //bounding sphere around the origin, frames the camera
+
+    //Per frame scratch, sized for every instance
+    BoundingSpheres bounds;
+    std::vector<std::uint32_t> visible;
+    std::vector<float> near_distance;
+    std::vector<std::uint8_t> visible_lod;
+    std::vector<std::uint32_t> sorted_indices;
+    std::vector<std::size_t> level_offsets; //into sorted_indices, one more than LOD levels
+    RenderQueue render_queue; //with a material library
+
+    //A run of sorted_indices drawn with one instanced call
+    struct DrawBatch
+    {
+        std::size_t offset;
+        std::size_t count;
+        std::size_t lod;
+        std::uint32_t material_state;
+    };
+    std::vector<DrawBatch> batches;
+
+    SceneStats frame_stats;
+};
@@ -0,0 +1,78 @@
+#include "frame_ring.hpp"
+#include <Corrade/Containers/ArrayView.h>
+#include <Corrade/Utility/Assert.h>
+#include <chrono>
+
+namespace
+{
+    std::size_t align_up(std::size_t value, std::size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    //Every offset alignment GL asks for is a power of two <= 256
+    constexpr std::size_t SegmentAlignment = 256;
+}
+
+FrameRing::FrameRing(std::size_t frame_capacity):
+    ring_buffer{ GL::Buffer::TargetHint::Uniform },
+    segment_capacity{ align_up(frame_capacity, SegmentAlignment) }
+{
+    const std::size_t size = segment_capacity * FramesInFlight;
+    ring_buffer.setStorage({ nullptr, size },
+        GL::Buffer::StorageFlag::MapWrite | GL::Buffer::StorageFlag::MapPersistent | GL::Buffer::StorageFlag::MapCoherent);
+
+    mapped = ring_buffer.map(0, size,
+        GL::Buffer::MapFlag::Write | GL::Buffer::MapFlag::Persistent | GL::Buffer::MapFlag::Coherent).data();
+    CORRADE_INTERNAL_ASSERT(mapped);
+    memory = TrackedAllocation{ MemoryCategory::Buffer, "uniform frame ring", size };
+}
+
+FrameRing::~FrameRing()
+{
+    for (GLsync& fence : fences)
+    {
+        if (fence)
+        {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+        }
+    }
+    ring_buffer.unmap();
+}
+
+void FrameRing::begin_frame()
+{
+    segment = (segment + 1) % FramesInFlight;
+    head = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    if (GLsync& fence = fences[segment])
+    {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    last_wait_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool FrameRing::allocate(std::size_t size, std::size_t alignment, Allocation& allocation)
+{
+    const std::size_t offset = align_up(head, alignment);
+    if (offset + size > segment_capacity)
+    {
+        return false;
+    }
+
+    head = offset + size;
+    allocation.offset = segment * segment_capacity + offset;
+    allocation.size = size;
+    allocation.data = mapped + allocation.offset;
+    return true;
+}
+
+void FrameRing::end_frame()
+{
+    CORRADE_INTERNAL_ASSERT(!fences[segment]);
+    fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/OpenGL.h>
+#include <cstddef>
+#include "memory_tracker.hpp"
+
+using namespace Magnum;
+
+//Persistently mapped buffer split into one segment per frame in flight for
+//data written every frame (uniform blocks, index lists). A segment is only
+//written again once the fence placed at the end of its frame has signaled,
+//so there's no implicit synchronization and no buffer orphaning. GL thread
+//only.
+class FrameRing
+{
+public:
+    struct Allocation
+    {
+        std::size_t offset = 0;
+        std::size_t size = 0;
+        char* data = nullptr;
+    };
+
+    static constexpr std::size_t FramesInFlight = 3;
+
+    explicit FrameRing(std::size_t frame_capacity);
+    ~FrameRing();
+
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    GL::Buffer& buffer()
+    {
+        return ring_buffer;
+    }
+
+    std::size_t frame_capacity() const
+    {
+        return segment_capacity;
+    }
+
+    //Moves to the next segment, waiting for the GPU to release it first
+    void begin_frame();
+
+    //Returns false if the current segment is full
+    bool allocate(std::size_t size, std::size_t alignment, Allocation& allocation);
+
+    //Fences the current segment
+    void end_frame();
+
+    //Time the last begin_frame() spent waiting for its fence
+    double wait_ms() const
+    {
+        return last_wait_ms;
+    }
+
+private:
+    GL::Buffer ring_buffer;
+    TrackedAllocation memory;
+    char* mapped = nullptr;
+    std::size_t segment_capacity = 0;
+
+    GLsync fences[FramesInFlight]{};
+    std::size_t segment = FramesInFlight - 1;
+    std::size_t head = 0;
+    double last_wait_ms = 0.0;
+};
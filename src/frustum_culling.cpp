@@ -0,0 +1,195 @@
+#include "frustum_culling.hpp"
+#include "simd.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+    int lowest_set_bit(unsigned mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return int(index);
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    using CullKernel = std::size_t(*)(const Frustum&, const BoundingSpheres&, std::size_t, std::size_t, std::uint32_t*, float*);
+
+    std::size_t cull_scalar(const Frustum& frustum, const BoundingSpheres& spheres, std::size_t begin, std::size_t end,
+        std::uint32_t* visible, float* near_distance)
+    {
+        std::size_t count = 0;
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            bool inside = true;
+            float near = 0.0f;
+            for (std::size_t p = 0; p != Frustum::PlaneCount; ++p)
+            {
+                const Vector4& plane = frustum.planes[p];
+                const float d = plane.x() * spheres.x[i] + plane.y() * spheres.y[i] + plane.z() * spheres.z[i] + plane.w();
+                inside = inside && d > -spheres.radius[i];
+                if (p == Frustum::Near)
+                {
+                    near = d;
+                }
+            }
+
+            if (inside)
+            {
+                visible[count] = std::uint32_t(i);
+                near_distance[count] = near;
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+#ifdef DEMO_SIMD_X86
+    std::size_t cull_sse2(const Frustum& frustum, const BoundingSpheres& spheres, std::size_t begin, std::size_t end,
+        std::uint32_t* visible, float* near_distance)
+    {
+        std::size_t count = 0;
+        std::size_t i = begin;
+        for (; i + 4 <= end; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(spheres.x.data() + i);
+            const __m128 y = _mm_loadu_ps(spheres.y.data() + i);
+            const __m128 z = _mm_loadu_ps(spheres.z.data() + i);
+            const __m128 neg_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius.data() + i));
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            __m128 near = _mm_setzero_ps();
+            for (std::size_t p = 0; p != Frustum::PlaneCount; ++p)
+            {
+                const Vector4& plane = frustum.planes[p];
+                __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x()), x), _mm_set1_ps(plane.w()));
+                d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.y()), y), d);
+                d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z()), z), d);
+                inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, neg_radius));
+                if (p == Frustum::Near)
+                {
+                    near = d;
+                }
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            if (!mask)
+            {
+                continue;
+            }
+
+            alignas(16) float near_lanes[4];
+            _mm_store_ps(near_lanes, near);
+            while (mask)
+            {
+                const int lane = lowest_set_bit(unsigned(mask));
+                visible[count] = std::uint32_t(i + lane);
+                near_distance[count] = near_lanes[lane];
+                ++count;
+                mask &= mask - 1;
+            }
+        }
+
+        return count + cull_scalar(frustum, spheres, i, end, visible + count, near_distance + count);
+    }
+
+    DEMO_TARGET_AVX2 std::size_t cull_avx2(const Frustum& frustum, const BoundingSpheres& spheres, std::size_t begin, std::size_t end,
+        std::uint32_t* visible, float* near_distance)
+    {
+        std::size_t count = 0;
+        std::size_t i = begin;
+        for (; i + 8 <= end; i += 8)
+        {
+            const __m256 x = _mm256_loadu_ps(spheres.x.data() + i);
+            const __m256 y = _mm256_loadu_ps(spheres.y.data() + i);
+            const __m256 z = _mm256_loadu_ps(spheres.z.data() + i);
+            const __m256 neg_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(spheres.radius.data() + i));
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            __m256 near = _mm256_setzero_ps();
+            for (std::size_t p = 0; p != Frustum::PlaneCount; ++p)
+            {
+                const Vector4& plane = frustum.planes[p];
+                __m256 d = _mm256_fmadd_ps(_mm256_set1_ps(plane.x()), x, _mm256_set1_ps(plane.w()));
+                d = _mm256_fmadd_ps(_mm256_set1_ps(plane.y()), y, d);
+                d = _mm256_fmadd_ps(_mm256_set1_ps(plane.z()), z, d);
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, neg_radius, _CMP_GT_OQ));
+                if (p == Frustum::Near)
+                {
+                    near = d;
+                }
+            }
+
+            int mask = _mm256_movemask_ps(inside);
+            if (!mask)
+            {
+                continue;
+            }
+
+            alignas(32) float near_lanes[8];
+            _mm256_store_ps(near_lanes, near);
+            while (mask)
+            {
+                const int lane = lowest_set_bit(unsigned(mask));
+                visible[count] = std::uint32_t(i + lane);
+                near_distance[count] = near_lanes[lane];
+                ++count;
+                mask &= mask - 1;
+            }
+        }
+
+        return count + cull_scalar(frustum, spheres, i, end, visible + count, near_distance + count);
+    }
+#endif
+
+    CullKernel select_kernel()
+    {
+        switch (simd_level())
+        {
+#ifdef DEMO_SIMD_X86
+            case SimdLevel::AVX2:
+                return cull_avx2;
+            case SimdLevel::SSE2:
+                return cull_sse2;
+#endif
+            default:
+                return cull_scalar;
+        }
+    }
+}
+
+Frustum extract_frustum(const Matrix4& clip_from_space)
+{
+    //Gribb/Hartmann: each plane is the w row plus or minus one of the others
+    const Vector4 x = clip_from_space.row(0);
+    const Vector4 y = clip_from_space.row(1);
+    const Vector4 z = clip_from_space.row(2);
+    const Vector4 w = clip_from_space.row(3);
+
+    Frustum frustum;
+    frustum.planes[Frustum::Left] = w + x;
+    frustum.planes[Frustum::Right] = w - x;
+    frustum.planes[Frustum::Bottom] = w + y;
+    frustum.planes[Frustum::Top] = w - y;
+    frustum.planes[Frustum::Near] = w + z;
+    frustum.planes[Frustum::Far] = w - z;
+
+    for (Vector4& plane : frustum.planes)
+    {
+        plane /= plane.xyz().length();
+    }
+
+    return frustum;
+}
+
+std::size_t cull_spheres(const Frustum& frustum, const BoundingSpheres& spheres,
+    std::uint32_t* visible, float* near_distance)
+{
+    return select_kernel()(frustum, spheres, 0, spheres.size(), visible, near_distance);
+}
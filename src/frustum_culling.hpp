@@ -0,0 +1,59 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/Math/Vector4.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace Magnum;
+
+//Normalized planes facing inwards, xyz is the normal and w the distance so
+//dot(plane.xyz, p) + plane.w is the signed distance of p
+struct Frustum
+{
+    enum : std::size_t
+    {
+        Left,
+        Right,
+        Bottom,
+        Top,
+        Near,
+        Far,
+        PlaneCount
+    };
+
+    Vector4 planes[PlaneCount];
+};
+
+//Planes of the clip volume in the space `clip_from_space` maps from, so
+//passing projection * view * model culls in model space
+Frustum extract_frustum(const Matrix4& clip_from_space);
+
+//Bounding spheres as structure of arrays, one lane per sphere
+struct BoundingSpheres
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> radius;
+
+    std::size_t size() const
+    {
+        return x.size();
+    }
+
+    void resize(std::size_t count)
+    {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        radius.resize(count);
+    }
+};
+
+//Writes the indices of spheres touching the frustum and their signed distance
+//to the near plane (view depth minus the near distance), returns how many
+//passed. Both outputs need room for spheres.size() entries.
+std::size_t cull_spheres(const Frustum& frustum, const BoundingSpheres& spheres,
+    std::uint32_t* visible, float* near_distance);
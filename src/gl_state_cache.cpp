@@ -0,0 +1,36 @@
+#include "gl_state_cache.hpp"
+
+void GLStateCache::bind_buffer(GL::Buffer::Target target, UnsignedInt index, GL::Buffer& buffer,
+    std::size_t offset, std::size_t size)
+{
+    std::vector<BufferBinding>& bindings = target == GL::Buffer::Target::Uniform ? uniform_buffers : storage_buffers;
+    if (index >= bindings.size())
+    {
+        bindings.resize(index + 1);
+    }
+
+    BufferBinding& binding = bindings[index];
+    if (binding.id == buffer.id() && binding.offset == offset && binding.size == size)
+    {
+        ++state_counters.buffer_binds_skipped;
+        return;
+    }
+
+    if (size == 0)
+    {
+        buffer.bind(target, index);
+    }
+    else
+    {
+        buffer.bind(target, index, GLintptr(offset), GLsizeiptr(size));
+    }
+
+    binding = { buffer.id(), offset, size };
+    ++state_counters.buffer_binds;
+}
+
+void GLStateCache::invalidate()
+{
+    uniform_buffers.clear();
+    storage_buffers.clear();
+}
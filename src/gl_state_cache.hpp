@@ -0,0 +1,51 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/OpenGL.h>
+#include <cstddef>
+#include <vector>
+
+using namespace Magnum;
+
+struct GLStateCounters
+{
+    std::size_t buffer_binds = 0;
+    std::size_t buffer_binds_skipped = 0;
+};
+
+//Remembers the ranges bound to indexed uniform/storage buffer bindings and
+//drops redundant binds before they reach the driver. Magnum already skips
+//redundant texture unit binds and program switches but doesn't track
+//indexed bindings. Anything that binds indexed buffers behind its back has
+//to call invalidate().
+class GLStateCache
+{
+public:
+    //Whole buffer when size is 0
+    void bind_buffer(GL::Buffer::Target target, UnsignedInt index, GL::Buffer& buffer,
+        std::size_t offset = 0, std::size_t size = 0);
+
+    void invalidate();
+
+    const GLStateCounters& counters() const
+    {
+        return state_counters;
+    }
+
+    void reset_counters()
+    {
+        state_counters = {};
+    }
+
+private:
+    struct BufferBinding
+    {
+        GLuint id = 0;
+        std::size_t offset = 0;
+        std::size_t size = 0;
+    };
+
+    std::vector<BufferBinding> uniform_buffers;
+    std::vector<BufferBinding> storage_buffers;
+    GLStateCounters state_counters;
+};
@@ -0,0 +1,1027 @@
+#include "ibl.hpp"
+#include <Magnum/ImageView.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/GL/Renderer.h>
+#include <Magnum/GL/TextureFormat.h>
+#include <Magnum/Math/Constants.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Math/Packing.h>
+#include <Magnum/Math/Vector4.h>
+#include <Magnum/Trade/ImageData.h>
+#include <Corrade/Utility/Assert.h>
+#include <Corrade/Utility/Directory.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <type_traits>
+#include "hash.hpp"
+#include "pbr_shader.hpp"
+#include "simd.hpp"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double elapsed_ms(Clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+
+    constexpr char Magic[8] = "PBRIBL";
+    constexpr std::uint32_t Version = 1;
+
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::int32_t specular_size;
+        std::int32_t specular_levels;
+        std::int32_t brdf_lut_size;
+        std::uint64_t key;
+        float sh_irradiance[27];
+        float padding;
+        double precompute_ms; //the cold start cost
+        std::uint32_t precompute_threads;
+        std::uint32_t padding2;
+    };
+
+    static_assert(std::is_trivially_copyable<FileHeader>::value, "FileHeader is written as-is");
+    static_assert(std::is_trivially_copyable<IblSettings>::value && sizeof(IblSettings) == 20, "IblSettings is hashed as-is");
+
+    //Source radiance mip chain, 2x2 box filtered
+    struct SourceLevel
+    {
+        Int width = 0;
+        Int height = 0;
+        std::vector<Vector3> texels;
+    };
+
+    //GGX samples around +Z for one roughness, structure of arrays padded to
+    //a multiple of four with zero weights
+    struct SampleTable
+    {
+        std::vector<float> x, y, z;
+        std::vector<float> weight; //NdotL, 0 for samples below the horizon
+        std::vector<float> lod; //source level from the sample PDF
+        float weight_sum = 0.0f;
+    };
+
+    std::size_t padded(std::size_t count)
+    {
+        return (count + 3) / 4 * 4;
+    }
+
+    Vector2 hammersley(UnsignedInt i, UnsignedInt count)
+    {
+        UnsignedInt bits = i;
+        bits = (bits << 16u) | (bits >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return { float(i) / float(count), float(bits) * 2.3283064365386963e-10f };
+    }
+
+    //GGX half vector around +Z for alpha = roughness^2
+    Vector3 importance_sample_ggx(const Vector2& xi, float alpha)
+    {
+        const float phi = Constants::tau() * xi.x();
+        const float cos_theta = std::sqrt((1.0f - xi.y()) / (1.0f + (alpha * alpha - 1.0f) * xi.y()));
+        const float sin_theta = std::sqrt(std::max(1.0f - cos_theta * cos_theta, 0.0f));
+        return { sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta };
+    }
+
+    //Same polynomial in the scalar and the SSE2 path so the cached result
+    //doesn't depend on the SIMD level, max error about 1e-5 rad
+    float atan_unit(float a)
+    {
+        const float s = a * a;
+        return a * (0.99997726f + s * (-0.33262347f + s * (0.19354346f + s * (-0.11643287f + s * (0.05265332f + s * -0.01172120f)))));
+    }
+
+    float atan2_approx(float y, float x)
+    {
+        const float ax = std::abs(x);
+        const float ay = std::abs(y);
+        float r = atan_unit(std::min(ax, ay) / std::max(std::max(ax, ay), 1.0e-30f));
+        if (ay > ax)
+        {
+            r = Constants::piHalf() - r;
+        }
+        if (x < 0.0f)
+        {
+            r = Constants::pi() - r;
+        }
+        return std::copysign(r, y);
+    }
+
+    //Direction to equirectangular texture coordinates in [0, 1]
+    Vector2 equirect_coordinates(const Vector3& direction)
+    {
+        const float y = Math::clamp(direction.y(), -1.0f, 1.0f);
+        return { 0.5f + atan2_approx(direction.x(), -direction.z()) / Constants::tau(),
+            atan2_approx(std::sqrt(std::max(1.0f - y * y, 0.0f)), y) / Constants::pi() };
+    }
+
+    Vector3 equirect_direction(float u, float v)
+    {
+        const float theta = Constants::pi() * v;
+        const float phi = Constants::tau() * (u - 0.5f);
+        return { std::sin(theta) * std::sin(phi), std::cos(theta), -std::sin(theta) * std::cos(phi) };
+    }
+
+    //GL face order, s and t in [-1, 1] along the face's texel rows and columns
+    Vector3 cube_direction(Int face, float s, float t)
+    {
+        switch (face)
+        {
+            case 0: return Vector3{ 1.0f, -t, -s }.normalized();
+            case 1: return Vector3{ -1.0f, -t, s }.normalized();
+            case 2: return Vector3{ s, 1.0f, t }.normalized();
+            case 3: return Vector3{ s, -1.0f, -t }.normalized();
+            case 4: return Vector3{ s, -t, 1.0f }.normalized();
+            default: return Vector3{ -s, -t, -1.0f }.normalized();
+        }
+    }
+
+    using CoordinateKernel = void(*)(const SampleTable&, const Vector3&, const Vector3&, const Vector3&, float*, float*);
+    using BrdfKernel = Vector2(*)(const float*, const float*, std::size_t, float, float);
+
+    //Rotates the table into the frame (t, b, n) and maps it to the equirect
+    void coordinates_scalar(const SampleTable& table, const Vector3& t, const Vector3& b, const Vector3& n, float* u, float* v)
+    {
+        for (std::size_t i = 0; i != table.x.size(); ++i)
+        {
+            const Vector2 uv = equirect_coordinates(t * table.x[i] + b * table.y[i] + n * table.z[i]);
+            u[i] = uv.x();
+            v[i] = uv.y();
+        }
+    }
+
+    //Split-sum scale and bias of F0 for one NdotV, over a table of half vectors
+    Vector2 brdf_scalar(const float* hx, const float* hz, std::size_t count, float n_dot_v, float k)
+    {
+        const float sin_v = std::sqrt(1.0f - n_dot_v * n_dot_v);
+        const float g_v = n_dot_v / (n_dot_v * (1.0f - k) + k);
+        Vector2 sum;
+        for (std::size_t i = 0; i != count; ++i)
+        {
+            const float v_dot_h = std::max(sin_v * hx[i] + n_dot_v * hz[i], 0.0f);
+            const float n_dot_l = 2.0f * v_dot_h * hz[i] - n_dot_v;
+            if (n_dot_l <= 0.0f)
+            {
+                continue;
+            }
+
+            const float g_l = n_dot_l / (n_dot_l * (1.0f - k) + k);
+            const float visibility = g_v * g_l * v_dot_h / (hz[i] * n_dot_v);
+            const float fresnel = std::pow(1.0f - v_dot_h, 5.0f);
+            sum += Vector2{ (1.0f - fresnel) * visibility, fresnel * visibility };
+        }
+        return sum;
+    }
+
+#ifdef DEMO_SIMD_X86
+    __m128 select_sse2(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    __m128 atan2_sse2(__m128 y, __m128 x)
+    {
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const __m128 ax = _mm_andnot_ps(sign, x);
+        const __m128 ay = _mm_andnot_ps(sign, y);
+        const __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1.0e-30f)));
+        const __m128 s = _mm_mul_ps(a, a);
+
+        __m128 p = _mm_set1_ps(-0.01172120f);
+        p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(0.05265332f));
+        p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.11643287f));
+        p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(0.19354346f));
+        p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(-0.33262347f));
+        p = _mm_add_ps(_mm_mul_ps(p, s), _mm_set1_ps(0.99997726f));
+        __m128 r = _mm_mul_ps(a, p);
+
+        r = select_sse2(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(Constants::piHalf()), r), r);
+        r = select_sse2(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(Constants::pi()), r), r);
+        return _mm_or_ps(r, _mm_and_ps(sign, y));
+    }
+
+    void coordinates_sse2(const SampleTable& table, const Vector3& t, const Vector3& b, const Vector3& n, float* u, float* v)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 inv_tau = _mm_set1_ps(1.0f / Constants::tau());
+        const __m128 inv_pi = _mm_set1_ps(1.0f / Constants::pi());
+        for (std::size_t i = 0; i != table.x.size(); i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(table.x.data() + i);
+            const __m128 y = _mm_loadu_ps(table.y.data() + i);
+            const __m128 z = _mm_loadu_ps(table.z.data() + i);
+
+            const __m128 wx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(t.x())), _mm_mul_ps(y, _mm_set1_ps(b.x()))), _mm_mul_ps(z, _mm_set1_ps(n.x())));
+            __m128 wy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(t.y())), _mm_mul_ps(y, _mm_set1_ps(b.y()))), _mm_mul_ps(z, _mm_set1_ps(n.y())));
+            const __m128 wz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(t.z())), _mm_mul_ps(y, _mm_set1_ps(b.z()))), _mm_mul_ps(z, _mm_set1_ps(n.z())));
+            wy = _mm_min_ps(_mm_max_ps(wy, _mm_set1_ps(-1.0f)), one);
+
+            const __m128 sin_theta = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(wy, wy)), _mm_setzero_ps()));
+            const __m128 negative_z = _mm_sub_ps(_mm_setzero_ps(), wz);
+            _mm_storeu_ps(u + i, _mm_add_ps(_mm_set1_ps(0.5f), _mm_mul_ps(atan2_sse2(wx, negative_z), inv_tau)));
+            _mm_storeu_ps(v + i, _mm_mul_ps(atan2_sse2(sin_theta, wy), inv_pi));
+        }
+    }
+
+    Vector2 brdf_sse2(const float* hx, const float* hz, std::size_t count, float n_dot_v, float k)
+    {
+        const float sin_v = std::sqrt(1.0f - n_dot_v * n_dot_v);
+        const float g_v = n_dot_v / (n_dot_v * (1.0f - k) + k);
+
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 sin_v4 = _mm_set1_ps(sin_v);
+        const __m128 n_dot_v4 = _mm_set1_ps(n_dot_v);
+        const __m128 k4 = _mm_set1_ps(k);
+        const __m128 one_minus_k = _mm_set1_ps(1.0f - k);
+        const __m128 g_v_over_n_dot_v = _mm_set1_ps(g_v / n_dot_v);
+
+        __m128 scale = zero;
+        __m128 bias = zero;
+        for (std::size_t i = 0; i != count; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(hx + i);
+            const __m128 z = _mm_loadu_ps(hz + i);
+
+            const __m128 v_dot_h = _mm_max_ps(_mm_add_ps(_mm_mul_ps(sin_v4, x), _mm_mul_ps(n_dot_v4, z)), zero);
+            const __m128 n_dot_l = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(v_dot_h, v_dot_h), z), n_dot_v4);
+            const __m128 valid = _mm_cmpgt_ps(n_dot_l, zero);
+
+            //Masked lanes may divide by zero, the mask drops whatever comes out
+            const __m128 g_l = _mm_div_ps(n_dot_l, _mm_add_ps(_mm_mul_ps(n_dot_l, one_minus_k), k4));
+            const __m128 visibility = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(g_v_over_n_dot_v, g_l), v_dot_h), z);
+
+            const __m128 c = _mm_sub_ps(one, v_dot_h);
+            const __m128 c2 = _mm_mul_ps(c, c);
+            const __m128 fresnel = _mm_mul_ps(_mm_mul_ps(c2, c2), c);
+
+            scale = _mm_add_ps(scale, _mm_and_ps(valid, _mm_mul_ps(_mm_sub_ps(one, fresnel), visibility)));
+            bias = _mm_add_ps(bias, _mm_and_ps(valid, _mm_mul_ps(fresnel, visibility)));
+        }
+
+        alignas(16) float scale_lanes[4];
+        alignas(16) float bias_lanes[4];
+        _mm_store_ps(scale_lanes, scale);
+        _mm_store_ps(bias_lanes, bias);
+        return { scale_lanes[0] + scale_lanes[1] + scale_lanes[2] + scale_lanes[3],
+            bias_lanes[0] + bias_lanes[1] + bias_lanes[2] + bias_lanes[3] };
+    }
+#endif
+
+    CoordinateKernel coordinate_kernel()
+    {
+#ifdef DEMO_SIMD_X86
+        if (simd_level() >= SimdLevel::SSE2)
+        {
+            return coordinates_sse2;
+        }
+#endif
+        return coordinates_scalar;
+    }
+
+    BrdfKernel brdf_kernel()
+    {
+#ifdef DEMO_SIMD_X86
+        if (simd_level() >= SimdLevel::SSE2)
+        {
+            return brdf_sse2;
+        }
+#endif
+        return brdf_scalar;
+    }
+
+    std::vector<SourceLevel> build_source_chain(const Environment& environment)
+    {
+        std::vector<SourceLevel> levels(1);
+        levels[0].width = environment.size.x();
+        levels[0].height = environment.size.y();
+        levels[0].texels = environment.texels;
+
+        while (levels.back().width > 1 || levels.back().height > 1)
+        {
+            const SourceLevel& source = levels.back();
+            SourceLevel level;
+            level.width = std::max(source.width / 2, 1);
+            level.height = std::max(source.height / 2, 1);
+            level.texels.resize(std::size_t(level.width) * level.height);
+            for (Int y = 0; y != level.height; ++y)
+            {
+                const Int y0 = std::min(2 * y, source.height - 1);
+                const Int y1 = std::min(2 * y + 1, source.height - 1);
+                for (Int x = 0; x != level.width; ++x)
+                {
+                    const Int x0 = std::min(2 * x, source.width - 1);
+                    const Int x1 = std::min(2 * x + 1, source.width - 1);
+                    level.texels[std::size_t(y) * level.width + x] = 0.25f * (source.texels[std::size_t(y0) * source.width + x0]
+                        + source.texels[std::size_t(y0) * source.width + x1] + source.texels[std::size_t(y1) * source.width + x0]
+                        + source.texels[std::size_t(y1) * source.width + x1]);
+                }
+            }
+            levels.push_back(std::move(level));
+        }
+
+        return levels;
+    }
+
+    //Wraps around in longitude, clamps in latitude
+    Vector3 sample_bilinear(const SourceLevel& level, float u, float v)
+    {
+        const float x = u * level.width - 0.5f;
+        const float y = v * level.height - 0.5f;
+        const float x_floor = std::floor(x);
+        const float y_floor = std::floor(y);
+        const float fx = x - x_floor;
+        const float fy = y - y_floor;
+
+        const Int x0 = ((Int(x_floor) % level.width) + level.width) % level.width;
+        const Int x1 = (x0 + 1) % level.width;
+        const Int y0 = Math::clamp(Int(y_floor), 0, level.height - 1);
+        const Int y1 = Math::clamp(Int(y_floor) + 1, 0, level.height - 1);
+
+        const Vector3* row0 = level.texels.data() + std::size_t(y0) * level.width;
+        const Vector3* row1 = level.texels.data() + std::size_t(y1) * level.width;
+        return Math::lerp(Math::lerp(row0[x0], row0[x1], fx), Math::lerp(row1[x0], row1[x1], fx), fy);
+    }
+
+    Vector3 sample_trilinear(const std::vector<SourceLevel>& levels, float u, float v, float lod)
+    {
+        lod = Math::clamp(lod, 0.0f, float(levels.size() - 1));
+        const std::size_t level = std::size_t(lod);
+        const float fraction = lod - float(level);
+        const Vector3 fine = sample_bilinear(levels[level], u, v);
+        if (fraction <= 0.0f || level + 1 == levels.size())
+        {
+            return fine;
+        }
+        return Math::lerp(fine, sample_bilinear(levels[level + 1], u, v), fraction);
+    }
+
+    //Source level whose texels cover the given solid angle
+    float lod_for_solid_angle(float solid_angle, const SourceLevel& base)
+    {
+        const float texel_solid_angle = 4.0f * Constants::pi() / (float(base.width) * float(base.height));
+        return std::max(0.5f * std::log2(solid_angle / texel_solid_angle), 0.0f);
+    }
+
+    SampleTable build_sample_table(float roughness, UnsignedInt sample_count, const SourceLevel& base, float min_lod)
+    {
+        const float alpha = roughness * roughness;
+        const std::size_t size = padded(sample_count);
+
+        SampleTable table;
+        table.x.assign(size, 0.0f);
+        table.y.assign(size, 0.0f);
+        table.z.assign(size, 1.0f);
+        table.weight.assign(size, 0.0f);
+        table.lod.assign(size, 0.0f);
+
+        for (UnsignedInt i = 0; i != sample_count; ++i)
+        {
+            const Vector3 h = importance_sample_ggx(hammersley(i, sample_count), alpha);
+            //Reflect V = N = +Z about H
+            const Vector3 l{ 2.0f * h.z() * h.x(), 2.0f * h.z() * h.y(), 2.0f * h.z() * h.z() - 1.0f };
+            if (l.z() <= 0.0f)
+            {
+                continue;
+            }
+
+            //With N = V the PDF of L is D / 4, blur by the solid angle each
+            //sample stands for (filtered importance sampling, +1 level bias)
+            const float cos2 = h.z() * h.z();
+            const float denominator = (alpha * alpha - 1.0f) * cos2 + 1.0f;
+            const float d = alpha * alpha / (Constants::pi() * denominator * denominator);
+            const float pdf = d * 0.25f;
+            const float sample_solid_angle = 1.0f / (float(sample_count) * pdf);
+
+            table.x[i] = l.x();
+            table.y[i] = l.y();
+            table.z[i] = l.z();
+            table.weight[i] = l.z();
+            table.lod[i] = std::max(lod_for_solid_angle(sample_solid_angle, base) + 1.0f, min_lod);
+            table.weight_sum += l.z();
+        }
+
+        return table;
+    }
+
+    void project_sh(const std::vector<SourceLevel>& levels, ThreadPool& pool, Vector3 (&sh)[9])
+    {
+        //A few hundred texels across are plenty for order 2
+        std::size_t index = 0;
+        while (index + 1 < levels.size() && levels[index].width > 256)
+        {
+            ++index;
+        }
+        const SourceLevel& level = levels[index];
+
+        std::vector<std::array<Vector3, 9>> partial(pool.size() + 1);
+        for (auto& sums : partial)
+        {
+            sums.fill(Vector3{});
+        }
+
+        pool.parallel_for(std::size_t(level.height), 4, [&](std::size_t begin, std::size_t end, std::size_t worker)
+        {
+            std::array<Vector3, 9>& sums = partial[worker];
+            for (std::size_t y = begin; y != end; ++y)
+            {
+                const float v = (float(y) + 0.5f) / float(level.height);
+                const float solid_angle = Constants::tau() / float(level.width) * Constants::pi() / float(level.height)
+                    * std::sin(Constants::pi() * v);
+                for (Int x = 0; x != level.width; ++x)
+                {
+                    const Vector3 d = equirect_direction((float(x) + 0.5f) / float(level.width), v);
+                    const Vector3 radiance = level.texels[y * level.width + x] * solid_angle;
+                    const float basis[9]{ 0.282095f, 0.488603f * d.y(), 0.488603f * d.z(), 0.488603f * d.x(),
+                        1.092548f * d.x() * d.y(), 1.092548f * d.y() * d.z(), 0.315392f * (3.0f * d.z() * d.z() - 1.0f),
+                        1.092548f * d.x() * d.z(), 0.546274f * (d.x() * d.x() - d.y() * d.y()) };
+                    for (std::size_t i = 0; i != 9; ++i)
+                    {
+                        sums[i] += radiance * basis[i];
+                    }
+                }
+            }
+        });
+
+        //Convolve with the clamped cosine (pi, 2pi/3, pi/4 per band), divide
+        //by pi and fold in the basis constants so the shader only evaluates
+        //the polynomials
+        const float band[9]{ 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+        const float constants[9]{ 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f };
+        for (std::size_t i = 0; i != 9; ++i)
+        {
+            Vector3 sum;
+            for (const auto& sums : partial)
+            {
+                sum += sums[i];
+            }
+            sh[i] = sum * band[i] * constants[i];
+        }
+    }
+
+    void pack_rgba16f(const Vector3& color, UnsignedShort* out)
+    {
+        out[0] = Math::packHalf(color.x());
+        out[1] = Math::packHalf(color.y());
+        out[2] = Math::packHalf(color.z());
+        out[3] = Math::packHalf(1.0f);
+    }
+
+    void prefilter_specular(const std::vector<SourceLevel>& levels, const IblSettings& settings, ThreadPool& pool, IblData& data)
+    {
+        const Int level_count = std::max(settings.specular_levels, 1);
+        data.specular_size = settings.specular_size;
+        data.specular.clear();
+
+        //Rows of every face of every level form one flat work list
+        struct Row
+        {
+            Int level;
+            Int face;
+            Int y;
+        };
+        std::vector<Row> rows;
+        std::vector<SampleTable> tables;
+        for (Int level = 0; level != level_count; ++level)
+        {
+            const Int size = std::max(settings.specular_size >> level, 1);
+            data.specular.emplace_back(Containers::ValueInit, std::size_t(6) * size * size * 4);
+
+            //Never sample finer than a texel of this face
+            const float texel_solid_angle = 4.0f * Constants::pi() / (6.0f * float(size) * float(size));
+            const float min_lod = lod_for_solid_angle(texel_solid_angle, levels[0]);
+            const float roughness = level_count > 1 ? float(level) / float(level_count - 1) : 0.0f;
+            if (level == 0)
+            {
+                //Roughness 0 is a mirror, a single sample along N
+                SampleTable mirror;
+                mirror.x = { 0.0f, 0.0f, 0.0f, 0.0f };
+                mirror.y = { 0.0f, 0.0f, 0.0f, 0.0f };
+                mirror.z = { 1.0f, 1.0f, 1.0f, 1.0f };
+                mirror.weight = { 1.0f, 0.0f, 0.0f, 0.0f };
+                mirror.lod = { min_lod, min_lod, min_lod, min_lod };
+                mirror.weight_sum = 1.0f;
+                tables.push_back(std::move(mirror));
+            }
+            else
+            {
+                tables.push_back(build_sample_table(roughness, settings.specular_samples, levels[0], min_lod));
+            }
+
+            for (Int face = 0; face != 6; ++face)
+            {
+                for (Int y = 0; y != size; ++y)
+                {
+                    rows.push_back({ level, face, y });
+                }
+            }
+        }
+
+        const CoordinateKernel coordinates = coordinate_kernel();
+        pool.parallel_for(rows.size(), 4, [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            std::vector<float> u;
+            std::vector<float> v;
+            for (std::size_t r = begin; r != end; ++r)
+            {
+                const Row& row = rows[r];
+                const SampleTable& table = tables[row.level];
+                const Int size = std::max(settings.specular_size >> row.level, 1);
+                u.resize(table.x.size());
+                v.resize(table.x.size());
+
+                UnsignedShort* out = data.specular[row.level].data() + (std::size_t(row.face) * size * size + std::size_t(row.y) * size) * 4;
+                const float t = 2.0f * (float(row.y) + 0.5f) / float(size) - 1.0f;
+                for (Int x = 0; x != size; ++x)
+                {
+                    const float s = 2.0f * (float(x) + 0.5f) / float(size) - 1.0f;
+                    const Vector3 n = cube_direction(row.face, s, t);
+                    const Vector3 up = std::abs(n.z()) < 0.999f ? Vector3::zAxis() : Vector3::xAxis();
+                    const Vector3 tangent = Math::cross(up, n).normalized();
+                    const Vector3 bitangent = Math::cross(n, tangent);
+
+                    coordinates(table, tangent, bitangent, n, u.data(), v.data());
+
+                    Vector3 sum;
+                    for (std::size_t i = 0; i != table.x.size(); ++i)
+                    {
+                        if (table.weight[i] > 0.0f)
+                        {
+                            sum += sample_trilinear(levels, u[i], v[i], table.lod[i]) * table.weight[i];
+                        }
+                    }
+                    pack_rgba16f(sum / table.weight_sum, out + std::size_t(x) * 4);
+                }
+            }
+        });
+    }
+
+    void integrate_brdf(const IblSettings& settings, ThreadPool& pool, IblData& data)
+    {
+        const Int size = settings.brdf_lut_size;
+        const UnsignedInt sample_count = settings.brdf_samples;
+        data.brdf_lut_size = size;
+        data.brdf_lut = Containers::Array<UnsignedShort>{ Containers::ValueInit, std::size_t(size) * size * 2 };
+
+        const BrdfKernel brdf = brdf_kernel();
+        pool.parallel_for(std::size_t(size), 1, [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            //Padding has hz = 0 so NdotL < 0 and the lane is dropped
+            std::vector<float> hx(padded(sample_count), 0.0f);
+            std::vector<float> hz(padded(sample_count), 0.0f);
+            for (std::size_t y = begin; y != end; ++y)
+            {
+                const float roughness = (float(y) + 0.5f) / float(size);
+                const float alpha = roughness * roughness;
+                for (UnsignedInt i = 0; i != sample_count; ++i)
+                {
+                    const Vector3 h = importance_sample_ggx(hammersley(i, sample_count), alpha);
+                    hx[i] = h.x();
+                    hz[i] = h.z();
+                }
+
+                //Smith-Schlick k for image-based lighting
+                const float k = alpha * 0.5f;
+                UnsignedShort* out = data.brdf_lut.data() + y * size * 2;
+                for (Int x = 0; x != size; ++x)
+                {
+                    const float n_dot_v = (float(x) + 0.5f) / float(size);
+                    const Vector2 result = brdf(hx.data(), hz.data(), hx.size(), n_dot_v, k) / float(sample_count);
+                    out[2 * x] = Math::packHalf(result.x());
+                    out[2 * x + 1] = Math::packHalf(result.y());
+                }
+            }
+        });
+    }
+
+    std::uint64_t settings_key(std::uint64_t environment_hash, const IblSettings& settings)
+    {
+        std::uint64_t key = fnv1a64(&Version, sizeof(Version), environment_hash);
+        return fnv1a64(&settings, sizeof(settings), key);
+    }
+
+    std::string cache_file(const std::string& directory, std::uint64_t key)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.ibl", static_cast<unsigned long long>(key));
+        return Utility::Directory::join(directory, name);
+    }
+
+    std::size_t specular_level_size(Int specular_size, Int level)
+    {
+        const std::size_t size = std::size_t(std::max(specular_size >> level, 1));
+        return 6 * size * size * 4;
+    }
+
+    Containers::Optional<IblData> load_cache(const std::string& file, std::uint64_t key, double& precompute_ms, std::uint32_t& threads)
+    {
+        const auto mapping = Utility::Directory::mapRead(file);
+        if (mapping.size() < sizeof(FileHeader))
+        {
+            return {};
+        }
+
+        FileHeader header;
+        std::memcpy(&header, mapping.data(), sizeof(header));
+        if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version || header.key != key
+            || header.specular_size <= 0 || header.specular_levels <= 0 || header.brdf_lut_size <= 0)
+        {
+            return {};
+        }
+
+        std::size_t expected = sizeof(FileHeader) + std::size_t(header.brdf_lut_size) * header.brdf_lut_size * 2 * sizeof(UnsignedShort);
+        for (Int level = 0; level != header.specular_levels; ++level)
+        {
+            expected += specular_level_size(header.specular_size, level) * sizeof(UnsignedShort);
+        }
+        if (mapping.size() < expected)
+        {
+            return {};
+        }
+
+        IblData data;
+        for (std::size_t i = 0; i != 9; ++i)
+        {
+            data.sh_irradiance[i] = Vector3{ header.sh_irradiance[3 * i], header.sh_irradiance[3 * i + 1], header.sh_irradiance[3 * i + 2] };
+        }
+
+        const char* cursor = mapping.data() + sizeof(FileHeader);
+        data.specular_size = header.specular_size;
+        for (Int level = 0; level != header.specular_levels; ++level)
+        {
+            data.specular.emplace_back(Containers::NoInit, specular_level_size(header.specular_size, level));
+            std::memcpy(data.specular.back().data(), cursor, data.specular.back().size() * sizeof(UnsignedShort));
+            cursor += data.specular.back().size() * sizeof(UnsignedShort);
+        }
+
+        data.brdf_lut_size = header.brdf_lut_size;
+        data.brdf_lut = Containers::Array<UnsignedShort>{ Containers::NoInit, std::size_t(header.brdf_lut_size) * header.brdf_lut_size * 2 };
+        std::memcpy(data.brdf_lut.data(), cursor, data.brdf_lut.size() * sizeof(UnsignedShort));
+
+        precompute_ms = header.precompute_ms;
+        threads = header.precompute_threads;
+        return data;
+    }
+
+    bool store_cache(const std::string& directory, const std::string& file, std::uint64_t key, const IblData& data,
+        double precompute_ms, std::uint32_t threads)
+    {
+        if (!Utility::Directory::mkpath(directory))
+        {
+            spdlog::error("Can't create {}", directory);
+            return false;
+        }
+
+        FileHeader header{};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.specular_size = data.specular_size;
+        header.specular_levels = Int(data.specular.size());
+        header.brdf_lut_size = data.brdf_lut_size;
+        header.key = key;
+        for (std::size_t i = 0; i != 9; ++i)
+        {
+            for (std::size_t c = 0; c != 3; ++c)
+            {
+                header.sh_irradiance[3 * i + c] = data.sh_irradiance[i][c];
+            }
+        }
+        header.precompute_ms = precompute_ms;
+        header.precompute_threads = threads;
+
+        const std::string temporary_path = file + ".tmp";
+        {
+            std::ofstream out{ temporary_path, std::ios::binary | std::ios::trunc };
+            if (!out)
+            {
+                spdlog::error("Can't write {}", temporary_path);
+                return false;
+            }
+
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const auto& level : data.specular)
+            {
+                out.write(reinterpret_cast<const char*>(level.data()), level.size() * sizeof(UnsignedShort));
+            }
+            out.write(reinterpret_cast<const char*>(data.brdf_lut.data()), data.brdf_lut.size() * sizeof(UnsignedShort));
+
+            if (!out)
+            {
+                spdlog::error("Can't write {}", temporary_path);
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary_path, file, error);
+        if (error)
+        {
+            spdlog::error("Can't replace {}: {}", file, error.message());
+            return false;
+        }
+        return true;
+    }
+
+    //Environment from the path, the procedural sky if there is none
+    Containers::Optional<Environment> resolve_environment(const std::string& path, PluginManager::Manager<Trade::AbstractImporter>& manager,
+        std::uint64_t& hash)
+    {
+        if (path.empty() || !Utility::Directory::exists(path))
+        {
+            if (!path.empty())
+            {
+                spdlog::warn("{} not found, lighting with a procedural sky", path);
+            }
+            Environment sky = procedural_sky();
+            const std::string name = "procedural_sky";
+            hash = fnv1a64(name.data(), name.size());
+            hash = fnv1a64(sky.texels.data(), sky.texels.size() * sizeof(Vector3), hash);
+            return sky;
+        }
+
+        const auto contents = Utility::Directory::mapRead(path);
+        hash = fnv1a64(contents.data(), contents.size());
+        return load_environment(path, manager);
+    }
+}
+
+Containers::Optional<Environment> load_environment(const std::string& path, PluginManager::Manager<Trade::AbstractImporter>& manager)
+{
+    Containers::Pointer<Trade::AbstractImporter> importer = manager.loadAndInstantiate("StbImageImporter");
+    Containers::Optional<Trade::ImageData2D> image;
+    if (importer && importer->openFile(path))
+    {
+        image = importer->image2D(0);
+    }
+
+    if (!image || image->isCompressed() || (image->format() != PixelFormat::RGB32F && image->format() != PixelFormat::RGBA32F))
+    {
+        spdlog::error("Can't load {} as a float RGB environment", path);
+        return {};
+    }
+
+    Environment environment;
+    environment.size = image->size();
+    environment.texels.resize(std::size_t(image->size().product()));
+
+    //Magnum images are bottom-up, the equirect rows go from the zenith down
+    const std::size_t channels = image->format() == PixelFormat::RGBA32F ? 4 : 3;
+    const std::size_t row_size = std::size_t(image->size().x()) * channels * sizeof(Float);
+    const std::size_t alignment = std::size_t(image->storage().alignment());
+    const std::size_t row_stride = (row_size + alignment - 1) / alignment * alignment;
+    for (Int y = 0; y != image->size().y(); ++y)
+    {
+        const auto* source = reinterpret_cast<const Float*>(image->data().data() + (image->size().y() - 1 - y) * row_stride);
+        Vector3* target = environment.texels.data() + std::size_t(y) * image->size().x();
+        for (Int x = 0; x != image->size().x(); ++x)
+        {
+            target[x] = Vector3{ source[x * channels], source[x * channels + 1], source[x * channels + 2] };
+        }
+    }
+
+    return environment;
+}
+
+Environment procedural_sky(const Vector2i& size)
+{
+    Environment environment;
+    environment.size = size;
+    environment.texels.resize(std::size_t(size.product()));
+
+    const Vector3 sun_direction = Vector3{ 0.4f, 0.6f, -0.5f }.normalized();
+    const Vector3 zenith{ 0.25f, 0.45f, 0.9f };
+    const Vector3 horizon{ 0.9f, 0.85f, 0.8f };
+    const Vector3 ground{ 0.18f, 0.15f, 0.12f };
+
+    for (Int y = 0; y != size.y(); ++y)
+    {
+        for (Int x = 0; x != size.x(); ++x)
+        {
+            const Vector3 d = equirect_direction((x + 0.5f) / size.x(), (y + 0.5f) / size.y());
+            Vector3 color = d.y() > 0.0f
+                ? Math::lerp(horizon, zenith, std::pow(d.y(), 0.4f))
+                : Math::lerp(horizon * 0.5f, ground, std::min(-d.y() * 4.0f, 1.0f));
+
+            //Bright, small sun so the specular lobes have something to show
+            const float sun = Math::dot(d, sun_direction);
+            if (sun > 0.9995f)
+            {
+                color += Vector3{ 400.0f, 380.0f, 340.0f };
+            }
+            else
+            {
+                color += Vector3{ 1.0f, 0.9f, 0.7f } * std::pow(std::max(sun, 0.0f), 64.0f);
+            }
+
+            environment.texels[std::size_t(y) * size.x() + x] = color;
+        }
+    }
+
+    return environment;
+}
+
+IblData precompute_ibl(const Environment& environment, const IblSettings& settings, ThreadPool& pool, IblTimings* timings)
+{
+    CORRADE_INTERNAL_ASSERT(environment.size.product() > 0 && environment.texels.size() == std::size_t(environment.size.product()));
+
+    const auto start = Clock::now();
+    IblData data;
+
+    const std::vector<SourceLevel> levels = build_source_chain(environment);
+
+    const auto sh_start = Clock::now();
+    project_sh(levels, pool, data.sh_irradiance);
+    const double sh_ms = elapsed_ms(sh_start);
+
+    const auto specular_start = Clock::now();
+    prefilter_specular(levels, settings, pool, data);
+    const double specular_ms = elapsed_ms(specular_start);
+
+    const auto brdf_start = Clock::now();
+    integrate_brdf(settings, pool, data);
+    const double brdf_ms = elapsed_ms(brdf_start);
+
+    if (timings)
+    {
+        timings->sh_ms = sh_ms;
+        timings->specular_ms = specular_ms;
+        timings->brdf_ms = brdf_ms;
+        timings->total_ms = elapsed_ms(start);
+    }
+
+    return data;
+}
+
+IblResources upload_ibl(const IblData& data, float intensity)
+{
+    //Filtering across face edges, without it the blurry levels show seams
+    GL::Renderer::enable(GL::Renderer::Feature::SeamlessCubeMapTexture);
+
+    IblResources resources;
+    resources.specular.setWrapping(GL::SamplerWrapping::ClampToEdge)
+        .setMagnificationFilter(GL::SamplerFilter::Linear)
+        .setMinificationFilter(GL::SamplerFilter::Linear, GL::SamplerMipmap::Linear)
+        .setStorage(Int(data.specular.size()), GL::TextureFormat::RGBA16F, Vector2i{ data.specular_size });
+
+    std::size_t specular_bytes = 0;
+    for (std::size_t level = 0; level != data.specular.size(); ++level)
+    {
+        specular_bytes += data.specular[level].size() * sizeof(UnsignedShort);
+        const Int size = std::max(data.specular_size >> level, 1);
+        const std::size_t face_size = std::size_t(size) * size * 4;
+        for (std::size_t face = 0; face != 6; ++face)
+        {
+            const ImageView2D image{ PixelFormat::RGBA16F, Vector2i{ size },
+                Containers::arrayView(data.specular[level].data() + face * face_size, face_size) };
+            resources.specular.setSubImage(GL::CubeMapCoordinate(GLenum(GL::CubeMapCoordinate::PositiveX) + GLenum(face)),
+                Int(level), {}, image);
+        }
+    }
+
+    resources.brdf_lut.setWrapping(GL::SamplerWrapping::ClampToEdge)
+        .setMagnificationFilter(GL::SamplerFilter::Linear)
+        .setMinificationFilter(GL::SamplerFilter::Linear)
+        .setStorage(1, GL::TextureFormat::RG16F, Vector2i{ data.brdf_lut_size })
+        .setSubImage(0, {}, ImageView2D{ PixelFormat::RG16F, Vector2i{ data.brdf_lut_size }, Containers::arrayView(data.brdf_lut) });
+    resources.specular_memory = TrackedAllocation{ MemoryCategory::Texture, "IBL specular cube map", specular_bytes };
+    resources.brdf_lut_memory = TrackedAllocation{ MemoryCategory::Texture, "IBL BRDF LUT", data.brdf_lut.size() * sizeof(UnsignedShort) };
+
+    PBRShader::EnvironmentUniforms uniforms{};
+    for (std::size_t i = 0; i != 9; ++i)
+    {
+        uniforms.sh_irradiance[i] = Vector4{ data.sh_irradiance[i], 0.0f };
+    }
+    uniforms.specular_max_lod = float(data.specular.size() - 1);
+    uniforms.intensity = intensity;
+    resources.uniforms.setData({ &uniforms, 1 }, GL::BufferUsage::StaticDraw);
+
+    return resources;
+}
+
+Containers::Optional<IblResources> load_ibl(const std::string& environment_path, const std::string& cache_directory,
+    const IblSettings& settings, PluginManager::Manager<Trade::AbstractImporter>& manager, ThreadPool& pool)
+{
+    const auto start = Clock::now();
+    const std::string name = environment_path.empty() || !Utility::Directory::exists(environment_path) ? "procedural sky" : environment_path;
+
+    //Hashing the file is cheap next to decoding it, a hit skips both the
+    //decode and the precompute
+    std::uint64_t environment_hash = 0;
+    Containers::Optional<Environment> environment;
+    if (name == environment_path)
+    {
+        const auto contents = Utility::Directory::mapRead(environment_path);
+        environment_hash = fnv1a64(contents.data(), contents.size());
+    }
+    else
+    {
+        environment = resolve_environment(environment_path, manager, environment_hash);
+    }
+
+    const std::uint64_t key = settings_key(environment_hash, settings);
+    const std::string file = cache_directory.empty() ? std::string{} : cache_file(cache_directory, key);
+
+    if (!file.empty() && Utility::Directory::exists(file))
+    {
+        double precompute_ms = 0.0;
+        std::uint32_t threads = 0;
+        if (Containers::Optional<IblData> data = load_cache(file, key, precompute_ms, threads))
+        {
+            IblResources resources = upload_ibl(*data);
+            spdlog::info("IBL for {} loaded from {} in {:.1f} ms, the precompute took {:.1f} ms on {} threads",
+                name, file, elapsed_ms(start), precompute_ms, threads);
+            return resources;
+        }
+    }
+
+    if (!environment)
+    {
+        environment = resolve_environment(environment_path, manager, environment_hash);
+        if (!environment)
+        {
+            return {};
+        }
+    }
+
+    IblTimings timings;
+    const IblData data = precompute_ibl(*environment, settings, pool, &timings);
+    spdlog::info("IBL for {} ({}x{}) precomputed in {:.1f} ms on {} threads with {}: SH {:.1f} ms, specular {:.1f} ms, BRDF LUT {:.1f} ms",
+        name, environment->size.x(), environment->size.y(), timings.total_ms, pool.size() + 1, simd_level_name(simd_level()),
+        timings.sh_ms, timings.specular_ms, timings.brdf_ms);
+
+    if (!file.empty())
+    {
+        store_cache(cache_directory, file, key, data, timings.total_ms, std::uint32_t(pool.size() + 1));
+    }
+
+    return upload_ibl(data);
+}
+
+bool run_ibl_benchmark(const std::string& environment_path, const IblSettings& settings,
+    PluginManager::Manager<Trade::AbstractImporter>& manager, std::size_t max_threads)
+{
+    std::uint64_t hash = 0;
+    const Containers::Optional<Environment> environment = resolve_environment(environment_path, manager, hash);
+    if (!environment)
+    {
+        return false;
+    }
+
+    if (max_threads == 0)
+    {
+        max_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    spdlog::info("IBL precompute benchmark, {}x{} environment, {} px specular base with {} levels, {}x{} LUT",
+        environment->size.x(), environment->size.y(), settings.specular_size, settings.specular_levels,
+        settings.brdf_lut_size, settings.brdf_lut_size);
+
+    //Workers plus the calling thread
+    std::vector<std::size_t> worker_counts;
+    for (std::size_t workers = 1; workers < max_threads; workers *= 2)
+    {
+        worker_counts.push_back(workers);
+    }
+    worker_counts.push_back(std::max<std::size_t>(max_threads - 1, 1));
+    worker_counts.erase(std::unique(worker_counts.begin(), worker_counts.end()), worker_counts.end());
+
+    const SimdLevel best_level = simd_level();
+    for (Int level = Int(SimdLevel::Scalar); level <= std::min(Int(best_level), Int(SimdLevel::SSE2)); ++level)
+    {
+        set_simd_level_limit(SimdLevel(level));
+
+        double baseline_ms = 0.0;
+        for (std::size_t workers : worker_counts)
+        {
+            ThreadPool pool{ workers };
+            IblTimings timings;
+            precompute_ibl(*environment, settings, pool, &timings);
+            if (baseline_ms == 0.0)
+            {
+                baseline_ms = timings.total_ms;
+            }
+
+            spdlog::info("  {:6} {:3} threads: {:8.1f} ms ({:.2f}x), SH {:.1f} ms, specular {:.1f} ms, BRDF LUT {:.1f} ms",
+                simd_level_name(SimdLevel(level)), workers + 1, timings.total_ms, baseline_ms / timings.total_ms,
+                timings.sh_ms, timings.specular_ms, timings.brdf_ms);
+        }
+    }
+
+    set_simd_level_limit(best_level);
+    return true;
+}
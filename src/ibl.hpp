@@ -0,0 +1,94 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/CubeMapTexture.h>
+#include <Magnum/GL/Texture.h>
+#include <Magnum/Math/Vector2.h>
+#include <Magnum/Math/Vector3.h>
+#include <Magnum/Trade/AbstractImporter.h>
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Containers/Optional.h>
+#include <Corrade/PluginManager/Manager.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "memory_tracker.hpp"
+#include "thread_pool.hpp"
+
+using namespace Magnum;
+
+//Linear RGB radiance on an equirectangular grid, +Y up, row 0 at the zenith
+//and the image center looking down -Z
+struct Environment
+{
+    Vector2i size;
+    std::vector<Vector3> texels;
+};
+
+//Any float RGB(A) image StbImageImporter reads, i.e. Radiance .hdr
+Containers::Optional<Environment> load_environment(const std::string& path, PluginManager::Manager<Trade::AbstractImporter>& manager);
+
+//Sky gradient with a sun over a darker ground, for when there's no HDR
+Environment procedural_sky(const Vector2i& size = { 512, 256 });
+
+struct IblSettings
+{
+    Int specular_size = 128; //cube face size of the roughness 0 level
+    Int specular_levels = 6; //roughness 0 to 1, one level per mip
+    UnsignedInt specular_samples = 128; //GGX samples per texel above roughness 0
+    Int brdf_lut_size = 128;
+    UnsignedInt brdf_samples = 512;
+};
+
+//Everything the shader needs for image-based lighting, textures as half floats
+struct IblData
+{
+    //Order 2 SH of the irradiance divided by pi, i.e. of the Lambert response
+    //to a white albedo, in the order 1, y, z, x, xy, yz, 3z^2 - 1, xz, x^2 - y^2
+    //without the basis constants
+    Vector3 sh_irradiance[9];
+    Int specular_size = 0;
+    //GGX-prefiltered radiance per mip level, six RGBA16F faces in GL order
+    std::vector<Containers::Array<UnsignedShort>> specular;
+    Int brdf_lut_size = 0;
+    //Split-sum scale and bias to F0 as RG16F over (NdotV, roughness)
+    Containers::Array<UnsignedShort> brdf_lut;
+};
+
+struct IblTimings
+{
+    double sh_ms = 0.0;
+    double specular_ms = 0.0;
+    double brdf_ms = 0.0;
+    double total_ms = 0.0;
+};
+
+//Projects the irradiance onto SH, prefilters the specular mip chain with
+//GGX importance sampling (reading from pre-blurred source mips chosen by the
+//sample PDF) and integrates the BRDF LUT, all spread over the pool. Sample
+//directions and LUT integrands are evaluated four at a time with SSE2.
+IblData precompute_ibl(const Environment& environment, const IblSettings& settings, ThreadPool& pool, IblTimings* timings = nullptr);
+
+//GPU side of IblData
+struct IblResources
+{
+    GL::CubeMapTexture specular;
+    GL::Texture2D brdf_lut;
+    GL::Buffer uniforms{ GL::Buffer::TargetHint::Uniform }; //PBRShader::EnvironmentUniforms
+    TrackedAllocation specular_memory;
+    TrackedAllocation brdf_lut_memory;
+};
+
+IblResources upload_ibl(const IblData& data, float intensity = 1.0f);
+
+//Loads the environment (procedural_sky() for an empty path), then takes the
+//precomputed data from `cache_directory` if it holds an entry for the same
+//environment file contents and settings, or computes and stores it. An
+//empty directory always computes. Uploading needs a current GL context.
+Containers::Optional<IblResources> load_ibl(const std::string& environment_path, const std::string& cache_directory,
+    const IblSettings& settings, PluginManager::Manager<Trade::AbstractImporter>& manager, ThreadPool& pool);
+
+//Times precompute_ibl() with a growing number of workers and with each SIMD
+//level, no GL context needed
+bool run_ibl_benchmark(const std::string& environment_path, const IblSettings& settings,
+    PluginManager::Manager<Trade::AbstractImporter>& manager, std::size_t max_threads);
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdio>
+#include <string>
+
+//Quoted and escaped for the hand-written JSON reports
+inline std::string json_string(const std::string& value)
+{
+    std::string out = "\"";
+    for (char c : value)
+    {
+        switch (c)
+        {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                }
+                else
+                {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
@@ -0,0 +1,236 @@
+#include "light_clusters.hpp"
+#include <Magnum/GL/Renderer.h>
+#include <Magnum/GL/Shader.h>
+#include <Magnum/GL/Version.h>
+#include <Magnum/Math/Constants.h>
+#include <Magnum/Math/Functions.h>
+#include <Corrade/Containers/ArrayView.h>
+#include <Corrade/Utility/Assert.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace
+{
+    //std430 layout of one cluster AABB
+    struct ClusterBounds
+    {
+        Vector4 min;
+        Vector4 max;
+    };
+
+    const char* const CullSource = R"(
+        layout(local_size_x = GROUP_SIZE) in;
+
+        struct Light
+        {
+            vec4 position_range;
+            vec4 color;
+            vec4 direction;
+        };
+
+        struct ClusterBounds
+        {
+            vec4 min_point;
+            vec4 max_point;
+        };
+
+        layout(std430, binding = 2) readonly buffer Lights
+        {
+            Light lights[];
+        };
+
+        layout(std430, binding = 3) writeonly buffer ClusterRanges
+        {
+            uvec2 cluster_ranges[];
+        };
+
+        layout(std430, binding = 4) buffer LightIndices
+        {
+            uint light_index_count;
+            uint light_indices[];
+        };
+
+        layout(std430, binding = 5) readonly buffer Clusters
+        {
+            ClusterBounds clusters[];
+        };
+
+        uniform uint light_count;
+        uniform uint cluster_count;
+        uniform uint index_capacity;
+
+        shared vec4 light_spheres[GROUP_SIZE];
+
+        //Spot lights are tested with their full sphere, conservative but cheap
+        bool intersects(vec4 sphere, ClusterBounds bounds)
+        {
+            vec3 closest = clamp(sphere.xyz, bounds.min_point.xyz, bounds.max_point.xyz);
+            vec3 d = closest - sphere.xyz;
+            return dot(d, d) <= sphere.w * sphere.w;
+        }
+
+        void main()
+        {
+            uint cluster = gl_GlobalInvocationID.x;
+            bool active = cluster < cluster_count;
+            ClusterBounds bounds = clusters[min(cluster, cluster_count - 1u)];
+
+            //First pass counts, the second one fills the reserved range. Every
+            //thread takes part in the loads and barriers, active or not.
+            uint count = 0u;
+            for (uint base = 0u; base < light_count; base += GROUP_SIZE)
+            {
+                uint i = base + gl_LocalInvocationIndex;
+                light_spheres[gl_LocalInvocationIndex] = i < light_count ? lights[i].position_range : vec4(0.0);
+                barrier();
+
+                uint batch = min(uint(GROUP_SIZE), light_count - base);
+                for (uint j = 0u; j < batch; ++j)
+                {
+                    count += intersects(light_spheres[j], bounds) ? 1u : 0u;
+                }
+                barrier();
+            }
+
+            uint offset = active && count != 0u ? atomicAdd(light_index_count, count) : 0u;
+            count = active ? min(count, index_capacity - min(offset, index_capacity)) : 0u;
+
+            uint written = 0u;
+            for (uint base = 0u; base < light_count; base += GROUP_SIZE)
+            {
+                uint i = base + gl_LocalInvocationIndex;
+                light_spheres[gl_LocalInvocationIndex] = i < light_count ? lights[i].position_range : vec4(0.0);
+                barrier();
+
+                uint batch = min(uint(GROUP_SIZE), light_count - base);
+                for (uint j = 0u; j < batch && written < count; ++j)
+                {
+                    if (intersects(light_spheres[j], bounds))
+                    {
+                        light_indices[offset + written++] = base + j;
+                    }
+                }
+                barrier();
+            }
+
+            if (active)
+            {
+                cluster_ranges[cluster] = uvec2(offset, count);
+            }
+        }
+    )";
+}
+
+LightCullShader::LightCullShader()
+{
+    MAGNUM_ASSERT_GL_VERSION_SUPPORTED(GL::Version::GL450);
+
+    GL::Shader comp(GL::Version::GL450, GL::Shader::Type::Compute);
+    comp.addSource("#define GROUP_SIZE " + std::to_string(GroupSize) + "\n").addSource(CullSource);
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(comp.compile());
+    attachShader(comp);
+    CORRADE_INTERNAL_ASSERT_OUTPUT(link());
+
+    light_count_uniform = uniformLocation("light_count");
+    cluster_count_uniform = uniformLocation("cluster_count");
+    index_capacity_uniform = uniformLocation("index_capacity");
+}
+
+LightCullShader& LightCullShader::set_counts(UnsignedInt light_count, UnsignedInt cluster_count, UnsignedInt index_capacity)
+{
+    setUniform(light_count_uniform, light_count);
+    setUniform(cluster_count_uniform, cluster_count);
+    setUniform(index_capacity_uniform, index_capacity);
+    return *this;
+}
+
+LightClusters::LightClusters()
+{
+    const std::size_t bounds_size = ClusterCount * sizeof(ClusterBounds);
+    const std::size_t range_size = ClusterCount * 2 * sizeof(UnsignedInt);
+    //Counter followed by the indices
+    const std::size_t index_size = (1 + ClusterCount * AverageLightsPerCluster) * sizeof(UnsignedInt);
+    bounds_buffer.setData({ nullptr, bounds_size }, GL::BufferUsage::StaticDraw);
+    range_buffer.setData({ nullptr, range_size }, GL::BufferUsage::DynamicCopy);
+    index_buffer.setData({ nullptr, index_size }, GL::BufferUsage::DynamicCopy);
+    memory = TrackedAllocation{ MemoryCategory::Buffer, "light clusters", bounds_size + range_size + index_size };
+}
+
+void LightClusters::update_bounds(const Matrix4& projection, float near_plane, float far_plane, const Vector2i& viewport_size)
+{
+    const Vector4 key{ projection[0][0], projection[1][1], near_plane, far_plane };
+    if (key == projection_key && viewport_size == viewport)
+    {
+        return;
+    }
+
+    projection_key = key;
+    viewport = viewport_size;
+
+    //slice = log(depth) * scale - bias puts depth k of GridZ at near * (far / near)^(k / GridZ)
+    const float log_ratio = std::log(far_plane / near_plane);
+    const float slice_scale = GridZ / log_ratio;
+    const float slice_bias = GridZ * std::log(near_plane) / log_ratio;
+    cluster_params = { GridX / float(viewport_size.x()), GridY / float(viewport_size.y()), slice_scale, slice_bias };
+
+    //Symmetric perspective: view x = ndc x * depth / P[0][0], same for y
+    std::vector<ClusterBounds> bounds(ClusterCount);
+    for (UnsignedInt z = 0; z != GridZ; ++z)
+    {
+        const float depth_near = near_plane * std::pow(far_plane / near_plane, float(z) / GridZ);
+        const float depth_far = near_plane * std::pow(far_plane / near_plane, float(z + 1) / GridZ);
+
+        for (UnsignedInt y = 0; y != GridY; ++y)
+        {
+            for (UnsignedInt x = 0; x != GridX; ++x)
+            {
+                const float ndc_x[2]{ -1.0f + 2.0f * x / GridX, -1.0f + 2.0f * (x + 1) / GridX };
+                const float ndc_y[2]{ -1.0f + 2.0f * y / GridY, -1.0f + 2.0f * (y + 1) / GridY };
+
+                Vector3 min{ Constants::inf() };
+                Vector3 max{ -Constants::inf() };
+                for (float depth : { depth_near, depth_far })
+                {
+                    for (float nx : ndc_x)
+                    {
+                        for (float ny : ndc_y)
+                        {
+                            const Vector3 corner{ nx * depth / projection[0][0], ny * depth / projection[1][1], -depth };
+                            min = Math::min(min, corner);
+                            max = Math::max(max, corner);
+                        }
+                    }
+                }
+
+                ClusterBounds& cluster = bounds[x + GridX * (y + GridY * z)];
+                cluster.min = Vector4{ min, 0.0f };
+                cluster.max = Vector4{ max, 0.0f };
+            }
+        }
+    }
+
+    bounds_buffer.setSubData(0, Containers::arrayView(bounds));
+}
+
+void LightClusters::cull(GL::Buffer& light_buffer, std::size_t light_count, const Matrix4& projection,
+    float near_plane, float far_plane, const Vector2i& viewport_size, GLStateCache& state_cache)
+{
+    update_bounds(projection, near_plane, far_plane, viewport_size);
+
+    const UnsignedInt zero = 0;
+    index_buffer.setSubData(0, Containers::arrayView(&zero, 1));
+
+    state_cache.bind_buffer(GL::Buffer::Target::ShaderStorage, PBRShader::LightBufferBinding, light_buffer);
+    state_cache.bind_buffer(GL::Buffer::Target::ShaderStorage, PBRShader::ClusterRangeBufferBinding, range_buffer);
+    state_cache.bind_buffer(GL::Buffer::Target::ShaderStorage, PBRShader::LightIndexBufferBinding, index_buffer);
+    state_cache.bind_buffer(GL::Buffer::Target::ShaderStorage, PBRShader::ClusterBoundsBufferBinding, bounds_buffer);
+
+    shader.set_counts(UnsignedInt(light_count), ClusterCount, ClusterCount * AverageLightsPerCluster)
+        .dispatchCompute({ (ClusterCount + LightCullShader::GroupSize - 1) / LightCullShader::GroupSize, 1, 1 });
+
+    //The fragment shader reads the lists as storage buffers
+    GL::Renderer::setMemoryBarrier(GL::Renderer::MemoryBarrier::ShaderStorage);
+}
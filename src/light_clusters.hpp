@@ -0,0 +1,86 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/AbstractShaderProgram.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/Math/Vector2.h>
+#include <Magnum/Math/Vector4.h>
+#include <cstddef>
+#include "gl_state_cache.hpp"
+#include "memory_tracker.hpp"
+#include "pbr_shader.hpp"
+
+using namespace Magnum;
+
+//Bins lights into one list per cluster: every cluster thread tests its
+//view-space AABB against all light spheres staged through shared memory,
+//then reserves a compact range of the global index list with one atomic
+class LightCullShader: public GL::AbstractShaderProgram
+{
+public:
+    static constexpr UnsignedInt GroupSize = 128;
+
+    explicit LightCullShader();
+
+    LightCullShader& set_counts(UnsignedInt light_count, UnsignedInt cluster_count, UnsignedInt index_capacity);
+
+private:
+    Int light_count_uniform = -1,
+        cluster_count_uniform = -1,
+        index_capacity_uniform = -1;
+};
+
+//Froxel grid for Flag::ClusteredLights: 16x8 screen tiles times 24
+//exponential depth slices between the near and far plane. The cluster
+//bounds are rebuilt on the CPU when the projection or viewport changes, the
+//per-frame culling runs as one compute dispatch.
+class LightClusters
+{
+public:
+    static constexpr UnsignedInt GridX = 16, GridY = 8, GridZ = 24;
+    static constexpr UnsignedInt ClusterCount = GridX * GridY * GridZ;
+    //Index list capacity, clusters over it get truncated lists
+    static constexpr UnsignedInt AverageLightsPerCluster = 128;
+
+    explicit LightClusters();
+
+    //Lights are the view-space ones already in light_buffer. Binds through
+    //the state cache on the same bindings PBRShader reads from.
+    void cull(GL::Buffer& light_buffer, std::size_t light_count, const Matrix4& projection,
+        float near_plane, float far_plane, const Vector2i& viewport_size, GLStateCache& state_cache);
+
+    //For FrameUniforms::cluster_grid and cluster_params
+    Vector4ui grid() const
+    {
+        return { GridX, GridY, GridZ, 0 };
+    }
+
+    Vector4 params() const
+    {
+        return cluster_params;
+    }
+
+    GL::Buffer& ranges()
+    {
+        return range_buffer;
+    }
+
+    GL::Buffer& indices()
+    {
+        return index_buffer;
+    }
+
+private:
+    void update_bounds(const Matrix4& projection, float near_plane, float far_plane, const Vector2i& viewport_size);
+
+    LightCullShader shader;
+    GL::Buffer bounds_buffer{ GL::Buffer::TargetHint::ShaderStorage };
+    GL::Buffer range_buffer{ GL::Buffer::TargetHint::ShaderStorage };
+    GL::Buffer index_buffer{ GL::Buffer::TargetHint::ShaderStorage };
+    TrackedAllocation memory;
+
+    //What the bounds were built for
+    Vector4 projection_key;
+    Vector2i viewport;
+    Vector4 cluster_params;
+};
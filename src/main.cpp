@@ -27,350 +27,514 @@
 #include <Magnum/GlmIntegration/Integration.h>
 #include <MagnumPlugins/StbImageImporter/StbImageImporter.h>
 #include <MagnumPlugins/StbImageImporter/configure.h>
+#include <MagnumPlugins/StbImageConverter/StbImageConverter.h>
+#include <Corrade/Utility/Directory.h>
+#include <Corrade/configure.h>
 #include <spdlog/spdlog.h>
+#include <spdlog/fmt/fmt.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include "benchmark.hpp"
+#include "compression_benchmark.hpp"
+#include "demo_scene.hpp"
+#include "ibl.hpp"
+#include "material_packer.hpp"
+#include "memory_tracker.hpp"
+#include "mesh_import.hpp"
+#include "options.hpp"
+#include "pbr_shader.hpp"
+#include "post_process.hpp"
+#include "profiler.hpp"
+#include "software_benchmark.hpp"
+#include "texture_cache.hpp"
+#include "texture_loader.hpp"
+#include "texture_streamer.hpp"
+#include "thread_pool.hpp"
+#include "turntable.hpp"
+
+//The headless modes need EGL, which Windows and macOS don't have. The conan
+//option for it is only set on the other platforms, see conanfile.py.
+#if defined(CORRADE_TARGET_UNIX) && !defined(CORRADE_TARGET_APPLE)
+#define DEMO_HEADLESS_EGL 1
+#include <Magnum/Platform/WindowlessEglApplication.h>
+#endif
 
 using namespace Magnum;
 
-class PBRShader: public GL::AbstractShaderProgram 
+std::vector<TextureSpec> material_texture_specs()
 {
-public:
-    typedef Shaders::Generic3D::Position Position; //0
-    typedef Shaders::Generic3D::TextureCoordinates TextureCoord; //1
-    typedef Shaders::Generic3D::Tangent4 Tangent4; //3
-    typedef Shaders::Generic3D::Bitangent Bitangent; //4
-    typedef Shaders::Generic3D::Normal Normal; //5
-
-    explicit PBRShader()
-    {
-        MAGNUM_ASSERT_GL_VERSION_SUPPORTED(GL::Version::GL450);
+    return {
+        { "data/albedo.png", TextureUsage::Color },
+        { "data/ao.png", TextureUsage::Scalar },
+        { "data/metallic.png", TextureUsage::Scalar },
+        { "data/normal.png", TextureUsage::Normal },
+        { "data/roughness.png", TextureUsage::Scalar },
+        { "data/height.png", TextureUsage::Scalar }
+    };
+}
 
-        GL::Shader vert(GL::Version::GL450, GL::Shader::Type::Vertex);
-        GL::Shader frag(GL::Version::GL450, GL::Shader::Type::Fragment);
+ORMHSources ormh_sources()
+{
+    return { "data/ao.png", "data/roughness.png", "data/metallic.png", "data/height.png" };
+}
 
-        vert.addSource(R"(
-            layout(location = 0) in vec3 position;
-            layout(location = 1) in vec2 tex_coord;
-            layout(location = 3) in vec4 tangent4;
-            layout(location = 5) in vec3 normal;
+//Albedo, normal, ORMH
+std::vector<TextureSpec> packed_material_texture_specs(const std::string& ormh_texture)
+{
+    return {
+        { "data/albedo.png", TextureUsage::Color },
+        { "data/normal.png", TextureUsage::Normal },
+        { ormh_texture, TextureUsage::Data }
+    };
+}
 
-            out vec2 frag_tex_coord;
-            out mat3 frag_TBN;
-            out vec3 frag_pos;
+SceneOptions scene_options_from(const DemoOptions& options)
+{
+    SceneOptions scene_options;
+    scene_options.instancing = options.instancing;
+    scene_options.lod = options.lod;
+    scene_options.culling = options.culling;
+    scene_options.uniform_buffers = options.uniform_buffers;
+    scene_options.vertex_format = options.vertex_format;
+    scene_options.optimize_indices = options.optimize_indices;
+    scene_options.displacement = options.displacement;
+    scene_options.tessellation_pixels = options.tessellation_pixels;
+    scene_options.parallax_quality = options.parallax_quality;
+    scene_options.shaders.directory = options.shader_directory;
+    scene_options.shaders.compile_mode = options.shader_compile;
+    if (options.use_shader_cache)
+    {
+        scene_options.shaders.binary_cache = options.shader_cache;
+    }
+    return scene_options;
+}
 
-            uniform mat4 model_matrix;
-            uniform mat4 view_matrix;
-            uniform mat4 proj_matrix;
-            uniform mat3 normal_matrix;
+SoftwareBenchmarkConfig software_benchmark_config(const DemoOptions& options)
+{
+    SoftwareBenchmarkConfig config;
+    config.layout = options.material_layout;
+    config.resolution = options.resolution;
+    config.frames = options.software_frames;
+    config.max_threads = options.threads;
+    config.output_directory = options.software_output;
+    config.min_psnr = options.software_min_psnr;
+    return config;
+}
+
+MeshImportOptions mesh_import_options(const DemoOptions& options)
+{
+    MeshImportOptions import_options;
+    import_options.format = options.vertex_format;
+    import_options.optimize_indices = options.optimize_indices;
+    import_options.cache_directory = options.use_mesh_cache ? options.mesh_cache : std::string{};
+    import_options.rebuild = options.rebuild_mesh_cache;
+    return import_options;
+}
+
+std::string displacement_name(const DemoOptions& options)
+{
+    switch (options.displacement)
+    {
+        case DisplacementMode::Vertex: return "vertex";
+        case DisplacementMode::Tessellation: return "tessellation, " + std::to_string(options.tessellation_pixels) + " px";
+        case DisplacementMode::Parallax: break;
+    }
 
-            uniform sampler2D height_texture;
-            uniform float height_factor = 0.5;
+    const char* const tiers[]{ "low", "medium", "high" };
+    return std::string{ "parallax, " } + tiers[int(options.parallax_quality)];
+}
 
-            void main()
-            {   
-                vec3 N = normalize(normal_matrix * normal);
-                vec3 T = normalize(normal_matrix * tangent4.xyz);
-                vec3 B = normalize(tangent4.a * cross(N, T));
-                frag_TBN = mat3(T, B, N);
+//Benchmark, stress test, light sweep, AA sweep, turntable, shader reload test or software rasterizer comparison. No display needed: an EGL
+//context without a surface, the scene renders into a framebuffer object. Works on llvmpipe, fails on platforms without EGL.
+using SceneFactory = std::function<Containers::Pointer<DemoScene>(const SceneOptions&, Containers::Pointer<TextureStreamer>&)>;
 
-                mat4 mv_matrix = view_matrix * model_matrix;
+int run_headless_benchmark(int argc, char** argv, const DemoOptions& options, ThreadPool& thread_pool, const SceneFactory& create_scene,
+    const std::function<bool(DemoScene&)>& load_scene_mesh, const std::function<bool(DemoScene&)>& load_scene_environment,
+    const std::function<bool(DemoScene&)>& compare_software)
+{
+#ifdef DEMO_HEADLESS_EGL
+    Platform::WindowlessEglContext egl_context{ Platform::WindowlessEglContext::Configuration{} };
+    if (!egl_context.isCreated() || !egl_context.makeCurrent())
+    {
+        spdlog::error("Can't create a headless EGL context");
+        return -1;
+    }
 
-                vec4 pos = mv_matrix * vec4(position, 1.0);
-                pos = proj_matrix * vec4(pos.xyz + N * texture2D(height_texture, tex_coord).r * height_factor, 1.0);
-                gl_Position = pos;
+    Platform::GLContext ctx{ argc, argv };
 
-                frag_tex_coord = tex_coord;
-            }
-        )");
-
-        frag.addSource(R"(
-            #define BASIC_MODE 0
-            #define ALBEDO_MODE 1
-            #define ROUGHNESS_MODE 2
-            #define METALLIC_MODE 3
-            #define NORMAL_MODE 4
-            #define AO_MODE 5
-            uniform int render_mode = BASIC_MODE;
-
-            in vec2 frag_tex_coord;
-            in mat3 frag_TBN;
-            in vec3 frag_pos;
-            out vec4 fragment_color;
-
-            uniform sampler2D albedo_texture;
-            uniform sampler2D roughness_texture;
-            uniform sampler2D metallic_texture;
-            uniform sampler2D normal_texture;
-            uniform sampler2D ao_texture;
-
-            uniform float albedo_factor = 1.0;
-            uniform float roughness_factor = 1.0;
-            uniform float metallic_factor = 1.0;
-            uniform float normal_factor = 1.0;
-            uniform float ao_factor = 1.0;
-
-            uniform vec3 light_direction = vec3(0.0, -0.5, -0.5);
-            uniform vec3 light_color = vec3(1.0);
-
-            void main()
-            {   
-                const float gamma = 2.2;
-                vec4 albedo = texture2D(albedo_texture, frag_tex_coord) * albedo_factor;
-                float roughness = texture2D(roughness_texture, frag_tex_coord).r * roughness_factor;
-                float metallic = texture2D(metallic_texture, frag_tex_coord).r * metallic_factor;
-
-                vec3 normal = normalize(texture2D(normal_texture, frag_tex_coord).rgb * 2.0 - vec3(1.0));
-                normal = normalize(frag_TBN * normal) * (gl_FrontFacing ? 1.0 : -1.0) * normal_factor;
-
-                vec3 ao = texture2D(ao_texture, frag_tex_coord).rgb * ao_factor;
-            
-                switch(render_mode)
-                {
-                    case ROUGHNESS_MODE:
-                        fragment_color = vec4(vec3(roughness), 1.0);
-                        break;
-                    case METALLIC_MODE:
-                        fragment_color = vec4(vec3(metallic), 1.0);
-                        break;
-                    case NORMAL_MODE:
-                        fragment_color = vec4(normal * 0.5 + 0.5, 1.0);
-                        break;
-                    case AO_MODE:
-                        fragment_color = vec4(ao, 1.0);
-                        break;
-                    case ALBEDO_MODE:
-                        fragment_color = albedo;
-                        break;
-                    case BASIC_MODE:
-                    default:
-                        float NdotL = max(dot(normal, normalize(-light_direction)), 0.1);
-                        fragment_color = (0.1 + NdotL * vec4(light_color, 1.0) * vec4(ao, 1.0) * 0.9) * albedo;
-
-                        break;
-                }
+    GL::Renderer::enable(GL::Renderer::Feature::DepthTest);
+    GL::Renderer::disable(GL::Renderer::Feature::FaceCulling);
 
-                fragment_color.rgb = pow(fragment_color.rgb, vec3(1.0 / gamma));
-                //fragment_color = vec4(normal, 1.0);
-            }
-        )");
-
-        CORRADE_INTERNAL_ASSERT_OUTPUT(GL::Shader::compile({ vert, frag }));
-        attachShaders({ vert, frag }); 
-        CORRADE_INTERNAL_ASSERT_OUTPUT(link());
+    SceneOptions scene_options = scene_options_from(options);
+    scene_options.grid = options.stress || options.instances > 0;
+    //Compile thread context when the driver has no KHR_parallel_shader_compile
+    scene_options.shaders.shared_context = [&egl_context]() -> Containers::Optional<SharedContext>
+    {
+        auto context = std::make_shared<Platform::WindowlessEglContext>(
+            Platform::WindowlessEglContext::Configuration{}.setSharedContext(egl_context.glContext()));
+        if (!context->isCreated())
+        {
+            return Containers::NullOpt;
+        }
+        return SharedContext{ [context] { return context->makeCurrent(); }, [context] { context->release(); } };
+    };
+    if (options.software_compare)
+    {
+        //What the software rasterizer draws
+        scene_options.grid = false;
+        scene_options.lod = false;
+        scene_options.vertex_format = VertexFormat::Float;
+        scene_options.displacement = DisplacementMode::Vertex;
+    }
+    const bool grid = scene_options.grid;
+    Containers::Pointer<TextureStreamer> streamer;
+    Containers::Pointer<DemoScene> scene_storage = create_scene(scene_options, streamer);
+    if (!scene_storage)
+    {
+        return -1;
+    }
+    DemoScene& scene = *scene_storage;
+    if (options.software_compare)
+    {
+        //The sphere, no environment and no lights
+        return compare_software(scene) ? 0 : -1;
+    }
+    if ((!grid && !load_scene_mesh(scene)) || !load_scene_environment(scene))
+    {
+        return -1;
+    }
 
-        auto [status, message] = validate();
+    std::vector<std::pair<std::string, std::string>> settings{
+        { "material_layout", options.material_layout == MaterialLayout::Packed ? "packed" : "separate" },
+        { "texture_source", options.texture_streaming ? "streamed from the cache" : options.use_texture_cache ? "cache" : "images" },
+        { "texture_compression", !options.texture_compression.enabled ? "none" : block_format_name(options.texture_compression.color_format) },
+        { "threads", std::to_string(options.threads) },
+        { "grid", grid ? "true" : "false" },
+        { "instancing", scene_options.instancing ? "true" : "false" },
+        { "lod", scene_options.lod ? "true" : "false" },
+        { "culling", scene_options.culling ? "true" : "false" },
+        { "uniform_buffers", scene_options.uniform_buffers ? "true" : "false" },
+        { "shader_cache", options.use_shader_cache ? "true" : "false" },
+        { "vertex_format", vertex_format_name(options.vertex_format) },
+        { "index_optimization", options.optimize_indices ? "true" : "false" },
+        { "displacement", displacement_name(options) },
+        { "mesh", grid || options.mesh.empty() ? "sphere" : options.mesh },
+        { "ibl", !options.ibl ? "none" : Utility::Directory::exists(options.environment) ? options.environment : "procedural sky" }
+    };
+    if (options.materials != 0)
+    {
+        scene.set_materials(options.materials, options.texture_sets, options.material_binding);
+        settings.push_back({ "materials", std::to_string(options.materials) });
+        settings.push_back({ "texture_sets", std::to_string(options.texture_sets) });
+        settings.push_back({ "material_binding", material_binding_name(options.material_binding) });
+    }
+    const PostProcessOptions& post_options = options.post_process_options;
+    if (options.post_process && !options.aa_sweep)
+    {
+        settings.push_back({ "antialiasing", antialiasing_name(post_options.antialiasing) });
+        settings.push_back({ "msaa", std::to_string(post_options.msaa_samples) });
+        settings.push_back({ "render_scale", std::to_string(post_options.render_scale) });
+        settings.push_back({ "dynamic_resolution", post_options.dynamic_resolution ? "true" : "false" });
+    }
+    else if (!options.post_process)
+    {
+        settings.push_back({ "post_process", "false" });
+    }
 
-        if (status)
+    log_memory_report("after loading");
+    const auto finish = [&](bool succeeded)
+    {
+        log_memory_report("at exit");
+        if (!options.memory_report.empty() && !write_memory_report(options.memory_report))
         {
-            spdlog::info("PBRShader compiled successfully");
+            succeeded = false;
         }
-        else
+        return succeeded ? 0 : -1;
+    };
+
+    const char* const lighting = options.lighting == LightingMode::Naive ? "naive" : "clustered";
+    if (options.light_sweep)
+    {
+        if (grid)
         {
-            spdlog::error("Unable to compile PBRShader");
+            scene.set_instance_count(options.instances);
+            settings.push_back({ "instances", std::to_string(options.instances) });
         }
 
+        LightSweepConfig config;
+        config.max_lights = options.light_sweep_max;
+        config.resolution = options.resolution;
+        config.output = options.light_sweep_output;
+        config.settings = std::move(settings);
+        return finish(run_light_sweep(scene, config));
+    }
 
-        if (!message.empty())
+    if (options.turntable)
+    {
+        if (grid)
         {
-            if (status)
-            {
-                spdlog::info(message);
-            }
-            else
-            {
-                spdlog::error(message);
-            }
+            scene.set_instance_count(options.instances);
+        }
+        if (options.lights > 0)
+        {
+            scene.set_lights(options.lighting, options.lights);
         }
 
-        //...
-        bindAttributeLocation(Position::Location, "position");
-        bindAttributeLocation(TextureCoord::Location, "tex_coord");
-        bindAttributeLocation(Normal::Location, "normal");
-        bindAttributeLocation(Tangent4::Location, "tangent4");
-        bindAttributeLocation(Bitangent::Location, "bitangent");
-
-        model_matrix_uniform = uniformLocation("model_matrix");
-        view_matrix_uniform = uniformLocation("view_matrix");
-        proj_matrix_uniform = uniformLocation("proj_matrix");
-        normal_matrix_uniform = uniformLocation("normal_matrix");
-
-        light_direction_uniform = uniformLocation("light_direction");
-        light_color_uniform = uniformLocation("light_color");
-
-        albedo_factor_uniform = uniformLocation("albedo_factor");
-        roughness_factor_uniform = uniformLocation("roughness_factor");
-        metallic_factor_uniform = uniformLocation("metallic_factor");
-        normal_factor_uniform = uniformLocation("normal_factor");
-        ao_factor_uniform = uniformLocation("ao_factor");
-        height_factor_uniform = uniformLocation("height_factor");
-
-        render_mode_uniform = uniformLocation("render_mode");
-
-        setUniform(uniformLocation("albedo_texture"), AlbedoUnit);
-        setUniform(uniformLocation("roughness_texture"), RoughnessUnit);
-        setUniform(uniformLocation("metallic_texture"), MetallicUnit);
-        setUniform(uniformLocation("normal_texture"), NormalUnit);
-        setUniform(uniformLocation("ao_texture"), AOUnit);
-        setUniform(uniformLocation("height_texture"), HeightUnit);
+        TurntableConfig config = options.turntable_config;
+        if (options.post_process)
+        {
+            //Every frame at the same resolution
+            config.post_process = post_options;
+            config.post_process->dynamic_resolution = false;
+        }
+        return finish(render_turntable(scene, thread_pool, config));
     }
 
-    PBRShader& set_model_matrix(const Matrix4& mtx)
+    if (options.aa_sweep)
     {
-        setUniform(model_matrix_uniform, mtx);
-        return *this;
-    }
+        if (grid)
+        {
+            scene.set_instance_count(options.instances);
+            settings.push_back({ "instances", std::to_string(options.instances) });
+        }
 
-    PBRShader& set_view_matrix(const Matrix4& mtx)
-    {
-        setUniform(view_matrix_uniform, mtx);
-        return *this;
+        AaSweepConfig config;
+        config.resolution = options.resolution;
+        config.output = options.aa_sweep_output;
+        config.settings = std::move(settings);
+        return finish(run_aa_sweep(scene, config));
     }
 
-    PBRShader& set_proj_matrix(const Matrix4& mtx)
+    if (options.shader_reload_test)
     {
-        setUniform(proj_matrix_uniform, mtx);
-        return *this;
-    }
+        if (grid)
+        {
+            scene.set_instance_count(options.instances);
+            settings.push_back({ "instances", std::to_string(options.instances) });
+        }
 
-    PBRShader& set_normal_matrix(const Matrix3x3& mtx)
-    {
-        setUniform(normal_matrix_uniform, mtx);
-        return *this;
+        ShaderReloadConfig config;
+        config.resolution = options.resolution;
+        config.output = options.shader_reload_output;
+        config.settings = std::move(settings);
+        return finish(run_shader_reload_test(scene, config));
     }
 
-    PBRShader& set_light_direction(const Vector3& dir)
+    if (options.stress)
     {
-        setUniform(light_direction_uniform, dir);
-        return *this;
+        StressConfig config;
+        config.frame_budget_ms = options.frame_budget_ms;
+        config.resolution = options.resolution;
+        config.output = options.stress_output;
+        config.settings = std::move(settings);
+        return finish(run_stress_test(scene, config));
     }
 
-    PBRShader& set_light_color(const Vector3& color)
+    if (grid)
     {
-        setUniform(light_color_uniform, color);
-        return *this;
+        scene.set_instance_count(options.instances);
+        settings.push_back({ "instances", std::to_string(options.instances) });
     }
 
-    PBRShader& set_albedo_factor(float factor)
+    if (options.lights > 0)
     {
-        setUniform(albedo_factor_uniform, factor);
-        return *this;
+        scene.set_lights(options.lighting, options.lights);
+        settings.push_back({ "lights", std::to_string(options.lights) });
+        settings.push_back({ "lighting", lighting });
     }
 
-    PBRShader& set_roughness_factor(float factor)
+    BenchmarkConfig config;
+    config.frames = options.benchmark_frames;
+    config.warmup_frames = options.benchmark_warmup;
+    config.resolution = options.resolution;
+    config.output = options.benchmark_output;
+    config.settings = std::move(settings);
+    if (options.post_process)
     {
-        setUniform(roughness_factor_uniform, factor);
-        return *this;
+        config.post_process = post_options;
     }
 
-    PBRShader& set_metallic_factor(float factor)
+    //Only profiled frames get into the trace, see --profile
+    FrameProfiler profiler;
+    bool succeeded = run_benchmark(scene, config);
+    if (profiler.trace_event_count() != 0)
     {
-        setUniform(metallic_factor_uniform, factor);
-        return *this;
+        profiler.log_summary();
+        succeeded = profiler.write_trace(options.profile_output) && succeeded;
     }
+    return finish(succeeded);
+#else
+    spdlog::error("The headless modes need EGL, which isn't available on this platform");
+    return -1;
+#endif
+}
 
-    PBRShader& set_normal_factor(float factor)
+int main(int argc, char** argv)
+{
+    const DemoOptions options = parse_options(argc, argv);
+    if (options.profile)
     {
-        setUniform(normal_factor_uniform, factor);
-        return *this;
+        set_profiling(true);
     }
 
-    PBRShader& set_ao_factor(float factor)
-    {
-        setUniform(ao_factor_uniform, factor);
-        return *this;
-    }
+    CORRADE_PLUGIN_IMPORT(StbImageImporter);
+    CORRADE_PLUGIN_IMPORT(StbImageConverter);
+    CORRADE_PLUGIN_IMPORT(AnySceneImporter);
+    CORRADE_PLUGIN_IMPORT(ObjImporter);
+    CORRADE_PLUGIN_IMPORT(TinyGltfImporter);
+    PluginManager::Manager<Trade::AbstractImporter> manager;
 
-    PBRShader& set_height_factor(float factor)
-    {
-        setUniform(height_factor_uniform, factor);
-        return *this;
-    }
+    ThreadPool thread_pool{ options.threads };
+    TextureLoader texture_loader{ manager, thread_pool };
+    TextureCache texture_cache{ options.texture_cache, texture_loader, thread_pool, options.texture_compression };
+
+    const bool packed_material = options.material_layout == MaterialLayout::Packed;
 
-    PBRShader& bind_albedo_texture(GL::Texture2D& tex)
+    if (options.pack_ormh || (packed_material && !Utility::Directory::exists(options.ormh_texture)))
     {
-        tex.bind(AlbedoUnit);
-        return *this;
+        if (!pack_ormh(texture_loader, ormh_sources(), options.ormh_texture))
+        {
+            return -1;
+        }
+
+        if (options.pack_ormh)
+        {
+            return 0;
+        }
     }
 
-    PBRShader& bind_roughness_texture(GL::Texture2D& tex)
+    const std::vector<TextureSpec> texture_specs = packed_material
+        ? packed_material_texture_specs(options.ormh_texture) : material_texture_specs();
+
+    if (options.bake_textures)
     {
-        tex.bind(RoughnessUnit);
-        return *this;
+        return texture_cache.bake(texture_specs, true) ? 0 : -1;
     }
 
-    PBRShader& bind_metallic_texture(GL::Texture2D& tex)
+    if (options.benchmark_compression)
     {
-        tex.bind(MetallicUnit);
-        return *this;
+        return run_compression_benchmark(texture_loader, thread_pool, texture_specs) ? 0 : -1;
     }
 
-    PBRShader& bind_normal_texture(GL::Texture2D& tex)
+    if (options.benchmark_ibl)
     {
-        tex.bind(NormalUnit);
-        return *this;
+        return run_ibl_benchmark(options.environment, IblSettings{}, manager, options.threads) ? 0 : -1;
     }
 
-    PBRShader& bind_ao_texture(GL::Texture2D& tex)
+    if (options.software_benchmark)
     {
-        tex.bind(AOUnit);
-        return *this;
+        return run_software_benchmark(texture_loader, thread_pool, texture_specs, software_benchmark_config(options)) ? 0 : -1;
     }
 
-    PBRShader& bind_height_texture(GL::Texture2D& tex)
+    //Needs a current GL context
+    const auto load_textures = [&]
     {
-        tex.bind(HeightUnit);
-        return *this;
-    }
+        return options.use_texture_cache ? texture_cache.load(texture_specs) : texture_loader.load(texture_specs);
+    };
 
-    PBRShader& set_render_mode(int mode)
+    //Needs a current GL context. The streamer has to outlive the scene.
+    const SceneFactory create_scene = [&](const SceneOptions& scene_options, Containers::Pointer<TextureStreamer>& streamer)
+        -> Containers::Pointer<DemoScene>
     {
-        setUniform(render_mode_uniform, mode % RENDER_MODE_COUNT);
-        return *this;
-    }
+        Containers::Pointer<DemoScene> scene;
+        if (options.texture_streaming)
+        {
+            //Streaming always reads from the cache
+            Containers::Optional<std::vector<CachedTexture>> cached = texture_cache.open(texture_specs);
+            if (!cached)
+            {
+                spdlog::error("Can't load textures");
+                return {};
+            }
+
+            TextureStreamingOptions streaming_options;
+            streaming_options.budget_bytes = std::size_t(options.texture_budget_mib * double(1 << 20));
+            streaming_options.tail_size = options.texture_tail;
+            streamer = Containers::pointer<TextureStreamer>(std::move(*cached), thread_pool, streaming_options);
+            scene = Containers::pointer<DemoScene>(options.material_layout, *streamer, scene_options);
+        }
+        else
+        {
+            auto textures = load_textures();
+            if (!textures)
+            {
+                spdlog::error("Can't load textures");
+                return {};
+            }
+            scene = Containers::pointer<DemoScene>(options.material_layout, std::move(*textures), scene_options);
+        }
+
+        //Run from the repository root or pass --shader-directory
+        if (!scene->shader_library().loaded())
+        {
+            spdlog::error("Can't load shaders from {}", scene_options.shaders.directory);
+            return {};
+        }
+        return scene;
+    };
 
-    static const int RENDER_MODE_COUNT = 6;
-private:
-    enum : Int //0..n
+    //Needs a current GL context too, the single sphere scene only
+    const auto load_scene_mesh = [&](DemoScene& scene)
     {
-        AlbedoUnit,
-        RoughnessUnit,
-        MetallicUnit,
-        NormalUnit,
-        AOUnit,
-        HeightUnit
+        if (options.mesh.empty())
+        {
+            return true;
+        }
+
+        Containers::Optional<MeshAsset> mesh = load_mesh(options.mesh, mesh_import_options(options), manager, thread_pool);
+        if (!mesh)
+        {
+            return false;
+        }
+
+        scene.set_mesh(std::move(*mesh));
+        return true;
     };
 
-    Int model_matrix_uniform,
-        view_matrix_uniform,
-        proj_matrix_uniform,
-        normal_matrix_uniform;
+    //Needs a current GL context as well
+    const auto load_scene_environment = [&](DemoScene& scene)
+    {
+        if (!options.ibl)
+        {
+            return true;
+        }
 
-    Int light_direction_uniform,
-        light_color_uniform,
-        render_mode_uniform;
+        Containers::Optional<IblResources> ibl = load_ibl(options.environment, options.use_ibl_cache ? options.ibl_cache : std::string{},
+            IblSettings{}, manager, thread_pool);
+        if (!ibl)
+        {
+            return false;
+        }
 
-    Int albedo_factor_uniform,
-        roughness_factor_uniform,
-        metallic_factor_uniform,
-        normal_factor_uniform,
-        ao_factor_uniform,
-        height_factor_uniform;
-};
+        scene.set_environment(std::move(*ibl));
+        return true;
+    };
+
+    //Needs the scene's GL context, decodes the maps again for the CPU
+    const auto compare_software = [&](DemoScene& scene)
+    {
+        return run_software_comparison(scene, texture_loader, thread_pool, texture_specs, software_benchmark_config(options));
+    };
+
+    if (options.benchmark || options.stress || options.light_sweep || options.aa_sweep || options.turntable || options.software_compare
+        || options.shader_reload_test)
+    {
+        return run_headless_benchmark(argc, argv, options, thread_pool, create_scene, load_scene_mesh, load_scene_environment,
+            compare_software);
+    }
 
-int main(int argc, char** argv)
-{
     if (!glfwInit())
     {
         spdlog::error("Can't initialize GLFW");
         return -1;
     }
 
-    constexpr glm::ivec2 window_size{ 1024, 1024 };
-    constexpr float aspect = window_size.x / float(window_size.y);
-    constexpr float fov = glm::radians(45.0f);
-    const glm::mat4 proj = glm::perspective(fov, aspect, 0.01f, 100.0f);
+    const glm::ivec2 window_size{ options.resolution.x(), options.resolution.y() };
 
     glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-    glfwWindowHint(GLFW_SAMPLES, 8);
+    //The post process has its own MSAA target if any
+    glfwWindowHint(GLFW_SAMPLES, options.post_process ? 0 : 8);
     GLFWwindow* const window = glfwCreateWindow(window_size.x, window_size.y, "Demo", nullptr, nullptr);
 
     if (!window)
@@ -395,120 +559,73 @@ int main(int argc, char** argv)
         /* Disable rather spammy "Buffer detailed info" debug messages on NVidia drivers */
         GL::DebugOutput::setEnabled(GL::DebugOutput::Source::Api, GL::DebugOutput::Type::Other, { 131185 }, false);
 
-        /* Setup the colored triangle */
-        using namespace Math::Literals;
-
-        struct TriangleVertex 
+        SceneOptions scene_options = scene_options_from(options);
+        scene_options.grid = options.instances > 0;
+        scene_options.shaders.hot_reload = options.hot_reload;
+        //Compile thread context when the driver has no KHR_parallel_shader_compile
+        scene_options.shaders.shared_context = [window]() -> Containers::Optional<SharedContext>
         {
-            Vector3 position;
-            Color3 color;
+            //Never shown, only there for its context
+            glfwDefaultWindowHints();
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            GLFWwindow* const compile_window = glfwCreateWindow(1, 1, "Shader compiler", nullptr, window);
+            if (!compile_window)
+            {
+                return Containers::NullOpt;
+            }
+
+            //Destroyed on the main thread with the scene's shader library
+            std::shared_ptr<GLFWwindow> owner{ compile_window, glfwDestroyWindow };
+            return SharedContext{ [owner] { glfwMakeContextCurrent(owner.get()); return true; }, [] { glfwMakeContextCurrent(nullptr); } };
         };
+        Containers::Pointer<TextureStreamer> streamer;
+        Containers::Pointer<DemoScene> scene_storage = create_scene(scene_options, streamer);
+        if (!scene_storage)
+        {
+            glfwTerminate();
+            return -1;
+        }
+        DemoScene& scene = *scene_storage;
+        if (options.instances > 0)
+        {
+            scene.set_instance_count(options.instances);
+        }
+        else if (!load_scene_mesh(scene))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        if (!load_scene_environment(scene))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        if (options.lights > 0)
+        {
+            scene.set_lights(options.lighting, options.lights);
+        }
+        if (options.materials != 0)
+        {
+            scene.set_materials(options.materials, options.texture_sets, options.material_binding);
+        }
 
-        const TriangleVertex vertices[]
+        Containers::Optional<PostProcess> post;
+        if (options.post_process)
         {
-            {{-0.5f, -0.5f, 0.0f}, 0xff0000_rgbf},
-            {{ 0.5f, -0.5f, 0.0f}, 0x00ff00_rgbf},
-            {{ 0.0f,  0.5f, 0.0f}, 0x0000ff_rgbf}
-        };
+            post.emplace(options.resolution, options.post_process_options);
+        }
+
+        spdlog::info("Initialization successful, {} material layout at {}x{}",
+            packed_material ? "packed" : "separate", window_size.x, window_size.y);
+        log_memory_report("after loading");
 
-        GL::Mesh mesh;
-        mesh.setCount(Containers::arraySize(vertices))
-            .addVertexBuffer(GL::Buffer{ vertices }, 0,
-                Shaders::VertexColor3D::Position{},
-                Shaders::VertexColor3D::Color3{});
-
-        GL::Mesh sphere_mesh = MeshTools::compile(Primitives::uvSphereSolid(128, 128, Primitives::UVSphereFlag::Tangents | Primitives::UVSphereFlag::TextureCoordinates), 
-            MeshTools::CompileFlag::GenerateSmoothNormals);
-
-        PBRShader pbr_shader; //TODO: pbr_shader -> shader
-        //pbr_shader.draw(sphere_mesh);
-
-        CORRADE_PLUGIN_IMPORT(StbImageImporter);
-        PluginManager::Manager<Trade::AbstractImporter> manager;
-        auto image_loader = manager.instantiate("StbImageImporter");
-
-        image_loader->openFile("data/albedo.png");
-        auto albedo_image = image_loader->image2D(0);
-        CORRADE_INTERNAL_ASSERT(albedo_image);
-        GL::Texture2D albedo_texture;
-        albedo_texture.setWrapping(GL::SamplerWrapping::ClampToEdge)
-            .setMagnificationFilter(GL::SamplerFilter::Linear)
-            .setMinificationFilter(GL::SamplerFilter::Linear, GL::SamplerMipmap::Linear)
-            .setStorage(1, GL::textureFormat(albedo_image->format()), albedo_image->size())
-            .setMaxAnisotropy(GL::Sampler::maxMaxAnisotropy())
-            .setSrgbDecode(true)
-            .setSubImage(0, {}, *albedo_image)
-            .generateMipmap();
-
-        image_loader->openFile("data/ao.png");
-        auto ao_image = image_loader->image2D(0);
-        CORRADE_INTERNAL_ASSERT(ao_image);
-        GL::Texture2D ao_texture;
-        ao_texture.setWrapping(GL::SamplerWrapping::ClampToEdge)
-            .setMagnificationFilter(GL::SamplerFilter::Linear)
-            .setMinificationFilter(GL::SamplerFilter::Linear, GL::SamplerMipmap::Linear)
-            .setStorage(1, GL::textureFormat(ao_image->format()), ao_image->size())
-            .setMaxAnisotropy(GL::Sampler::maxMaxAnisotropy())
-            .setSrgbDecode(false)
-            .setSubImage(0, {}, * ao_image)
-            .generateMipmap();
-
-        image_loader->openFile("data/metallic.png");
-        auto metallic_image = image_loader->image2D(0);
-        CORRADE_INTERNAL_ASSERT(metallic_image);
-        GL::Texture2D metallic_texture;
-        metallic_texture.setWrapping(GL::SamplerWrapping::ClampToEdge)
-            .setMagnificationFilter(GL::SamplerFilter::Linear)
-            .setMinificationFilter(GL::SamplerFilter::Linear, GL::SamplerMipmap::Linear)
-            .setStorage(1, GL::textureFormat(metallic_image->format()), metallic_image->size())
-            .setMaxAnisotropy(GL::Sampler::maxMaxAnisotropy())
-            .setSrgbDecode(false)
-            .setSubImage(0, {}, * metallic_image)
-            .generateMipmap();
-
-        image_loader->openFile("data/normal.png");
-        auto normal_image = image_loader->image2D(0);
-        CORRADE_INTERNAL_ASSERT(normal_image);
-        GL::Texture2D normal_texture;
-        normal_texture.setWrapping(GL::SamplerWrapping::ClampToEdge)
-            .setMagnificationFilter(GL::SamplerFilter::Linear)
-            .setMinificationFilter(GL::SamplerFilter::Linear, GL::SamplerMipmap::Linear)
-            .setStorage(1, GL::textureFormat(normal_image->format()), normal_image->size())
-            .setMaxAnisotropy(GL::Sampler::maxMaxAnisotropy())
-            .setSrgbDecode(false)
-            .setSubImage(0, {}, * normal_image)
-            .generateMipmap();
-
-        image_loader->openFile("data/roughness.png");
-        auto roughness_image = image_loader->image2D(0);
-        CORRADE_INTERNAL_ASSERT(roughness_image);
-        GL::Texture2D roughness_texture;
-        roughness_texture.setWrapping(GL::SamplerWrapping::ClampToEdge)
-            .setMagnificationFilter(GL::SamplerFilter::Linear)
-            .setMinificationFilter(GL::SamplerFilter::Linear, GL::SamplerMipmap::Linear)
-            .setStorage(1, GL::textureFormat(roughness_image->format()), roughness_image->size())
-            .setMaxAnisotropy(GL::Sampler::maxMaxAnisotropy())
-            .setSrgbDecode(false)
-            .setSubImage(0, {}, * roughness_image)
-            .generateMipmap();
-
-        image_loader->openFile("data/height.png");
-        auto height_image = image_loader->image2D(0);
-        CORRADE_INTERNAL_ASSERT(height_image);
-        GL::Texture2D height_texture;
-        height_texture.setWrapping(GL::SamplerWrapping::ClampToEdge)
-            .setMagnificationFilter(GL::SamplerFilter::Linear)
-            .setMinificationFilter(GL::SamplerFilter::Linear, GL::SamplerMipmap::Linear)
-            .setStorage(1, GL::textureFormat(height_image->format()), height_image->size())
-            .setMaxAnisotropy(GL::Sampler::maxMaxAnisotropy())
-            .setSrgbDecode(false)
-            .setSubImage(0, {}, * height_image)
-            .generateMipmap();
-
-        spdlog::info("Initialization successful");
+        //Zones recorded while loading are drained by the first frame
+        FrameProfiler profiler;
 
         while (!glfwWindowShouldClose(window)) 
         {
+            Containers::Optional<ProfileZone> stage{ Containers::InPlaceInit, "input" };
+
             static int last_key_state = GLFW_RELEASE;
             static int current_mode = 0;
 
@@ -541,26 +658,112 @@ int main(int argc, char** argv)
             
             last_key_state = glfwGetKey(window, GLFW_KEY_SPACE);
 
-            const glm::mat4 model = glm::rotate(glm::mat4(1.0), glm::radians(float(40.0f * glfwGetTime())), glm::vec3(0, 1, 0)) * glm::scale(glm::mat4(1.0), glm::vec3(5.0f));
-            const glm::mat4 view = glm::lookAt(glm::vec3(0.0, 0.0, 20.0), glm::vec3(0.0), glm::vec3(0.0, 1.0, 0.0));
-
-            GL::defaultFramebuffer.clear(GL::FramebufferClear::Color | GL::FramebufferClear::Depth);
-            pbr_shader.set_model_matrix(Matrix4(model))
-                .set_view_matrix(Matrix4(view))
-                .set_proj_matrix(Matrix4(proj))
-                .set_normal_matrix(Matrix4(view * model).normalMatrix())
-                .bind_albedo_texture(albedo_texture)
-                .bind_ao_texture(ao_texture)
-                .bind_metallic_texture(metallic_texture)
-                .bind_normal_texture(normal_texture)
-                .bind_roughness_texture(roughness_texture)
-                .bind_height_texture(height_texture)
-                .set_light_direction(Vector3(light_dir))
-                .set_render_mode(current_mode)
-                .draw(sphere_mesh);
+            static int last_profile_key_state = GLFW_RELEASE;
+            const int profile_key_state = glfwGetKey(window, GLFW_KEY_P);
+            if (last_profile_key_state == GLFW_RELEASE && profile_key_state == GLFW_PRESS)
+            {
+                set_profiling(!profiling_enabled());
+            }
+            last_profile_key_state = profile_key_state;
+            stage = Containers::NullOpt;
+
+            SceneFrame frame;
+            frame.time = glfwGetTime();
+            frame.light_direction = Vector3(light_dir);
+            frame.render_mode = current_mode;
+
+            if (post)
+            {
+                //Every output pixel is written, no clear needed
+                post->begin_frame();
+                frame.jitter = post->jitter();
+                scene.draw(frame, post->render_size());
+                post->end_frame(GL::defaultFramebuffer, scene.reprojection());
+            }
+            else
+            {
+                GL::defaultFramebuffer.clear(GL::FramebufferClear::Color | GL::FramebufferClear::Depth);
+                scene.draw(frame, options.resolution);
+            }
+
+            static double last_resolution_log = 0.0;
+            if (post && post->options().dynamic_resolution && frame.time - last_resolution_log > 2.0)
+            {
+                last_resolution_log = frame.time;
+                const PostProcessStats& post_stats = post->stats();
+                spdlog::info("Dynamic resolution: scale {:.2f}, {}x{}, GPU {:.2f} ms", post_stats.render_scale,
+                    post_stats.render_size.x(), post_stats.render_size.y(), post_stats.gpu_frame_ms);
+            }
+
+            static double last_state_log = 0.0;
+            if (options.instances > 0 && frame.time - last_state_log > 2.0)
+            {
+                last_state_log = frame.time;
+                const SceneStats& scene_stats = scene.stats();
+                spdlog::info("Per frame: {} draw calls, {} buffer binds ({} skipped), {} materials",
+                    scene_stats.draw_calls, scene_stats.gl.buffer_binds, scene_stats.gl.buffer_binds_skipped, scene_stats.materials);
+            }
+
+            static double last_streaming_log = 0.0;
+            if (streamer && frame.time - last_streaming_log > 2.0)
+            {
+                last_streaming_log = frame.time;
+                const TextureStreamingStats& streaming = streamer->stats();
+                spdlog::info("Texture streaming: {:.1f} of {:.1f} MiB resident, {} pending, {} stalls, {} over budget, {} evicted levels",
+                    streaming.resident_bytes / double(1 << 20), streaming.budget_bytes / double(1 << 20), streaming.pending_requests,
+                    streaming.stalls, streaming.budget_stalls, streaming.evicted_levels);
+            }
+
+            static double last_profile_log = 0.0;
+            if (profiling_enabled() && frame.time - last_profile_log > 2.0)
+            {
+                last_profile_log = frame.time;
+                profiler.log_summary();
+            }
+
+            //Frame time and the top level GPU zones in the title, there is no text rendering
+            static double last_title_update = 0.0;
+            static double last_frame_time = frame.time;
+            static double mean_frame_ms = 0.0;
+            mean_frame_ms += ((frame.time - last_frame_time) * 1000.0 - mean_frame_ms) * 0.05;
+            last_frame_time = frame.time;
+            if (frame.time - last_title_update > 0.25)
+            {
+                last_title_update = frame.time;
+                std::string title = fmt::format("Demo, frame {:.2f} ms", mean_frame_ms);
+                if (profiling_enabled())
+                {
+                    for (const ZoneSummary& zone : profiler.summary())
+                    {
+                        if (zone.gpu && zone.depth == 0)
+                        {
+                            title += fmt::format(", GPU {} {:.2f} ms", zone.name, zone.mean_ms);
+                        }
+                    }
+                }
+                glfwSetWindowTitle(window, title.c_str());
+            }
+
+            stage.emplace("swap buffers");
             glfwSwapBuffers(window);
+            stage.emplace("poll events");
             glfwPollEvents();
+            stage = Containers::NullOpt;
+
+            profiler.end_frame();
+        }
+
+        log_memory_report("at exit");
+        if (!options.memory_report.empty())
+        {
+            write_memory_report(options.memory_report);
+        }
+        if (profiler.trace_event_count() != 0)
+        {
+            profiler.write_trace(options.profile_output);
         }
+        //The shader compile window has to go before GLFW
+        scene_storage = nullptr;
         glfwTerminate();
     }
     return 0;
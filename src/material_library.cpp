@@ -0,0 +1,213 @@
+#include "material_library.hpp"
+#include <Magnum/GL/Context.h>
+#include <Magnum/GL/Extensions.h>
+#include <Magnum/GL/Sampler.h>
+#include <Magnum/GL/TextureFormat.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Math/Vector3.h>
+#include <Corrade/Utility/Assert.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include "hash.hpp"
+
+namespace
+{
+    //Deterministic value in [0, 1] per material and channel, the channels
+    //differ from the instance ones
+    float material_random(std::size_t index, std::uint64_t channel)
+    {
+        return (fnv1a64(&index, sizeof(index), 14695981039346656037ull ^ channel) & 0xffff) / 65535.0f;
+    }
+
+    std::vector<PBRShader::MaterialMap> material_maps(MaterialLayout layout)
+    {
+        using Map = PBRShader::MaterialMap;
+        if (layout == MaterialLayout::Packed)
+        {
+            return { Map::Albedo, Map::Normal, Map::ORMH };
+        }
+        return { Map::Albedo, Map::AO, Map::Metallic, Map::Normal, Map::Roughness, Map::Height };
+    }
+
+    struct LevelFormat
+    {
+        GL::TextureFormat format;
+        Int levels;
+        Vector2i size;
+        bool srgb_decode;
+    };
+
+    LevelFormat level_format(GL::Texture2D& texture)
+    {
+        GLint format = 0, levels = 0, decode = 0;
+        glGetTextureLevelParameteriv(texture.id(), 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+        glGetTextureParameteriv(texture.id(), GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+        glGetTextureParameteriv(texture.id(), GL_TEXTURE_SRGB_DECODE_EXT, &decode);
+        return { GL::TextureFormat(format), levels, texture.imageSize(0), decode == GL_DECODE_EXT };
+    }
+
+    template<class Texture> void setup_material_sampler(Texture& texture, bool srgb_decode)
+    {
+        texture.setWrapping(GL::SamplerWrapping::ClampToEdge)
+            .setMagnificationFilter(GL::SamplerFilter::Linear)
+            .setMinificationFilter(GL::SamplerFilter::Linear, GL::SamplerMipmap::Linear)
+            .setMaxAnisotropy(GL::Sampler::maxMaxAnisotropy())
+            .setSrgbDecode(srgb_decode);
+    }
+
+    //Whole levels, so block compressed ones don't need block-aligned sizes
+    void copy_levels(GL::Texture2D& source, const LevelFormat& format, GLuint target, GLenum target_type, Int layer)
+    {
+        for (Int level = 0; level != format.levels; ++level)
+        {
+            const Vector2i size = Math::max(format.size >> level, Vector2i{ 1 });
+            glCopyImageSubData(source.id(), GL_TEXTURE_2D, level, 0, 0, 0,
+                target, target_type, level, 0, 0, layer, size.x(), size.y(), 1);
+        }
+    }
+}
+
+const char* material_binding_name(MaterialBinding binding)
+{
+    switch (binding)
+    {
+    case MaterialBinding::Loose:
+        return "loose";
+    case MaterialBinding::Arrays:
+        return "arrays";
+    case MaterialBinding::Bindless:
+        return "bindless";
+    }
+    return "";
+}
+
+bool bindless_textures_supported()
+{
+    return GL::Context::current().isExtensionSupported<GL::Extensions::ARB::bindless_texture>();
+}
+
+MaterialLibrary::MaterialLibrary(MaterialLayout layout, std::vector<GL::Texture2D>& textures, std::size_t count,
+    std::size_t texture_sets, MaterialBinding binding):
+    material_binding{ binding },
+    sets{ std::max<std::size_t>(std::min(texture_sets, count), 1) },
+    maps{ material_maps(layout) },
+    originals{ textures }
+{
+    CORRADE_INTERNAL_ASSERT(textures.size() == maps.size());
+    CORRADE_ASSERT(count != 0 && count <= 0xffff, "MaterialLibrary: material count out of range", );
+
+    const auto start = std::chrono::steady_clock::now();
+
+    if (binding == MaterialBinding::Arrays)
+    {
+        arrays.reserve(textures.size());
+        for (std::size_t i = 0; i != textures.size(); ++i)
+        {
+            const LevelFormat format = level_format(textures[i]);
+            GL::Texture2DArray& array = arrays.emplace_back();
+            setup_material_sampler(array, format.srgb_decode);
+            array.setStorage(format.levels, format.format, Vector3i{ format.size, Int(sets) })
+                .setLabel(textures[i].label() + " (array)");
+            for (std::size_t set = 0; set != sets; ++set)
+            {
+                copy_levels(textures[i], format, array.id(), GL_TEXTURE_2D_ARRAY, Int(set));
+            }
+            memory.emplace_back(MemoryCategory::Texture, array.label(), sets * texture_memory_bytes(textures[i]));
+        }
+    }
+    else
+    {
+        copies.reserve((sets - 1) * textures.size());
+        for (std::size_t set = 1; set != sets; ++set)
+        {
+            for (std::size_t i = 0; i != textures.size(); ++i)
+            {
+                const LevelFormat format = level_format(textures[i]);
+                GL::Texture2D& copy = copies.emplace_back();
+                setup_material_sampler(copy, format.srgb_decode);
+                copy.setStorage(format.levels, format.format, format.size)
+                    .setLabel(textures[i].label() + " (set " + std::to_string(set) + ")");
+                copy_levels(textures[i], format, copy.id(), GL_TEXTURE_2D, 0);
+                memory.emplace_back(MemoryCategory::Texture, copy.label(), texture_memory_bytes(textures[i]));
+            }
+        }
+    }
+
+    //Handles are taken once per texture, the sampler state is frozen from
+    //then on
+    std::vector<Vector2ui> set_handles;
+    if (binding == MaterialBinding::Bindless)
+    {
+        for (std::size_t set = 0; set != sets; ++set)
+        {
+            for (std::size_t i = 0; i != textures.size(); ++i)
+            {
+                const GLuint64 handle = glGetTextureHandleARB(texture(set, i).id());
+                glMakeTextureHandleResidentARB(handle);
+                handles.push_back(handle);
+                set_handles.push_back(Vector2ui{ UnsignedInt(handle), UnsignedInt(handle >> 32) });
+            }
+        }
+    }
+
+    materials.resize(count);
+    for (std::size_t m = 0; m != count; ++m)
+    {
+        PBRShader::Material& material = materials[m];
+        const Vector3 color{ material_random(m, 20), material_random(m, 21), material_random(m, 22) };
+        material.albedo_tint = Vector4{ Math::lerp(Vector3{ 1.0f }, color, 0.6f), 1.0f };
+        material.roughness_factor = 0.3f + 1.2f * material_random(m, 23);
+        material.metallic_factor = material_random(m, 24) < 0.5f ? 0.0f : 1.0f;
+        material.height_factor = 0.5f + material_random(m, 25);
+        material.texture_set = UnsignedInt(m * sets / count);
+        for (std::size_t i = 0; i != set_handles.size() / sets; ++i)
+        {
+            material.handles[std::size_t(maps[i])] = set_handles[material.texture_set * maps.size() + i];
+        }
+    }
+
+    buffer.setData(materials, GL::BufferUsage::StaticDraw);
+    memory.emplace_back(MemoryCategory::Buffer, "material table", materials.size() * sizeof(PBRShader::Material));
+
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("{} materials over {} texture sets, {} binding, set up in {:.2f} ms", count, sets, material_binding_name(binding), ms);
+}
+
+MaterialLibrary::~MaterialLibrary()
+{
+    for (const GLuint64 handle : handles)
+    {
+        glMakeTextureHandleNonResidentARB(handle);
+    }
+}
+
+PBRShader::Flags MaterialLibrary::shader_flags() const
+{
+    PBRShader::Flags flags = PBRShader::Flag::MaterialTable;
+    if (material_binding == MaterialBinding::Arrays)
+    {
+        flags |= PBRShader::Flag::TextureArrays;
+    }
+    else if (material_binding == MaterialBinding::Bindless)
+    {
+        flags |= PBRShader::Flag::BindlessTextures;
+    }
+    return flags;
+}
+
+GL::Texture2D& MaterialLibrary::texture(std::size_t set, std::size_t index)
+{
+    CORRADE_INTERNAL_ASSERT(material_binding != MaterialBinding::Arrays && set < sets);
+    return set == 0 ? originals[index] : copies[(set - 1) * originals.size() + index];
+}
+
+void MaterialLibrary::bind(PBRShader& shader)
+{
+    shader.bind_material_buffer(buffer);
+    for (std::size_t i = 0; i != arrays.size(); ++i)
+    {
+        shader.bind_material_array(maps[i], arrays[i]);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/OpenGL.h>
+#include <Magnum/GL/Texture.h>
+#include <Magnum/GL/TextureArray.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "material_packer.hpp"
+#include "memory_tracker.hpp"
+#include "pbr_shader.hpp"
+
+using namespace Magnum;
+
+//How the shader reaches the maps of a material
+enum class MaterialBinding
+{
+    Loose, //a Texture2D per map and texture set, rebound whenever the set changes
+    Arrays, //a Texture2DArray per map with a layer per texture set, bound once
+    Bindless //ARB_bindless_texture handles in the material table, nothing bound
+};
+
+const char* material_binding_name(MaterialBinding binding);
+
+bool bindless_textures_supported();
+
+//A table of materials in a shader storage buffer, spread over a few texture
+//sets. Every set is a GPU copy of the scene's maps, so sets differ in
+//identity and not in content, and materials differ by tint, roughness,
+//metallic and height factors. Materials of the same set are contiguous.
+class MaterialLibrary
+{
+public:
+    //`textures` are in the order of the material specs, see DemoScene. With
+    //Loose and Bindless they are the first set, Arrays copies them into
+    //every layer.
+    explicit MaterialLibrary(MaterialLayout layout, std::vector<GL::Texture2D>& textures, std::size_t count,
+        std::size_t texture_sets, MaterialBinding binding);
+    ~MaterialLibrary();
+
+    MaterialLibrary(const MaterialLibrary&) = delete;
+    MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+    std::size_t size() const
+    {
+        return materials.size();
+    }
+
+    std::size_t texture_set_count() const
+    {
+        return sets;
+    }
+
+    MaterialBinding binding() const
+    {
+        return material_binding;
+    }
+
+    std::uint32_t texture_set(std::size_t material) const
+    {
+        return materials[material].texture_set;
+    }
+
+    //Flag::MaterialTable and the binding's flag
+    PBRShader::Flags shader_flags() const;
+
+    //Loose only, the `index`-th map of a set in material spec order
+    GL::Texture2D& texture(std::size_t set, std::size_t index);
+
+    //The table and with Arrays the texture arrays. Loose needs the maps of
+    //each texture set bound as well.
+    void bind(PBRShader& shader);
+
+private:
+    MaterialBinding material_binding;
+    std::size_t sets;
+    std::vector<PBRShader::MaterialMap> maps; //per material spec
+    std::vector<GL::Texture2D>& originals;
+    std::vector<GL::Texture2D> copies; //Loose and Bindless, sets after the first, set-major
+    std::vector<GL::Texture2DArray> arrays; //Arrays, per material spec
+    std::vector<GLuint64> handles; //Bindless, resident while the library lives
+    std::vector<PBRShader::Material> materials;
+    GL::Buffer buffer{ GL::Buffer::TargetHint::ShaderStorage };
+    std::vector<TrackedAllocation> memory;
+};
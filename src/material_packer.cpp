@@ -0,0 +1,93 @@
+#include "material_packer.hpp"
+#include "mip_chain.hpp"
+#include <Magnum/ImageView.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/Trade/AbstractImageConverter.h>
+#include <Corrade/Containers/Array.h>
+#include <Corrade/PluginManager/Manager.h>
+#include <Corrade/Utility/Directory.h>
+#include <spdlog/spdlog.h>
+#include <chrono>
+#include <vector>
+
+bool pack_ormh(TextureLoader& loader, const ORMHSources& sources, const std::string& output)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    //Missing ao is common in material sets, the others are required
+    const bool has_ao = Utility::Directory::exists(sources.ao);
+    if (!has_ao)
+    {
+        spdlog::warn("{} not found, packing constant ao", sources.ao);
+    }
+
+    const std::vector<TextureSpec> specs{
+        { has_ao ? sources.ao : sources.roughness, TextureUsage::Scalar },
+        { sources.roughness, TextureUsage::Scalar },
+        { sources.metallic, TextureUsage::Scalar },
+        { sources.height, TextureUsage::Scalar }
+    };
+
+    std::vector<Containers::Optional<Trade::ImageData2D>> images = loader.decode(specs);
+
+    Vector2i size;
+    for (std::size_t i = 0; i != images.size(); ++i)
+    {
+        const auto& image = images[i];
+        if (!image || image->isCompressed() || !supports_mip_generation(image->format()))
+        {
+            spdlog::error("Can't pack {}: not an 8-bit image", specs[i].path);
+            return false;
+        }
+
+        if (i == 0)
+        {
+            size = image->size();
+        }
+        else if (image->size() != size)
+        {
+            spdlog::error("Can't pack {}: size {}x{} doesn't match {}x{}", specs[i].path,
+                image->size().x(), image->size().y(), size.x(), size.y());
+            return false;
+        }
+    }
+
+    Containers::Array<char> packed{ Containers::NoInit, std::size_t(size.product()) * 4 };
+    for (std::size_t c = 0; c != 4; ++c)
+    {
+        const Trade::ImageData2D& image = *images[c];
+        const std::size_t pixel_size = image.pixelSize();
+        const std::size_t row_size = std::size_t(size.x()) * pixel_size;
+        const std::size_t alignment = std::size_t(image.storage().alignment());
+        const std::size_t row_stride = (row_size + alignment - 1) / alignment * alignment;
+
+        for (Int y = 0; y < size.y(); ++y)
+        {
+            const char* src = image.data().data() + y * row_stride;
+            char* dst = packed.data() + std::size_t(y) * size.x() * 4 + c;
+            for (Int x = 0; x < size.x(); ++x)
+            {
+                dst[x * 4] = (c == 0 && !has_ao) ? char(0xff) : src[x * pixel_size];
+            }
+        }
+    }
+
+    PluginManager::Manager<Trade::AbstractImageConverter> manager;
+    Containers::Pointer<Trade::AbstractImageConverter> converter = manager.loadAndInstantiate("PngImageConverter");
+    if (!converter)
+    {
+        spdlog::error("Can't load PngImageConverter");
+        return false;
+    }
+
+    //Rows are tightly packed, RGBA8 is 4-byte aligned anyway
+    if (!converter->exportToFile(ImageView2D{ PixelFormat::RGBA8Unorm, size, packed }, output))
+    {
+        spdlog::error("Can't write {}", output);
+        return false;
+    }
+
+    spdlog::info("Packed ORMH {}x{} into {} in {:.1f} ms", size.x(), size.y(), output,
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return true;
+}
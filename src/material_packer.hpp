@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include "texture_loader.hpp"
+
+enum class MaterialLayout
+{
+    Separate, //one texture per scalar map
+    Packed //ao/roughness/metallic/height in one ORMH texture
+};
+
+struct ORMHSources
+{
+    std::string ao; //optional, white when missing
+    std::string roughness;
+    std::string metallic;
+    std::string height;
+};
+
+//Merges the red channel of each scalar map into one RGBA8 PNG,
+//R = ao, G = roughness, B = metallic, A = height
+bool pack_ormh(TextureLoader& loader, const ORMHSources& sources, const std::string& output);
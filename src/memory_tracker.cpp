@@ -0,0 +1,289 @@
+#include "memory_tracker.hpp"
+#include <Magnum/GL/OpenGL.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include "json.hpp"
+
+namespace
+{
+    constexpr std::size_t CategoryCount = std::size_t(MemoryCategory::Count);
+
+    struct Record
+    {
+        MemoryCategory category;
+        std::string name;
+        std::size_t bytes;
+    };
+
+    struct Registry
+    {
+        std::mutex mutex;
+        std::unordered_map<std::uint64_t, Record> records;
+        std::uint64_t next_id = 1;
+        MemoryUsage categories[CategoryCount];
+        MemoryUsage cpu;
+        MemoryUsage gpu;
+    };
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    void add_bytes(MemoryUsage& usage, std::size_t bytes)
+    {
+        usage.current_bytes += bytes;
+        usage.peak_bytes = std::max(usage.peak_bytes, usage.current_bytes);
+    }
+
+    //Caller holds the registry lock
+    void apply(Registry& state, MemoryCategory category, std::size_t added, std::size_t removed)
+    {
+        MemoryUsage& usage = state.categories[std::size_t(category)];
+        MemoryUsage& domain = is_gpu_memory(category) ? state.gpu : state.cpu;
+        usage.current_bytes -= removed;
+        domain.current_bytes -= removed;
+        add_bytes(usage, added);
+        add_bytes(domain, added);
+    }
+
+    void write_usage(std::ostream& out, const MemoryUsage& usage)
+    {
+        out << "{ \"current_bytes\": " << usage.current_bytes << ", \"peak_bytes\": " << usage.peak_bytes
+            << ", \"allocations\": " << usage.allocations << " }";
+    }
+
+    double mib(std::size_t bytes)
+    {
+        return bytes / double(1 << 20);
+    }
+}
+
+const char* memory_category_name(MemoryCategory category)
+{
+    switch (category)
+    {
+        case MemoryCategory::Texture:
+            return "texture";
+        case MemoryCategory::Mesh:
+            return "mesh";
+        case MemoryCategory::Buffer:
+            return "buffer";
+        case MemoryCategory::Staging:
+            return "staging";
+        case MemoryCategory::Count:
+            break;
+    }
+
+    return "unknown";
+}
+
+bool is_gpu_memory(MemoryCategory category)
+{
+    return category != MemoryCategory::Staging;
+}
+
+TrackedAllocation::TrackedAllocation(MemoryCategory category, std::string name, std::size_t bytes):
+    category{ category },
+    size{ bytes }
+{
+    Registry& state = registry();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    id = state.next_id++;
+    state.records.emplace(id, Record{ category, std::move(name), bytes });
+    ++state.categories[std::size_t(category)].allocations;
+    ++(is_gpu_memory(category) ? state.gpu : state.cpu).allocations;
+    apply(state, category, bytes, 0);
+}
+
+TrackedAllocation::~TrackedAllocation()
+{
+    release();
+}
+
+TrackedAllocation::TrackedAllocation(TrackedAllocation&& other) noexcept:
+    id{ std::exchange(other.id, 0) },
+    category{ other.category },
+    size{ std::exchange(other.size, 0) }
+{
+}
+
+TrackedAllocation& TrackedAllocation::operator=(TrackedAllocation&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        id = std::exchange(other.id, 0);
+        category = other.category;
+        size = std::exchange(other.size, 0);
+    }
+    return *this;
+}
+
+void TrackedAllocation::resize(std::size_t bytes)
+{
+    if (!id || bytes == size)
+    {
+        return;
+    }
+
+    Registry& state = registry();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.records.at(id).bytes = bytes;
+    apply(state, category, bytes, size);
+    size = bytes;
+}
+
+void TrackedAllocation::release()
+{
+    if (!id)
+    {
+        return;
+    }
+
+    Registry& state = registry();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.records.erase(id);
+    --state.categories[std::size_t(category)].allocations;
+    --(is_gpu_memory(category) ? state.gpu : state.cpu).allocations;
+    apply(state, category, 0, size);
+    id = 0;
+    size = 0;
+}
+
+MemoryReport memory_report()
+{
+    Registry& state = registry();
+    MemoryReport report;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        report.cpu = state.cpu;
+        report.gpu = state.gpu;
+        std::copy(std::begin(state.categories), std::end(state.categories), report.categories);
+        report.allocations.reserve(state.records.size());
+        for (const auto& [id, record] : state.records)
+        {
+            report.allocations.push_back({ record.category, record.name, record.bytes });
+        }
+    }
+
+    std::sort(report.allocations.begin(), report.allocations.end(), [](const MemoryReport::Allocation& a, const MemoryReport::Allocation& b)
+    {
+        return a.bytes != b.bytes ? a.bytes > b.bytes : a.name < b.name;
+    });
+    return report;
+}
+
+void log_memory_report(const std::string& when)
+{
+    const MemoryReport report = memory_report();
+
+    spdlog::info("Memory {}: CPU {:.1f} MiB (peak {:.1f} MiB), GPU {:.1f} MiB (peak {:.1f} MiB)", when,
+        mib(report.cpu.current_bytes), mib(report.cpu.peak_bytes), mib(report.gpu.current_bytes), mib(report.gpu.peak_bytes));
+    for (std::size_t i = 0; i != CategoryCount; ++i)
+    {
+        const MemoryUsage& usage = report.categories[i];
+        spdlog::info("  {}: {:.2f} MiB in {} allocations, peak {:.2f} MiB", memory_category_name(MemoryCategory(i)),
+            mib(usage.current_bytes), usage.allocations, mib(usage.peak_bytes));
+    }
+
+    const std::size_t largest = std::min<std::size_t>(report.allocations.size(), 8);
+    for (std::size_t i = 0; i != largest; ++i)
+    {
+        const MemoryReport::Allocation& allocation = report.allocations[i];
+        spdlog::info("    {:.2f} MiB {} ({})", mib(allocation.bytes), allocation.name, memory_category_name(allocation.category));
+    }
+}
+
+void write_memory_json(std::ostream& out, const MemoryReport& report, const std::string& indent)
+{
+    out << "{\n" << indent << "  \"cpu\": ";
+    write_usage(out, report.cpu);
+    out << ",\n" << indent << "  \"gpu\": ";
+    write_usage(out, report.gpu);
+    out << ",\n" << indent << "  \"categories\": {\n";
+    for (std::size_t i = 0; i != CategoryCount; ++i)
+    {
+        out << indent << "    " << json_string(memory_category_name(MemoryCategory(i))) << ": ";
+        write_usage(out, report.categories[i]);
+        out << (i + 1 != CategoryCount ? ",\n" : "\n");
+    }
+    out << indent << "  },\n" << indent << "  \"allocations\": [\n";
+    for (std::size_t i = 0; i != report.allocations.size(); ++i)
+    {
+        const MemoryReport::Allocation& allocation = report.allocations[i];
+        out << indent << "    { \"category\": " << json_string(memory_category_name(allocation.category))
+            << ", \"name\": " << json_string(allocation.name) << ", \"bytes\": " << allocation.bytes
+            << (i + 1 != report.allocations.size() ? " },\n" : " }\n");
+    }
+    out << indent << "  ]\n" << indent << "}";
+}
+
+bool write_memory_report(const std::string& output)
+{
+    const MemoryReport report = memory_report();
+    if (output == "-")
+    {
+        write_memory_json(std::cout, report);
+        std::cout << "\n";
+        return true;
+    }
+
+    std::ofstream file{ output };
+    write_memory_json(file, report);
+    file << "\n";
+    if (!file)
+    {
+        spdlog::error("Can't write {}", output);
+        return false;
+    }
+
+    spdlog::info("Memory report written to {}", output);
+    return true;
+}
+
+std::size_t texture_memory_bytes(GL::Texture2D& texture)
+{
+    GLint levels = 0;
+    glGetTextureParameteriv(texture.id(), GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+
+    std::size_t bytes = 0;
+    for (GLint level = 0; level < levels; ++level)
+    {
+        GLint compressed = 0;
+        glGetTextureLevelParameteriv(texture.id(), level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed)
+        {
+            GLint size = 0;
+            glGetTextureLevelParameteriv(texture.id(), level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            bytes += std::size_t(size);
+            continue;
+        }
+
+        GLint width = 0, height = 0, bits = 0;
+        glGetTextureLevelParameteriv(texture.id(), level, GL_TEXTURE_WIDTH, &width);
+        glGetTextureLevelParameteriv(texture.id(), level, GL_TEXTURE_HEIGHT, &height);
+        for (GLenum channel : { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE })
+        {
+            GLint channel_bits = 0;
+            glGetTextureLevelParameteriv(texture.id(), level, channel, &channel_bits);
+            bits += channel_bits;
+        }
+
+        //Drivers store three 8-bit channels in four
+        if (bits == 24)
+        {
+            bits = 32;
+        }
+        bytes += std::size_t(width) * std::size_t(height) * std::size_t(bits) / 8;
+    }
+
+    return bytes;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Texture.h>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace Magnum;
+
+enum class MemoryCategory : UnsignedInt
+{
+    Texture, //GPU, format size times texels over the allocated mips
+    Mesh, //GPU vertex and index buffers
+    Buffer, //GPU uniform, storage and persistently mapped staging buffers
+    Staging, //CPU copies waiting for or feeding an upload: decoded images, mapped caches, level reads
+    Count
+};
+
+const char* memory_category_name(MemoryCategory category);
+
+//Whether the category lives in GPU memory
+bool is_gpu_memory(MemoryCategory category);
+
+//Registers `bytes` under `name` in the process-wide accounting for as long
+//as it lives, so owners keep one next to the memory it describes. Thread-safe.
+class TrackedAllocation
+{
+public:
+    TrackedAllocation() = default;
+    explicit TrackedAllocation(MemoryCategory category, std::string name, std::size_t bytes);
+    ~TrackedAllocation();
+
+    TrackedAllocation(const TrackedAllocation&) = delete;
+    TrackedAllocation& operator=(const TrackedAllocation&) = delete;
+    TrackedAllocation(TrackedAllocation&& other) noexcept;
+    TrackedAllocation& operator=(TrackedAllocation&& other) noexcept;
+
+    //For memory that grows or shrinks in place, e.g. a reallocated buffer
+    void resize(std::size_t bytes);
+
+    std::size_t bytes() const
+    {
+        return size;
+    }
+
+private:
+    void release();
+
+    std::uint64_t id = 0; //0 for an empty one
+    MemoryCategory category = MemoryCategory::Staging;
+    std::size_t size = 0;
+};
+
+struct MemoryUsage
+{
+    std::size_t current_bytes = 0;
+    std::size_t peak_bytes = 0;
+    std::size_t allocations = 0; //live ones
+};
+
+struct MemoryReport
+{
+    MemoryUsage cpu;
+    MemoryUsage gpu;
+    MemoryUsage categories[std::size_t(MemoryCategory::Count)];
+
+    struct Allocation
+    {
+        MemoryCategory category;
+        std::string name;
+        std::size_t bytes;
+    };
+    std::vector<Allocation> allocations; //live ones, largest first
+};
+
+MemoryReport memory_report();
+
+//Totals and peaks per category and the largest live allocations
+void log_memory_report(const std::string& when);
+
+//As a JSON object, `indent` prefixes every line after the first
+void write_memory_json(std::ostream& out, const MemoryReport& report, const std::string& indent = "");
+
+//memory_report() as JSON into a file, "-" for stdout
+bool write_memory_report(const std::string& output);
+
+//Estimated from the internal format and size of every allocated level, for
+//textures whose creator didn't track them. Needs a current GL context.
+std::size_t texture_memory_bytes(GL::Texture2D& texture);
@@ -0,0 +1,410 @@
+#include "mesh_import.hpp"
+#include <Magnum/Math/Constants.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/MeshTools/GenerateNormals.h>
+#include <Magnum/Trade/MeshData.h>
+#include <Magnum/Trade/MeshObjectData3D.h>
+#include <Magnum/Trade/ObjectData3D.h>
+#include <Magnum/Trade/SceneData.h>
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Containers/StridedArrayView.h>
+#include <Corrade/Utility/Directory.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <type_traits>
+#include "hash.hpp"
+#include "tangent_generation.hpp"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double elapsed_ms(Clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+
+    constexpr char Magic[8] = "PBRMESH";
+    constexpr std::uint32_t Version = 2;
+    constexpr std::size_t DataAlignment = 256;
+
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t vertex_format; //VertexFormat
+        std::uint32_t index_type; //Magnum::MeshIndexType
+        std::uint32_t optimized;
+        std::uint64_t source_size;
+        std::int64_t source_mtime;
+        std::uint64_t vertex_count;
+        std::uint64_t index_count;
+        std::uint64_t vertex_offset;
+        std::uint64_t vertex_size;
+        std::uint64_t index_offset;
+        std::uint64_t index_size;
+        float position_scale;
+        float center[3];
+        float radius;
+        float uv_density;
+        double build_ms; //import to packed buffers, the cold start cost
+    };
+
+    static_assert(std::is_trivially_copyable<FileHeader>::value, "FileHeader is written as-is");
+
+    std::uint64_t align_up(std::uint64_t value, std::uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    bool source_key(const std::string& path, std::uint64_t& size, std::int64_t& mtime)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error)
+        {
+            return false;
+        }
+
+        mtime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        return !error;
+    }
+
+    std::string cache_path(const std::string& path, const MeshImportOptions& options)
+    {
+        std::error_code error;
+        const std::string absolute = std::filesystem::absolute(path, error).string();
+        std::uint64_t key = fnv1a64(absolute.data(), absolute.size());
+        const std::uint32_t variant[2]{ std::uint32_t(options.format), options.optimize_indices ? 1u : 0u };
+        key = fnv1a64(variant, sizeof(variant), key);
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.mesh", static_cast<unsigned long long>(key));
+        return Utility::Directory::join(options.cache_directory, name);
+    }
+
+    //Appends one imported mesh, transformed into scene space
+    bool append_mesh(MeshGeometry& geometry, const Trade::MeshData& data, const Matrix4& transformation, const std::string& name)
+    {
+        if (data.primitive() != MeshPrimitive::Triangles || !data.hasAttribute(Trade::MeshAttribute::Position))
+        {
+            spdlog::warn("Skipping {}: not a triangle mesh with positions", name);
+            return false;
+        }
+
+        const Containers::Array<Vector3> positions = data.positions3DAsArray();
+        Containers::Array<UnsignedInt> indices;
+        if (data.isIndexed())
+        {
+            indices = data.indicesAsArray();
+        }
+        else
+        {
+            indices = Containers::Array<UnsignedInt>{ Containers::NoInit, positions.size() };
+            for (std::size_t i = 0; i != indices.size(); ++i)
+            {
+                indices[i] = UnsignedInt(i);
+            }
+        }
+
+        const Containers::Array<Vector3> normals = data.hasAttribute(Trade::MeshAttribute::Normal)
+            ? data.normalsAsArray()
+            : MeshTools::generateSmoothNormals(Containers::stridedArrayView(indices), Containers::stridedArrayView(positions));
+
+        const bool textured = data.hasAttribute(Trade::MeshAttribute::TextureCoordinates);
+        const Containers::Array<Vector2> tex_coords = textured ? data.textureCoordinates2DAsArray() : Containers::Array<Vector2>{};
+        if (!textured)
+        {
+            spdlog::warn("{} has no texture coordinates, its tangents are arbitrary", name);
+        }
+
+        const UnsignedInt base = UnsignedInt(geometry.positions.size());
+        const Matrix3x3 normal_matrix = transformation.normalMatrix();
+        for (std::size_t i = 0; i != positions.size(); ++i)
+        {
+            geometry.positions.push_back(transformation.transformPoint(positions[i]));
+            geometry.normals.push_back((normal_matrix * normals[i]).normalized());
+            geometry.tex_coords.push_back(textured ? tex_coords[i] : Vector2{});
+        }
+        for (UnsignedInt index : indices)
+        {
+            geometry.indices.push_back(base + index);
+        }
+        return true;
+    }
+
+    bool import_geometry(const std::string& path, PluginManager::Manager<Trade::AbstractImporter>& manager, MeshGeometry& geometry)
+    {
+        Containers::Pointer<Trade::AbstractImporter> importer = manager.loadAndInstantiate("AnySceneImporter");
+        if (!importer || !importer->openFile(path))
+        {
+            spdlog::error("Can't import {}", path);
+            return false;
+        }
+
+        const Int scene_id = importer->defaultScene() >= 0 ? importer->defaultScene() : importer->sceneCount() > 0 ? 0 : -1;
+        if (scene_id < 0)
+        {
+            //No node hierarchy (OBJ), every mesh as is
+            for (UnsignedInt id = 0; id != importer->meshCount(); ++id)
+            {
+                if (Containers::Optional<Trade::MeshData> data = importer->mesh(id))
+                {
+                    append_mesh(geometry, *data, Matrix4{}, importer->meshName(id));
+                }
+            }
+        }
+        else
+        {
+            const Containers::Optional<Trade::SceneData> scene = importer->scene(scene_id);
+            if (!scene)
+            {
+                spdlog::error("Can't import scene {} of {}", scene_id, path);
+                return false;
+            }
+
+            const std::function<void(UnsignedInt, const Matrix4&)> visit = [&](UnsignedInt object_id, const Matrix4& parent)
+            {
+                const Containers::Pointer<Trade::ObjectData3D> object = importer->object3D(object_id);
+                if (!object)
+                {
+                    return;
+                }
+
+                const Matrix4 transformation = parent * object->transformation();
+                if (object->instanceType() == Trade::ObjectInstanceType3D::Mesh && object->instance() >= 0)
+                {
+                    if (Containers::Optional<Trade::MeshData> data = importer->mesh(UnsignedInt(object->instance())))
+                    {
+                        append_mesh(geometry, *data, transformation, importer->object3DName(object_id));
+                    }
+                }
+
+                for (UnsignedInt child : object->children())
+                {
+                    visit(child, transformation);
+                }
+            };
+
+            for (UnsignedInt child : scene->children3D())
+            {
+                visit(child, Matrix4{});
+            }
+        }
+
+        if (geometry.indices.empty())
+        {
+            spdlog::error("{} contains no triangle meshes", path);
+            return false;
+        }
+        return true;
+    }
+
+    bool write_cache(const std::string& file, const FileHeader& header_template, const PackedVertexData& data)
+    {
+        FileHeader header = header_template;
+        header.vertex_offset = align_up(sizeof(FileHeader), DataAlignment);
+        header.vertex_size = data.vertices.size();
+        header.index_offset = align_up(header.vertex_offset + header.vertex_size, DataAlignment);
+        header.index_size = data.indices.size();
+
+        const std::string temporary_path = file + ".tmp";
+        {
+            std::ofstream out{ temporary_path, std::ios::binary | std::ios::trunc };
+            if (!out)
+            {
+                spdlog::error("Can't write {}", temporary_path);
+                return false;
+            }
+
+            const auto pad_to = [&](std::uint64_t offset)
+            {
+                for (std::uint64_t position = std::uint64_t(out.tellp()); position < offset; ++position)
+                {
+                    out.put('\0');
+                }
+            };
+
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            pad_to(header.vertex_offset);
+            out.write(data.vertices.data(), data.vertices.size());
+            pad_to(header.index_offset);
+            out.write(data.indices.data(), data.indices.size());
+
+            if (!out)
+            {
+                spdlog::error("Can't write {}", temporary_path);
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporary_path, file, error);
+        if (error)
+        {
+            spdlog::error("Can't replace {}: {}", file, error.message());
+            return false;
+        }
+        return true;
+    }
+
+    //nullptr unless the file is a complete entry for this source and variant
+    const FileHeader* fresh_header(Containers::ArrayView<const char> data, const MeshImportOptions& options,
+        std::uint64_t source_size, std::int64_t source_mtime)
+    {
+        if (data.size() < sizeof(FileHeader))
+        {
+            return nullptr;
+        }
+
+        const auto* header = reinterpret_cast<const FileHeader*>(data.data());
+        if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != Version
+            || header->vertex_format != std::uint32_t(options.format) || header->optimized != (options.optimize_indices ? 1u : 0u)
+            || header->source_size != source_size || header->source_mtime != source_mtime
+            || header->vertex_offset + header->vertex_size > data.size() || header->index_offset + header->index_size > data.size())
+        {
+            return nullptr;
+        }
+        return header;
+    }
+}
+
+Containers::Optional<MeshAsset> load_mesh(const std::string& path, const MeshImportOptions& options,
+    PluginManager::Manager<Trade::AbstractImporter>& manager, ThreadPool& pool)
+{
+    const auto start = Clock::now();
+
+    std::uint64_t source_size = 0;
+    std::int64_t source_mtime = 0;
+    if (!source_key(path, source_size, source_mtime))
+    {
+        spdlog::error("Can't read {}", path);
+        return {};
+    }
+
+    const bool use_cache = !options.cache_directory.empty();
+    const std::string file = use_cache ? cache_path(path, options) : std::string{};
+
+    if (use_cache && !options.rebuild && Utility::Directory::exists(file))
+    {
+        const auto mapping = Utility::Directory::mapRead(file);
+        const TrackedAllocation mapped{ MemoryCategory::Staging, file, mapping.size() };
+        if (const FileHeader* header = fresh_header(mapping, options, source_size, source_mtime))
+        {
+            const double map_ms = elapsed_ms(start);
+            const auto upload_start = Clock::now();
+
+            MeshAsset asset;
+            asset.mesh = upload_mesh(mapping.slice(header->vertex_offset, header->vertex_offset + header->vertex_size),
+                mapping.slice(header->index_offset, header->index_offset + header->index_size),
+                MeshIndexType(header->index_type), header->index_count, options.format);
+            asset.vertex_count = header->vertex_count;
+            asset.index_count = header->index_count;
+            asset.position_scale = header->position_scale;
+            asset.center = Vector3{ header->center[0], header->center[1], header->center[2] };
+            asset.radius = header->radius;
+            asset.uv_density = header->uv_density;
+            asset.memory = TrackedAllocation{ MemoryCategory::Mesh, path, std::size_t(header->vertex_size + header->index_size) };
+
+            spdlog::info("Mesh {}: {} vertices, {} triangles, warm load {:.1f} ms (map {:.1f}, upload {:.1f}) from {}, cold was {:.1f} ms",
+                path, asset.vertex_count, asset.index_count / 3, elapsed_ms(start), map_ms, elapsed_ms(upload_start), file, header->build_ms);
+            return asset;
+        }
+    }
+
+    MeshGeometry geometry;
+    if (!import_geometry(path, manager, geometry))
+    {
+        return {};
+    }
+    const double import_ms = elapsed_ms(start);
+
+    const auto tangent_start = Clock::now();
+    generate_tangents(geometry, pool);
+    const double tangent_ms = elapsed_ms(tangent_start);
+
+    //Bounding sphere around the box center, frames the camera
+    Vector3 min{ Constants::inf() };
+    Vector3 max{ -Constants::inf() };
+    for (const Vector3& position : geometry.positions)
+    {
+        min = Math::min(min, position);
+        max = Math::max(max, position);
+    }
+    const Vector3 center = (min + max) * 0.5f;
+    float radius = 0.0f;
+    for (const Vector3& position : geometry.positions)
+    {
+        radius = std::max(radius, (position - center).dot());
+    }
+    radius = std::max(std::sqrt(radius), 1.0e-6f);
+
+    //Surface area over UV area, what texture streaming scales its demand by
+    double world_area = 0.0;
+    double uv_area = 0.0;
+    for (std::size_t i = 0; i + 2 < geometry.indices.size(); i += 3)
+    {
+        const UnsignedInt a = geometry.indices[i];
+        const UnsignedInt b = geometry.indices[i + 1];
+        const UnsignedInt c = geometry.indices[i + 2];
+        world_area += Math::cross(geometry.positions[b] - geometry.positions[a], geometry.positions[c] - geometry.positions[a]).length();
+        uv_area += std::abs(Math::cross(geometry.tex_coords[b] - geometry.tex_coords[a], geometry.tex_coords[c] - geometry.tex_coords[a]));
+    }
+    const float uv_density = uv_area > 0.0 ? float(std::sqrt(world_area / uv_area)) : radius;
+
+    const auto pack_start = Clock::now();
+    const PackedVertexData data = pack_vertices(std::move(geometry), options.format, options.optimize_indices);
+    const TrackedAllocation packed{ MemoryCategory::Staging, path + " packed vertices", data.vertices.size() + data.indices.size() };
+    const double pack_ms = elapsed_ms(pack_start);
+    const double build_ms = elapsed_ms(start);
+
+    const auto write_start = Clock::now();
+    if (use_cache && Utility::Directory::mkpath(options.cache_directory))
+    {
+        FileHeader header{};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.vertex_format = std::uint32_t(options.format);
+        header.index_type = std::uint32_t(data.index_type);
+        header.optimized = options.optimize_indices ? 1 : 0;
+        header.source_size = source_size;
+        header.source_mtime = source_mtime;
+        header.vertex_count = data.vertex_count;
+        header.index_count = data.index_count;
+        header.position_scale = data.position_scale;
+        header.center[0] = center.x();
+        header.center[1] = center.y();
+        header.center[2] = center.z();
+        header.radius = radius;
+        header.uv_density = uv_density;
+        header.build_ms = build_ms;
+        write_cache(file, header, data);
+    }
+    const double write_ms = elapsed_ms(write_start);
+
+    const auto upload_start = Clock::now();
+    MeshAsset asset;
+    asset.mesh = upload_mesh(data.vertices, data.indices, data.index_type, data.index_count, options.format);
+    asset.vertex_count = data.vertex_count;
+    asset.index_count = data.index_count;
+    asset.position_scale = data.position_scale;
+    asset.center = center;
+    asset.radius = radius;
+    asset.uv_density = uv_density;
+    asset.memory = TrackedAllocation{ MemoryCategory::Mesh, path, data.vertices.size() + data.indices.size() };
+
+    spdlog::info("Mesh {}: {} vertices, {} triangles, cold load {:.1f} ms (import {:.1f}, tangents {:.1f} on {} threads, "
+        "packing {:.1f}, cache write {:.1f}, upload {:.1f}), ACMR {:.3f} -> {:.3f}",
+        path, asset.vertex_count, asset.index_count / 3, elapsed_ms(start), import_ms, tangent_ms, pool.size() + 1,
+        pack_ms, write_ms, elapsed_ms(upload_start), data.acmr_before, data.acmr_after);
+    return asset;
+}
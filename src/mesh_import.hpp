@@ -0,0 +1,45 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Mesh.h>
+#include <Magnum/Math/Vector3.h>
+#include <Magnum/Trade/AbstractImporter.h>
+#include <Corrade/Containers/Optional.h>
+#include <Corrade/PluginManager/Manager.h>
+#include <cstddef>
+#include <string>
+#include "memory_tracker.hpp"
+#include "mesh_packing.hpp"
+#include "thread_pool.hpp"
+
+using namespace Magnum;
+
+struct MeshAsset
+{
+    GL::Mesh mesh;
+    std::size_t vertex_count = 0;
+    std::size_t index_count = 0;
+    float position_scale = 1.0f; //VertexFormat::PackedPositions dequantization
+    //Bounding sphere in object space
+    Vector3 center;
+    float radius = 1.0f;
+    //Object space length per unit of UV, from the ratio of surface to UV area
+    float uv_density = 1.0f;
+    TrackedAllocation memory; //vertex and index buffers
+};
+
+struct MeshImportOptions
+{
+    VertexFormat format = VertexFormat::Packed;
+    bool optimize_indices = true;
+    std::string cache_directory = "data/mesh_cache"; //empty imports every launch
+    bool rebuild = false; //ignore a fresh cache entry
+};
+
+//Imports every mesh of the default scene (or of the file, if it has no
+//scenes) through AnySceneImporter, so glTF and OBJ both work, flattened into
+//one mesh with the node transforms applied. Missing normals are generated,
+//tangents always are, both on the pool. The packed vertex and index buffers
+//are written to a cache file keyed by path, size, mtime and vertex format;
+//a fresh entry is mmapped and uploaded as is. Needs a current GL context.
+Containers::Optional<MeshAsset> load_mesh(const std::string& path, const MeshImportOptions& options,
+    PluginManager::Manager<Trade::AbstractImporter>& manager, ThreadPool& pool);
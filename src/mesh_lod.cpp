@@ -0,0 +1,50 @@
+#include "mesh_lod.hpp"
+#include <Magnum/Primitives/UVSphere.h>
+#include <Magnum/Trade/MeshData.h>
+#include <Magnum/Math/Constants.h>
+#include <Corrade/Utility/Assert.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <string>
+
+SphereLodChain::SphereLodChain(const std::vector<UnsignedInt>& rings, float pixels_per_ring, VertexFormat format, bool optimize_indices):
+    pixels_per_ring{ pixels_per_ring },
+    format{ format }
+{
+    CORRADE_INTERNAL_ASSERT(!rings.empty() && std::is_sorted(rings.rbegin(), rings.rend()));
+
+    for (UnsignedInt ring_count : rings)
+    {
+        Trade::MeshData data = Primitives::uvSphereSolid(ring_count, ring_count,
+            Primitives::UVSphereFlag::Tangents | Primitives::UVSphereFlag::TextureCoordinates);
+
+        PackedMesh packed = pack_mesh(data, format, optimize_indices);
+        spdlog::info("  {} rings: {} vertices, ACMR {:.3f} -> {:.3f}", ring_count, packed.vertex_count, packed.acmr_before, packed.acmr_after);
+
+        LodLevel level;
+        level.rings = ring_count;
+        level.vertex_count = data.vertexCount();
+        level.position_scale = packed.position_scale;
+        level.mesh = std::move(packed.mesh);
+        level.memory = TrackedAllocation{ MemoryCategory::Mesh, "sphere LOD " + std::to_string(ring_count) + " rings", packed.bytes };
+        levels.push_back(std::move(level));
+    }
+
+    spdlog::info("Sphere LOD chain: {} levels, {} to {} vertices, {} format ({} bytes per vertex){}", levels.size(),
+        levels.back().vertex_count, levels.front().vertex_count, vertex_format_name(format), vertex_stride(format),
+        optimize_indices ? ", cache optimized" : "");
+}
+
+std::size_t SphereLodChain::select(float projected_radius_px) const
+{
+    //Rings run pole to pole, half the projected circumference
+    const float wanted_rings = Constants::pi() * projected_radius_px / pixels_per_ring;
+
+    std::size_t index = 0;
+    while (index + 1 < levels.size() && levels[index + 1].rings >= wanted_rings)
+    {
+        ++index;
+    }
+
+    return index;
+}
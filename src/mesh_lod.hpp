@@ -0,0 +1,50 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Mesh.h>
+#include <cstddef>
+#include <vector>
+#include "memory_tracker.hpp"
+#include "mesh_packing.hpp"
+
+using namespace Magnum;
+
+struct LodLevel
+{
+    GL::Mesh mesh;
+    UnsignedInt rings = 0;
+    UnsignedInt vertex_count = 0;
+    float position_scale = 1.0f; //VertexFormat::PackedPositions dequantization
+    TrackedAllocation memory;
+};
+
+//UV spheres of decreasing tessellation built once at startup. A level is
+//picked from the projected radius so that a ring spans a few pixels.
+class SphereLodChain
+{
+public:
+    explicit SphereLodChain(const std::vector<UnsignedInt>& rings = { 128, 64, 32, 16 }, float pixels_per_ring = 4.0f,
+        VertexFormat format = VertexFormat::Packed, bool optimize_indices = true);
+
+    //0 is the finest level
+    std::size_t select(float projected_radius_px) const;
+
+    std::size_t size() const
+    {
+        return levels.size();
+    }
+
+    VertexFormat vertex_format() const
+    {
+        return format;
+    }
+
+    LodLevel& level(std::size_t index)
+    {
+        return levels[index];
+    }
+
+private:
+    std::vector<LodLevel> levels; //finest first
+    float pixels_per_ring;
+    VertexFormat format;
+};
@@ -0,0 +1,277 @@
+#include "mesh_packing.hpp"
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/Mesh.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Math/Vector4.h>
+#include <Magnum/Trade/MeshData.h>
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Containers/ArrayViewStl.h>
+#include <Corrade/Utility/Assert.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "pbr_shader.hpp"
+#include "vertex_cache.hpp"
+
+namespace
+{
+    struct FloatVertex
+    {
+        Vector3 position;
+        Vector2 tex_coord;
+        Vector3 normal;
+        Vector4 tangent; //w is the bitangent sign
+    };
+
+    struct PackedVertex
+    {
+        Vector3 position;
+        Vector2us tex_coord;
+        Vector2s normal;
+        Vector4s tangent; //octahedral xy, bitangent sign, unused
+    };
+
+    struct PackedPositionVertex
+    {
+        Vector4s position; //w unused
+        Vector2us tex_coord;
+        Vector2s normal;
+        Vector4s tangent;
+    };
+
+    static_assert(sizeof(FloatVertex) == 48 && sizeof(PackedVertex) == 28 && sizeof(PackedPositionVertex) == 24,
+        "Unexpected vertex padding");
+
+    Short snorm16(float value)
+    {
+        return Short(std::lround(Math::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    UnsignedShort unorm16(float value)
+    {
+        return UnsignedShort(std::lround(Math::clamp(value, 0.0f, 1.0f) * 65535.0f));
+    }
+
+    Vector2s snorm16(const Vector2& value)
+    {
+        return { snorm16(value.x()), snorm16(value.y()) };
+    }
+
+    template<class Vertex> void fill_packed(Vertex& vertex, const Vector2& tex_coord, const Vector3& normal, const Vector3& tangent, float sign)
+    {
+        vertex.tex_coord = { unorm16(tex_coord.x()), unorm16(tex_coord.y()) };
+        vertex.normal = snorm16(octahedral_encode(normal));
+        const Vector2s tangent_oct = snorm16(octahedral_encode(tangent));
+        vertex.tangent = { tangent_oct.x(), tangent_oct.y(), snorm16(sign < 0.0f ? -1.0f : 1.0f), 0 };
+    }
+}
+
+const char* vertex_format_name(VertexFormat format)
+{
+    switch (format)
+    {
+        case VertexFormat::Float: return "float";
+        case VertexFormat::Packed: return "packed";
+        case VertexFormat::PackedPositions: return "packed-positions";
+    }
+
+    CORRADE_INTERNAL_ASSERT_UNREACHABLE();
+}
+
+std::size_t vertex_stride(VertexFormat format)
+{
+    switch (format)
+    {
+        case VertexFormat::Float: return sizeof(FloatVertex);
+        case VertexFormat::Packed: return sizeof(PackedVertex);
+        case VertexFormat::PackedPositions: return sizeof(PackedPositionVertex);
+    }
+
+    CORRADE_INTERNAL_ASSERT_UNREACHABLE();
+}
+
+Vector2 octahedral_encode(const Vector3& direction)
+{
+    const Vector3 n = direction / (std::abs(direction.x()) + std::abs(direction.y()) + std::abs(direction.z()));
+    Vector2 p = n.xy();
+    if (n.z() < 0.0f)
+    {
+        //Fold the lower hemisphere over the diagonals
+        p = (Vector2{ 1.0f } - Math::abs(Vector2{ n.y(), n.x() })) * Vector2{ n.x() >= 0.0f ? 1.0f : -1.0f, n.y() >= 0.0f ? 1.0f : -1.0f };
+    }
+    return p;
+}
+
+PackedVertexData pack_vertices(MeshGeometry&& geometry, VertexFormat format, bool optimize_indices)
+{
+    const std::size_t vertex_count = geometry.positions.size();
+    CORRADE_INTERNAL_ASSERT(geometry.normals.size() == vertex_count && geometry.tangents.size() == vertex_count
+        && geometry.tex_coords.size() == vertex_count && geometry.indices.size() % 3 == 0);
+
+    std::vector<UnsignedInt>& indices = geometry.indices;
+
+    PackedVertexData packed;
+    packed.vertex_count = vertex_count;
+    packed.index_count = indices.size();
+    packed.acmr_before = average_cache_miss_ratio(indices, vertex_count);
+
+    //Old to new vertex index, identity without optimization
+    std::vector<UnsignedInt> remap(vertex_count);
+    for (std::size_t i = 0; i != vertex_count; ++i)
+    {
+        remap[i] = UnsignedInt(i);
+    }
+
+    if (optimize_indices)
+    {
+        optimize_vertex_cache(indices, vertex_count);
+        optimize_vertex_fetch(indices, remap);
+    }
+    packed.acmr_after = average_cache_miss_ratio(indices, vertex_count);
+
+    float extent = 0.0f;
+    for (const Vector3& position : geometry.positions)
+    {
+        extent = std::max(extent, Math::abs(position).max());
+    }
+    if (format == VertexFormat::PackedPositions && extent > 0.0f)
+    {
+        packed.position_scale = extent;
+    }
+
+    packed.vertices = Containers::Array<char>{ Containers::ValueInit, vertex_count * vertex_stride(format) };
+    for (std::size_t i = 0; i != vertex_count; ++i)
+    {
+        const std::size_t target = remap[i];
+        const Vector3& position = geometry.positions[i];
+        const Vector2& tex_coord = geometry.tex_coords[i];
+        const Vector3& normal = geometry.normals[i];
+        const Vector4& tangent = geometry.tangents[i];
+        switch (format)
+        {
+            case VertexFormat::Float:
+            {
+                FloatVertex& vertex = reinterpret_cast<FloatVertex*>(packed.vertices.data())[target];
+                vertex = { position, tex_coord, normal, tangent };
+                break;
+            }
+            case VertexFormat::Packed:
+            {
+                PackedVertex& vertex = reinterpret_cast<PackedVertex*>(packed.vertices.data())[target];
+                vertex.position = position;
+                fill_packed(vertex, tex_coord, normal, tangent.xyz(), tangent.w());
+                break;
+            }
+            case VertexFormat::PackedPositions:
+            {
+                PackedPositionVertex& vertex = reinterpret_cast<PackedPositionVertex*>(packed.vertices.data())[target];
+                const Vector3 scaled = position / packed.position_scale;
+                vertex.position = { snorm16(scaled.x()), snorm16(scaled.y()), snorm16(scaled.z()), 0 };
+                fill_packed(vertex, tex_coord, normal, tangent.xyz(), tangent.w());
+                break;
+            }
+        }
+    }
+
+    //Spheres up to 180 rings fit 16-bit indices
+    if (vertex_count <= 65536)
+    {
+        packed.index_type = MeshIndexType::UnsignedShort;
+        packed.indices = Containers::Array<char>{ Containers::NoInit, indices.size() * sizeof(UnsignedShort) };
+        auto* target = reinterpret_cast<UnsignedShort*>(packed.indices.data());
+        for (std::size_t i = 0; i != indices.size(); ++i)
+        {
+            target[i] = UnsignedShort(indices[i]);
+        }
+    }
+    else
+    {
+        packed.index_type = MeshIndexType::UnsignedInt;
+        packed.indices = Containers::Array<char>{ Containers::NoInit, indices.size() * sizeof(UnsignedInt) };
+        std::memcpy(packed.indices.data(), indices.data(), packed.indices.size());
+    }
+
+    return packed;
+}
+
+GL::Mesh upload_mesh(Containers::ArrayView<const char> vertices, Containers::ArrayView<const char> indices,
+    MeshIndexType index_type, std::size_t index_count, VertexFormat format)
+{
+    GL::Buffer vertex_buffer{ GL::Buffer::TargetHint::Array };
+    vertex_buffer.setData(vertices, GL::BufferUsage::StaticDraw);
+
+    GL::Buffer index_buffer{ GL::Buffer::TargetHint::ElementArray };
+    index_buffer.setData(indices, GL::BufferUsage::StaticDraw);
+
+    GL::Mesh mesh;
+    mesh.setPrimitive(GL::MeshPrimitive::Triangles)
+        .setCount(Int(index_count));
+
+    switch (format)
+    {
+        case VertexFormat::Float:
+            mesh.addVertexBuffer(std::move(vertex_buffer), 0,
+                PBRShader::Position{},
+                PBRShader::TextureCoord{},
+                PBRShader::Normal{},
+                PBRShader::Tangent4{});
+            break;
+        case VertexFormat::Packed:
+            mesh.addVertexBuffer(std::move(vertex_buffer), 0,
+                PBRShader::Position{},
+                PBRShader::TextureCoord{ PBRShader::TextureCoord::DataType::UnsignedShort, PBRShader::TextureCoord::DataOption::Normalized },
+                PBRShader::OctahedralNormal{ PBRShader::OctahedralNormal::DataType::Short, PBRShader::OctahedralNormal::DataOption::Normalized },
+                PBRShader::Tangent4{ PBRShader::Tangent4::DataType::Short, PBRShader::Tangent4::DataOption::Normalized });
+            break;
+        case VertexFormat::PackedPositions:
+            mesh.addVertexBuffer(std::move(vertex_buffer), 0,
+                PBRShader::PackedPosition{ PBRShader::PackedPosition::DataType::Short, PBRShader::PackedPosition::DataOption::Normalized },
+                PBRShader::TextureCoord{ PBRShader::TextureCoord::DataType::UnsignedShort, PBRShader::TextureCoord::DataOption::Normalized },
+                PBRShader::OctahedralNormal{ PBRShader::OctahedralNormal::DataType::Short, PBRShader::OctahedralNormal::DataOption::Normalized },
+                PBRShader::Tangent4{ PBRShader::Tangent4::DataType::Short, PBRShader::Tangent4::DataOption::Normalized });
+            break;
+    }
+
+    mesh.setIndexBuffer(std::move(index_buffer), 0, GL::meshIndexType(index_type));
+    return mesh;
+}
+
+MeshGeometry mesh_geometry(const Trade::MeshData& data)
+{
+    CORRADE_INTERNAL_ASSERT(data.isIndexed() && data.primitive() == MeshPrimitive::Triangles);
+
+    MeshGeometry geometry;
+    const Containers::Array<Vector3> positions = data.positions3DAsArray();
+    const Containers::Array<Vector3> normals = data.normalsAsArray();
+    const Containers::Array<Vector3> tangents = data.tangentsAsArray();
+    const Containers::Array<Float> signs = data.bitangentSignsAsArray();
+    const Containers::Array<Vector2> tex_coords = data.textureCoordinates2DAsArray();
+    const Containers::Array<UnsignedInt> indices = data.indicesAsArray();
+
+    geometry.positions.assign(positions.begin(), positions.end());
+    geometry.normals.assign(normals.begin(), normals.end());
+    geometry.tex_coords.assign(tex_coords.begin(), tex_coords.end());
+    geometry.indices.assign(indices.begin(), indices.end());
+    geometry.tangents.resize(tangents.size());
+    for (std::size_t i = 0; i != tangents.size(); ++i)
+    {
+        geometry.tangents[i] = Vector4{ tangents[i], signs[i] };
+    }
+    return geometry;
+}
+
+PackedMesh pack_mesh(const Trade::MeshData& data, VertexFormat format, bool optimize_indices)
+{
+    const PackedVertexData vertex_data = pack_vertices(mesh_geometry(data), format, optimize_indices);
+
+    PackedMesh packed;
+    packed.mesh = upload_mesh(vertex_data.vertices, vertex_data.indices, vertex_data.index_type, vertex_data.index_count, format);
+    packed.position_scale = vertex_data.position_scale;
+    packed.vertex_count = vertex_data.vertex_count;
+    packed.index_count = vertex_data.index_count;
+    packed.bytes = vertex_data.vertices.size() + vertex_data.indices.size();
+    packed.acmr_before = vertex_data.acmr_before;
+    packed.acmr_after = vertex_data.acmr_after;
+    return packed;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/GL/Mesh.h>
+#include <Magnum/Math/Vector2.h>
+#include <Magnum/Math/Vector3.h>
+#include <Magnum/Math/Vector4.h>
+#include <Magnum/Trade/Trade.h>
+#include <Corrade/Containers/Array.h>
+#include <cstddef>
+#include <vector>
+
+using namespace Magnum;
+
+enum class VertexFormat
+{
+    //float position, UV, normal and tangent, 48 bytes
+    Float,
+    //float position, unorm16 UV, octahedral snorm16 normal and tangent, 28 bytes
+    Packed,
+    //like Packed with snorm16 positions scaled by PackedMesh::position_scale, 24 bytes
+    PackedPositions
+};
+
+const char* vertex_format_name(VertexFormat format);
+
+std::size_t vertex_stride(VertexFormat format);
+
+struct PackedMesh
+{
+    GL::Mesh mesh;
+    float position_scale = 1.0f; //object space extent of a unit snorm16 position
+    std::size_t vertex_count = 0;
+    std::size_t index_count = 0;
+    std::size_t bytes = 0; //vertex and index buffers
+    //FIFO-32 average cache miss ratio of the source and the final index order
+    float acmr_before = 0.0f;
+    float acmr_after = 0.0f;
+};
+
+//Indexed triangles with one entry per vertex in every attribute array
+struct MeshGeometry
+{
+    std::vector<Vector3> positions;
+    std::vector<Vector3> normals;
+    std::vector<Vector4> tangents; //w is the bitangent sign
+    std::vector<Vector2> tex_coords;
+    std::vector<UnsignedInt> indices;
+};
+
+//Interleaved vertices and indices of a mesh in their final GPU layout
+struct PackedVertexData
+{
+    Containers::Array<char> vertices;
+    Containers::Array<char> indices;
+    MeshIndexType index_type = MeshIndexType::UnsignedInt;
+    float position_scale = 1.0f;
+    std::size_t vertex_count = 0;
+    std::size_t index_count = 0;
+    float acmr_before = 0.0f;
+    float acmr_after = 0.0f;
+};
+
+//Octahedral mapping of a unit vector to [-1, 1]^2
+Vector2 octahedral_encode(const Vector3& direction);
+
+//Interleaves the geometry into the PBRShader vertex layout of the format,
+//optionally reordering it for the post-transform cache and linear vertex
+//fetch first. Indices are 16-bit when the vertex count allows.
+PackedVertexData pack_vertices(MeshGeometry&& geometry, VertexFormat format, bool optimize_indices);
+
+//Uploads packed data and sets up the attributes of the format
+GL::Mesh upload_mesh(Containers::ArrayView<const char> vertices, Containers::ArrayView<const char> indices,
+    MeshIndexType index_type, std::size_t index_count, VertexFormat format);
+
+//Copies the attributes of an indexed triangle mesh with positions, normals,
+//tangents with bitangent signs and texture coordinates
+MeshGeometry mesh_geometry(const Trade::MeshData& data);
+
+//pack_vertices() and upload_mesh() of a mesh with positions, normals,
+//tangents with bitangent signs and texture coordinates
+PackedMesh pack_mesh(const Trade::MeshData& data, VertexFormat format, bool optimize_indices);
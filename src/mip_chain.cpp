@@ -0,0 +1,138 @@
+#include "mip_chain.hpp"
+#include <Magnum/Math/Functions.h>
+#include <Corrade/Utility/Assert.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    const std::array<float, 256>& srgb_to_linear_table()
+    {
+        static const std::array<float, 256> table = []
+        {
+            std::array<float, 256> result{};
+            for (std::size_t i = 0; i < result.size(); ++i)
+            {
+                const float c = i / 255.0f;
+                result[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return result;
+        }();
+
+        return table;
+    }
+
+    unsigned char linear_to_srgb(float c)
+    {
+        c = std::clamp(c, 0.0f, 1.0f);
+        const float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+        return static_cast<unsigned char>(s * 255.0f + 0.5f);
+    }
+
+    void downsample_row(const MipLevel& src, MipLevel& dst, std::size_t channels, MipFilter filter, Int y)
+    {
+        const auto& to_linear = srgb_to_linear_table();
+        const std::size_t src_stride = src.size.x() * channels;
+        const unsigned char* src_data = reinterpret_cast<const unsigned char*>(src.data.data());
+        unsigned char* out = reinterpret_cast<unsigned char*>(dst.data.data()) + std::size_t(y) * dst.size.x() * channels;
+
+        const Int y0 = std::min(2 * y, src.size.y() - 1);
+        const Int y1 = std::min(2 * y + 1, src.size.y() - 1);
+        const unsigned char* row0 = src_data + y0 * src_stride;
+        const unsigned char* row1 = src_data + y1 * src_stride;
+
+        for (Int x = 0; x < dst.size.x(); ++x, out += channels)
+        {
+            const std::size_t x0 = std::min(2 * x, src.size.x() - 1) * channels;
+            const std::size_t x1 = std::min(2 * x + 1, src.size.x() - 1) * channels;
+            const unsigned char* p[4]{ row0 + x0, row0 + x1, row1 + x0, row1 + x1 };
+
+            std::size_t c = 0;
+            if (filter == MipFilter::Srgb && channels >= 3)
+            {
+                for (; c < 3; ++c)
+                {
+                    out[c] = linear_to_srgb((to_linear[p[0][c]] + to_linear[p[1][c]] + to_linear[p[2][c]] + to_linear[p[3][c]]) * 0.25f);
+                }
+            }
+            else if (filter == MipFilter::Normal && channels >= 3)
+            {
+                float n[3]{};
+                for (const unsigned char* texel : p)
+                {
+                    for (std::size_t i = 0; i < 3; ++i)
+                    {
+                        n[i] += texel[i] / 127.5f - 1.0f;
+                    }
+                }
+
+                const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (; c < 3; ++c)
+                {
+                    const float v = length > 0.0f ? n[c] / length : (c == 2 ? 1.0f : 0.0f);
+                    out[c] = static_cast<unsigned char>(std::clamp((v * 0.5f + 0.5f) * 255.0f + 0.5f, 0.0f, 255.0f));
+                }
+            }
+
+            for (; c < channels; ++c)
+            {
+                out[c] = static_cast<unsigned char>((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+            }
+        }
+    }
+}
+
+bool supports_mip_generation(PixelFormat format)
+{
+    switch (format)
+    {
+        case PixelFormat::R8Unorm:
+        case PixelFormat::RG8Unorm:
+        case PixelFormat::RGB8Unorm:
+        case PixelFormat::RGBA8Unorm:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::vector<MipLevel> generate_mip_chain(const ImageView2D& image, MipFilter filter, ThreadPool& pool)
+{
+    CORRADE_INTERNAL_ASSERT(supports_mip_generation(image.format()));
+
+    const std::size_t channels = pixelSize(image.format());
+    const std::size_t row_size = image.size().x() * channels;
+    const std::size_t alignment = std::size_t(image.storage().alignment());
+    const std::size_t row_stride = (row_size + alignment - 1) / alignment * alignment;
+
+    std::vector<MipLevel> levels;
+
+    MipLevel base{ image.size(), Containers::Array<char>{ Containers::NoInit, row_size * image.size().y() } };
+    const char* src = static_cast<const char*>(image.data().data());
+    for (Int y = 0; y < image.size().y(); ++y)
+    {
+        std::memcpy(base.data.data() + y * row_size, src + y * row_stride, row_size);
+    }
+    levels.push_back(std::move(base));
+
+    while (levels.back().size != Vector2i{ 1 })
+    {
+        const Vector2i size = Math::max(levels.back().size / 2, Vector2i{ 1 });
+        MipLevel level{ size, Containers::Array<char>{ Containers::NoInit, std::size_t(size.product()) * channels } };
+
+        const MipLevel& previous = levels.back();
+        pool.parallel_for(std::size_t(size.y()), 16, [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t y = begin; y < end; ++y)
+            {
+                downsample_row(previous, level, channels, filter, Int(y));
+            }
+        });
+
+        levels.push_back(std::move(level));
+    }
+
+    return levels;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/ImageView.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/Math/Vector2.h>
+#include <Corrade/Containers/Array.h>
+#include <vector>
+#include "thread_pool.hpp"
+
+using namespace Magnum;
+
+enum class MipFilter
+{
+    Linear,
+    Srgb, //averages RGB in linear space, alpha stays linear
+    Normal //averages decoded normals and renormalizes
+};
+
+//Rows are tightly packed (alignment 1)
+struct MipLevel
+{
+    Vector2i size;
+    Containers::Array<char> data;
+};
+
+//Only 8-bit unorm formats with 1..4 channels
+bool supports_mip_generation(PixelFormat format);
+
+//Full chain down to 1x1 with a 2x2 box filter, level 0 is a packed copy of image
+std::vector<MipLevel> generate_mip_chain(const ImageView2D& image, MipFilter filter, ThreadPool& pool);
@@ -0,0 +1,26 @@
+#include "offscreen_target.hpp"
+#include <Magnum/GL/RenderbufferFormat.h>
+#include <spdlog/spdlog.h>
+
+OffscreenTarget::OffscreenTarget(const Vector2i& size):
+    framebuffer{ { {}, size } }
+{
+    color.setStorage(GL::RenderbufferFormat::RGBA8, size);
+    depth.setStorage(GL::RenderbufferFormat::DepthComponent24, size);
+    framebuffer.attachRenderbuffer(GL::Framebuffer::ColorAttachment{ 0 }, color)
+        .attachRenderbuffer(GL::Framebuffer::BufferAttachment::Depth, depth);
+    //Depth padded to 32 bits like drivers store it
+    memory = TrackedAllocation{ MemoryCategory::Texture, "offscreen render target", std::size_t(size.product()) * 8 };
+}
+
+bool OffscreenTarget::bind()
+{
+    if (framebuffer.checkStatus(GL::FramebufferTarget::Draw) != GL::Framebuffer::Status::Complete)
+    {
+        spdlog::error("Offscreen framebuffer is incomplete");
+        return false;
+    }
+
+    framebuffer.bind();
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Framebuffer.h>
+#include <Magnum/GL/Renderbuffer.h>
+#include <Magnum/Math/Vector2.h>
+#include "memory_tracker.hpp"
+
+using namespace Magnum;
+
+//RGBA8 color and 24-bit depth renderbuffers for rendering without a window
+class OffscreenTarget
+{
+public:
+    explicit OffscreenTarget(const Vector2i& size);
+
+    //Returns false if the framebuffer is incomplete
+    bool bind();
+
+    GL::Renderbuffer color;
+    GL::Renderbuffer depth;
+    GL::Framebuffer framebuffer;
+    TrackedAllocation memory;
+};
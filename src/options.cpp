@@ -0,0 +1,429 @@
+#include "options.hpp"
+#include <Corrade/Utility/Arguments.h>
+#include <Corrade/Utility/String.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Corrade;
+
+namespace
+{
+    [[noreturn]] void invalid_value(const std::string& option, const std::string& value)
+    {
+        spdlog::error("Invalid value {} for --{}", value, option);
+        std::exit(1);
+    }
+}
+
+DemoOptions parse_options(int argc, char** argv)
+{
+    Utility::Arguments args;
+    args.addOption("threads", "0").setHelp("threads", "worker thread count, 0 for one per core", "N")
+        .addOption("texture-cache", "data/textures.cache").setHelp("texture-cache", "baked texture cache", "PATH")
+        .addBooleanOption("no-texture-cache").setHelp("no-texture-cache", "always decode the source images")
+        .addBooleanOption("bake-textures").setHelp("bake-textures", "rebuild the texture cache and exit")
+        .addOption("texture-compression", "bc7").setHelp("texture-compression", "color map block format in the cache", "none|bc1|bc7")
+        .addOption("compression-quality", "normal").setHelp("compression-quality", "block encoder quality", "fast|normal|high")
+        .addBooleanOption("benchmark-compression").setHelp("benchmark-compression", "measure block encoder throughput and exit")
+        .addBooleanOption("texture-streaming").setHelp("texture-streaming", "start with the small mips only and stream finer ones by screen-space demand")
+        .addOption("texture-budget", "32").setHelp("texture-budget", "streamed texture memory budget", "MIB")
+        .addOption("texture-tail", "128").setHelp("texture-tail", "mips up to this size stay resident", "PX")
+        .addOption("material-layout", "separate").setHelp("material-layout", "scalar material maps as separate textures or one packed ORMH texture", "separate|packed")
+        .addOption("ormh-texture", "data/ormh.png").setHelp("ormh-texture", "packed ao/roughness/metallic/height texture, created when missing", "PATH")
+        .addBooleanOption("pack-ormh").setHelp("pack-ormh", "rebuild the ORMH texture and exit")
+        .addOption("resolution", "1024x1024").setHelp("resolution", "window or benchmark framebuffer size", "WxH")
+        .addOption("antialiasing", "fxaa").setHelp("antialiasing", "post process anti-aliasing of the scene", "none|fxaa|taa")
+        .addOption("msaa", "1").setHelp("msaa", "MSAA samples of the post processed scene target", "N")
+        .addOption("render-scale", "1").setHelp("render-scale", "scene resolution relative to the output, the largest one with --dynamic-resolution", "S")
+        .addBooleanOption("dynamic-resolution").setHelp("dynamic-resolution", "lower the render scale to keep the GPU frame time within --frame-budget")
+        .addBooleanOption("no-post-process").setHelp("no-post-process", "draw straight into the output with 8x window MSAA, ignoring the options above")
+        .addBooleanOption("aa-sweep").setHelp("aa-sweep", "headless, measure frame time and PSNR of the anti-aliasing modes and render scales")
+        .addOption("aa-sweep-output", "aa_sweep.json").setHelp("aa-sweep-output", "anti-aliasing sweep report, - for stdout", "PATH")
+        .addOption("shader-cache", "data/shader_cache").setHelp("shader-cache", "directory for linked shader program binaries", "DIR")
+        .addBooleanOption("no-shader-cache").setHelp("no-shader-cache", "always compile shaders from source")
+        .addOption("shader-directory", "data/shaders").setHelp("shader-directory", "GLSL sources of the PBR shader", "DIR")
+        .addOption("shader-compile", "auto").setHelp("shader-compile", "compile shaders with KHR_parallel_shader_compile, on a thread with a shared context or blocking", "auto|parallel|thread|sync")
+        .addBooleanOption("no-hot-reload").setHelp("no-hot-reload", "don't rebuild shaders when their files change")
+        .addBooleanOption("shader-reload-test").setHelp("shader-reload-test", "headless, compare frame times while all shaders are rebuilt blocking and in the background")
+        .addOption("shader-reload-output", "shader_reload.json").setHelp("shader-reload-output", "shader reload test report, - for stdout", "PATH")
+        .addBooleanOption("benchmark").setHelp("benchmark", "render a fixed script offscreen without a display and write a JSON report")
+        .addOption("benchmark-frames", "500").setHelp("benchmark-frames", "recorded benchmark frames", "N")
+        .addOption("benchmark-warmup", "50").setHelp("benchmark-warmup", "frames rendered before recording starts", "N")
+        .addOption("benchmark-output", "benchmark.json").setHelp("benchmark-output", "benchmark report, - for stdout", "PATH")
+        .addOption("memory-report", "").setHelp("memory-report", "write CPU and GPU memory accounting at exit, - for stdout", "PATH")
+        .addBooleanOption("profile").setHelp("profile", "start with the frame profiler on, P toggles it in the window")
+        .addOption("profile-output", "profile.json").setHelp("profile-output", "Chrome trace of the profiled frames written at exit", "PATH")
+        .addOption("mesh", "").setHelp("mesh", "glTF or OBJ file to draw instead of the sphere", "PATH")
+        .addOption("mesh-cache", "data/mesh_cache").setHelp("mesh-cache", "directory for packed, ready to upload meshes", "DIR")
+        .addBooleanOption("no-mesh-cache").setHelp("no-mesh-cache", "always import and process the mesh")
+        .addBooleanOption("rebuild-mesh-cache").setHelp("rebuild-mesh-cache", "reimport the mesh and replace its cache entry")
+        .addBooleanOption("no-ibl").setHelp("no-ibl", "directional light and constant ambient instead of image-based lighting")
+        .addOption("environment", "data/environment.hdr").setHelp("environment", "equirectangular HDR environment, a procedural sky if missing", "PATH")
+        .addOption("ibl-cache", "data/ibl_cache").setHelp("ibl-cache", "directory for precomputed image-based lighting", "DIR")
+        .addBooleanOption("no-ibl-cache").setHelp("no-ibl-cache", "always precompute the image-based lighting")
+        .addBooleanOption("benchmark-ibl").setHelp("benchmark-ibl", "measure the IBL precompute over thread counts and exit")
+        .addBooleanOption("software-benchmark").setHelp("software-benchmark", "render the sphere with the CPU rasterizer over thread counts and exit")
+        .addBooleanOption("software-compare").setHelp("software-compare", "headless, compare every render mode of the CPU rasterizer against GL")
+        .addOption("software-frames", "60").setHelp("software-frames", "CPU rasterizer benchmark frames per thread count", "N")
+        .addOption("software-output", "software").setHelp("software-output", "directory for the render mode images of the CPU rasterizer", "DIR")
+        .addOption("software-min-psnr", "30").setHelp("software-min-psnr", "smallest PSNR against GL the comparison passes with", "DB")
+        .addOption("instances", "0").setHelp("instances", "draw a grid of N spheres, 0 for the single sphere", "N")
+        .addBooleanOption("no-instancing").setHelp("no-instancing", "draw the grid with one call per sphere")
+        .addBooleanOption("no-uniform-buffers").setHelp("no-uniform-buffers", "set shader state with glUniform*() instead of ring-buffered uniform blocks")
+        .addOption("vertex-format", "packed").setHelp("vertex-format", "sphere vertex layout, 48, 28 or 24 bytes", "float|packed|packed-positions")
+        .addBooleanOption("no-index-optimization").setHelp("no-index-optimization", "keep the generated sphere index order")
+        .addOption("displacement", "vertex").setHelp("displacement", "height map displacement per vertex, on tessellated patches or by parallax occlusion mapping", "vertex|tessellation|parallax")
+        .addOption("tessellation-pixels", "8").setHelp("tessellation-pixels", "target edge length of tessellated triangles", "PX")
+        .addOption("parallax-quality", "medium").setHelp("parallax-quality", "parallax occlusion mapping layer count tier", "low|medium|high")
+        .addBooleanOption("no-lod").setHelp("no-lod", "always draw the finest sphere tessellation")
+        .addBooleanOption("no-culling").setHelp("no-culling", "don't frustum cull instances")
+        .addBooleanOption("stress").setHelp("stress", "headless, find the instance count that fits the frame budget")
+        .addOption("frame-budget", "16.667").setHelp("frame-budget", "stress test budget for the median frame time, dynamic resolution budget for the GPU one", "MS")
+        .addOption("stress-output", "stress.json").setHelp("stress-output", "stress test report, - for stdout", "PATH")
+        .addOption("materials", "0").setHelp("materials", "give the grid spheres N materials from a table, 0 for the loaded maps alone", "N")
+        .addOption("texture-sets", "4").setHelp("texture-sets", "copies of the loaded maps the materials are spread over", "N")
+        .addOption("material-binding", "arrays").setHelp("material-binding", "how shaders reach material maps: texture arrays, bindless handles or textures rebound per set", "arrays|bindless|loose")
+        .addOption("lights", "0").setHelp("lights", "point and spot lights besides the directional one", "N")
+        .addOption("lighting", "clustered").setHelp("lighting", "how fragments find their lights", "clustered|naive")
+        .addBooleanOption("light-sweep").setHelp("light-sweep", "headless, measure frame time from 1 light up to --light-sweep-max")
+        .addOption("light-sweep-max", "4096").setHelp("light-sweep-max", "largest light count of the sweep", "N")
+        .addOption("light-sweep-output", "light_sweep.json").setHelp("light-sweep-output", "light sweep report, - for stdout", "PATH")
+        .addBooleanOption("turntable").setHelp("turntable", "headless, render every material, render mode and angle into an image sequence")
+        .addOption("turntable-angles", "36").setHelp("turntable-angles", "frames per turn", "N")
+        .addOption("turntable-modes", "0").setHelp("turntable-modes", "comma-separated render modes, 0 to 5", "LIST|all")
+        .addOption("turntable-materials", "default").setHelp("turntable-materials", "comma-separated material variations", "default,glossy,rough,dielectric|all")
+        .addOption("turntable-output", "turntable").setHelp("turntable-output", "image sequence directory", "DIR")
+        .addOption("turntable-format", "png").setHelp("turntable-format", "image format", "png|tga")
+        .addSkippedPrefix("magnum", "engine-specific options")
+        .setGlobalHelp("PBR material demo")
+        .parse(argc, argv);
+
+    DemoOptions options;
+    options.threads = args.value<std::size_t>("threads");
+    options.texture_cache = args.value("texture-cache");
+    options.use_texture_cache = !args.isSet("no-texture-cache");
+    options.bake_textures = args.isSet("bake-textures");
+    options.benchmark_compression = args.isSet("benchmark-compression");
+
+    const std::string compression = args.value("texture-compression");
+    if (compression == "none")
+    {
+        options.texture_compression.enabled = false;
+    }
+    else if (compression == "bc1")
+    {
+        options.texture_compression.color_format = BlockFormat::BC1;
+    }
+    else if (compression != "bc7")
+    {
+        invalid_value("texture-compression", compression);
+    }
+
+    const std::string quality = args.value("compression-quality");
+    if (quality == "fast")
+    {
+        options.texture_compression.quality = CompressionQuality::Fast;
+    }
+    else if (quality == "high")
+    {
+        options.texture_compression.quality = CompressionQuality::High;
+    }
+    else if (quality != "normal")
+    {
+        invalid_value("compression-quality", quality);
+    }
+
+    const std::string layout = args.value("material-layout");
+    if (layout == "packed")
+    {
+        options.material_layout = MaterialLayout::Packed;
+    }
+    else if (layout != "separate")
+    {
+        invalid_value("material-layout", layout);
+    }
+
+    options.texture_streaming = args.isSet("texture-streaming");
+    options.texture_budget_mib = args.value<double>("texture-budget");
+    if (options.texture_budget_mib <= 0.0)
+    {
+        invalid_value("texture-budget", args.value("texture-budget"));
+    }
+    options.texture_tail = args.value<Int>("texture-tail");
+    if (options.texture_tail <= 0)
+    {
+        invalid_value("texture-tail", args.value("texture-tail"));
+    }
+
+    options.ormh_texture = args.value("ormh-texture");
+    options.pack_ormh = args.isSet("pack-ormh");
+
+    const std::string resolution = args.value("resolution");
+    if (std::sscanf(resolution.c_str(), "%dx%d", &options.resolution.x(), &options.resolution.y()) != 2
+        || options.resolution.x() <= 0 || options.resolution.y() <= 0)
+    {
+        invalid_value("resolution", resolution);
+    }
+
+    options.post_process = !args.isSet("no-post-process");
+    const std::string antialiasing = args.value("antialiasing");
+    if (antialiasing == "none")
+    {
+        options.post_process_options.antialiasing = AntiAliasing::None;
+    }
+    else if (antialiasing == "taa")
+    {
+        options.post_process_options.antialiasing = AntiAliasing::Taa;
+    }
+    else if (antialiasing != "fxaa")
+    {
+        invalid_value("antialiasing", antialiasing);
+    }
+
+    options.post_process_options.msaa_samples = args.value<Int>("msaa");
+    if (options.post_process_options.msaa_samples < 1)
+    {
+        invalid_value("msaa", args.value("msaa"));
+    }
+    options.post_process_options.render_scale = args.value<float>("render-scale");
+    if (!(options.post_process_options.render_scale > 0.0f && options.post_process_options.render_scale <= 2.0f))
+    {
+        invalid_value("render-scale", args.value("render-scale"));
+    }
+    options.post_process_options.dynamic_resolution = args.isSet("dynamic-resolution");
+    options.aa_sweep = args.isSet("aa-sweep");
+    options.aa_sweep_output = args.value("aa-sweep-output");
+
+    options.shader_cache = args.value("shader-cache");
+    options.use_shader_cache = !args.isSet("no-shader-cache");
+    options.shader_directory = args.value("shader-directory");
+    options.hot_reload = !args.isSet("no-hot-reload");
+    options.shader_reload_test = args.isSet("shader-reload-test");
+    options.shader_reload_output = args.value("shader-reload-output");
+
+    const std::string shader_compile = args.value("shader-compile");
+    if (shader_compile == "parallel")
+    {
+        options.shader_compile = ShaderCompileMode::ParallelExtension;
+    }
+    else if (shader_compile == "thread")
+    {
+        options.shader_compile = ShaderCompileMode::WorkerThread;
+    }
+    else if (shader_compile == "sync")
+    {
+        options.shader_compile = ShaderCompileMode::Synchronous;
+    }
+    else if (shader_compile != "auto")
+    {
+        invalid_value("shader-compile", shader_compile);
+    }
+
+    options.benchmark = args.isSet("benchmark");
+    options.benchmark_frames = args.value<std::size_t>("benchmark-frames");
+    options.benchmark_warmup = args.value<std::size_t>("benchmark-warmup");
+    options.benchmark_output = args.value("benchmark-output");
+    options.memory_report = args.value("memory-report");
+    options.profile = args.isSet("profile");
+    options.profile_output = args.value("profile-output");
+
+    options.mesh = args.value("mesh");
+    options.mesh_cache = args.value("mesh-cache");
+    options.use_mesh_cache = !args.isSet("no-mesh-cache");
+    options.rebuild_mesh_cache = args.isSet("rebuild-mesh-cache");
+
+    options.ibl = !args.isSet("no-ibl");
+    options.environment = args.value("environment");
+    options.ibl_cache = args.value("ibl-cache");
+    options.use_ibl_cache = !args.isSet("no-ibl-cache");
+    options.benchmark_ibl = args.isSet("benchmark-ibl");
+
+    options.software_benchmark = args.isSet("software-benchmark");
+    options.software_compare = args.isSet("software-compare");
+    options.software_frames = args.value<std::size_t>("software-frames");
+    options.software_output = args.value("software-output");
+    options.software_min_psnr = args.value<double>("software-min-psnr");
+    if (options.software_frames == 0)
+    {
+        invalid_value("software-frames", args.value("software-frames"));
+    }
+
+    options.instances = args.value<std::size_t>("instances");
+    options.instancing = !args.isSet("no-instancing");
+    options.uniform_buffers = !args.isSet("no-uniform-buffers");
+    options.optimize_indices = !args.isSet("no-index-optimization");
+    options.lod = !args.isSet("no-lod");
+
+    const std::string vertex_format = args.value("vertex-format");
+    if (vertex_format == "float")
+    {
+        options.vertex_format = VertexFormat::Float;
+    }
+    else if (vertex_format == "packed-positions")
+    {
+        options.vertex_format = VertexFormat::PackedPositions;
+    }
+    else if (vertex_format != "packed")
+    {
+        invalid_value("vertex-format", vertex_format);
+    }
+    options.culling = !args.isSet("no-culling");
+    options.stress = args.isSet("stress");
+    options.frame_budget_ms = args.value<double>("frame-budget");
+    options.stress_output = args.value("stress-output");
+    if (options.frame_budget_ms <= 0.0)
+    {
+        invalid_value("frame-budget", args.value("frame-budget"));
+    }
+    options.post_process_options.frame_budget_ms = options.frame_budget_ms;
+
+    options.materials = args.value<std::size_t>("materials");
+    if (options.materials > 0xffff)
+    {
+        invalid_value("materials", args.value("materials"));
+    }
+    options.texture_sets = args.value<std::size_t>("texture-sets");
+    if (options.texture_sets == 0)
+    {
+        invalid_value("texture-sets", args.value("texture-sets"));
+    }
+    const std::string material_binding = args.value("material-binding");
+    if (material_binding == "bindless")
+    {
+        options.material_binding = MaterialBinding::Bindless;
+    }
+    else if (material_binding == "loose")
+    {
+        options.material_binding = MaterialBinding::Loose;
+    }
+    else if (material_binding != "arrays")
+    {
+        invalid_value("material-binding", material_binding);
+    }
+
+    const std::string displacement = args.value("displacement");
+    if (displacement == "tessellation")
+    {
+        options.displacement = DisplacementMode::Tessellation;
+    }
+    else if (displacement == "parallax")
+    {
+        options.displacement = DisplacementMode::Parallax;
+    }
+    else if (displacement != "vertex")
+    {
+        invalid_value("displacement", displacement);
+    }
+
+    if (options.materials != 0 && ((options.instances == 0 && !options.stress) || !options.instancing
+        || options.texture_streaming || options.displacement == DisplacementMode::Tessellation))
+    {
+        spdlog::error("--materials needs an instanced grid (--instances or --stress) without texture streaming or tessellation");
+        std::exit(1);
+    }
+
+    options.tessellation_pixels = args.value<float>("tessellation-pixels");
+    if (options.tessellation_pixels <= 0.0f)
+    {
+        invalid_value("tessellation-pixels", args.value("tessellation-pixels"));
+    }
+
+    const std::string parallax_quality = args.value("parallax-quality");
+    if (parallax_quality == "low")
+    {
+        options.parallax_quality = PBRShader::ParallaxQuality::Low;
+    }
+    else if (parallax_quality == "high")
+    {
+        options.parallax_quality = PBRShader::ParallaxQuality::High;
+    }
+    else if (parallax_quality != "medium")
+    {
+        invalid_value("parallax-quality", parallax_quality);
+    }
+
+    options.lights = args.value<std::size_t>("lights");
+    const std::string lighting = args.value("lighting");
+    if (lighting == "naive")
+    {
+        options.lighting = LightingMode::Naive;
+    }
+    else if (lighting != "clustered")
+    {
+        invalid_value("lighting", lighting);
+    }
+
+    options.light_sweep = args.isSet("light-sweep");
+    options.light_sweep_max = args.value<std::size_t>("light-sweep-max");
+    options.light_sweep_output = args.value("light-sweep-output");
+
+    options.turntable = args.isSet("turntable");
+    TurntableConfig& turntable = options.turntable_config;
+    turntable.angles = args.value<std::size_t>("turntable-angles");
+    if (turntable.angles == 0)
+    {
+        invalid_value("turntable-angles", args.value("turntable-angles"));
+    }
+
+    const std::string modes = args.value("turntable-modes");
+    turntable.render_modes.clear();
+    for (const std::string& mode : Utility::String::splitWithoutEmptyParts(modes, ','))
+    {
+        if (mode == "all")
+        {
+            for (int i = 0; i != PBRShader::RENDER_MODE_COUNT; ++i)
+            {
+                turntable.render_modes.push_back(i);
+            }
+            continue;
+        }
+
+        if (mode.size() != 1 || mode[0] < '0' || mode[0] >= '0' + PBRShader::RENDER_MODE_COUNT)
+        {
+            invalid_value("turntable-modes", modes);
+        }
+        turntable.render_modes.push_back(mode[0] - '0');
+    }
+    if (turntable.render_modes.empty())
+    {
+        invalid_value("turntable-modes", modes);
+    }
+
+    const std::string materials = args.value("turntable-materials");
+    turntable.materials.clear();
+    for (const std::string& name : Utility::String::splitWithoutEmptyParts(materials, ','))
+    {
+        const std::vector<TurntableMaterial>& presets = turntable_materials();
+        if (name == "all")
+        {
+            turntable.materials.insert(turntable.materials.end(), presets.begin(), presets.end());
+            continue;
+        }
+
+        const auto found = std::find_if(presets.begin(), presets.end(), [&](const TurntableMaterial& material)
+        {
+            return material.name == name;
+        });
+        if (found == presets.end())
+        {
+            invalid_value("turntable-materials", materials);
+        }
+        turntable.materials.push_back(*found);
+    }
+    if (turntable.materials.empty())
+    {
+        invalid_value("turntable-materials", materials);
+    }
+
+    turntable.output_directory = args.value("turntable-output");
+    turntable.format = args.value("turntable-format");
+    if (turntable.format != "png" && turntable.format != "tga")
+    {
+        invalid_value("turntable-format", turntable.format);
+    }
+    turntable.resolution = options.resolution;
+
+    return options;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector2.h>
+#include <string>
+#include "demo_scene.hpp"
+#include "material_packer.hpp"
+#include "post_process.hpp"
+#include "texture_cache.hpp"
+#include "turntable.hpp"
+
+struct DemoOptions
+{
+    std::size_t threads = 0; //0 -> hardware concurrency
+
+    std::string texture_cache = "data/textures.cache";
+    bool use_texture_cache = true;
+    bool bake_textures = false; //bake the cache and exit, no GL context needed
+    TextureCompression texture_compression;
+    bool benchmark_compression = false; //encoder throughput, no GL context needed
+    bool texture_streaming = false; //needs the texture cache
+    double texture_budget_mib = 32.0;
+    Int texture_tail = 128;
+
+    MaterialLayout material_layout = MaterialLayout::Separate;
+    std::string ormh_texture = "data/ormh.png";
+    bool pack_ormh = false; //repack the ORMH texture and exit
+
+    Vector2i resolution{ 1024, 1024 };
+    bool post_process = true; //otherwise straight into the window with 8x MSAA
+    PostProcessOptions post_process_options; //its frame budget is frame_budget_ms
+    bool aa_sweep = false; //headless, frame time and quality over the AA modes
+    std::string aa_sweep_output = "aa_sweep.json";
+
+    std::string shader_cache = "data/shader_cache"; //linked program binaries
+    bool use_shader_cache = true;
+    std::string shader_directory = "data/shaders"; //GLSL sources
+    Containers::Optional<ShaderCompileMode> shader_compile; //NullOpt picks the best one available
+    bool hot_reload = true; //the window rebuilds shaders when their files change
+    bool shader_reload_test = false; //headless, frame times while every shader is rebuilt over and over
+    std::string shader_reload_output = "shader_reload.json";
+
+    bool benchmark = false; //headless, scripted frames, JSON report
+    std::size_t benchmark_frames = 500;
+    std::size_t benchmark_warmup = 50;
+    std::string benchmark_output = "benchmark.json";
+
+    std::string memory_report; //JSON memory accounting written at exit, empty for none, "-" for stdout
+
+    bool profile = false; //frame profiler on from the start, P toggles it in the window
+    std::string profile_output = "profile.json"; //Chrome trace written at exit if anything was profiled
+
+    std::string mesh; //glTF or OBJ drawn instead of the single sphere, empty for the sphere
+    std::string mesh_cache = "data/mesh_cache"; //packed vertex and index buffers
+    bool use_mesh_cache = true;
+    bool rebuild_mesh_cache = false;
+
+    bool ibl = true; //image-based lighting, otherwise the directional light and a constant ambient
+    std::string environment = "data/environment.hdr"; //equirect HDR, a procedural sky if it's missing
+    std::string ibl_cache = "data/ibl_cache"; //precomputed SH, specular mips and BRDF LUT
+    bool use_ibl_cache = true;
+    bool benchmark_ibl = false; //precompute time over thread counts, no GL context needed
+
+    bool software_benchmark = false; //CPU rasterizer throughput over thread counts, no GL context needed
+    bool software_compare = false; //headless, PSNR of the CPU rasterizer against GL in every render mode
+    std::size_t software_frames = 60;
+    std::string software_output = "software"; //render mode images of both
+    double software_min_psnr = 30.0;
+
+    std::size_t instances = 0; //0 draws the single sphere, otherwise a grid
+    bool instancing = true;
+    bool lod = true;
+    bool culling = true;
+    bool uniform_buffers = true;
+    VertexFormat vertex_format = VertexFormat::Packed;
+    bool optimize_indices = true;
+    DisplacementMode displacement = DisplacementMode::Vertex;
+    float tessellation_pixels = 8.0f;
+    PBRShader::ParallaxQuality parallax_quality = PBRShader::ParallaxQuality::Medium;
+    bool stress = false; //headless, grow the instance count up to the frame budget
+    double frame_budget_ms = 1000.0 / 60.0;
+    std::string stress_output = "stress.json";
+
+    std::size_t materials = 0; //grid materials in a table, 0 for the loaded maps alone
+    std::size_t texture_sets = 4; //copies of the loaded maps the materials are spread over
+    MaterialBinding material_binding = MaterialBinding::Arrays;
+
+    std::size_t lights = 0; //point and spot lights besides the directional one
+    LightingMode lighting = LightingMode::Clustered;
+    bool light_sweep = false; //headless, frame time over the light count
+    std::size_t light_sweep_max = 4096;
+    std::string light_sweep_output = "light_sweep.json";
+
+    bool turntable = false; //headless, render an image sequence and exit
+    TurntableConfig turntable_config; //resolution and post process come from the options above
+};
+
+DemoOptions parse_options(int argc, char** argv);
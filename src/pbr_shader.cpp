@@ -0,0 +1,445 @@
+#include "pbr_shader.hpp"
+#include <Magnum/GL/Context.h>
+#include <Magnum/GL/Version.h>
+#include <Corrade/Utility/Assert.h>
+#include <Corrade/Utility/Directory.h>
+#include <spdlog/spdlog.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "hash.hpp"
+
+static_assert(sizeof(PBRShader::InstanceData) == 128, "InstanceData must match the std430 layout");
+static_assert(sizeof(PBRShader::FrameUniforms) == 208, "FrameUniforms must match the std140 layout");
+static_assert(sizeof(PBRShader::ObjectUniforms) == 144, "ObjectUniforms must match the std140 layout");
+static_assert(sizeof(PBRShader::Light) == 48, "Light must match the std430 layout");
+static_assert(sizeof(PBRShader::Material) == 80, "Material must match the std430 layout");
+static_assert(sizeof(PBRShader::EnvironmentUniforms) == 160, "EnvironmentUniforms must match the std140 layout");
+
+namespace
+{
+    //In PBRShaderSources order
+    const char* const SourceFiles[]{ "pbr_uniforms.glsl", "pbr.vert", "pbr.tesc", "pbr.tese", "pbr.frag" };
+
+    std::uint64_t hash_string(const std::string& value, std::uint64_t hash)
+    {
+        return fnv1a64(value.data(), value.size(), hash);
+    }
+}
+
+std::vector<std::string> pbr_shader_files(const std::string& directory)
+{
+    std::vector<std::string> files;
+    for (const char* file : SourceFiles)
+    {
+        files.push_back(Utility::Directory::join(directory, file));
+    }
+    return files;
+}
+
+Containers::Optional<PBRShaderSources> load_pbr_shader_sources(const std::string& directory)
+{
+    PBRShaderSources sources;
+    std::string* const members[]{ &sources.uniforms, &sources.vertex, &sources.tessellation_control,
+        &sources.tessellation_evaluation, &sources.fragment };
+
+    const std::vector<std::string> files = pbr_shader_files(directory);
+    sources.hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i != files.size(); ++i)
+    {
+        if (!Utility::Directory::exists(files[i]))
+        {
+            spdlog::error("Can't read {}", files[i]);
+            return Containers::NullOpt;
+        }
+
+        *members[i] = Utility::Directory::readString(files[i]);
+        sources.hash = hash_string(*members[i], sources.hash);
+    }
+    return sources;
+}
+
+PBRShader::PBRShader(Flags flags, int render_mode, ParallaxQuality parallax_quality, const PBRShaderSources& sources,
+    ShaderCompiler& compiler, const ProgramBinaryCache* binary_cache):
+    shader_flags{ flags },
+    mode{ render_mode },
+    compile_mode{ compiler.mode() }
+{
+    MAGNUM_ASSERT_GL_VERSION_SUPPORTED(GL::Version::GL450);
+    CORRADE_ASSERT(render_mode >= 0 && render_mode < RENDER_MODE_COUNT, "PBRShader: render mode out of range", );
+    CORRADE_ASSERT(!(flags & Flag::PointLights) || !(flags & Flag::ClusteredLights),
+        "PBRShader: Flag::PointLights and Flag::ClusteredLights are exclusive", );
+    CORRADE_ASSERT(!(flags & Flag::PackedPositions) || (flags & Flag::PackedVertices),
+        "PBRShader: Flag::PackedPositions needs Flag::PackedVertices", );
+    CORRADE_ASSERT(!(flags & Flag::Tessellated) || !(flags & Flag::ParallaxOcclusion),
+        "PBRShader: Flag::Tessellated and Flag::ParallaxOcclusion are exclusive", );
+    CORRADE_ASSERT(!(flags & Flag::MaterialTable) || ((flags & Flag::Instanced) && !(flags & Flag::Tessellated)),
+        "PBRShader: Flag::MaterialTable needs Flag::Instanced and no Flag::Tessellated", );
+    CORRADE_ASSERT(!(flags & (Flag::TextureArrays | Flag::BindlessTextures)) || (flags & Flag::MaterialTable),
+        "PBRShader: Flag::TextureArrays and Flag::BindlessTextures need Flag::MaterialTable", );
+    CORRADE_ASSERT(!(flags & Flag::TextureArrays) || !(flags & Flag::BindlessTextures),
+        "PBRShader: Flag::TextureArrays and Flag::BindlessTextures are exclusive", );
+
+    const auto start = std::chrono::steady_clock::now();
+
+    //Extension directives have to come before anything else
+    std::string defines = flags & Flag::BindlessTextures ? "#extension GL_ARB_bindless_texture : require\n" : "";
+    defines += "#define RENDER_MODE " + std::to_string(render_mode) + "\n";
+    if (flags & Flag::PackedMaterial)
+    {
+        defines += "#define PACKED_MATERIAL\n";
+    }
+    if (flags & Flag::Instanced)
+    {
+        defines += "#define INSTANCED\n";
+    }
+    if (flags & Flag::UniformBuffers)
+    {
+        defines += "#define UNIFORM_BUFFERS\n";
+    }
+    if (flags & Flag::PackedVertices)
+    {
+        defines += "#define PACKED_VERTICES\n";
+    }
+    if (flags & Flag::PackedPositions)
+    {
+        defines += "#define PACKED_POSITIONS\n";
+    }
+    if (flags & Flag::PointLights)
+    {
+        defines += "#define POINT_LIGHTS\n";
+    }
+    if (flags & Flag::ClusteredLights)
+    {
+        defines += "#define CLUSTERED_LIGHTS\n";
+    }
+    if (flags & Flag::Tessellated)
+    {
+        defines += "#define TESSELLATED\n";
+    }
+    if (flags & Flag::ParallaxOcclusion)
+    {
+        //Min and max layers, secant refinement
+        const int tiers[][3]{ { 4, 8, 0 }, { 8, 16, 1 }, { 16, 48, 1 } };
+        const int* const tier = tiers[int(parallax_quality)];
+        defines += "#define PARALLAX_OCCLUSION\n";
+        defines += "#define PARALLAX_SCALE 0.04\n";
+        defines += "#define PARALLAX_MIN_STEPS " + std::to_string(tier[0]) + "\n";
+        defines += "#define PARALLAX_MAX_STEPS " + std::to_string(tier[1]) + "\n";
+        defines += "#define PARALLAX_REFINE " + std::to_string(tier[2]) + "\n";
+    }
+    if (flags & Flag::ImageBasedLighting)
+    {
+        defines += "#define IMAGE_BASED_LIGHTING\n";
+    }
+    if (flags & Flag::MaterialTable)
+    {
+        defines += "#define MATERIAL_TABLE\n";
+    }
+    if (flags & Flag::TextureArrays)
+    {
+        defines += "#define TEXTURE_ARRAYS\n";
+    }
+    if (flags & Flag::BindlessTextures)
+    {
+        defines += "#define BINDLESS_TEXTURES\n";
+    }
+
+    //Takes effect with the link
+    bindAttributeLocation(Position::Location, "position");
+    bindAttributeLocation(TextureCoord::Location, "tex_coord");
+    bindAttributeLocation(Normal::Location, "normal");
+    bindAttributeLocation(Tangent4::Location, "tangent4");
+    bindAttributeLocation(Bitangent::Location, "bitangent");
+
+    //Everything that ends up in any stage
+    const std::uint64_t source_hash = hash_string(defines, sources.hash);
+
+    const bool use_binary_cache = binary_cache && binary_cache->enabled();
+    binary_key = use_binary_cache ? binary_cache->key(source_hash) : 0;
+    if (use_binary_cache && binary_cache->load(id(), binary_key))
+    {
+        spdlog::info("PBRShader (flags {:#x}, render mode {}) loaded from the binary cache in {:.2f} ms",
+            UnsignedShort(flags), render_mode, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        from_binary_cache = true;
+        finish_build();
+        return;
+    }
+
+    if (use_binary_cache)
+    {
+        binary_cache->prepare(id());
+        this->binary_cache = binary_cache;
+    }
+
+    //Every file restarts the line numbers and gets its own source string
+    //number, see SourceFiles
+    const auto stage = [&](GLenum type, const std::string& source, int file)
+    {
+        return ShaderStageSource{ type, { "#version 450\n", defines, "#line 1 1\n", sources.uniforms,
+            "#line 1 " + std::to_string(file + 1) + "\n", source } };
+    };
+
+    std::vector<ShaderStageSource> stages;
+    stages.push_back(stage(GL_VERTEX_SHADER, sources.vertex, 1));
+    if (flags & Flag::Tessellated)
+    {
+        stages.push_back(stage(GL_TESS_CONTROL_SHADER, sources.tessellation_control, 2));
+        stages.push_back(stage(GL_TESS_EVALUATION_SHADER, sources.tessellation_evaluation, 3));
+    }
+    stages.push_back(stage(GL_FRAGMENT_SHADER, sources.fragment, 4));
+
+    build = compiler.submit(id(), std::move(stages));
+    poll();
+}
+
+PBRShader::Status PBRShader::poll()
+{
+    if (build && build->poll())
+    {
+        finish_build();
+    }
+    return build_status;
+}
+
+PBRShader::Status PBRShader::wait()
+{
+    if (build)
+    {
+        build->wait();
+        finish_build();
+    }
+    return build_status;
+}
+
+void PBRShader::finish_build()
+{
+    if (build)
+    {
+        result = build->result();
+        if (!result.linked)
+        {
+            spdlog::error("PBRShader (flags {:#x}, render mode {}) failed to build, source strings are 0 defines, 1 {}, 2 {}, 3 {}, 4 {}, 5 {}:\n{}",
+                UnsignedShort(shader_flags), mode, SourceFiles[0], SourceFiles[1], SourceFiles[2], SourceFiles[3], SourceFiles[4], result.log);
+            build_status = Status::Failed;
+            build = nullptr;
+            return;
+        }
+
+        auto [status, message] = validate();
+
+        if (!status)
+        {
+            spdlog::error("Unable to compile PBRShader");
+        }
+
+        if (!message.empty())
+        {
+            if (status)
+            {
+                spdlog::info(message);
+            }
+            else
+            {
+                spdlog::error(message);
+            }
+        }
+
+        if (binary_cache)
+        {
+            binary_cache->store(id(), binary_key);
+        }
+
+        spdlog::info("PBRShader (flags {:#x}, render mode {}) compiled in {:.2f} ms and linked in {:.2f} ms, {}",
+            UnsignedShort(shader_flags), mode, result.compile_ms, result.link_ms, shader_compile_mode_name(compile_mode));
+        build = nullptr;
+    }
+
+    build_status = Status::Ready;
+    const Flags flags = shader_flags;
+
+    if (!(flags & Flag::UniformBuffers))
+    {
+        model_matrix_uniform = find_uniform("model_matrix");
+        view_matrix_uniform = find_uniform("view_matrix");
+        proj_matrix_uniform = find_uniform("proj_matrix");
+        normal_matrix_uniform = find_uniform("normal_matrix");
+
+        light_direction_uniform = find_uniform("light_direction");
+        light_color_uniform = find_uniform("light_color");
+
+        albedo_factor_uniform = find_uniform("albedo_factor");
+        roughness_factor_uniform = find_uniform("roughness_factor");
+        metallic_factor_uniform = find_uniform("metallic_factor");
+        normal_factor_uniform = find_uniform("normal_factor");
+        ao_factor_uniform = find_uniform("ao_factor");
+        height_factor_uniform = find_uniform("height_factor");
+        position_scale_uniform = find_uniform("position_scale");
+
+        if (flags & Flag::Instanced)
+        {
+            instance_offset_uniform = find_uniform("instance_offset");
+        }
+
+        light_count_uniform = find_uniform("light_count");
+        cluster_grid_uniform = find_uniform("cluster_grid");
+        cluster_params_uniform = find_uniform("cluster_params");
+        viewport_size_uniform = find_uniform("viewport_size");
+        tessellation_pixels_uniform = find_uniform("tessellation_pixels");
+    }
+
+    static_assert(Int(MaterialMap::Height) == HeightUnit && Int(MaterialMap::ORMH) == ORMHUnit,
+        "MaterialMap has to match the texture units");
+    if (!(flags & Flag::BindlessTextures))
+    {
+        setUniform(find_uniform("albedo_texture"), AlbedoUnit);
+        setUniform(find_uniform("normal_texture"), NormalUnit);
+        if (flags & Flag::PackedMaterial)
+        {
+            setUniform(find_uniform("ormh_texture"), ORMHUnit);
+        }
+        else
+        {
+            setUniform(find_uniform("roughness_texture"), RoughnessUnit);
+            setUniform(find_uniform("metallic_texture"), MetallicUnit);
+            setUniform(find_uniform("ao_texture"), AOUnit);
+            setUniform(find_uniform("height_texture"), HeightUnit);
+        }
+    }
+    if (flags & Flag::ImageBasedLighting)
+    {
+        setUniform(find_uniform("specular_environment"), SpecularEnvironmentUnit);
+        setUniform(find_uniform("brdf_lut"), BrdfLutUnit);
+    }
+}
+
+PBRShader& PBRShader::bind_roughness_texture(GL::Texture2D& tex)
+{
+    CORRADE_ASSERT(!(shader_flags & Flag::PackedMaterial), "PBRShader: roughness is packed into the ORMH texture", *this);
+    tex.bind(RoughnessUnit);
+    return *this;
+}
+
+PBRShader& PBRShader::bind_metallic_texture(GL::Texture2D& tex)
+{
+    CORRADE_ASSERT(!(shader_flags & Flag::PackedMaterial), "PBRShader: metallic is packed into the ORMH texture", *this);
+    tex.bind(MetallicUnit);
+    return *this;
+}
+
+PBRShader& PBRShader::bind_ao_texture(GL::Texture2D& tex)
+{
+    CORRADE_ASSERT(!(shader_flags & Flag::PackedMaterial), "PBRShader: ao is packed into the ORMH texture", *this);
+    tex.bind(AOUnit);
+    return *this;
+}
+
+PBRShader& PBRShader::bind_height_texture(GL::Texture2D& tex)
+{
+    CORRADE_ASSERT(!(shader_flags & Flag::PackedMaterial), "PBRShader: height is packed into the ORMH texture", *this);
+    tex.bind(HeightUnit);
+    return *this;
+}
+
+PBRShader& PBRShader::bind_ormh_texture(GL::Texture2D& tex)
+{
+    CORRADE_ASSERT(shader_flags & Flag::PackedMaterial, "PBRShader: ORMH texture needs Flag::PackedMaterial", *this);
+    tex.bind(ORMHUnit);
+    return *this;
+}
+
+PBRShader& PBRShader::bind_instance_buffer(GL::Buffer& buffer)
+{
+    CORRADE_ASSERT(shader_flags & Flag::Instanced, "PBRShader: instance buffer needs Flag::Instanced", *this);
+    bind_buffer(GL::Buffer::Target::ShaderStorage, InstanceBufferBinding, buffer);
+    return *this;
+}
+
+PBRShader& PBRShader::bind_instance_index_buffer(GL::Buffer& buffer, std::size_t offset, std::size_t size)
+{
+    CORRADE_ASSERT(shader_flags & Flag::Instanced, "PBRShader: instance index buffer needs Flag::Instanced", *this);
+    bind_buffer(GL::Buffer::Target::ShaderStorage, InstanceIndexBufferBinding, buffer, offset, size);
+    return *this;
+}
+
+PBRShader& PBRShader::set_instance_offset(UnsignedInt offset)
+{
+    CORRADE_ASSERT(shader_flags & Flag::Instanced, "PBRShader: instance offset needs Flag::Instanced", *this);
+    setUniform(instance_offset_uniform, offset);
+    return *this;
+}
+
+PBRShader& PBRShader::bind_material_buffer(GL::Buffer& buffer)
+{
+    CORRADE_ASSERT(shader_flags & Flag::MaterialTable, "PBRShader: material buffer needs Flag::MaterialTable", *this);
+    bind_buffer(GL::Buffer::Target::ShaderStorage, MaterialBufferBinding, buffer);
+    return *this;
+}
+
+PBRShader& PBRShader::bind_material_array(MaterialMap map, GL::Texture2DArray& array)
+{
+    CORRADE_ASSERT(shader_flags & Flag::TextureArrays, "PBRShader: material arrays need Flag::TextureArrays", *this);
+    array.bind(Int(map));
+    return *this;
+}
+
+PBRShader& PBRShader::bind_environment(GL::CubeMapTexture& specular, GL::Texture2D& brdf_lut, GL::Buffer& uniforms)
+{
+    CORRADE_ASSERT(shader_flags & Flag::ImageBasedLighting, "PBRShader: environment needs Flag::ImageBasedLighting", *this);
+    specular.bind(SpecularEnvironmentUnit);
+    brdf_lut.bind(BrdfLutUnit);
+    bind_buffer(GL::Buffer::Target::Uniform, EnvironmentUniformBinding, uniforms, 0, sizeof(EnvironmentUniforms));
+    return *this;
+}
+
+PBRShader& PBRShader::bind_frame_uniforms(GL::Buffer& buffer, std::size_t offset)
+{
+    CORRADE_ASSERT(shader_flags & Flag::UniformBuffers, "PBRShader: frame uniform block needs Flag::UniformBuffers", *this);
+    bind_buffer(GL::Buffer::Target::Uniform, FrameUniformBinding, buffer, offset, sizeof(FrameUniforms));
+    return *this;
+}
+
+PBRShader& PBRShader::bind_object_uniforms(GL::Buffer& buffer, std::size_t offset)
+{
+    CORRADE_ASSERT(shader_flags & Flag::UniformBuffers, "PBRShader: object uniform block needs Flag::UniformBuffers", *this);
+    bind_buffer(GL::Buffer::Target::Uniform, ObjectUniformBinding, buffer, offset, sizeof(ObjectUniforms));
+    return *this;
+}
+
+PBRShader& PBRShader::bind_light_buffer(GL::Buffer& buffer)
+{
+    CORRADE_ASSERT(shader_flags & (Flag::PointLights | Flag::ClusteredLights), "PBRShader: light buffer needs Flag::PointLights or Flag::ClusteredLights", *this);
+    bind_buffer(GL::Buffer::Target::ShaderStorage, LightBufferBinding, buffer);
+    return *this;
+}
+
+PBRShader& PBRShader::bind_cluster_buffers(GL::Buffer& ranges, GL::Buffer& indices)
+{
+    CORRADE_ASSERT(shader_flags & Flag::ClusteredLights, "PBRShader: cluster buffers need Flag::ClusteredLights", *this);
+    bind_buffer(GL::Buffer::Target::ShaderStorage, ClusterRangeBufferBinding, ranges);
+    bind_buffer(GL::Buffer::Target::ShaderStorage, LightIndexBufferBinding, indices);
+    return *this;
+}
+
+Int PBRShader::find_uniform(const char* name)
+{
+    //Permutations compile unused uniforms out, uniformLocation() would warn
+    //about each of them
+    return glGetUniformLocation(id(), name);
+}
+
+void PBRShader::bind_buffer(GL::Buffer::Target target, UnsignedInt index, GL::Buffer& buffer, std::size_t offset, std::size_t size)
+{
+    if (state_cache)
+    {
+        state_cache->bind_buffer(target, index, buffer, offset, size);
+    }
+    else if (size == 0)
+    {
+        buffer.bind(target, index);
+    }
+    else
+    {
+        buffer.bind(target, index, GLintptr(offset), GLsizeiptr(size));
+    }
+}
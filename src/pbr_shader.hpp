@@ -0,0 +1,469 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/AbstractShaderProgram.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/CubeMapTexture.h>
+#include <Magnum/GL/Texture.h>
+#include <Magnum/GL/TextureArray.h>
+#include <Magnum/Math/Matrix3.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/Math/Vector3.h>
+#include <Magnum/Math/Vector4.h>
+#include <Magnum/Shaders/Generic.h>
+#include <Corrade/Containers/EnumSet.h>
+#include <Corrade/Containers/Optional.h>
+#include <Corrade/Containers/Pointer.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "gl_state_cache.hpp"
+#include "program_cache.hpp"
+#include "shader_compiler.hpp"
+
+using namespace Magnum;
+
+//PBRShader's GLSL, a file per stage plus the declarations every stage
+//starts with
+struct PBRShaderSources
+{
+    std::string uniforms;
+    std::string vertex;
+    std::string tessellation_control;
+    std::string tessellation_evaluation;
+    std::string fragment;
+    std::uint64_t hash = 0; //of all of the above
+};
+
+//The files of PBRShaderSources in member order: pbr_uniforms.glsl,
+//pbr.vert, pbr.tesc, pbr.tese and pbr.frag
+std::vector<std::string> pbr_shader_files(const std::string& directory);
+
+Containers::Optional<PBRShaderSources> load_pbr_shader_sources(const std::string& directory);
+
+class PBRShader: public GL::AbstractShaderProgram
+{
+public:
+    typedef Shaders::Generic3D::Position Position; //0
+    typedef Shaders::Generic3D::TextureCoordinates TextureCoord; //1
+    typedef Shaders::Generic3D::Tangent4 Tangent4; //3
+    typedef Shaders::Generic3D::Bitangent Bitangent; //4
+    typedef Shaders::Generic3D::Normal Normal; //5
+
+    //Flag::PackedVertices inputs, the tangent stays Tangent4 with snorm16
+    //components: octahedral xy and the bitangent sign
+    typedef GL::Attribute<Position::Location, Vector4> PackedPosition; //snorm16, Flag::PackedPositions
+    typedef GL::Attribute<Normal::Location, Vector2> OctahedralNormal; //snorm16
+
+    enum class Flag : UnsignedShort
+    {
+        //ao/roughness/metallic/height packed into one RGBA texture (ORMH)
+        PackedMaterial = 1 << 0,
+        //model/normal matrices and material factors come from an InstanceData
+        //storage buffer, combined with the uniforms. Instance gl_InstanceID
+        //of a draw reads entry instance_indices[instance_offset + gl_InstanceID]
+        //so culled and LOD-sorted subsets need no copy of the data itself.
+        Instanced = 1 << 1,
+        //per-frame and per-object state comes from the FrameUniforms and
+        //ObjectUniforms std140 blocks instead of individual uniforms, the
+        //set_*() uniform setters do nothing in this variant
+        UniformBuffers = 1 << 2,
+        //every fragment adds up all light_count lights of the light buffer
+        PointLights = 1 << 3,
+        //every fragment adds up the lights of its cluster only, the lists
+        //come from LightClusters
+        ClusteredLights = 1 << 4,
+        //unorm16 UVs and octahedral snorm16 normals and tangents, see
+        //pack_mesh()
+        PackedVertices = 1 << 5,
+        //snorm16 positions scaled by position_scale, needs PackedVertices
+        PackedPositions = 1 << 6,
+        //draws patches of a coarse mesh, subdivided by the projected edge
+        //length, inside scaled by the height variation, and displaced in
+        //the evaluation stage
+        Tessellated = 1 << 7,
+        //no geometric displacement, the fragment shader ray marches the
+        //height map in tangent space
+        ParallaxOcclusion = 1 << 8,
+        //Cook-Torrance GGX shading lit by the environment: SH irradiance for
+        //the diffuse part, a prefiltered cube map and the split-sum BRDF LUT
+        //for the specular part, see precompute_ibl()
+        ImageBasedLighting = 1 << 9,
+        //InstanceData::factors.w picks an entry of the Material storage
+        //buffer, whose tint and factors combine with the instance's. Needs
+        //Instanced, not with Tessellated.
+        MaterialTable = 1 << 10,
+        //material maps are Texture2DArrays, the layer is the material's
+        //texture set. Needs MaterialTable.
+        TextureArrays = 1 << 11,
+        //material maps are ARB_bindless_texture handles from the material
+        //table, nothing is bound. A handle has to be the same for the whole
+        //draw. Needs MaterialTable.
+        BindlessTextures = 1 << 12
+    };
+
+    //Material maps in texture unit order, also the order of
+    //Material::handles
+    enum class MaterialMap : UnsignedInt
+    {
+        Albedo,
+        Normal,
+        Roughness,
+        Metallic,
+        AO,
+        Height,
+        ORMH = Roughness //Flag::PackedMaterial
+    };
+
+    static constexpr std::size_t MaterialMapCount = 6;
+
+    //Flag::ParallaxOcclusion layer counts: 4-8, 8-16 and 16-48 layers, the
+    //latter two with a secant refinement step
+    enum class ParallaxQuality : UnsignedByte
+    {
+        Low,
+        Medium,
+        High
+    };
+
+    //std430 layout of one entry in the instance storage buffer
+    struct InstanceData
+    {
+        Matrix4 model_matrix;
+        Vector4 normal_matrix[3]; //mat3 columns padded to vec4
+        Vector4 factors; //albedo, roughness, metallic, material index as a float with Flag::MaterialTable
+    };
+
+    //std430 layout of one entry in the material table
+    struct Material
+    {
+        Vector4 albedo_tint; //rgb, w unused
+        Float roughness_factor;
+        Float metallic_factor;
+        Float height_factor;
+        UnsignedInt texture_set; //Flag::TextureArrays layer
+        Vector2ui handles[MaterialMapCount]; //Flag::BindlessTextures
+    };
+
+    //std430 layout of one point or spot light, in view space
+    struct Light
+    {
+        Vector4 position_range; //no contribution beyond the range
+        Vector4 color; //rgb times intensity, w cos of the spot inner angle
+        Vector4 direction; //spot axis, w cos of the outer angle, -2 for point lights
+    };
+
+    //std140 layout of the FrameUniforms block
+    struct FrameUniforms
+    {
+        Matrix4 view_matrix;
+        Matrix4 proj_matrix;
+        Vector3 light_direction;
+        Float direction_padding;
+        Vector3 light_color;
+        UnsignedInt light_count; //Flag::PointLights
+        Vector4ui cluster_grid; //Flag::ClusteredLights, clusters along x, y, z
+        Vector4 cluster_params; //1 / tile size in pixels, depth slice scale and bias
+        Vector2 viewport_size; //Flag::Tessellated
+        Float tessellation_pixels; //target edge length
+        Float padding;
+    };
+
+    //std140 layout of the ObjectUniforms block
+    struct ObjectUniforms
+    {
+        Matrix4 model_matrix;
+        Vector4 normal_matrix[3]; //mat3 columns padded to vec4
+        Float albedo_factor;
+        Float roughness_factor;
+        Float metallic_factor;
+        Float normal_factor;
+        Float ao_factor;
+        Float height_factor;
+        UnsignedInt instance_offset;
+        Float position_scale; //Flag::PackedPositions
+    };
+
+    //std140 layout of the EnvironmentUniforms block, Flag::ImageBasedLighting
+    struct EnvironmentUniforms
+    {
+        Vector4 sh_irradiance[9]; //rgb, see IblData
+        Float specular_max_lod; //roughness 1
+        Float intensity;
+        Float padding[2];
+    };
+
+    enum : UnsignedInt
+    {
+        //Shader storage
+        InstanceBufferBinding = 0,
+        InstanceIndexBufferBinding = 1,
+        LightBufferBinding = 2,
+        ClusterRangeBufferBinding = 3,
+        LightIndexBufferBinding = 4,
+        ClusterBoundsBufferBinding = 5, //light culling only
+        MaterialBufferBinding = 6,
+        //Uniform
+        FrameUniformBinding = 0,
+        ObjectUniformBinding = 1,
+        EnvironmentUniformBinding = 2
+    };
+
+    typedef Containers::EnumSet<Flag> Flags;
+
+    enum class Status
+    {
+        Building,
+        Ready,
+        Failed //the compiler or linker output is logged
+    };
+
+    //Each flag combination and render mode is its own program with the
+    //unused paths compiled out. With a binary cache the linked program is
+    //loaded from disk when the driver and the sources haven't changed,
+    //otherwise the compiler builds it in the background. No uniforms and no
+    //draws until it's Ready.
+    explicit PBRShader(Flags flags, int render_mode, ParallaxQuality parallax_quality, const PBRShaderSources& sources,
+        ShaderCompiler& compiler, const ProgramBinaryCache* binary_cache = nullptr);
+
+    Status status() const
+    {
+        return build_status;
+    }
+
+    //Never blocks
+    Status poll();
+
+    //Blocks until the build is done
+    Status wait();
+
+    bool loaded_from_binary_cache() const
+    {
+        return from_binary_cache;
+    }
+
+    //Latencies and errors of the build from source
+    const ProgramBuildResult& build_result() const
+    {
+        return result;
+    }
+
+    Flags flags() const
+    {
+        return shader_flags;
+    }
+
+    int render_mode() const
+    {
+        return mode;
+    }
+
+    PBRShader& set_model_matrix(const Matrix4& mtx)
+    {
+        setUniform(model_matrix_uniform, mtx);
+        return *this;
+    }
+
+    PBRShader& set_view_matrix(const Matrix4& mtx)
+    {
+        setUniform(view_matrix_uniform, mtx);
+        return *this;
+    }
+
+    PBRShader& set_proj_matrix(const Matrix4& mtx)
+    {
+        setUniform(proj_matrix_uniform, mtx);
+        return *this;
+    }
+
+    PBRShader& set_normal_matrix(const Matrix3x3& mtx)
+    {
+        setUniform(normal_matrix_uniform, mtx);
+        return *this;
+    }
+
+    PBRShader& set_light_direction(const Vector3& dir)
+    {
+        setUniform(light_direction_uniform, dir);
+        return *this;
+    }
+
+    PBRShader& set_light_color(const Vector3& color)
+    {
+        setUniform(light_color_uniform, color);
+        return *this;
+    }
+
+    PBRShader& set_position_scale(float scale)
+    {
+        setUniform(position_scale_uniform, scale);
+        return *this;
+    }
+
+    PBRShader& set_tessellation(const Vector2& viewport_size, float target_edge_pixels)
+    {
+        setUniform(viewport_size_uniform, viewport_size);
+        setUniform(tessellation_pixels_uniform, target_edge_pixels);
+        return *this;
+    }
+
+    PBRShader& set_light_count(UnsignedInt count)
+    {
+        setUniform(light_count_uniform, count);
+        return *this;
+    }
+
+    PBRShader& set_cluster_grid(const Vector4ui& grid, const Vector4& params)
+    {
+        setUniform(cluster_grid_uniform, grid);
+        setUniform(cluster_params_uniform, params);
+        return *this;
+    }
+
+    PBRShader& set_albedo_factor(float factor)
+    {
+        setUniform(albedo_factor_uniform, factor);
+        return *this;
+    }
+
+    PBRShader& set_roughness_factor(float factor)
+    {
+        setUniform(roughness_factor_uniform, factor);
+        return *this;
+    }
+
+    PBRShader& set_metallic_factor(float factor)
+    {
+        setUniform(metallic_factor_uniform, factor);
+        return *this;
+    }
+
+    PBRShader& set_normal_factor(float factor)
+    {
+        setUniform(normal_factor_uniform, factor);
+        return *this;
+    }
+
+    PBRShader& set_ao_factor(float factor)
+    {
+        setUniform(ao_factor_uniform, factor);
+        return *this;
+    }
+
+    PBRShader& set_height_factor(float factor)
+    {
+        setUniform(height_factor_uniform, factor);
+        return *this;
+    }
+
+    //Uniform and storage buffer binds go through the cache if there is one
+    PBRShader& set_state_cache(GLStateCache* cache)
+    {
+        state_cache = cache;
+        return *this;
+    }
+
+    PBRShader& bind_albedo_texture(GL::Texture2D& tex)
+    {
+        tex.bind(AlbedoUnit);
+        return *this;
+    }
+
+    PBRShader& bind_normal_texture(GL::Texture2D& tex)
+    {
+        tex.bind(NormalUnit);
+        return *this;
+    }
+
+    //Separate layout only
+    PBRShader& bind_roughness_texture(GL::Texture2D& tex);
+    PBRShader& bind_metallic_texture(GL::Texture2D& tex);
+    PBRShader& bind_ao_texture(GL::Texture2D& tex);
+    PBRShader& bind_height_texture(GL::Texture2D& tex);
+
+    //Flag::PackedMaterial only
+    PBRShader& bind_ormh_texture(GL::Texture2D& tex);
+
+    //Flag::Instanced only
+    PBRShader& bind_instance_buffer(GL::Buffer& buffer);
+    PBRShader& bind_instance_index_buffer(GL::Buffer& buffer, std::size_t offset = 0, std::size_t size = 0);
+    PBRShader& set_instance_offset(UnsignedInt offset);
+
+    //Flag::MaterialTable only, an array of Material
+    PBRShader& bind_material_buffer(GL::Buffer& buffer);
+
+    //Flag::TextureArrays only, replaces the bind_*_texture() calls above
+    PBRShader& bind_material_array(MaterialMap map, GL::Texture2DArray& array);
+
+    //Flag::PointLights or Flag::ClusteredLights
+    PBRShader& bind_light_buffer(GL::Buffer& buffer);
+
+    //Flag::ClusteredLights only
+    PBRShader& bind_cluster_buffers(GL::Buffer& ranges, GL::Buffer& indices);
+
+    //Flag::ImageBasedLighting only, the buffer holds one EnvironmentUniforms
+    PBRShader& bind_environment(GL::CubeMapTexture& specular, GL::Texture2D& brdf_lut, GL::Buffer& uniforms);
+
+    //Flag::UniformBuffers only, ranges of one FrameUniforms/ObjectUniforms
+    PBRShader& bind_frame_uniforms(GL::Buffer& buffer, std::size_t offset);
+    PBRShader& bind_object_uniforms(GL::Buffer& buffer, std::size_t offset);
+
+    static const int RENDER_MODE_COUNT = 6;
+private:
+    void finish_build();
+    Int find_uniform(const char* name);
+    void bind_buffer(GL::Buffer::Target target, UnsignedInt index, GL::Buffer& buffer, std::size_t offset = 0, std::size_t size = 0);
+
+    enum : Int //0..n
+    {
+        AlbedoUnit,
+        NormalUnit,
+        //Separate layout
+        RoughnessUnit,
+        MetallicUnit,
+        AOUnit,
+        HeightUnit,
+        //Flag::ImageBasedLighting
+        SpecularEnvironmentUnit,
+        BrdfLutUnit,
+        //Packed layout reuses the first unit after the common ones
+        ORMHUnit = RoughnessUnit
+    };
+
+    Flags shader_flags;
+    int mode;
+    GLStateCache* state_cache = nullptr;
+
+    Status build_status = Status::Building;
+    Containers::Pointer<ProgramBuild> build;
+    ProgramBuildResult result;
+    bool from_binary_cache = false;
+    ShaderCompileMode compile_mode;
+    const ProgramBinaryCache* binary_cache = nullptr; //stores the program once linked
+    std::uint64_t binary_key = 0;
+
+    Int model_matrix_uniform = -1,
+        view_matrix_uniform = -1,
+        proj_matrix_uniform = -1,
+        normal_matrix_uniform = -1;
+
+    Int instance_offset_uniform = -1;
+
+    Int light_direction_uniform = -1,
+        light_color_uniform = -1,
+        light_count_uniform = -1,
+        cluster_grid_uniform = -1,
+        cluster_params_uniform = -1,
+        viewport_size_uniform = -1,
+        tessellation_pixels_uniform = -1;
+
+    Int albedo_factor_uniform = -1,
+        roughness_factor_uniform = -1,
+        metallic_factor_uniform = -1,
+        normal_factor_uniform = -1,
+        ao_factor_uniform = -1,
+        height_factor_uniform = -1,
+        position_scale_uniform = -1;
+};
+
+CORRADE_ENUMSET_OPERATORS(PBRShader::Flags)
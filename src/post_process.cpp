@@ -0,0 +1,436 @@
+#include "post_process.hpp"
+#include <Magnum/GL/Renderer.h>
+#include <Magnum/GL/RenderbufferFormat.h>
+#include <Magnum/GL/Sampler.h>
+#include <Magnum/GL/Shader.h>
+#include <Magnum/GL/TextureFormat.h>
+#include <Magnum/GL/Version.h>
+#include <Magnum/Math/Functions.h>
+#include <Corrade/Utility/Assert.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include "profiler.hpp"
+
+namespace
+{
+    const char* const VertexSource = R"(
+        out vec2 uv;
+
+        void main()
+        {
+            //One triangle covering the viewport
+            vec2 position = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+            uv = position;
+            gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+        }
+    )";
+
+    const char* const FragmentSource = R"(
+        in vec2 uv;
+        out vec4 fragment_color;
+
+        layout(binding = 0) uniform sampler2D scene_color;
+        layout(binding = 1) uniform sampler2D scene_depth;
+        layout(binding = 2) uniform sampler2D history;
+
+        uniform vec2 uv_scale;
+        uniform vec2 texel_size;
+        uniform vec2 jitter;
+        uniform mat4 reprojection;
+        uniform float history_weight;
+
+        //Keeps bilinear taps off the texels outside the drawn viewport
+        vec3 scene(vec2 p)
+        {
+            return texture(scene_color, clamp(p, texel_size * 0.5, uv_scale - texel_size * 0.5)).rgb;
+        }
+
+        float luma(vec3 color)
+        {
+            return dot(color, vec3(0.299, 0.587, 0.114));
+        }
+
+        //Blurs along the edge direction found from the luma gradient of the
+        //four diagonal neighbors, keeping the wider blur only if it stays
+        //within the local luma range
+        vec3 fxaa(vec2 p)
+        {
+            const float reduce_min = 1.0 / 128.0;
+            const float reduce_mul = 1.0 / 8.0;
+            const float span_max = 8.0;
+
+            vec3 nw = scene(p + vec2(-1.0, -1.0) * texel_size);
+            vec3 ne = scene(p + vec2(1.0, -1.0) * texel_size);
+            vec3 sw = scene(p + vec2(-1.0, 1.0) * texel_size);
+            vec3 se = scene(p + vec2(1.0, 1.0) * texel_size);
+            vec3 m = scene(p);
+
+            float luma_nw = luma(nw);
+            float luma_ne = luma(ne);
+            float luma_sw = luma(sw);
+            float luma_se = luma(se);
+            float luma_m = luma(m);
+            float luma_min = min(luma_m, min(min(luma_nw, luma_ne), min(luma_sw, luma_se)));
+            float luma_max = max(luma_m, max(max(luma_nw, luma_ne), max(luma_sw, luma_se)));
+
+            vec2 direction = vec2(-((luma_nw + luma_ne) - (luma_sw + luma_se)), (luma_nw + luma_sw) - (luma_ne + luma_se));
+            float reduce = max((luma_nw + luma_ne + luma_sw + luma_se) * 0.25 * reduce_mul, reduce_min);
+            float scale = 1.0 / (min(abs(direction.x), abs(direction.y)) + reduce);
+            direction = clamp(direction * scale, vec2(-span_max), vec2(span_max)) * texel_size;
+
+            vec3 narrow = 0.5 * (scene(p + direction * (1.0 / 3.0 - 0.5)) + scene(p + direction * (2.0 / 3.0 - 0.5)));
+            vec3 wide = narrow * 0.5 + 0.25 * (scene(p - direction * 0.5) + scene(p + direction * 0.5));
+            float luma_wide = luma(wide);
+            return luma_wide < luma_min || luma_wide > luma_max ? narrow : wide;
+        }
+
+        //Blends the jittered frame into the history reprojected by depth,
+        //clamped to the current neighborhood so disocclusions and shading
+        //changes don't ghost
+        vec3 taa(vec2 p)
+        {
+            //The scene was drawn shifted by the jitter, this pixel's center
+            //landed there
+            vec2 source = p + jitter;
+            vec3 current = scene(source);
+
+            vec3 low = current;
+            vec3 high = current;
+            for (int y = -1; y <= 1; ++y)
+            {
+                for (int x = -1; x <= 1; ++x)
+                {
+                    vec3 neighbor = scene(source + vec2(x, y) * texel_size);
+                    low = min(low, neighbor);
+                    high = max(high, neighbor);
+                }
+            }
+
+            float depth = texture(scene_depth, clamp(source, texel_size * 0.5, uv_scale - texel_size * 0.5)).r;
+            vec4 previous = reprojection * vec4(uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+            vec2 history_uv = previous.xy / previous.w * 0.5 + 0.5;
+
+            float weight = history_weight;
+            if (any(lessThan(history_uv, vec2(0.0))) || any(greaterThan(history_uv, vec2(1.0))))
+            {
+                weight = 0.0;
+            }
+
+            vec3 accumulated = clamp(texture(history, history_uv).rgb, low, high);
+            return mix(current, accumulated, weight);
+        }
+
+        void main()
+        {
+            vec2 p = uv * uv_scale;
+        #if defined(FXAA)
+            fragment_color = vec4(fxaa(p), 1.0);
+        #elif defined(TAA)
+            fragment_color = vec4(taa(p), 1.0);
+        #else
+            fragment_color = vec4(scene(p), 1.0);
+        #endif
+        }
+    )";
+
+    //Halton(2, 3), centered on the pixel
+    Vector2 halton_jitter(std::uint64_t index)
+    {
+        const auto halton = [](std::uint64_t i, std::uint64_t base)
+        {
+            float fraction = 1.0f;
+            float result = 0.0f;
+            while (i > 0)
+            {
+                fraction /= float(base);
+                result += fraction * float(i % base);
+                i /= base;
+            }
+            return result;
+        };
+
+        return { halton(index, 2) - 0.5f, halton(index, 3) - 0.5f };
+    }
+
+    //Jitter sequence length, long enough for a smooth edge gradient
+    constexpr std::uint64_t JitterPhases = 8;
+
+    //Share of the history in every TAA frame
+    constexpr float HistoryWeight = 0.9f;
+}
+
+const char* antialiasing_name(AntiAliasing antialiasing)
+{
+    switch (antialiasing)
+    {
+        case AntiAliasing::None:
+            return "none";
+        case AntiAliasing::Fxaa:
+            return "fxaa";
+        case AntiAliasing::Taa:
+            return "taa";
+    }
+
+    return "unknown";
+}
+
+ResolutionController::ResolutionController(double budget_ms, float min_scale, float max_scale):
+    budget_ms{ budget_ms },
+    min_scale{ min_scale },
+    max_scale{ max_scale }
+{
+}
+
+float ResolutionController::update(float current_scale, float measured_scale, double measured_ms)
+{
+    //Aim under the budget so frame to frame noise doesn't cross it
+    constexpr double Headroom = 0.9;
+    constexpr double Smoothing = 0.2;
+    constexpr float MaxGrowth = 0.02f;
+    constexpr float DeadBand = 0.01f;
+
+    const double full_scale = measured_ms / (double(measured_scale) * measured_scale);
+    full_scale_ms = full_scale_ms > 0.0 ? full_scale_ms + (full_scale - full_scale_ms) * Smoothing : full_scale;
+
+    float wanted = float(std::sqrt(Headroom * budget_ms / std::max(full_scale_ms, 1.0e-6)));
+    wanted = Math::clamp(wanted, min_scale, max_scale);
+
+    if (measured_ms > budget_ms)
+    {
+        return std::min(wanted, current_scale);
+    }
+    if (wanted > current_scale + DeadBand)
+    {
+        return std::min(wanted, current_scale + MaxGrowth);
+    }
+    if (wanted < current_scale - DeadBand)
+    {
+        return wanted;
+    }
+    return current_scale;
+}
+
+ResolveShader::ResolveShader(AntiAliasing antialiasing)
+{
+    MAGNUM_ASSERT_GL_VERSION_SUPPORTED(GL::Version::GL450);
+
+    std::string defines;
+    if (antialiasing == AntiAliasing::Fxaa)
+    {
+        defines = "#define FXAA\n";
+    }
+    else if (antialiasing == AntiAliasing::Taa)
+    {
+        defines = "#define TAA\n";
+    }
+
+    GL::Shader vert(GL::Version::GL450, GL::Shader::Type::Vertex);
+    GL::Shader frag(GL::Version::GL450, GL::Shader::Type::Fragment);
+    vert.addSource(VertexSource);
+    frag.addSource(defines).addSource(FragmentSource);
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(GL::Shader::compile({ vert, frag }));
+    attachShaders({ vert, frag });
+    CORRADE_INTERNAL_ASSERT_OUTPUT(link());
+
+    uv_scale_uniform = uniformLocation("uv_scale");
+    texel_size_uniform = uniformLocation("texel_size");
+    jitter_uniform = uniformLocation("jitter");
+    reprojection_uniform = uniformLocation("reprojection");
+    history_weight_uniform = uniformLocation("history_weight");
+}
+
+ResolveShader& ResolveShader::set_source(const Vector2& uv_scale, const Vector2& texel_size)
+{
+    setUniform(uv_scale_uniform, uv_scale);
+    setUniform(texel_size_uniform, texel_size);
+    return *this;
+}
+
+ResolveShader& ResolveShader::set_jitter(const Vector2& jitter_uv)
+{
+    setUniform(jitter_uniform, jitter_uv);
+    return *this;
+}
+
+ResolveShader& ResolveShader::set_reprojection(const Matrix4& reprojection)
+{
+    setUniform(reprojection_uniform, reprojection);
+    return *this;
+}
+
+ResolveShader& ResolveShader::set_history_weight(float weight)
+{
+    setUniform(history_weight_uniform, weight);
+    return *this;
+}
+
+ResolveShader& ResolveShader::bind_scene_color(GL::Texture2D& texture)
+{
+    texture.bind(SceneColorUnit);
+    return *this;
+}
+
+ResolveShader& ResolveShader::bind_scene_depth(GL::Texture2D& texture)
+{
+    texture.bind(SceneDepthUnit);
+    return *this;
+}
+
+ResolveShader& ResolveShader::bind_history(GL::Texture2D& texture)
+{
+    texture.bind(HistoryUnit);
+    return *this;
+}
+
+PostProcess::PostProcess(const Vector2i& output_size, const PostProcessOptions& options):
+    post_options{ options },
+    output_size{ output_size },
+    target_size{ Math::max(Vector2i{ Math::ceil(Vector2{ output_size } * options.render_scale) }, Vector2i{ 1 }) },
+    scene_framebuffer{ { {}, target_size } },
+    msaa_framebuffer{ { {}, target_size } },
+    history_framebuffer{ GL::Framebuffer{ { {}, output_size } }, GL::Framebuffer{ { {}, output_size } } },
+    shader{ options.antialiasing },
+    controller{ options.frame_budget_ms, std::min(options.min_render_scale, options.render_scale), options.render_scale },
+    queries(QueryLatency)
+{
+    std::size_t bytes = 0;
+
+    scene_color.setStorage(1, GL::TextureFormat::RGBA8, target_size)
+        .setMinificationFilter(GL::SamplerFilter::Linear)
+        .setMagnificationFilter(GL::SamplerFilter::Linear)
+        .setWrapping(GL::SamplerWrapping::ClampToEdge)
+        .setLabel("scene color");
+    scene_depth.setStorage(1, GL::TextureFormat::DepthComponent24, target_size)
+        .setMinificationFilter(GL::SamplerFilter::Nearest)
+        .setMagnificationFilter(GL::SamplerFilter::Nearest)
+        .setWrapping(GL::SamplerWrapping::ClampToEdge)
+        .setLabel("scene depth");
+    scene_framebuffer.attachTexture(GL::Framebuffer::ColorAttachment{ 0 }, scene_color, 0)
+        .attachTexture(GL::Framebuffer::BufferAttachment::Depth, scene_depth, 0);
+    bytes += std::size_t(target_size.product()) * 8;
+
+    Int samples = options.msaa_samples;
+    if (samples > GL::Renderbuffer::maxSamples())
+    {
+        spdlog::warn("{}x MSAA not supported, using {}x", samples, GL::Renderbuffer::maxSamples());
+        samples = GL::Renderbuffer::maxSamples();
+    }
+    post_options.msaa_samples = std::max(samples, 1);
+    multisampled = samples > 1;
+    if (multisampled)
+    {
+        msaa_color.setStorageMultisample(samples, GL::RenderbufferFormat::RGBA8, target_size);
+        msaa_depth.setStorageMultisample(samples, GL::RenderbufferFormat::DepthComponent24, target_size);
+        msaa_framebuffer.attachRenderbuffer(GL::Framebuffer::ColorAttachment{ 0 }, msaa_color)
+            .attachRenderbuffer(GL::Framebuffer::BufferAttachment::Depth, msaa_depth);
+        bytes += std::size_t(target_size.product()) * 8 * std::size_t(samples);
+    }
+
+    if (options.antialiasing == AntiAliasing::Taa)
+    {
+        for (std::size_t i = 0; i != 2; ++i)
+        {
+            history[i].setStorage(1, GL::TextureFormat::RGBA8, output_size)
+                .setMinificationFilter(GL::SamplerFilter::Linear)
+                .setMagnificationFilter(GL::SamplerFilter::Linear)
+                .setWrapping(GL::SamplerWrapping::ClampToEdge)
+                .setLabel("TAA history");
+            history_framebuffer[i].attachTexture(GL::Framebuffer::ColorAttachment{ 0 }, history[i], 0);
+        }
+        bytes += std::size_t(output_size.product()) * 4 * 2;
+    }
+
+    memory = TrackedAllocation{ MemoryCategory::Texture, "post process targets", bytes };
+
+    triangle.setPrimitive(GL::MeshPrimitive::Triangles)
+        .setCount(3);
+
+    post_stats.render_scale = options.render_scale;
+    post_stats.render_size = target_size;
+
+    spdlog::info("Post process: {} at {}x{}, {}x MSAA, render scale {}{}", antialiasing_name(options.antialiasing),
+        output_size.x(), output_size.y(), post_options.msaa_samples, options.render_scale,
+        options.dynamic_resolution ? " (dynamic, for a " + std::to_string(options.frame_budget_ms) + " ms budget)" : std::string{});
+}
+
+void PostProcess::begin_frame()
+{
+    //Reusing the slot means waiting for the frame QueryLatency ago
+    FrameQueries& slot = queries[frame % QueryLatency];
+    if (slot.issued)
+    {
+        post_stats.gpu_frame_ms = (slot.end.result<UnsignedLong>() - slot.begin.result<UnsignedLong>()) / 1.0e6;
+        if (post_options.dynamic_resolution)
+        {
+            post_stats.render_scale = controller.update(post_stats.render_scale, slot.render_scale, post_stats.gpu_frame_ms);
+        }
+    }
+
+    post_stats.render_size = Math::clamp(Vector2i{ Math::round(Vector2{ output_size } * post_stats.render_scale) },
+        Vector2i{ 1 }, target_size);
+    frame_jitter = post_options.antialiasing == AntiAliasing::Taa ? halton_jitter(frame % JitterPhases + 1) : Vector2{};
+
+    slot.render_scale = post_stats.render_scale;
+    slot.issued = true;
+    slot.begin.timestamp();
+
+    GL::Framebuffer& target = multisampled ? msaa_framebuffer : scene_framebuffer;
+    target.setViewport({ {}, post_stats.render_size })
+        .clear(GL::FramebufferClear::Color | GL::FramebufferClear::Depth)
+        .bind();
+}
+
+void PostProcess::end_frame(GL::AbstractFramebuffer& output, const Matrix4& reprojection)
+{
+    ProfileZone zone{ "post process" };
+    GpuZone gpu_zone{ "post process" };
+
+    const Range2Di rendered{ {}, post_stats.render_size };
+    const bool taa = post_options.antialiasing == AntiAliasing::Taa;
+    if (multisampled)
+    {
+        //Depth only feeds the TAA reprojection
+        GL::AbstractFramebuffer::blit(msaa_framebuffer, scene_framebuffer, rendered, rendered,
+            taa ? GL::FramebufferBlit::Color | GL::FramebufferBlit::Depth : GL::FramebufferBlitMask{ GL::FramebufferBlit::Color },
+            GL::FramebufferBlitFilter::Nearest);
+    }
+
+    GL::Renderer::disable(GL::Renderer::Feature::DepthTest);
+
+    const Vector2 texel_size = 1.0f / Vector2{ target_size };
+    shader.set_source(Vector2{ post_stats.render_size } * texel_size, texel_size)
+        .bind_scene_color(scene_color);
+
+    if (taa)
+    {
+        const std::size_t previous = history_index ^ 1;
+        shader.set_jitter(frame_jitter * texel_size)
+            .set_reprojection(reprojection)
+            .set_history_weight(history_valid ? HistoryWeight : 0.0f)
+            .bind_scene_depth(scene_depth)
+            .bind_history(history[previous]);
+
+        history_framebuffer[history_index].bind();
+        shader.draw(triangle);
+
+        //The history is the output, copied out before it's read next frame
+        GL::AbstractFramebuffer::blit(history_framebuffer[history_index], output, { {}, output_size }, { {}, output_size },
+            GL::FramebufferBlit::Color, GL::FramebufferBlitFilter::Nearest);
+        output.bind();
+        history_index = previous;
+        history_valid = true;
+    }
+    else
+    {
+        output.bind();
+        shader.draw(triangle);
+    }
+
+    GL::Renderer::enable(GL::Renderer::Feature::DepthTest);
+
+    queries[frame % QueryLatency].end.timestamp();
+    ++frame;
+}
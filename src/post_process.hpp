@@ -0,0 +1,180 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/AbstractFramebuffer.h>
+#include <Magnum/GL/AbstractShaderProgram.h>
+#include <Magnum/GL/Framebuffer.h>
+#include <Magnum/GL/Mesh.h>
+#include <Magnum/GL/Renderbuffer.h>
+#include <Magnum/GL/Texture.h>
+#include <Magnum/GL/TimeQuery.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/Math/Vector2.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "memory_tracker.hpp"
+
+using namespace Magnum;
+
+enum class AntiAliasing
+{
+    None, //bilinear upscale only
+    Fxaa, //edge-directed blur on the resolved scene
+    Taa //jittered frames accumulated into a reprojected history
+};
+
+const char* antialiasing_name(AntiAliasing antialiasing);
+
+struct PostProcessOptions
+{
+    AntiAliasing antialiasing = AntiAliasing::Fxaa;
+    Int msaa_samples = 1; //of the scene target, 1 for none
+    float render_scale = 1.0f; //fixed, or the largest one with dynamic_resolution
+    bool dynamic_resolution = false;
+    float min_render_scale = 0.5f;
+    double frame_budget_ms = 1000.0 / 60.0; //GPU time the resolution controller aims under
+};
+
+struct PostProcessStats
+{
+    float render_scale = 1.0f;
+    Vector2i render_size;
+    double gpu_frame_ms = 0.0; //scene and post process, measured a few frames late
+};
+
+//Picks the render scale for a GPU frame time budget, assuming the cost grows
+//with the pixel count. Drops at once when over budget and grows back slowly.
+class ResolutionController
+{
+public:
+    explicit ResolutionController(double budget_ms, float min_scale, float max_scale);
+
+    //`measured_ms` is the GPU time of a frame drawn at `measured_scale`,
+    //returns the scale for the next frame
+    float update(float current_scale, float measured_scale, double measured_ms);
+
+private:
+    double budget_ms;
+    float min_scale;
+    float max_scale;
+    double full_scale_ms = 0.0; //filtered estimate at scale 1
+};
+
+//Full-screen pass from the scene target into the output, every pixel of
+//which it writes
+class ResolveShader: public GL::AbstractShaderProgram
+{
+public:
+    static constexpr Int SceneColorUnit = 0;
+    static constexpr Int SceneDepthUnit = 1;
+    static constexpr Int HistoryUnit = 2;
+
+    explicit ResolveShader(AntiAliasing antialiasing);
+
+    //Part of the scene texture that was drawn to, in UV, and its texel size
+    ResolveShader& set_source(const Vector2& uv_scale, const Vector2& texel_size);
+
+    //TAA only
+    ResolveShader& set_jitter(const Vector2& jitter_uv);
+    ResolveShader& set_reprojection(const Matrix4& reprojection);
+    ResolveShader& set_history_weight(float weight);
+
+    ResolveShader& bind_scene_color(GL::Texture2D& texture);
+    ResolveShader& bind_scene_depth(GL::Texture2D& texture);
+    ResolveShader& bind_history(GL::Texture2D& texture);
+
+private:
+    Int uv_scale_uniform = -1,
+        texel_size_uniform = -1,
+        jitter_uniform = -1,
+        reprojection_uniform = -1,
+        history_weight_uniform = -1;
+};
+
+//Offscreen scene target with optional MSAA, drawn at a fraction of the
+//output resolution and resolved into the output by FXAA, TAA or a plain
+//bilinear upscale. The target is allocated for the largest render scale and
+//a smaller one only shrinks the viewport, so dynamic resolution never
+//reallocates. GL thread only.
+class PostProcess
+{
+public:
+    explicit PostProcess(const Vector2i& output_size, const PostProcessOptions& options = {});
+
+    PostProcess(const PostProcess&) = delete;
+    PostProcess& operator=(const PostProcess&) = delete;
+
+    //Updates the render scale from the GPU time of a finished frame, then
+    //binds and clears the scene target with a viewport of render_size()
+    void begin_frame();
+
+    Vector2i render_size() const
+    {
+        return post_stats.render_size;
+    }
+
+    //Subpixel projection offset for the scene in render pixels, zero
+    //without TAA. Goes into SceneFrame::jitter.
+    Vector2 jitter() const
+    {
+        return frame_jitter;
+    }
+
+    //Resolves the scene into `output`, which needs a viewport of the output
+    //size. `reprojection` maps this frame's clip space to the previous
+    //one's, see DemoScene::reprojection(). Binds textures and programs
+    //behind the scene's state cache.
+    void end_frame(GL::AbstractFramebuffer& output, const Matrix4& reprojection);
+
+    //Starts the TAA accumulation over, e.g. after a camera cut
+    void reset_history()
+    {
+        history_valid = false;
+    }
+
+    const PostProcessOptions& options() const
+    {
+        return post_options;
+    }
+
+    const PostProcessStats& stats() const
+    {
+        return post_stats;
+    }
+
+private:
+    static constexpr std::size_t QueryLatency = 3;
+
+    struct FrameQueries
+    {
+        GL::TimeQuery begin{ GL::TimeQuery::Target::Timestamp };
+        GL::TimeQuery end{ GL::TimeQuery::Target::Timestamp };
+        float render_scale = 1.0f;
+        bool issued = false;
+    };
+
+    PostProcessOptions post_options;
+    Vector2i output_size;
+    Vector2i target_size; //allocated for the largest render scale
+    bool multisampled = false;
+
+    GL::Texture2D scene_color;
+    GL::Texture2D scene_depth;
+    GL::Framebuffer scene_framebuffer;
+    GL::Renderbuffer msaa_color;
+    GL::Renderbuffer msaa_depth;
+    GL::Framebuffer msaa_framebuffer;
+    GL::Texture2D history[2];
+    GL::Framebuffer history_framebuffer[2];
+    std::size_t history_index = 0; //written this frame
+    bool history_valid = false;
+
+    ResolveShader shader;
+    GL::Mesh triangle;
+    ResolutionController controller;
+    std::vector<FrameQueries> queries;
+    std::uint64_t frame = 0;
+    Vector2 frame_jitter;
+    PostProcessStats post_stats;
+    TrackedAllocation memory;
+};
@@ -0,0 +1,353 @@
+#include "profiler.hpp"
+#include <Magnum/GL/OpenGL.h>
+#include <Corrade/Utility/Assert.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include "json.hpp"
+
+namespace
+{
+    constexpr std::size_t RingCapacity = std::size_t{ 1 } << 14;
+    constexpr std::uint32_t GpuTrack = 0xffff;
+    //Weight of the newest frame in the rolling mean, about a second at 60 fps
+    constexpr double MeanWeight = 1.0 / 60.0;
+
+    //Slots are written by the owning thread and read by the drain while the
+    //owner may be lapping it, hence the relaxed atomics
+    struct RingSlot
+    {
+        std::atomic<const char*> name{ nullptr };
+        std::atomic<std::uint64_t> begin_ns{ 0 };
+        std::atomic<std::uint64_t> end_ns{ 0 };
+        std::atomic<std::uint32_t> depth{ 0 };
+    };
+
+    struct ThreadRing
+    {
+        explicit ThreadRing(std::uint32_t track): track{ track }, slots(RingCapacity) {}
+
+        std::uint32_t track;
+        std::string name; //under the registry lock
+        std::vector<RingSlot> slots;
+        std::atomic<std::uint64_t> written{ 0 };
+        std::uint64_t read = 0; //drain only
+        std::uint32_t depth = 0; //owner only
+    };
+
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadRing>> rings; //never freed, threads may outlive a profiler
+        FrameProfiler* current = nullptr;
+        const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    };
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    thread_local ThreadRing* thread_ring = nullptr;
+
+    ThreadRing& this_thread_ring()
+    {
+        if (!thread_ring)
+        {
+            Registry& state = registry();
+            std::lock_guard<std::mutex> lock{ state.mutex };
+            state.rings.push_back(std::make_unique<ThreadRing>(std::uint32_t(state.rings.size())));
+            thread_ring = state.rings.back().get();
+            thread_ring->name = "thread " + std::to_string(thread_ring->track);
+        }
+        return *thread_ring;
+    }
+
+    std::uint64_t now_ns()
+    {
+        return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - registry().epoch).count());
+    }
+}
+
+void set_profiling(bool enabled)
+{
+    profiling_active.store(enabled, std::memory_order_relaxed);
+    spdlog::info("Profiling {}", enabled ? "on" : "off");
+}
+
+void set_profile_thread_name(const std::string& name)
+{
+    ThreadRing& ring = this_thread_ring();
+    std::lock_guard<std::mutex> lock{ registry().mutex };
+    ring.name = name;
+}
+
+void ProfileZone::begin(const char* name)
+{
+    zone_name = name;
+    depth = this_thread_ring().depth++;
+    start_ns = now_ns();
+}
+
+void ProfileZone::end()
+{
+    const std::uint64_t end = now_ns();
+    ThreadRing& ring = *thread_ring;
+    --ring.depth;
+
+    const std::uint64_t index = ring.written.load(std::memory_order_relaxed);
+    RingSlot& slot = ring.slots[index % RingCapacity];
+    //Pairs with the drain's acquire fence: a drain that sees any of the new
+    //values also sees the count that tells it the slot was lapped
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(zone_name, std::memory_order_relaxed);
+    slot.begin_ns.store(start_ns, std::memory_order_relaxed);
+    slot.end_ns.store(end, std::memory_order_relaxed);
+    slot.depth.store(depth, std::memory_order_relaxed);
+    ring.written.store(index + 1, std::memory_order_release);
+}
+
+FrameProfiler::FrameProfiler(std::size_t max_trace_events):
+    max_trace_events{ max_trace_events }
+{
+    Registry& state = registry();
+    CORRADE_ASSERT(!state.current, "FrameProfiler: there already is one", );
+    state.current = this;
+
+    set_profile_thread_name("main");
+    calibrate();
+}
+
+FrameProfiler::~FrameProfiler()
+{
+    registry().current = nullptr;
+}
+
+FrameProfiler* FrameProfiler::current()
+{
+    return registry().current;
+}
+
+void FrameProfiler::calibrate()
+{
+    //Where the GPU clock is right now, no need to wait for anything
+    GLint64 gpu_ns = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_ns);
+    gpu_to_cpu_ns = std::int64_t(now_ns()) - std::int64_t(gpu_ns);
+}
+
+GL::TimeQuery& FrameProfiler::next_query(GpuFrame& gpu_frame)
+{
+    if (gpu_frame.used == gpu_frame.queries.size())
+    {
+        gpu_frame.queries.push_back(GL::TimeQuery{ GL::TimeQuery::Target::Timestamp });
+    }
+    return gpu_frame.queries[gpu_frame.used++];
+}
+
+std::size_t FrameProfiler::begin_gpu_zone(const char* name)
+{
+    GpuFrame& gpu_frame = gpu_frames[frame % QueryLatency];
+    const std::size_t query = gpu_frame.used;
+    next_query(gpu_frame).timestamp();
+    gpu_frame.records.push_back({ name, gpu_depth++, query, 0 });
+    return gpu_frame.records.size() - 1;
+}
+
+void FrameProfiler::end_gpu_zone(std::size_t index)
+{
+    GpuFrame& gpu_frame = gpu_frames[frame % QueryLatency];
+    gpu_frame.records[index].end_query = gpu_frame.used;
+    next_query(gpu_frame).timestamp();
+    --gpu_depth;
+}
+
+void FrameProfiler::collect_gpu(GpuFrame& gpu_frame)
+{
+    if (gpu_frame.used != 0)
+    {
+        //Queries complete in order, the last one covers all of them
+        if (gpu_frame.queries[gpu_frame.used - 1].resultAvailable())
+        {
+            for (const GpuRecord& record : gpu_frame.records)
+            {
+                const std::int64_t begin = std::int64_t(gpu_frame.queries[record.begin_query].result<UnsignedLong>()) + gpu_to_cpu_ns;
+                const std::int64_t end = std::int64_t(gpu_frame.queries[record.end_query].result<UnsignedLong>()) + gpu_to_cpu_ns;
+                this->record(record.name, std::uint64_t(std::max<std::int64_t>(begin, 0)), std::uint64_t(std::max<std::int64_t>(end, 0)),
+                    GpuTrack, record.depth, true);
+            }
+        }
+        else
+        {
+            ++dropped_gpu_frames;
+        }
+    }
+
+    gpu_frame.used = 0;
+    gpu_frame.records.clear();
+}
+
+void FrameProfiler::record(const char* name, std::uint64_t begin_ns, std::uint64_t end_ns, std::uint32_t track, std::uint32_t depth, bool gpu)
+{
+    if (trace.size() < max_trace_events)
+    {
+        trace.push_back({ name, begin_ns, std::max(end_ns, begin_ns), track });
+    }
+    else if (!trace_full)
+    {
+        trace_full = true;
+        spdlog::warn("Profile trace is full at {} events, later zones only go into the summary", max_trace_events);
+    }
+
+    std::unordered_map<const char*, std::size_t>& index = gpu ? gpu_zone_index : cpu_zone_index;
+    const auto found = index.emplace(name, zones.size());
+    if (found.second)
+    {
+        zones.push_back({ { name, gpu, depth, 0.0, 0.0 } });
+    }
+    zones[found.first->second].frame_ms += (end_ns > begin_ns ? end_ns - begin_ns : 0) / 1.0e6;
+}
+
+void FrameProfiler::end_frame()
+{
+    const bool enabled = profiling_enabled();
+    if (enabled && !was_enabled)
+    {
+        calibrate();
+    }
+    was_enabled = enabled;
+
+    //The pool the next frame writes to was last used QueryLatency frames ago
+    ++frame;
+    collect_gpu(gpu_frames[frame % QueryLatency]);
+
+    {
+        Registry& state = registry();
+        std::lock_guard<std::mutex> lock{ state.mutex };
+        for (const std::unique_ptr<ThreadRing>& ring : state.rings)
+        {
+            //Slot written % RingCapacity may be half rewritten by the owner
+            //already, so at most RingCapacity - 1 slots are safe to read
+            const std::uint64_t written = ring->written.load(std::memory_order_acquire);
+            if (written - ring->read >= RingCapacity)
+            {
+                dropped_events += written - ring->read - RingCapacity + 1;
+                ring->read = written - RingCapacity + 1;
+            }
+
+            for (; ring->read != written; ++ring->read)
+            {
+                const RingSlot& slot = ring->slots[ring->read % RingCapacity];
+                const char* const name = slot.name.load(std::memory_order_relaxed);
+                const std::uint64_t begin = slot.begin_ns.load(std::memory_order_relaxed);
+                const std::uint64_t end = slot.end_ns.load(std::memory_order_relaxed);
+                const std::uint32_t depth = slot.depth.load(std::memory_order_relaxed);
+
+                //The owner lapped us while we were reading this slot. The
+                //fence keeps the slot loads before the re-check (seqlock).
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (ring->written.load(std::memory_order_relaxed) - ring->read >= RingCapacity)
+                {
+                    ++dropped_events;
+                    continue;
+                }
+                record(name, begin, end, ring->track, depth, false);
+            }
+        }
+    }
+
+    for (ZoneStats& zone : zones)
+    {
+        zone.summary.mean_ms += (zone.frame_ms - zone.summary.mean_ms) * MeanWeight;
+        zone.summary.max_ms = std::max(zone.summary.max_ms, zone.frame_ms);
+        zone.frame_ms = 0.0;
+    }
+}
+
+std::vector<ZoneSummary> FrameProfiler::summary() const
+{
+    std::vector<ZoneSummary> out;
+    out.reserve(zones.size());
+    for (const ZoneStats& zone : zones)
+    {
+        out.push_back(zone.summary);
+    }
+    return out;
+}
+
+void FrameProfiler::log_summary()
+{
+    spdlog::info("Profile, ms per frame (mean, max):");
+    for (ZoneStats& zone : zones)
+    {
+        spdlog::info("  {:<4}{}{} {:.3f}, {:.3f}", zone.summary.gpu ? "GPU" : "CPU", std::string(2 * zone.summary.depth, ' '),
+            zone.summary.name, zone.summary.mean_ms, zone.summary.max_ms);
+        zone.summary.max_ms = 0.0;
+    }
+    if (dropped_gpu_frames != 0 || dropped_events != 0)
+    {
+        spdlog::info("  {} GPU frames not ready in time, {} CPU zones overwritten before a drain", dropped_gpu_frames, dropped_events);
+    }
+}
+
+bool FrameProfiler::write_trace(const std::string& path) const
+{
+    std::ofstream file{ path };
+    //Default precision would round timestamps to 100 us after a few seconds
+    file << std::fixed << std::setprecision(3);
+    file << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+
+    //Track names first, durations are in microseconds
+    {
+        Registry& state = registry();
+        std::lock_guard<std::mutex> lock{ state.mutex };
+        for (const std::unique_ptr<ThreadRing>& ring : state.rings)
+        {
+            file << "  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << ring->track
+                << ", \"args\": { \"name\": " << json_string(ring->name) << " } },\n";
+        }
+    }
+    file << "  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << GpuTrack << ", \"args\": { \"name\": \"GPU\" } }";
+
+    for (const TraceEvent& event : trace)
+    {
+        file << ",\n  { \"name\": " << json_string(event.name) << ", \"cat\": \"" << (event.track == GpuTrack ? "gpu" : "cpu")
+            << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.track
+            << ", \"ts\": " << event.begin_ns / 1000.0 << ", \"dur\": " << (event.end_ns - event.begin_ns) / 1000.0 << " }";
+    }
+    file << "\n] }\n";
+
+    if (!file)
+    {
+        spdlog::error("Can't write {}", path);
+        return false;
+    }
+
+    spdlog::info("Profile trace with {} zones written to {}", trace.size(), path);
+    return true;
+}
+
+GpuZone::GpuZone(const char* name)
+{
+    FrameProfiler* const current = FrameProfiler::current();
+    if (current && profiling_enabled())
+    {
+        profiler = current;
+        record = profiler->begin_gpu_zone(name);
+    }
+}
+
+GpuZone::~GpuZone()
+{
+    if (profiler)
+    {
+        profiler->end_gpu_zone(record);
+    }
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/TimeQuery.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace Magnum;
+
+//Process-wide switch. Zones opened while it's off record nothing and cost
+//one relaxed load.
+inline std::atomic<bool> profiling_active{ false };
+
+inline bool profiling_enabled()
+{
+    return profiling_active.load(std::memory_order_relaxed);
+}
+
+void set_profiling(bool enabled);
+
+//Labels the calling thread's track in the trace
+void set_profile_thread_name(const std::string& name);
+
+//Times a scope on the calling thread. Only the name pointer is stored, so
+//it has to live as long as the profiler, a string literal in practice.
+//Zones go into a ring of the thread that only it writes and the
+//FrameProfiler drains, lock-free after the thread's first zone.
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name)
+    {
+        if (profiling_enabled())
+        {
+            begin(name);
+        }
+    }
+
+    ~ProfileZone()
+    {
+        if (zone_name)
+        {
+            end();
+        }
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    void begin(const char* name);
+    void end();
+
+    const char* zone_name = nullptr;
+    std::uint64_t start_ns = 0;
+    std::uint32_t depth = 0;
+};
+
+struct ZoneSummary
+{
+    const char* name;
+    bool gpu;
+    std::uint32_t depth; //of its first occurrence
+    double mean_ms; //per frame, exponentially weighted over about a second
+    double max_ms; //per frame, since the last log_summary()
+};
+
+//Drains every thread's zones at the end of each frame into a Chrome
+//trace_event list and a rolling per-zone summary. GPU zones are pairs of
+//timestamp queries from one pool per frame in flight; a pool is read back
+//when it comes around again and dropped if the GPU still isn't done with
+//it, so nothing ever waits. One at a time, GL thread only.
+class FrameProfiler
+{
+public:
+    explicit FrameProfiler(std::size_t max_trace_events = std::size_t{ 1 } << 20);
+    ~FrameProfiler();
+
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    //The one GpuZone reports to, null if there is none
+    static FrameProfiler* current();
+
+    void end_frame();
+
+    //Zones seen so far, in order of first appearance
+    std::vector<ZoneSummary> summary() const;
+
+    //Logs summary() and starts a new max window
+    void log_summary();
+
+    std::size_t trace_event_count() const
+    {
+        return trace.size();
+    }
+
+    //Chrome trace_event JSON, load it in chrome://tracing or Perfetto
+    bool write_trace(const std::string& path) const;
+
+private:
+    friend class GpuZone;
+
+    static constexpr std::size_t QueryLatency = 4;
+
+    struct TraceEvent
+    {
+        const char* name;
+        std::uint64_t begin_ns;
+        std::uint64_t end_ns;
+        std::uint32_t track;
+    };
+
+    struct GpuRecord
+    {
+        const char* name;
+        std::uint32_t depth;
+        std::size_t begin_query;
+        std::size_t end_query;
+    };
+
+    struct GpuFrame
+    {
+        std::vector<GL::TimeQuery> queries; //grows to the most zones a frame had
+        std::size_t used = 0;
+        std::vector<GpuRecord> records;
+    };
+
+    struct ZoneStats
+    {
+        ZoneSummary summary;
+        double frame_ms = 0.0; //accumulating for the current frame
+    };
+
+    std::size_t begin_gpu_zone(const char* name);
+    void end_gpu_zone(std::size_t record);
+    GL::TimeQuery& next_query(GpuFrame& frame);
+    void collect_gpu(GpuFrame& frame);
+    void calibrate();
+    void record(const char* name, std::uint64_t begin_ns, std::uint64_t end_ns, std::uint32_t track, std::uint32_t depth, bool gpu);
+
+    std::size_t max_trace_events;
+    std::vector<TraceEvent> trace;
+    bool trace_full = false;
+
+    GpuFrame gpu_frames[QueryLatency];
+    std::uint64_t frame = 0;
+    std::uint32_t gpu_depth = 0;
+    std::int64_t gpu_to_cpu_ns = 0; //added to GPU timestamps
+    bool was_enabled = false;
+    std::size_t dropped_gpu_frames = 0;
+    std::size_t dropped_events = 0; //overwritten in a thread ring before a drain
+
+    std::vector<ZoneStats> zones;
+    std::unordered_map<const char*, std::size_t> cpu_zone_index;
+    std::unordered_map<const char*, std::size_t> gpu_zone_index;
+};
+
+//Times a scope on the GPU with two timestamp queries. Nothing happens
+//without a current FrameProfiler or while profiling is off. GL thread only.
+class GpuZone
+{
+public:
+    explicit GpuZone(const char* name);
+    ~GpuZone();
+
+    GpuZone(const GpuZone&) = delete;
+    GpuZone& operator=(const GpuZone&) = delete;
+
+private:
+    FrameProfiler* profiler = nullptr;
+    std::size_t record = 0;
+};
@@ -0,0 +1,154 @@
+#include "program_cache.hpp"
+#include <Magnum/GL/Context.h>
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Utility/Directory.h>
+#include <spdlog/spdlog.h>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "hash.hpp"
+
+namespace
+{
+    constexpr char Magic[8] = "PBRPROG";
+    constexpr std::uint32_t Version = 1;
+
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t format; //GLenum from glGetProgramBinary
+        std::uint64_t key;
+        std::uint64_t size;
+    };
+}
+
+ProgramBinaryCache::ProgramBinaryCache(std::string directory):
+    directory{ std::move(directory) }
+{
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    supported = format_count > 0;
+    if (!supported)
+    {
+        spdlog::warn("Driver exposes no program binary formats, shaders are always compiled from source");
+        return;
+    }
+
+    if (!Utility::Directory::mkpath(this->directory))
+    {
+        spdlog::warn("Can't create {}, shaders are always compiled from source", this->directory);
+        supported = false;
+        return;
+    }
+
+    GL::Context& context = GL::Context::current();
+    for (const std::string& value : { context.vendorString(), context.rendererString(), context.versionString() })
+    {
+        driver_hash = fnv1a64(value.data(), value.size(), driver_hash);
+    }
+}
+
+std::uint64_t ProgramBinaryCache::key(std::uint64_t source_hash) const
+{
+    return fnv1a64(&source_hash, sizeof(source_hash), driver_hash);
+}
+
+void ProgramBinaryCache::prepare(GLuint program) const
+{
+    if (supported)
+    {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+}
+
+bool ProgramBinaryCache::load(GLuint program, std::uint64_t key) const
+{
+    if (!supported)
+    {
+        return false;
+    }
+
+    const std::string file = path(key);
+    if (!Utility::Directory::exists(file))
+    {
+        return false;
+    }
+
+    const Containers::Array<char> data = Utility::Directory::read(file);
+    FileHeader header;
+    if (data.size() < sizeof(header))
+    {
+        return false;
+    }
+
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version
+        || header.key != key || header.size != data.size() - sizeof(header))
+    {
+        spdlog::warn("Ignoring damaged program binary {}", file);
+        return false;
+    }
+
+    glProgramBinary(program, header.format, data.data() + sizeof(header), GLsizei(header.size));
+
+    //The driver may still reject it, e.g. after an update that kept the version string
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    return status == GL_TRUE;
+}
+
+void ProgramBinaryCache::store(GLuint program, std::uint64_t key) const
+{
+    if (!supported)
+    {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return;
+    }
+
+    Containers::Array<char> binary{ Containers::NoInit, std::size_t(length) };
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+
+    FileHeader header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.format = format;
+    header.key = key;
+    header.size = std::uint64_t(written);
+
+    const std::string file = path(key);
+    const std::string temporary_path = file + ".tmp";
+    {
+        std::ofstream out{ temporary_path, std::ios::binary | std::ios::trunc };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(binary.data(), written);
+        if (!out)
+        {
+            spdlog::warn("Can't write {}", temporary_path);
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary_path, file, error);
+    if (error)
+    {
+        spdlog::warn("Can't replace {}: {}", file, error.message());
+    }
+}
+
+std::string ProgramBinaryCache::path(std::uint64_t key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return Utility::Directory::join(directory, name);
+}
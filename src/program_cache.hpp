@@ -0,0 +1,38 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/OpenGL.h>
+#include <cstdint>
+#include <string>
+
+using namespace Magnum;
+
+//Linked program binaries on disk, one file per program. The key mixes the
+//driver's vendor/renderer/version strings with the caller's source hash, so
+//a driver update or a shader edit just misses. Needs a current GL context.
+class ProgramBinaryCache
+{
+public:
+    explicit ProgramBinaryCache(std::string directory);
+
+    bool enabled() const
+    {
+        return supported;
+    }
+
+    std::uint64_t key(std::uint64_t source_hash) const;
+
+    //Call before linking so the driver keeps a retrievable binary
+    void prepare(GLuint program) const;
+
+    //True if the program was linked from a cached binary
+    bool load(GLuint program, std::uint64_t key) const;
+
+    void store(GLuint program, std::uint64_t key) const;
+
+private:
+    std::string path(std::uint64_t key) const;
+
+    std::string directory;
+    std::uint64_t driver_hash = 14695981039346656037ull;
+    bool supported = false;
+};
@@ -0,0 +1,110 @@
+#include "readback_ring.hpp"
+#include <Magnum/GL/Context.h>
+#include <Corrade/Utility/Assert.h>
+#include <chrono>
+
+namespace
+{
+    std::size_t align_up(std::size_t value, std::size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    constexpr std::size_t SlotAlignment = 256;
+}
+
+ReadbackRing::ReadbackRing(const Vector2i& size, std::size_t slot_count):
+    ring_buffer{ GL::Buffer::TargetHint::PixelPack },
+    image_size{ size },
+    slot_size{ align_up(std::size_t(size.product()) * 4, SlotAlignment) },
+    slots(slot_count)
+{
+    CORRADE_INTERNAL_ASSERT(slot_count > 0);
+
+    const std::size_t capacity = slot_size * slot_count;
+    ring_buffer.setStorage({ nullptr, capacity },
+        GL::Buffer::StorageFlag::MapRead | GL::Buffer::StorageFlag::MapPersistent | GL::Buffer::StorageFlag::MapCoherent);
+
+    mapped = ring_buffer.map(0, capacity,
+        GL::Buffer::MapFlag::Read | GL::Buffer::MapFlag::Persistent | GL::Buffer::MapFlag::Coherent).data();
+    CORRADE_INTERNAL_ASSERT(mapped);
+    memory = TrackedAllocation{ MemoryCategory::Buffer, "readback ring", capacity };
+}
+
+ReadbackRing::~ReadbackRing()
+{
+    for (Slot& slot : slots)
+    {
+        if (slot.fence)
+        {
+            glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(slot.fence);
+        }
+    }
+    ring_buffer.unmap();
+}
+
+void ReadbackRing::read(GL::Framebuffer& framebuffer, std::uint64_t tag, const Consumer& consumer)
+{
+    Slot& slot = slots[next];
+    if (slot.fence)
+    {
+        consume(next, true, consumer);
+    }
+
+    GL::Context::current().resetState(GL::Context::State::EnterExternal);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.id());
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, ring_buffer.id());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glReadPixels(0, 0, image_size.x(), image_size.y(), GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<void*>(next * slot_size));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GL::Context::current().resetState(GL::Context::State::ExitExternal);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.tag = tag;
+    next = (next + 1) % slots.size();
+}
+
+void ReadbackRing::poll(const Consumer& consumer)
+{
+    for (std::size_t i = 0; i != slots.size(); ++i)
+    {
+        const std::size_t index = (next + i) % slots.size();
+        if (slots[index].fence && !consume(index, false, consumer))
+        {
+            return;
+        }
+    }
+}
+
+void ReadbackRing::finish(const Consumer& consumer)
+{
+    for (std::size_t i = 0; i != slots.size(); ++i)
+    {
+        const std::size_t index = (next + i) % slots.size();
+        if (slots[index].fence)
+        {
+            consume(index, true, consumer);
+        }
+    }
+}
+
+bool ReadbackRing::consume(std::size_t index, bool wait, const Consumer& consumer)
+{
+    Slot& slot = slots[index];
+
+    const auto start = std::chrono::steady_clock::now();
+    const GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        return false;
+    }
+    total_wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    consumer(slot.tag, { mapped + index * slot_size, std::size_t(image_size.product()) * 4 });
+    return true;
+}
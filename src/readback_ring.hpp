@@ -0,0 +1,73 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/Framebuffer.h>
+#include <Magnum/GL/OpenGL.h>
+#include <Magnum/Math/Vector2.h>
+#include <Corrade/Containers/ArrayView.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "memory_tracker.hpp"
+
+using namespace Magnum;
+
+//Persistently mapped pixel pack buffer split into one slot per readback in
+//flight. read() queues an asynchronous glReadPixels() of a whole RGBA8
+//framebuffer into the next slot and fences it; the pixels are handed out
+//once the fence has signaled, so the GL thread only waits when every slot is
+//still busy. Rows are bottom to top like Magnum images. GL thread only.
+class ReadbackRing
+{
+public:
+    //Called with the tag given to read() and the mapped pixels, which stay
+    //valid only until it returns
+    using Consumer = std::function<void(std::uint64_t tag, Containers::ArrayView<const char> pixels)>;
+
+    explicit ReadbackRing(const Vector2i& size, std::size_t slot_count = 4);
+    ~ReadbackRing();
+
+    ReadbackRing(const ReadbackRing&) = delete;
+    ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+    Vector2i size() const
+    {
+        return image_size;
+    }
+
+    //Hands the oldest readback to `consumer` first if its slot is the next
+    //one and still pending
+    void read(GL::Framebuffer& framebuffer, std::uint64_t tag, const Consumer& consumer);
+
+    //Hands out every finished readback, oldest first, without waiting
+    void poll(const Consumer& consumer);
+
+    //Waits for and hands out every pending readback
+    void finish(const Consumer& consumer);
+
+    //Time spent waiting for fences so far
+    double wait_ms() const
+    {
+        return total_wait_ms;
+    }
+
+private:
+    struct Slot
+    {
+        GLsync fence = nullptr;
+        std::uint64_t tag = 0;
+    };
+
+    //Returns false without waiting if the slot's readback isn't done yet
+    bool consume(std::size_t index, bool wait, const Consumer& consumer);
+
+    GL::Buffer ring_buffer;
+    TrackedAllocation memory;
+    const char* mapped = nullptr;
+    Vector2i image_size;
+    std::size_t slot_size = 0;
+    std::vector<Slot> slots;
+    std::size_t next = 0; //slot of the next read(), the oldest pending one if any
+    double total_wait_ms = 0.0;
+};
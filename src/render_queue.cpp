@@ -0,0 +1,59 @@
+#include "render_queue.hpp"
+#include <algorithm>
+#include <cstring>
+
+std::uint64_t make_sort_key(std::uint32_t program, std::uint32_t material, std::uint32_t mesh, float depth)
+{
+    //Non-negative floats order like their bit patterns
+    const float clamped = std::max(depth, 0.0f);
+    std::uint32_t depth_bits;
+    std::memcpy(&depth_bits, &clamped, sizeof(depth_bits));
+
+    return std::uint64_t(program & 0xff) << 56 | std::uint64_t(material & 0xffff) << 40
+        | std::uint64_t(mesh & 0xff) << 32 | depth_bits;
+}
+
+void RenderQueue::sort()
+{
+    constexpr std::size_t Passes = 8;
+    const std::size_t count = queue.size();
+    if (count < 2)
+    {
+        return;
+    }
+
+    //All histograms in one read of the keys
+    std::uint32_t histograms[Passes][256]{};
+    for (const Item& item : queue)
+    {
+        for (std::size_t pass = 0; pass != Passes; ++pass)
+        {
+            ++histograms[pass][item.key >> (8 * pass) & 0xff];
+        }
+    }
+
+    scratch.resize(count);
+    for (std::size_t pass = 0; pass != Passes; ++pass)
+    {
+        std::uint32_t* const histogram = histograms[pass];
+        const unsigned shift = unsigned(8 * pass);
+        if (histogram[queue.front().key >> shift & 0xff] == count)
+        {
+            continue;
+        }
+
+        std::uint32_t offset = 0;
+        for (std::size_t digit = 0; digit != 256; ++digit)
+        {
+            const std::uint32_t digit_count = histogram[digit];
+            histogram[digit] = offset;
+            offset += digit_count;
+        }
+
+        for (const Item& item : queue)
+        {
+            scratch[histogram[item.key >> shift & 0xff]++] = item;
+        }
+        queue.swap(scratch);
+    }
+}
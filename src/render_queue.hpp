@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Draw state packed so that sorting the keys groups draws by the most
+//expensive state change first: program in the top 8 bits, then material
+//(16), mesh (8) and the view depth as float bits (32), nearest first
+std::uint64_t make_sort_key(std::uint32_t program, std::uint32_t material, std::uint32_t mesh, float depth);
+
+inline std::uint32_t sort_key_program(std::uint64_t key)
+{
+    return std::uint32_t(key >> 56);
+}
+
+inline std::uint32_t sort_key_material(std::uint64_t key)
+{
+    return std::uint32_t(key >> 40) & 0xffff;
+}
+
+inline std::uint32_t sort_key_mesh(std::uint64_t key)
+{
+    return std::uint32_t(key >> 32) & 0xff;
+}
+
+//Draw items of one frame, sorted by key with an LSD radix sort. The item
+//index is whatever the owner draws from, e.g. an instance.
+class RenderQueue
+{
+public:
+    struct Item
+    {
+        std::uint64_t key;
+        std::uint32_t index;
+    };
+
+    void clear()
+    {
+        queue.clear();
+    }
+
+    void reserve(std::size_t count)
+    {
+        queue.reserve(count);
+        scratch.reserve(count);
+    }
+
+    void push(std::uint64_t key, std::uint32_t index)
+    {
+        queue.push_back({ key, index });
+    }
+
+    //Stable, 8 bits per pass. Bytes all keys share are skipped, so unused
+    //fields cost nothing.
+    void sort();
+
+    const std::vector<Item>& items() const
+    {
+        return queue;
+    }
+
+    std::size_t size() const
+    {
+        return queue.size();
+    }
+
+private:
+    std::vector<Item> queue;
+    std::vector<Item> scratch;
+};
@@ -0,0 +1,338 @@
+#include "shader_compiler.hpp"
+#include <Magnum/GL/Context.h>
+#include <spdlog/spdlog.h>
+
+//Same value for the ARB extension
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double elapsed_ms(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    bool parallel_compile_supported()
+    {
+        for (const std::string& extension : GL::Context::current().extensionStrings())
+        {
+            if (extension == "GL_KHR_parallel_shader_compile" || extension == "GL_ARB_parallel_shader_compile")
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* stage_name(GLenum type)
+    {
+        switch (type)
+        {
+            case GL_VERTEX_SHADER: return "vertex";
+            case GL_TESS_CONTROL_SHADER: return "tessellation control";
+            case GL_TESS_EVALUATION_SHADER: return "tessellation evaluation";
+            case GL_GEOMETRY_SHADER: return "geometry";
+            case GL_FRAGMENT_SHADER: return "fragment";
+            case GL_COMPUTE_SHADER: return "compute";
+        }
+        return "unknown";
+    }
+
+    std::string info_log(GLuint object, bool program)
+    {
+        GLint length = 0;
+        (program ? glGetProgramiv : glGetShaderiv)(object, GL_INFO_LOG_LENGTH, &length);
+        if (length <= 1)
+        {
+            return {};
+        }
+
+        std::string log(std::size_t(length), '\0');
+        GLsizei written = 0;
+        (program ? glGetProgramInfoLog : glGetShaderInfoLog)(object, length, &written, log.data());
+        log.resize(std::size_t(written));
+        return log;
+    }
+
+    //Only submits the work, the driver may compile later or on its own threads
+    std::vector<GLuint> compile_shaders(const std::vector<ShaderStageSource>& stages)
+    {
+        std::vector<GLuint> shaders;
+        shaders.reserve(stages.size());
+        for (const ShaderStageSource& stage : stages)
+        {
+            std::vector<const GLchar*> strings;
+            std::vector<GLint> lengths;
+            for (const std::string& string : stage.strings)
+            {
+                strings.push_back(string.data());
+                lengths.push_back(GLint(string.size()));
+            }
+
+            const GLuint shader = glCreateShader(stage.type);
+            glShaderSource(shader, GLsizei(strings.size()), strings.data(), lengths.data());
+            glCompileShader(shader);
+            shaders.push_back(shader);
+        }
+        return shaders;
+    }
+
+    bool completed(GLuint object, bool program)
+    {
+        GLint status = GL_FALSE;
+        (program ? glGetProgramiv : glGetShaderiv)(object, GL_COMPLETION_STATUS_KHR, &status);
+        return status == GL_TRUE;
+    }
+
+    //Blocks until every stage compiled
+    bool check_compile(const std::vector<GLuint>& shaders, std::string& log)
+    {
+        bool compiled = true;
+        for (GLuint shader : shaders)
+        {
+            GLint status = GL_FALSE;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+            if (status != GL_TRUE)
+            {
+                GLint type = 0;
+                glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+                log += std::string{ stage_name(GLenum(type)) } + " shader:\n" + info_log(shader, false);
+                compiled = false;
+            }
+        }
+        return compiled;
+    }
+
+    void link_shaders(GLuint program, const std::vector<GLuint>& shaders)
+    {
+        for (GLuint shader : shaders)
+        {
+            glAttachShader(program, shader);
+        }
+        glLinkProgram(program);
+    }
+
+    //Blocks until linked
+    bool check_link(GLuint program, std::string& log)
+    {
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status != GL_TRUE)
+        {
+            log += "link:\n" + info_log(program, true);
+        }
+        return status == GL_TRUE;
+    }
+
+    void delete_shaders(GLuint program, std::vector<GLuint>& shaders, bool attached)
+    {
+        for (GLuint shader : shaders)
+        {
+            if (attached)
+            {
+                glDetachShader(program, shader);
+            }
+            glDeleteShader(shader);
+        }
+        shaders.clear();
+    }
+
+    //Synchronous and compile thread builds
+    ProgramBuildResult build_program(GLuint program, const std::vector<ShaderStageSource>& stages, Clock::time_point start)
+    {
+        ProgramBuildResult result;
+        std::vector<GLuint> shaders = compile_shaders(stages);
+        const bool compiled = check_compile(shaders, result.log);
+        result.compile_ms = elapsed_ms(start);
+        if (compiled)
+        {
+            link_shaders(program, shaders);
+            result.linked = check_link(program, result.log);
+            result.link_ms = elapsed_ms(start) - result.compile_ms;
+        }
+        delete_shaders(program, shaders, compiled);
+        return result;
+    }
+}
+
+const char* shader_compile_mode_name(ShaderCompileMode mode)
+{
+    switch (mode)
+    {
+        case ShaderCompileMode::Synchronous: return "synchronous";
+        case ShaderCompileMode::ParallelExtension: return "KHR_parallel_shader_compile";
+        case ShaderCompileMode::WorkerThread: return "compile thread";
+    }
+    return "unknown";
+}
+
+ProgramBuild::ProgramBuild(ShaderCompileMode mode, GLuint program):
+    mode{ mode },
+    program{ program },
+    start{ Clock::now() }
+{
+}
+
+ProgramBuild::~ProgramBuild()
+{
+    if (job.valid())
+    {
+        job.wait();
+    }
+    delete_shaders(program, shaders, linking);
+}
+
+bool ProgramBuild::poll()
+{
+    return advance(false);
+}
+
+void ProgramBuild::wait()
+{
+    while (!advance(true))
+    {
+    }
+}
+
+bool ProgramBuild::advance(bool block)
+{
+    if (done)
+    {
+        return true;
+    }
+
+    if (mode == ShaderCompileMode::WorkerThread)
+    {
+        if (!block && job.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready)
+        {
+            return false;
+        }
+        build_result = job.get();
+        done = true;
+        return true;
+    }
+
+    //KHR_parallel_shader_compile, any status query but the completion one
+    //waits for the driver's threads
+    if (!linking)
+    {
+        for (GLuint shader : shaders)
+        {
+            if (!block && !completed(shader, false))
+            {
+                return false;
+            }
+        }
+
+        build_result.compile_ms = elapsed_ms(start);
+        if (!check_compile(shaders, build_result.log))
+        {
+            delete_shaders(program, shaders, false);
+            done = true;
+            return true;
+        }
+
+        link_shaders(program, shaders);
+        linking = true;
+        //Asking right away would only see it busy
+        if (!block)
+        {
+            return false;
+        }
+    }
+
+    if (!block && !completed(program, true))
+    {
+        return false;
+    }
+
+    build_result.linked = check_link(program, build_result.log);
+    build_result.link_ms = elapsed_ms(start) - build_result.compile_ms;
+    delete_shaders(program, shaders, true);
+    linking = false;
+    done = true;
+    return true;
+}
+
+ShaderCompiler::ShaderCompiler(Containers::Optional<ShaderCompileMode> requested, const SharedContextFactory& shared_context_factory)
+{
+    const bool parallel = parallel_compile_supported();
+    if (requested && *requested == ShaderCompileMode::Synchronous)
+    {
+        compile_mode = ShaderCompileMode::Synchronous;
+    }
+    else if (parallel && !(requested && *requested == ShaderCompileMode::WorkerThread))
+    {
+        //The default thread count is the driver's maximum, nothing to set
+        compile_mode = ShaderCompileMode::ParallelExtension;
+    }
+    else
+    {
+        if (requested && *requested == ShaderCompileMode::ParallelExtension)
+        {
+            spdlog::warn("KHR_parallel_shader_compile isn't supported, trying a compile thread");
+        }
+
+        if (shared_context_factory)
+        {
+            shared_context = shared_context_factory();
+        }
+        if (shared_context)
+        {
+            worker = Containers::pointer<ThreadPool>(1);
+            if (worker->submit([this](std::size_t) { return shared_context->make_current(); }).get())
+            {
+                compile_mode = ShaderCompileMode::WorkerThread;
+            }
+            else
+            {
+                worker = nullptr;
+                shared_context = Containers::NullOpt;
+            }
+        }
+        if (compile_mode != ShaderCompileMode::WorkerThread)
+        {
+            spdlog::warn("No shared GL context for a compile thread, shaders compile synchronously");
+        }
+    }
+
+    spdlog::info("Shader compilation: {}", shader_compile_mode_name(compile_mode));
+}
+
+ShaderCompiler::~ShaderCompiler()
+{
+    if (worker)
+    {
+        worker->submit([this](std::size_t) { shared_context->release(); }).wait();
+    }
+}
+
+Containers::Pointer<ProgramBuild> ShaderCompiler::submit(GLuint program, std::vector<ShaderStageSource>&& stages)
+{
+    Containers::Pointer<ProgramBuild> build{ new ProgramBuild{ compile_mode, program } };
+    switch (compile_mode)
+    {
+        case ShaderCompileMode::Synchronous:
+            build->build_result = build_program(program, stages, build->start);
+            build->done = true;
+            break;
+        case ShaderCompileMode::ParallelExtension:
+            build->shaders = compile_shaders(stages);
+            break;
+        case ShaderCompileMode::WorkerThread:
+            build->job = worker->submit([program, stages = std::move(stages), start = build->start](std::size_t)
+            {
+                ProgramBuildResult result = build_program(program, stages, start);
+                //The render thread may use the program as soon as it sees
+                //the result, the link has to be done by then
+                glFinish();
+                return result;
+            });
+            break;
+    }
+    return build;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/OpenGL.h>
+#include <Corrade/Containers/Optional.h>
+#include <Corrade/Containers/Pointer.h>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+#include "thread_pool.hpp"
+
+using namespace Magnum;
+
+enum class ShaderCompileMode
+{
+    //compiles and links inside submit(), the old way
+    Synchronous,
+    //KHR_parallel_shader_compile: the driver's threads do the work and the
+    //render thread only polls the completion status
+    ParallelExtension,
+    //raw GL calls on a thread with its own context sharing objects with the
+    //rendering one
+    WorkerThread
+};
+
+const char* shader_compile_mode_name(ShaderCompileMode mode);
+
+//Context for ShaderCompileMode::WorkerThread, created on the render thread.
+//Both functions run on the compile thread. Platform specific, see main.cpp.
+struct SharedContext
+{
+    std::function<bool()> make_current;
+    std::function<void()> release; //before the thread exits
+};
+
+//Only called when the compile thread is needed
+using SharedContextFactory = std::function<Containers::Optional<SharedContext>()>;
+
+//One stage of a program, its strings in glShaderSource() order. The first
+//has the #version directive.
+struct ShaderStageSource
+{
+    GLenum type;
+    std::vector<std::string> strings;
+};
+
+//Latencies are from ShaderCompiler::submit() until the render thread saw
+//the step finish, so with ShaderCompileMode::ParallelExtension they are
+//rounded up to the polling rate
+struct ProgramBuildResult
+{
+    bool linked = false;
+    std::string log; //compiler and linker output of the failed step
+    double compile_ms = 0.0; //every stage
+    double link_ms = 0.0; //after the stages compiled
+};
+
+class ShaderCompiler;
+
+//A program being compiled and linked, see ShaderCompiler::submit()
+class ProgramBuild
+{
+public:
+    ProgramBuild(const ProgramBuild&) = delete;
+    ProgramBuild& operator=(const ProgramBuild&) = delete;
+
+    //Waits for the compile thread, the program may go right after
+    ~ProgramBuild();
+
+    //Never blocks, true once result() is there
+    bool poll();
+
+    //Blocks until poll() would return true
+    void wait();
+
+    const ProgramBuildResult& result() const
+    {
+        return build_result;
+    }
+
+private:
+    friend ShaderCompiler;
+
+    ProgramBuild(ShaderCompileMode mode, GLuint program);
+
+    bool advance(bool block);
+
+    ShaderCompileMode mode;
+    GLuint program;
+    std::chrono::steady_clock::time_point start;
+    std::vector<GLuint> shaders; //ParallelExtension
+    bool linking = false;
+    bool done = false;
+    std::future<ProgramBuildResult> job; //WorkerThread
+    ProgramBuildResult build_result;
+};
+
+//Compiles and links programs without blocking the render thread where the
+//platform allows. Needs a current GL context, and so does everything but
+//the compile thread's work.
+class ShaderCompiler
+{
+public:
+    //NullOpt picks KHR_parallel_shader_compile (or the ARB one) if the driver
+    //has it, then a compile thread, then synchronous builds. A requested
+    //mode that isn't available falls back the same way.
+    explicit ShaderCompiler(Containers::Optional<ShaderCompileMode> requested = {},
+        const SharedContextFactory& shared_context_factory = {});
+
+    //Releases the shared context on the compile thread and joins it
+    ~ShaderCompiler();
+
+    ShaderCompiler(const ShaderCompiler&) = delete;
+    ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+    ShaderCompileMode mode() const
+    {
+        return compile_mode;
+    }
+
+    //Compiles the stages and links them into the program, which has to
+    //outlive the returned build. Attribute locations, binary retrieval hints
+    //and the like have to be set on the program before.
+    Containers::Pointer<ProgramBuild> submit(GLuint program, std::vector<ShaderStageSource>&& stages);
+
+private:
+    ShaderCompileMode compile_mode = ShaderCompileMode::Synchronous;
+    Containers::Optional<SharedContext> shared_context;
+    Containers::Pointer<ThreadPool> worker; //one thread, owns the shared context
+};
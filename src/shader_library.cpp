@@ -0,0 +1,269 @@
+#include "shader_library.hpp"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <system_error>
+
+namespace
+{
+    //How often update() looks at the files with hot reload
+    constexpr std::chrono::milliseconds WatchInterval{ 250 };
+
+    UnsignedInt permutation_key(PBRShader::Flags flags, int render_mode, PBRShader::ParallaxQuality parallax_quality)
+    {
+        //Quality only matters to the parallax variants
+        const UnsignedInt quality = flags & PBRShader::Flag::ParallaxOcclusion ? UnsignedInt(parallax_quality) : 0;
+        return UnsignedInt(UnsignedShort(flags)) << 16 | quality << 8 | UnsignedInt(render_mode);
+    }
+
+    double elapsed_ms(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+PBRShaderLibrary::PBRShaderLibrary(const ShaderLibraryOptions& options):
+    options{ options },
+    compiler{ options.compile_mode, options.shared_context },
+    files{ pbr_shader_files(options.directory) },
+    last_watch{ std::chrono::steady_clock::now() }
+{
+    if (!options.binary_cache.empty())
+    {
+        binary_cache = Containers::pointer<ProgramBinaryCache>(options.binary_cache);
+    }
+
+    Containers::Optional<PBRShaderSources> loaded = load_pbr_shader_sources(options.directory);
+    if (loaded)
+    {
+        sources = std::move(*loaded);
+        sources_loaded = true;
+    }
+
+    file_times = modification_times();
+    if (options.hot_reload)
+    {
+        spdlog::info("Watching {} for shader changes", options.directory);
+    }
+}
+
+PBRShader* PBRShaderLibrary::get(PBRShader::Flags flags, int render_mode, PBRShader::ParallaxQuality parallax_quality)
+{
+    Permutation& shader = permutation(flags, render_mode % PBRShader::RENDER_MODE_COUNT, parallax_quality);
+    //Drawn before it ever linked, nothing to fall back to. An outdated
+    //build is submitted again by retire() and waited for as well.
+    while (!shader.current && shader.pending)
+    {
+        shader.pending->wait();
+        retire(shader);
+    }
+
+    return shader.current.get();
+}
+
+void PBRShaderLibrary::preload(PBRShader::Flags flags, PBRShader::ParallaxQuality parallax_quality)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int mode = 0; mode != PBRShader::RENDER_MODE_COUNT; ++mode)
+    {
+        permutation(flags, mode, parallax_quality);
+    }
+
+    spdlog::info("{} shader permutations requested in {:.2f} ms, {} building, {}", PBRShader::RENDER_MODE_COUNT, elapsed_ms(start),
+        pending(), shader_compile_mode_name(compiler.mode()));
+}
+
+void PBRShaderLibrary::update()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (options.hot_reload && now - last_watch >= WatchInterval)
+    {
+        last_watch = now;
+
+        //Editors may replace a file in several steps, a half-written one
+        //just fails to build and the next change builds again
+        std::vector<std::filesystem::file_time_type> times = modification_times();
+        if (times != file_times)
+        {
+            file_times = std::move(times);
+            reload();
+        }
+    }
+
+    for (auto& [key, shader] : shaders)
+    {
+        if (shader.pending && shader.pending->poll() != PBRShader::Status::Building)
+        {
+            retire(shader);
+        }
+    }
+
+    report_reload();
+}
+
+bool PBRShaderLibrary::reload()
+{
+    Containers::Optional<PBRShaderSources> loaded = load_pbr_shader_sources(options.directory);
+    if (!loaded)
+    {
+        spdlog::warn("Keeping the previous shaders");
+        return false;
+    }
+
+    if (sources_loaded && loaded->hash == sources.hash)
+    {
+        return true;
+    }
+
+    sources = std::move(*loaded);
+    sources_loaded = true;
+    spdlog::info("Shader sources changed, rebuilding {} programs", shaders.size());
+    rebuild();
+    return true;
+}
+
+void PBRShaderLibrary::rebuild()
+{
+    ++generation;
+    ++library_stats.reloads;
+    reload_start = std::chrono::steady_clock::now();
+    reload_baseline = library_stats;
+    reporting_reload = true;
+
+    for (auto& [key, shader] : shaders)
+    {
+        //Dropping a running build could block on the compile thread, it's
+        //built again once done instead
+        if (shader.pending)
+        {
+            shader.outdated = true;
+        }
+        else
+        {
+            submit(shader);
+        }
+    }
+}
+
+void PBRShaderLibrary::finish()
+{
+    for (auto& [key, shader] : shaders)
+    {
+        while (shader.pending)
+        {
+            shader.pending->wait();
+            retire(shader);
+        }
+    }
+
+    report_reload();
+}
+
+std::size_t PBRShaderLibrary::pending() const
+{
+    return std::size_t(std::count_if(shaders.begin(), shaders.end(), [](const auto& entry) { return bool(entry.second.pending); }));
+}
+
+PBRShaderLibrary::Permutation& PBRShaderLibrary::permutation(PBRShader::Flags flags, int render_mode,
+    PBRShader::ParallaxQuality parallax_quality)
+{
+    const UnsignedInt key = permutation_key(flags, render_mode, parallax_quality);
+    const auto found = shaders.find(key);
+    if (found != shaders.end())
+    {
+        return found->second;
+    }
+
+    Permutation& shader = shaders[key];
+    shader.flags = flags;
+    shader.render_mode = render_mode;
+    shader.parallax_quality = parallax_quality;
+    submit(shader);
+    return shader;
+}
+
+void PBRShaderLibrary::submit(Permutation& shader)
+{
+    if (!sources_loaded)
+    {
+        return;
+    }
+
+    //Only the launch's sources go through the binary cache
+    shader.pending = Containers::pointer<PBRShader>(shader.flags, shader.render_mode, shader.parallax_quality, sources, compiler,
+        generation == 0 ? binary_cache.get() : nullptr);
+    shader.pending->set_state_cache(state_cache);
+    if (shader.pending->status() != PBRShader::Status::Building)
+    {
+        retire(shader);
+    }
+}
+
+void PBRShaderLibrary::retire(Permutation& shader)
+{
+    Containers::Pointer<PBRShader> built = std::move(shader.pending);
+    const bool ready = built->status() == PBRShader::Status::Ready;
+    if (!built->loaded_from_binary_cache())
+    {
+        const ProgramBuildResult& result = built->build_result();
+        if (ready)
+        {
+            ++library_stats.builds;
+            library_stats.compile_ms += result.compile_ms;
+            library_stats.link_ms += result.link_ms;
+            library_stats.max_compile_ms = std::max(library_stats.max_compile_ms, result.compile_ms);
+            library_stats.max_link_ms = std::max(library_stats.max_link_ms, result.link_ms);
+        }
+        else
+        {
+            ++library_stats.failed_builds;
+        }
+    }
+
+    if (shader.outdated)
+    {
+        //Built from sources that changed since, better than nothing on a
+        //first build
+        shader.outdated = false;
+        if (ready && !shader.current)
+        {
+            shader.current = std::move(built);
+        }
+        submit(shader);
+        return;
+    }
+
+    //A failed rebuild leaves the previous program drawing
+    if (ready)
+    {
+        if (shader.current)
+        {
+            ++library_stats.swaps;
+        }
+        shader.current = std::move(built);
+    }
+}
+
+void PBRShaderLibrary::report_reload()
+{
+    if (!reporting_reload || pending() != 0)
+    {
+        return;
+    }
+
+    reporting_reload = false;
+    spdlog::info("Shader rebuild done in {:.2f} ms, {} programs swapped, {} failed and kept their previous program",
+        elapsed_ms(reload_start), library_stats.swaps - reload_baseline.swaps, library_stats.failed_builds - reload_baseline.failed_builds);
+}
+
+std::vector<std::filesystem::file_time_type> PBRShaderLibrary::modification_times() const
+{
+    std::vector<std::filesystem::file_time_type> times;
+    for (const std::string& file : files)
+    {
+        //file_time_type::min() for a missing file
+        std::error_code error;
+        times.push_back(std::filesystem::last_write_time(file, error));
+    }
+    return times;
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Corrade/Containers/Optional.h>
+#include <Corrade/Containers/Pointer.h>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "gl_state_cache.hpp"
+#include "pbr_shader.hpp"
+#include "program_cache.hpp"
+#include "shader_compiler.hpp"
+
+using namespace Magnum;
+
+struct ShaderLibraryOptions
+{
+    std::string directory = "data/shaders"; //see load_pbr_shader_sources()
+    std::string binary_cache; //program binary directory, empty compiles every launch
+    Containers::Optional<ShaderCompileMode> compile_mode; //NullOpt picks the best one available
+    SharedContextFactory shared_context; //for ShaderCompileMode::WorkerThread
+    bool hot_reload = false; //rebuild every permutation when the files change, see update()
+};
+
+//Over every build from source since the library was created
+struct ShaderLibraryStats
+{
+    std::size_t builds = 0; //linked
+    std::size_t failed_builds = 0;
+    std::size_t swaps = 0; //rebuilds that replaced a program
+    std::size_t reloads = 0; //rebuilds of every permutation
+    double compile_ms = 0.0; //summed
+    double link_ms = 0.0;
+    double max_compile_ms = 0.0;
+    double max_link_ms = 0.0;
+};
+
+//PBRShader permutations keyed by flags and render mode, built on first use.
+//Builds run in the ShaderCompiler's background: a permutation drawn for the
+//first time waits for its program, a rebuilt one keeps drawing with the
+//previous program until the new one has linked, or for good if it fails.
+class PBRShaderLibrary
+{
+public:
+    //Needs a current GL context
+    explicit PBRShaderLibrary(const ShaderLibraryOptions& options = {});
+
+    //Every permutation gets the state cache, set it before the first get()
+    void set_state_cache(GLStateCache* cache)
+    {
+        state_cache = cache;
+    }
+
+    //Waits for the first build of a permutation. Null if it never linked,
+    //e.g. after a compile error at startup or in sources a hot reload broke
+    //before the permutation was first used; PBRShader logged why.
+    PBRShader* get(PBRShader::Flags flags, int render_mode,
+        PBRShader::ParallaxQuality parallax_quality = PBRShader::ParallaxQuality::Medium);
+
+    //Starts building all render modes of one flag combination up front, so
+    //switching modes later doesn't stall on a compile
+    void preload(PBRShader::Flags flags, PBRShader::ParallaxQuality parallax_quality = PBRShader::ParallaxQuality::Medium);
+
+    //Once per frame, never blocks: swaps in the rebuilt programs that have
+    //linked and, with hot reload, looks at the files' modification times a
+    //few times per second and calls reload() when they changed
+    void update();
+
+    //Reads the files again and rebuilds every permutation if the sources
+    //changed. False if a file can't be read, the current sources stay.
+    bool reload();
+
+    //Rebuilds every permutation from the current sources. Rebuilds never
+    //go through the binary cache, its load and store would run on the
+    //render thread.
+    void rebuild();
+
+    //Blocks until every build has finished and swaps the programs in
+    void finish();
+
+    //False if the files couldn't be read when the library was created,
+    //nothing can be drawn then
+    bool loaded() const
+    {
+        return sources_loaded;
+    }
+
+    std::size_t size() const
+    {
+        return shaders.size();
+    }
+
+    //Builds still running
+    std::size_t pending() const;
+
+    ShaderCompileMode compile_mode() const
+    {
+        return compiler.mode();
+    }
+
+    const ShaderLibraryStats& stats() const
+    {
+        return library_stats;
+    }
+
+private:
+    struct Permutation
+    {
+        PBRShader::Flags flags;
+        int render_mode = 0;
+        PBRShader::ParallaxQuality parallax_quality = PBRShader::ParallaxQuality::Medium;
+        Containers::Pointer<PBRShader> current; //Ready
+        Containers::Pointer<PBRShader> pending;
+        bool outdated = false; //the sources changed while pending was building
+    };
+
+    Permutation& permutation(PBRShader::Flags flags, int render_mode, PBRShader::ParallaxQuality parallax_quality);
+    void submit(Permutation& permutation);
+    //Once pending isn't Building any more
+    void retire(Permutation& permutation);
+    void report_reload();
+    std::vector<std::filesystem::file_time_type> modification_times() const;
+
+    ShaderLibraryOptions options;
+    ShaderCompiler compiler;
+    Containers::Pointer<ProgramBinaryCache> binary_cache;
+    GLStateCache* state_cache = nullptr;
+    PBRShaderSources sources;
+    bool sources_loaded = false;
+    std::size_t generation = 0; //of the sources, 0 is the launch
+    std::vector<std::string> files;
+    std::vector<std::filesystem::file_time_type> file_times;
+    std::chrono::steady_clock::time_point last_watch;
+    std::chrono::steady_clock::time_point reload_start;
+    bool reporting_reload = false; //logs when the last rebuild of a reload is done
+    ShaderLibraryStats reload_baseline;
+    ShaderLibraryStats library_stats;
+    std::unordered_map<UnsignedInt, Permutation> shaders;
+};
@@ -0,0 +1,54 @@
+#include "simd.hpp"
+#include <algorithm>
+#include <atomic>
+
+#if defined(DEMO_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+    SimdLevel detect_simd_level()
+    {
+#if defined(DEMO_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#elif defined(DEMO_SIMD_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        const bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+        const bool fma = info[2] & (1 << 12);
+        __cpuidex(info, 7, 0);
+        return os_saves_ymm && fma && (info[1] & (1 << 5)) ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+
+    std::atomic<SimdLevel> level_limit{ SimdLevel::AVX2 };
+}
+
+SimdLevel simd_level()
+{
+    static const SimdLevel detected = detect_simd_level();
+    return std::min(detected, level_limit.load(std::memory_order_relaxed));
+}
+
+void set_simd_level_limit(SimdLevel limit)
+{
+    level_limit.store(limit, std::memory_order_relaxed);
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::AVX2:
+            return "AVX2";
+        case SimdLevel::SSE2:
+            return "SSE2";
+        case SimdLevel::Scalar:
+        default:
+            return "scalar";
+    }
+}
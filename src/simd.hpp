@@ -0,0 +1,29 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DEMO_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+//AVX2 kernels are compiled per function and picked at runtime, so the rest of
+//the project doesn't need -mavx2
+#if defined(DEMO_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define DEMO_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define DEMO_TARGET_AVX2
+#endif
+
+enum class SimdLevel
+{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+//Best level the CPU supports, capped by set_simd_level_limit()
+SimdLevel simd_level();
+
+//Lets benchmarks compare code paths, not thread-safe w.r.t. running kernels
+void set_simd_level_limit(SimdLevel limit);
+
+const char* simd_level_name(SimdLevel level);
@@ -0,0 +1,250 @@
+#include "software_benchmark.hpp"
+#include "benchmark.hpp"
+#include "offscreen_target.hpp"
+#include "simd.hpp"
+#include "software_rasterizer.hpp"
+#include <Magnum/GL/Framebuffer.h>
+#include <Magnum/Image.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/Primitives/UVSphere.h>
+#include <Magnum/Trade/AbstractImageConverter.h>
+#include <Magnum/Trade/MeshData.h>
+#include <Corrade/Containers/Pointer.h>
+#include <Corrade/PluginManager/Manager.h>
+#include <Corrade/Utility/Directory.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <initializer_list>
+#include <thread>
+
+namespace
+{
+    //DemoScene's finest sphere tessellation
+    constexpr UnsignedInt SphereRings = 128;
+
+    //Points of the benchmark script every render mode is compared at, a
+    //half orbit of the light apart
+    constexpr std::size_t ComparisonFrames[]{ 0, 120 };
+
+    const char* const render_mode_names[PBRShader::RENDER_MODE_COUNT]{ "basic", "albedo", "roughness", "metallic", "normal", "ao" };
+
+    struct SoftwareScene
+    {
+        SoftwareMaterial material;
+        MeshGeometry sphere;
+    };
+
+    Containers::Optional<SoftwareScene> load_software_scene(TextureLoader& loader, ThreadPool& pool, const std::vector<TextureSpec>& specs,
+        MaterialLayout layout)
+    {
+        Containers::Optional<SoftwareMaterial> material = software_material(layout, loader.decode(specs), pool);
+        if (!material)
+        {
+            return Containers::NullOpt;
+        }
+
+        return SoftwareScene{ std::move(*material), mesh_geometry(Primitives::uvSphereSolid(SphereRings, SphereRings,
+            Primitives::UVSphereFlag::Tangents | Primitives::UVSphereFlag::TextureCoordinates)) };
+    }
+
+    //What DemoScene sets up for the single sphere
+    SoftwareView software_view(const SceneFrame& frame, const Vector2i& size)
+    {
+        const SceneCamera camera = scene_camera(frame.time, size);
+
+        SoftwareView view;
+        view.model_view = camera.view * camera.model;
+        view.normal_matrix = view.model_view.normalMatrix();
+        view.projection = camera.projection;
+        view.light_direction = frame.light_direction;
+        view.material_factors = frame.material_factors;
+        view.height_factor = SceneHeightFactor;
+        view.render_mode = frame.render_mode;
+        return view;
+    }
+
+    Containers::Pointer<Trade::AbstractImageConverter> png_converter(PluginManager::Manager<Trade::AbstractImageConverter>& manager,
+        const std::string& directory)
+    {
+        if (!Utility::Directory::mkpath(directory))
+        {
+            spdlog::error("Can't create {}", directory);
+            return {};
+        }
+
+        Containers::Pointer<Trade::AbstractImageConverter> converter = manager.loadAndInstantiate("PngImageConverter");
+        if (!converter)
+        {
+            spdlog::error("Can't load PngImageConverter");
+        }
+        return converter;
+    }
+
+    bool write_png(Trade::AbstractImageConverter& converter, const Image2D& image, const std::string& path)
+    {
+        if (!converter.exportToFile(image, path))
+        {
+            spdlog::error("Can't write {}", path);
+            return false;
+        }
+        return true;
+    }
+}
+
+bool run_software_benchmark(TextureLoader& loader, ThreadPool& pool, const std::vector<TextureSpec>& specs,
+    const SoftwareBenchmarkConfig& config)
+{
+    Containers::Optional<SoftwareScene> scene = load_software_scene(loader, pool, specs, config.layout);
+    if (!scene)
+    {
+        return false;
+    }
+
+    std::size_t max_threads = config.max_threads;
+    if (max_threads == 0)
+    {
+        max_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const std::size_t frames = std::max<std::size_t>(config.frames, 1);
+    spdlog::info("Software rasterizer benchmark, {}x{}, {} frames, {} triangles", config.resolution.x(), config.resolution.y(),
+        frames, scene->sphere.indices.size() / 3);
+
+    //Workers plus the calling thread
+    std::vector<std::size_t> worker_counts;
+    for (std::size_t workers = 1; workers < max_threads; workers *= 2)
+    {
+        worker_counts.push_back(workers);
+    }
+    worker_counts.push_back(std::max<std::size_t>(max_threads - 1, 1));
+    worker_counts.erase(std::unique(worker_counts.begin(), worker_counts.end()), worker_counts.end());
+
+    //The kernels are scalar or AVX2, SSE2 would run the scalar one again
+    const SimdLevel best_level = simd_level();
+    for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::AVX2 })
+    {
+        if (level > best_level)
+        {
+            continue;
+        }
+        set_simd_level_limit(level);
+
+        double baseline_ms = 0.0;
+        for (std::size_t workers : worker_counts)
+        {
+            ThreadPool workers_pool{ workers };
+            SoftwareRasterizer rasterizer{ workers_pool, config.resolution };
+
+            //Buffers and bins grow to their steady size
+            rasterizer.draw(scene->sphere, scene->material, software_view(benchmark_frame(0), config.resolution));
+
+            SoftwareRenderStats totals;
+            const auto start = std::chrono::steady_clock::now();
+            for (std::size_t frame = 0; frame != frames; ++frame)
+            {
+                rasterizer.draw(scene->sphere, scene->material, software_view(benchmark_frame(frame), config.resolution));
+                const SoftwareRenderStats& stats = rasterizer.stats();
+                totals.vertex_ms += stats.vertex_ms;
+                totals.binning_ms += stats.binning_ms;
+                totals.raster_ms += stats.raster_ms;
+                totals.tile_triangles += stats.tile_triangles;
+                totals.shaded_blocks += stats.shaded_blocks;
+            }
+            const double frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+            if (baseline_ms == 0.0)
+            {
+                baseline_ms = frame_ms;
+            }
+
+            spdlog::info("  {:6} {:3} threads: {:8.1f} MP/s ({:.2f}x), {:.2f} ms per frame: vertices {:.2f}, binning {:.2f}, tiles {:.2f}, "
+                "{} binned triangles, {} shaded 4x2 blocks", simd_level_name(level), workers + 1,
+                config.resolution.product() / frame_ms / 1.0e3, baseline_ms / frame_ms, frame_ms, totals.vertex_ms / frames,
+                totals.binning_ms / frames, totals.raster_ms / frames, totals.tile_triangles / frames, totals.shaded_blocks / frames);
+        }
+    }
+
+    set_simd_level_limit(best_level);
+
+    PluginManager::Manager<Trade::AbstractImageConverter> manager;
+    Containers::Pointer<Trade::AbstractImageConverter> converter = png_converter(manager, config.output_directory);
+    if (!converter)
+    {
+        return false;
+    }
+
+    SoftwareRasterizer rasterizer{ pool, config.resolution };
+    bool written = true;
+    for (int mode = 0; mode != PBRShader::RENDER_MODE_COUNT; ++mode)
+    {
+        SceneFrame frame = benchmark_frame(0);
+        frame.render_mode = mode;
+        rasterizer.draw(scene->sphere, scene->material, software_view(frame, config.resolution));
+        written = write_png(*converter, rasterizer.image(), Utility::Directory::join(config.output_directory,
+            std::string{ "software_" } + render_mode_names[mode] + ".png")) && written;
+    }
+
+    spdlog::info("  render modes written to {}", config.output_directory);
+    return written;
+}
+
+bool run_software_comparison(DemoScene& scene, TextureLoader& loader, ThreadPool& pool, const std::vector<TextureSpec>& specs,
+    const SoftwareBenchmarkConfig& config)
+{
+    Containers::Optional<SoftwareScene> software_scene = load_software_scene(loader, pool, specs, config.layout);
+    if (!software_scene)
+    {
+        return false;
+    }
+
+    PluginManager::Manager<Trade::AbstractImageConverter> manager;
+    Containers::Pointer<Trade::AbstractImageConverter> converter = png_converter(manager, config.output_directory);
+    if (!converter)
+    {
+        return false;
+    }
+
+    OffscreenTarget target{ config.resolution };
+    if (!target.bind())
+    {
+        return false;
+    }
+
+    SoftwareRasterizer rasterizer{ pool, config.resolution };
+    spdlog::info("Software rasterizer against GL at {}x{}, at least {:.1f} dB PSNR in every render mode", config.resolution.x(),
+        config.resolution.y(), config.min_psnr);
+
+    bool passed = true;
+    for (int mode = 0; mode != PBRShader::RENDER_MODE_COUNT; ++mode)
+    {
+        double worst_psnr = 100.0;
+        for (std::size_t frame : ComparisonFrames)
+        {
+            SceneFrame scene_frame = benchmark_frame(frame);
+            scene_frame.render_mode = mode;
+
+            target.framebuffer.clear(GL::FramebufferClear::Color | GL::FramebufferClear::Depth);
+            scene.draw(scene_frame, config.resolution);
+            const Image2D reference = target.framebuffer.read({ {}, config.resolution }, { PixelFormat::RGBA8Unorm });
+
+            rasterizer.draw(software_scene->sphere, software_scene->material, software_view(scene_frame, config.resolution));
+            const Image2D image = rasterizer.image();
+            worst_psnr = std::min(worst_psnr, image_psnr(image, reference));
+
+            if (frame == ComparisonFrames[0])
+            {
+                const std::string name = std::string{ render_mode_names[mode] } + ".png";
+                passed = write_png(*converter, reference, Utility::Directory::join(config.output_directory, "gl_" + name)) && passed;
+                passed = write_png(*converter, image, Utility::Directory::join(config.output_directory, "software_" + name)) && passed;
+            }
+        }
+
+        const bool matches = worst_psnr >= config.min_psnr;
+        passed = passed && matches;
+        spdlog::info("  {:>9}: {:6.2f} dB{}, {:.2f} ms on {} threads", render_mode_names[mode], worst_psnr, matches ? "" : " FAILED",
+            rasterizer.stats().total_ms, pool.size() + 1);
+    }
+
+    spdlog::info("  images written to {}", config.output_directory);
+    return passed;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector2.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "demo_scene.hpp"
+#include "material_packer.hpp"
+#include "texture_loader.hpp"
+#include "thread_pool.hpp"
+
+using namespace Magnum;
+
+struct SoftwareBenchmarkConfig
+{
+    MaterialLayout layout = MaterialLayout::Separate;
+    Vector2i resolution{ 1024, 1024 };
+    std::size_t frames = 60; //of the benchmark script, per thread count and SIMD level
+    std::size_t max_threads = 0; //0 -> hardware concurrency
+    std::string output_directory = "software"; //PNGs of every render mode
+    double min_psnr = 30.0; //comparison against GL only
+};
+
+//Renders the benchmark script's sphere with the software rasterizer over
+//SIMD levels and thread counts and logs megapixels per second, then writes
+//the first frame in every render mode. No GL context needed.
+bool run_software_benchmark(TextureLoader& loader, ThreadPool& pool, const std::vector<TextureSpec>& specs,
+    const SoftwareBenchmarkConfig& config);
+
+//Renders every render mode with the scene and the software rasterizer and
+//fails if any PSNR is below the config's minimum. The scene has to draw the
+//single sphere with per-vertex displacement at the finest tessellation,
+//without image-based or local lights and post process.
+bool run_software_comparison(DemoScene& scene, TextureLoader& loader, ThreadPool& pool, const std::vector<TextureSpec>& specs,
+    const SoftwareBenchmarkConfig& config);
@@ -0,0 +1,1067 @@
+#include "software_rasterizer.hpp"
+#include "mip_chain.hpp"
+#include "profiler.hpp"
+#include "simd.hpp"
+#include <Magnum/ImageView.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/PixelFormat.h>
+#include <Corrade/Containers/Array.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+    using Vertex = SoftwareRasterizer::Vertex;
+    using Triangle = SoftwareRasterizer::Triangle;
+    using MaterialMap = PBRShader::MaterialMap;
+
+    double elapsed_ms(Clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+
+    constexpr Int TileSize = 64;
+    constexpr std::size_t VertexGrain = 1024;
+    //Triangles per binning chunk, tiles replay the chunks in order
+    constexpr std::size_t BinGrain = 2048;
+
+    //The fragment shader's RENDER_MODE values
+    enum RenderMode : int
+    {
+        BasicMode,
+        AlbedoMode,
+        RoughnessMode,
+        MetallicMode,
+        NormalMode,
+        AoMode
+    };
+
+    //Pixel offsets of the lanes of a 4x2 block, two 2x2 quads side by side
+    constexpr int LaneX[8]{ 0, 1, 0, 1, 2, 3, 2, 3 };
+    constexpr int LaneY[8]{ 0, 0, 1, 1, 0, 0, 1, 1 };
+
+    constexpr float Gamma = 2.2f;
+
+    const std::array<float, 256>& srgb_to_linear_table()
+    {
+        static const std::array<float, 256> table = []
+        {
+            std::array<float, 256> result{};
+            for (std::size_t i = 0; i < result.size(); ++i)
+            {
+                const float c = i / 255.0f;
+                result[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return result;
+        }();
+
+        return table;
+    }
+
+    //What the pixel kernels need besides the triangle
+    struct ShadeSetup
+    {
+        const SoftwareMaterial* material;
+        const float* srgb_table;
+        unsigned channels[PBRShader::MaterialMapCount]; //bit mask of the channels sampled per texture, 0 skips it
+        Vector3 light; //towards the light
+        Vector3 light_color;
+        Vector3 factors;
+        int render_mode;
+    };
+
+    //One tile of the padded color and depth buffers
+    struct TileTarget
+    {
+        std::uint32_t* color;
+        float* depth;
+        Int stride;
+        Vector2i min;
+        Vector2i max;
+    };
+
+    //Bitmask of the channels a map is read from
+    unsigned map_channels(const SoftwareMaterial& material, MaterialMap map, unsigned count)
+    {
+        return ((1u << count) - 1) << material.map_channel[std::size_t(map)];
+    }
+
+    ShadeSetup shade_setup(const SoftwareMaterial& material, const SoftwareView& view)
+    {
+        ShadeSetup setup{};
+        setup.material = &material;
+        setup.srgb_table = srgb_to_linear_table().data();
+        setup.light = (-view.light_direction).normalized();
+        setup.light_color = view.light_color;
+        setup.factors = view.material_factors;
+        setup.render_mode = view.render_mode;
+
+        //Only what the render mode reads, like the shader permutations
+        const auto sample = [&](MaterialMap map, unsigned count)
+        {
+            setup.channels[material.map_texture[std::size_t(map)]] |= map_channels(material, map, count);
+        };
+        switch (view.render_mode)
+        {
+            case AlbedoMode:
+                sample(MaterialMap::Albedo, 4);
+                break;
+            case RoughnessMode:
+                sample(MaterialMap::Roughness, 1);
+                break;
+            case MetallicMode:
+                sample(MaterialMap::Metallic, 1);
+                break;
+            case NormalMode:
+                sample(MaterialMap::Normal, 2);
+                break;
+            case AoMode:
+                sample(MaterialMap::AO, 1);
+                break;
+            default:
+                sample(MaterialMap::Albedo, 4);
+                sample(MaterialMap::Normal, 2);
+                sample(MaterialMap::AO, 1);
+                break;
+        }
+
+        return setup;
+    }
+
+    float decode_channel(std::uint32_t texel, unsigned channel, bool srgb, const float* srgb_table)
+    {
+        const std::uint32_t value = (texel >> (8 * channel)) & 0xff;
+        return srgb && channel < 3 ? srgb_table[value] : value * (1.0f / 255.0f);
+    }
+
+    //Bilinear, clamped to the edge. NaN coordinates of helper pixels end up
+    //on the edge too.
+    void sample_level(const SoftwareTexture& texture, std::size_t level, float u, float v, unsigned channels,
+        const float* srgb_table, float* out)
+    {
+        const Vector2i size = texture.sizes[level];
+        const float x = std::min(float(size.x()), std::max(-1.0f, u * size.x() - 0.5f));
+        const float y = std::min(float(size.y()), std::max(-1.0f, v * size.y() - 0.5f));
+        const float x_floor = std::floor(x);
+        const float y_floor = std::floor(y);
+        const float fx = x - x_floor;
+        const float fy = y - y_floor;
+
+        const Int x0 = std::clamp(Int(x_floor), 0, size.x() - 1);
+        const Int x1 = std::clamp(Int(x_floor) + 1, 0, size.x() - 1);
+        const Int y0 = std::clamp(Int(y_floor), 0, size.y() - 1);
+        const Int y1 = std::clamp(Int(y_floor) + 1, 0, size.y() - 1);
+        const std::uint32_t* texels = texture.texels.data() + texture.offsets[level];
+        const std::uint32_t t00 = texels[y0 * size.x() + x0];
+        const std::uint32_t t10 = texels[y0 * size.x() + x1];
+        const std::uint32_t t01 = texels[y1 * size.x() + x0];
+        const std::uint32_t t11 = texels[y1 * size.x() + x1];
+
+        for (unsigned c = 0; c != 4; ++c)
+        {
+            if (!(channels & (1u << c)))
+            {
+                continue;
+            }
+
+            const float c00 = decode_channel(t00, c, texture.srgb, srgb_table);
+            const float c10 = decode_channel(t10, c, texture.srgb, srgb_table);
+            const float c01 = decode_channel(t01, c, texture.srgb, srgb_table);
+            const float c11 = decode_channel(t11, c, texture.srgb, srgb_table);
+            const float top = c00 + (c10 - c00) * fx;
+            const float bottom = c01 + (c11 - c01) * fx;
+            out[c] = top + (bottom - top) * fy;
+        }
+    }
+
+    //Trilinear between the two levels around `lod`
+    void sample_texture(const SoftwareTexture& texture, float u, float v, float lod, unsigned channels,
+        const float* srgb_table, float* out)
+    {
+        const float max_lod = float(texture.sizes.size() - 1);
+        lod = std::min(max_lod, std::max(0.0f, lod));
+        const std::size_t level = std::size_t(lod);
+        const float fraction = lod - float(level);
+
+        sample_level(texture, level, u, v, channels, srgb_table, out);
+        if (fraction > 0.0f)
+        {
+            float next[4];
+            sample_level(texture, level + 1, u, v, channels, srgb_table, next);
+            for (unsigned c = 0; c != 4; ++c)
+            {
+                if (channels & (1u << c))
+                {
+                    out[c] += (next[c] - out[c]) * fraction;
+                }
+            }
+        }
+    }
+
+    //GL's scale factor from the texture coordinate derivatives, no anisotropy
+    float texture_lod(const SoftwareTexture& texture, float du_dx, float dv_dx, float du_dy, float dv_dy)
+    {
+        const Vector2 size{ texture.sizes[0] };
+        const float rho_x = du_dx * du_dx * size.x() * size.x() + dv_dx * dv_dx * size.y() * size.y();
+        const float rho_y = du_dy * du_dy * size.x() * size.x() + dv_dy * dv_dy * size.y() * size.y();
+        return 0.5f * std::log2(std::max(std::max(rho_x, rho_y), 1.0e-20f));
+    }
+
+    std::uint32_t pack_color(float r, float g, float b, float a)
+    {
+        const auto unorm = [](float c)
+        {
+            return std::uint32_t(std::min(1.0f, std::max(0.0f, c)) * 255.0f + 0.5f);
+        };
+        return unorm(r) | unorm(g) << 8 | unorm(b) << 16 | unorm(a) << 24;
+    }
+
+    //The fragment shader without image-based and local lighting for one
+    //pixel, samples[texture][channel] as picked by ShadeSetup::channels
+    std::uint32_t shade_pixel(const ShadeSetup& setup, const float (*samples)[4], const Vector3& tangent,
+        const Vector3& bitangent, const Vector3& normal)
+    {
+        const SoftwareMaterial& material = *setup.material;
+        const auto map = [&](MaterialMap which, std::size_t channel = 0)
+        {
+            return samples[material.map_texture[std::size_t(which)]][material.map_channel[std::size_t(which)] + channel];
+        };
+
+        float r, g, b, a = 1.0f;
+        if (setup.render_mode == RoughnessMode)
+        {
+            r = g = b = map(MaterialMap::Roughness) * setup.factors.y();
+        }
+        else if (setup.render_mode == MetallicMode)
+        {
+            r = g = b = map(MaterialMap::Metallic) * setup.factors.z();
+        }
+        else if (setup.render_mode == AoMode)
+        {
+            r = g = b = map(MaterialMap::AO);
+        }
+        else if (setup.render_mode == AlbedoMode)
+        {
+            r = map(MaterialMap::Albedo, 0) * setup.factors.x();
+            g = map(MaterialMap::Albedo, 1) * setup.factors.x();
+            b = map(MaterialMap::Albedo, 2) * setup.factors.x();
+            a = map(MaterialMap::Albedo, 3) * setup.factors.x();
+        }
+        else
+        {
+            //Only XY are stored, Z is always positive in tangent space
+            const float x = map(MaterialMap::Normal, 0) * 2.0f - 1.0f;
+            const float y = map(MaterialMap::Normal, 1) * 2.0f - 1.0f;
+            const float z = std::sqrt(std::max(1.0f - x * x - y * y, 0.0f));
+            const Vector3 n = (tangent * x + bitangent * y + normal * z).normalized();
+
+            if (setup.render_mode == NormalMode)
+            {
+                r = n.x() * 0.5f + 0.5f;
+                g = n.y() * 0.5f + 0.5f;
+                b = n.z() * 0.5f + 0.5f;
+            }
+            else
+            {
+                const float n_dot_l = std::max(Math::dot(n, setup.light), 0.1f);
+                const float ao = map(MaterialMap::AO);
+                const float albedo_factor = setup.factors.x();
+                r = (0.1f + n_dot_l * setup.light_color.x() * ao * 0.9f) * map(MaterialMap::Albedo, 0) * albedo_factor;
+                g = (0.1f + n_dot_l * setup.light_color.y() * ao * 0.9f) * map(MaterialMap::Albedo, 1) * albedo_factor;
+                b = (0.1f + n_dot_l * setup.light_color.z() * ao * 0.9f) * map(MaterialMap::Albedo, 2) * albedo_factor;
+                a = (0.1f + n_dot_l * 0.9f) * map(MaterialMap::Albedo, 3) * albedo_factor;
+            }
+        }
+
+        return pack_color(std::pow(std::max(0.0f, r), 1.0f / Gamma), std::pow(std::max(0.0f, g), 1.0f / Gamma),
+            std::pow(std::max(0.0f, b), 1.0f / Gamma), a);
+    }
+
+    //Block range of a triangle within a tile, blocks are aligned to 4x2
+    bool block_range(const Triangle& triangle, const TileTarget& target, Vector2i& begin, Vector2i& end)
+    {
+        begin = Math::max(triangle.min, target.min);
+        end = Math::min(triangle.max, target.max);
+        begin.x() &= ~3;
+        begin.y() &= ~1;
+        return begin.x() < end.x() && begin.y() < end.y();
+    }
+
+    //Returns the number of blocks with a pixel passing the depth test
+    using RasterKernel = std::size_t(*)(const Triangle&, const Vertex*, const ShadeSetup&, const TileTarget&);
+
+    std::size_t rasterize_scalar(const Triangle& triangle, const Vertex* vertices, const ShadeSetup& setup, const TileTarget& target)
+    {
+        Vector2i begin, end;
+        if (!block_range(triangle, target, begin, end))
+        {
+            return 0;
+        }
+
+        const SoftwareMaterial& material = *setup.material;
+        const Vertex* v[3]{ &vertices[triangle.vertices[0]], &vertices[triangle.vertices[1]], &vertices[triangle.vertices[2]] };
+
+        std::size_t shaded = 0;
+        for (Int by = begin.y(); by < end.y(); by += 2)
+        {
+            for (Int bx = begin.x(); bx < end.x(); bx += 4)
+            {
+                float e[3][8];
+                float z[8];
+                bool covered[8];
+                bool any = false;
+                for (int lane = 0; lane != 8; ++lane)
+                {
+                    const float px = bx + LaneX[lane] + 0.5f;
+                    const float py = by + LaneY[lane] + 0.5f;
+                    bool inside = true;
+                    for (int i = 0; i != 3; ++i)
+                    {
+                        e[i][lane] = triangle.edge_x[i] * px + triangle.edge_y[i] * py + triangle.edge_c[i];
+                        inside = inside && (e[i][lane] > 0.0f || (e[i][lane] == 0.0f && triangle.top_left[i]));
+                    }
+
+                    z[lane] = e[0][lane] * v[0]->depth + e[1][lane] * v[1]->depth + e[2][lane] * v[2]->depth;
+                    const std::size_t pixel = std::size_t(by + LaneY[lane]) * target.stride + bx + LaneX[lane];
+                    covered[lane] = inside && z[lane] < target.depth[pixel];
+                    any = any || covered[lane];
+                }
+
+                if (!any)
+                {
+                    continue;
+                }
+                ++shaded;
+
+                //Perspective-correct attributes of all eight lanes, the
+                //uncovered ones only feed the derivatives
+                float u[8], tv[8];
+                Vector3 tangent[8], bitangent[8], normal[8];
+                for (int lane = 0; lane != 8; ++lane)
+                {
+                    float p[3];
+                    for (int i = 0; i != 3; ++i)
+                    {
+                        p[i] = e[i][lane] * v[i]->inv_w;
+                    }
+                    const float scale = 1.0f / (p[0] + p[1] + p[2]);
+                    for (int i = 0; i != 3; ++i)
+                    {
+                        p[i] *= scale;
+                    }
+
+                    u[lane] = p[0] * v[0]->tex_coord.x() + p[1] * v[1]->tex_coord.x() + p[2] * v[2]->tex_coord.x();
+                    tv[lane] = p[0] * v[0]->tex_coord.y() + p[1] * v[1]->tex_coord.y() + p[2] * v[2]->tex_coord.y();
+                    tangent[lane] = p[0] * v[0]->tangent + p[1] * v[1]->tangent + p[2] * v[2]->tangent;
+                    bitangent[lane] = p[0] * v[0]->bitangent + p[1] * v[1]->bitangent + p[2] * v[2]->bitangent;
+                    normal[lane] = p[0] * v[0]->normal + p[1] * v[1]->normal + p[2] * v[2]->normal;
+                }
+
+                for (int lane = 0; lane != 8; ++lane)
+                {
+                    if (!covered[lane])
+                    {
+                        continue;
+                    }
+
+                    //Differences within the lane's 2x2 quad
+                    const int quad = lane & 4;
+                    const int row = quad + (lane & 2);
+                    const int column = quad + (lane & 1);
+                    const float du_dx = u[row + 1] - u[row];
+                    const float dv_dx = tv[row + 1] - tv[row];
+                    const float du_dy = u[column + 2] - u[column];
+                    const float dv_dy = tv[column + 2] - tv[column];
+
+                    float samples[PBRShader::MaterialMapCount][4];
+                    for (std::size_t t = 0; t != material.textures.size(); ++t)
+                    {
+                        if (setup.channels[t])
+                        {
+                            const SoftwareTexture& texture = material.textures[t];
+                            sample_texture(texture, u[lane], tv[lane], texture_lod(texture, du_dx, dv_dx, du_dy, dv_dy),
+                                setup.channels[t], setup.srgb_table, samples[t]);
+                        }
+                    }
+
+                    const std::size_t pixel = std::size_t(by + LaneY[lane]) * target.stride + bx + LaneX[lane];
+                    target.color[pixel] = shade_pixel(setup, samples, tangent[lane], bitangent[lane], normal[lane]);
+                    target.depth[pixel] = z[lane];
+                }
+            }
+        }
+
+        return shaded;
+    }
+
+#ifdef DEMO_SIMD_X86
+    DEMO_TARGET_AVX2 inline __m256 lerp_avx2(__m256 a, __m256 b, __m256 t)
+    {
+        return _mm256_fmadd_ps(_mm256_sub_ps(b, a), t, a);
+    }
+
+    //Polynomial on the mantissa, x > 0
+    DEMO_TARGET_AVX2 inline __m256 log2_avx2(__m256 x)
+    {
+        const __m256i bits = _mm256_castps_si256(x);
+        const __m256 exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+        const __m256 mantissa = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)),
+            _mm256_set1_epi32(0x3f800000)));
+
+        const __m256 t = _mm256_sub_ps(mantissa, _mm256_set1_ps(1.0f));
+        __m256 p = _mm256_set1_ps(-0.0341607262f);
+        p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(0.144644091f));
+        p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(-0.30100982f));
+        p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(0.468012213f));
+        p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(-0.720173248f));
+        p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(1.44266875f));
+        return _mm256_fmadd_ps(p, t, exponent);
+    }
+
+    //Polynomial on the fraction times the integer part put into the exponent
+    DEMO_TARGET_AVX2 inline __m256 exp2_avx2(__m256 x)
+    {
+        x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(126.0f));
+        const __m256 whole = _mm256_floor_ps(x);
+        const __m256 f = _mm256_sub_ps(x, whole);
+
+        __m256 p = _mm256_set1_ps(0.0136765608f);
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(0.0516670284f));
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(0.241709986f));
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(0.692931415f));
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.00000727f));
+
+        const __m256i scale = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(whole), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(scale));
+    }
+
+    DEMO_TARGET_AVX2 inline __m256 gamma_avx2(__m256 x)
+    {
+        x = _mm256_max_ps(x, _mm256_set1_ps(1.0e-30f));
+        return exp2_avx2(_mm256_mul_ps(log2_avx2(x), _mm256_set1_ps(1.0f / Gamma)));
+    }
+
+    DEMO_TARGET_AVX2 inline __m256 decode_channel_avx2(__m256i texels, unsigned channel, bool srgb, const float* srgb_table)
+    {
+        const __m256i value = _mm256_and_si256(_mm256_srlv_epi32(texels, _mm256_set1_epi32(int(8 * channel))), _mm256_set1_epi32(0xff));
+        return srgb && channel < 3 ? _mm256_i32gather_ps(srgb_table, value, 4)
+            : _mm256_mul_ps(_mm256_cvtepi32_ps(value), _mm256_set1_ps(1.0f / 255.0f));
+    }
+
+    //sample_level() with a level per lane
+    DEMO_TARGET_AVX2 void sample_level_avx2(const SoftwareTexture& texture, __m256i level, __m256 u, __m256 v, unsigned channels,
+        const float* srgb_table, __m256* out)
+    {
+        const int* sizes = reinterpret_cast<const int*>(texture.sizes.data());
+        const __m256i size_index = _mm256_slli_epi32(level, 1);
+        const __m256i width = _mm256_i32gather_epi32(sizes, size_index, 4);
+        const __m256i height = _mm256_i32gather_epi32(sizes + 1, size_index, 4);
+        const __m256i offset = _mm256_i32gather_epi32(reinterpret_cast<const int*>(texture.offsets.data()), level, 4);
+
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 x = _mm256_fmsub_ps(u, _mm256_cvtepi32_ps(width), half);
+        const __m256 y = _mm256_fmsub_ps(v, _mm256_cvtepi32_ps(height), half);
+        const __m256 x_floor = _mm256_floor_ps(x);
+        const __m256 y_floor = _mm256_floor_ps(y);
+        const __m256 fx = _mm256_sub_ps(x, x_floor);
+        const __m256 fy = _mm256_sub_ps(y, y_floor);
+
+        //Out of range and NaN coordinates convert to INT_MIN and get clamped
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i max_x = _mm256_sub_epi32(width, one);
+        const __m256i max_y = _mm256_sub_epi32(height, one);
+        const __m256i ix = _mm256_cvttps_epi32(x_floor);
+        const __m256i iy = _mm256_cvttps_epi32(y_floor);
+        const __m256i x0 = _mm256_min_epi32(_mm256_max_epi32(ix, zero), max_x);
+        const __m256i x1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(ix, one), zero), max_x);
+        const __m256i row0 = _mm256_add_epi32(offset, _mm256_mullo_epi32(_mm256_min_epi32(_mm256_max_epi32(iy, zero), max_y), width));
+        const __m256i row1 = _mm256_add_epi32(offset, _mm256_mullo_epi32(_mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(iy, one), zero), max_y), width));
+
+        const int* texels = reinterpret_cast<const int*>(texture.texels.data());
+        const __m256i t00 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, x0), 4);
+        const __m256i t10 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, x1), 4);
+        const __m256i t01 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x0), 4);
+        const __m256i t11 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x1), 4);
+
+        for (unsigned c = 0; c != 4; ++c)
+        {
+            if (!(channels & (1u << c)))
+            {
+                continue;
+            }
+
+            const __m256 top = lerp_avx2(decode_channel_avx2(t00, c, texture.srgb, srgb_table),
+                decode_channel_avx2(t10, c, texture.srgb, srgb_table), fx);
+            const __m256 bottom = lerp_avx2(decode_channel_avx2(t01, c, texture.srgb, srgb_table),
+                decode_channel_avx2(t11, c, texture.srgb, srgb_table), fx);
+            out[c] = lerp_avx2(top, bottom, fy);
+        }
+    }
+
+    //Lanes hold two 2x2 quads, one per 128-bit half, so the in-lane
+    //permutes give the quad's horizontal and vertical differences
+    DEMO_TARGET_AVX2 inline __m256 ddx_avx2(__m256 v)
+    {
+        return _mm256_sub_ps(_mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 1, 1)), _mm256_permute_ps(v, _MM_SHUFFLE(2, 2, 0, 0)));
+    }
+
+    DEMO_TARGET_AVX2 inline __m256 ddy_avx2(__m256 v)
+    {
+        return _mm256_sub_ps(_mm256_permute_ps(v, _MM_SHUFFLE(3, 2, 3, 2)), _mm256_permute_ps(v, _MM_SHUFFLE(1, 0, 1, 0)));
+    }
+
+    DEMO_TARGET_AVX2 void sample_texture_avx2(const SoftwareTexture& texture, __m256 u, __m256 v, __m256 du_dx, __m256 dv_dx,
+        __m256 du_dy, __m256 dv_dy, unsigned channels, const float* srgb_table, __m256* out)
+    {
+        const __m256 width_sq = _mm256_set1_ps(float(texture.sizes[0].x()) * texture.sizes[0].x());
+        const __m256 height_sq = _mm256_set1_ps(float(texture.sizes[0].y()) * texture.sizes[0].y());
+        const __m256 rho_x = _mm256_fmadd_ps(_mm256_mul_ps(du_dx, du_dx), width_sq, _mm256_mul_ps(_mm256_mul_ps(dv_dx, dv_dx), height_sq));
+        const __m256 rho_y = _mm256_fmadd_ps(_mm256_mul_ps(du_dy, du_dy), width_sq, _mm256_mul_ps(_mm256_mul_ps(dv_dy, dv_dy), height_sq));
+        __m256 lod = _mm256_mul_ps(_mm256_set1_ps(0.5f), log2_avx2(_mm256_max_ps(_mm256_max_ps(rho_x, rho_y), _mm256_set1_ps(1.0e-20f))));
+        //max() first, it returns the second operand for NaN
+        lod = _mm256_min_ps(_mm256_max_ps(lod, _mm256_setzero_ps()), _mm256_set1_ps(float(texture.sizes.size() - 1)));
+
+        const __m256 level_floor = _mm256_floor_ps(lod);
+        const __m256 fraction = _mm256_sub_ps(lod, level_floor);
+        const __m256i level = _mm256_cvttps_epi32(level_floor);
+        sample_level_avx2(texture, level, u, v, channels, srgb_table, out);
+
+        //Magnified or exactly on a level everywhere, common up close
+        if (!_mm256_movemask_ps(_mm256_cmp_ps(fraction, _mm256_setzero_ps(), _CMP_GT_OQ)))
+        {
+            return;
+        }
+
+        const __m256i next_level = _mm256_min_epi32(_mm256_add_epi32(level, _mm256_set1_epi32(1)),
+            _mm256_set1_epi32(int(texture.sizes.size() - 1)));
+        __m256 next[4];
+        sample_level_avx2(texture, next_level, u, v, channels, srgb_table, next);
+        for (unsigned c = 0; c != 4; ++c)
+        {
+            if (channels & (1u << c))
+            {
+                out[c] = lerp_avx2(out[c], next[c], fraction);
+            }
+        }
+    }
+
+    DEMO_TARGET_AVX2 inline __m256 interpolate_avx2(const __m256* p, float a0, float a1, float a2)
+    {
+        return _mm256_fmadd_ps(p[0], _mm256_set1_ps(a0), _mm256_fmadd_ps(p[1], _mm256_set1_ps(a1), _mm256_mul_ps(p[2], _mm256_set1_ps(a2))));
+    }
+
+    DEMO_TARGET_AVX2 inline __m256i unorm8_avx2(__m256 c)
+    {
+        c = _mm256_min_ps(_mm256_max_ps(c, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+        return _mm256_cvttps_epi32(_mm256_fmadd_ps(c, _mm256_set1_ps(255.0f), _mm256_set1_ps(0.5f)));
+    }
+
+    DEMO_TARGET_AVX2 inline __m256i pack_color_avx2(__m256 r, __m256 g, __m256 b, __m256 a)
+    {
+        return _mm256_or_si256(_mm256_or_si256(unorm8_avx2(r), _mm256_slli_epi32(unorm8_avx2(g), 8)),
+            _mm256_or_si256(_mm256_slli_epi32(unorm8_avx2(b), 16), _mm256_slli_epi32(unorm8_avx2(a), 24)));
+    }
+
+    //shade_pixel() for all eight lanes, p are the perspective-correct weights
+    DEMO_TARGET_AVX2 __m256i shade_block_avx2(const ShadeSetup& setup, const Vertex* const* v, const __m256* p)
+    {
+        const SoftwareMaterial& material = *setup.material;
+        const __m256 u = interpolate_avx2(p, v[0]->tex_coord.x(), v[1]->tex_coord.x(), v[2]->tex_coord.x());
+        const __m256 tv = interpolate_avx2(p, v[0]->tex_coord.y(), v[1]->tex_coord.y(), v[2]->tex_coord.y());
+        const __m256 du_dx = ddx_avx2(u);
+        const __m256 dv_dx = ddx_avx2(tv);
+        const __m256 du_dy = ddy_avx2(u);
+        const __m256 dv_dy = ddy_avx2(tv);
+
+        __m256 samples[PBRShader::MaterialMapCount][4];
+        for (std::size_t t = 0; t != material.textures.size(); ++t)
+        {
+            if (setup.channels[t])
+            {
+                sample_texture_avx2(material.textures[t], u, tv, du_dx, dv_dx, du_dy, dv_dy, setup.channels[t], setup.srgb_table, samples[t]);
+            }
+        }
+
+        const auto map = [&](MaterialMap which, std::size_t channel = 0)
+        {
+            return samples[material.map_texture[std::size_t(which)]][material.map_channel[std::size_t(which)] + channel];
+        };
+
+        const __m256 one = _mm256_set1_ps(1.0f);
+        __m256 r, g, b, a = one;
+        if (setup.render_mode == RoughnessMode)
+        {
+            r = g = b = _mm256_mul_ps(map(MaterialMap::Roughness), _mm256_set1_ps(setup.factors.y()));
+        }
+        else if (setup.render_mode == MetallicMode)
+        {
+            r = g = b = _mm256_mul_ps(map(MaterialMap::Metallic), _mm256_set1_ps(setup.factors.z()));
+        }
+        else if (setup.render_mode == AoMode)
+        {
+            r = g = b = map(MaterialMap::AO);
+        }
+        else if (setup.render_mode == AlbedoMode)
+        {
+            const __m256 albedo_factor = _mm256_set1_ps(setup.factors.x());
+            r = _mm256_mul_ps(map(MaterialMap::Albedo, 0), albedo_factor);
+            g = _mm256_mul_ps(map(MaterialMap::Albedo, 1), albedo_factor);
+            b = _mm256_mul_ps(map(MaterialMap::Albedo, 2), albedo_factor);
+            a = _mm256_mul_ps(map(MaterialMap::Albedo, 3), albedo_factor);
+        }
+        else
+        {
+            const __m256 two = _mm256_set1_ps(2.0f);
+            const __m256 x = _mm256_fmsub_ps(map(MaterialMap::Normal, 0), two, one);
+            const __m256 y = _mm256_fmsub_ps(map(MaterialMap::Normal, 1), two, one);
+            const __m256 z = _mm256_sqrt_ps(_mm256_max_ps(_mm256_fnmadd_ps(y, y, _mm256_fnmadd_ps(x, x, one)), _mm256_setzero_ps()));
+
+            __m256 n[3];
+            for (std::size_t i = 0; i != 3; ++i)
+            {
+                const __m256 t = interpolate_avx2(p, v[0]->tangent[i], v[1]->tangent[i], v[2]->tangent[i]);
+                const __m256 bt = interpolate_avx2(p, v[0]->bitangent[i], v[1]->bitangent[i], v[2]->bitangent[i]);
+                const __m256 nt = interpolate_avx2(p, v[0]->normal[i], v[1]->normal[i], v[2]->normal[i]);
+                n[i] = _mm256_fmadd_ps(t, x, _mm256_fmadd_ps(bt, y, _mm256_mul_ps(nt, z)));
+            }
+            const __m256 length_sq = _mm256_fmadd_ps(n[0], n[0], _mm256_fmadd_ps(n[1], n[1], _mm256_mul_ps(n[2], n[2])));
+            const __m256 inv_length = _mm256_div_ps(one, _mm256_sqrt_ps(length_sq));
+            for (__m256& c : n)
+            {
+                c = _mm256_mul_ps(c, inv_length);
+            }
+
+            if (setup.render_mode == NormalMode)
+            {
+                const __m256 half = _mm256_set1_ps(0.5f);
+                r = _mm256_fmadd_ps(n[0], half, half);
+                g = _mm256_fmadd_ps(n[1], half, half);
+                b = _mm256_fmadd_ps(n[2], half, half);
+            }
+            else
+            {
+                const __m256 n_dot_l = _mm256_max_ps(_mm256_fmadd_ps(n[0], _mm256_set1_ps(setup.light.x()),
+                    _mm256_fmadd_ps(n[1], _mm256_set1_ps(setup.light.y()), _mm256_mul_ps(n[2], _mm256_set1_ps(setup.light.z())))),
+                    _mm256_set1_ps(0.1f));
+                const __m256 ambient = _mm256_set1_ps(0.1f);
+                const __m256 lit = _mm256_mul_ps(_mm256_mul_ps(n_dot_l, map(MaterialMap::AO)), _mm256_set1_ps(0.9f));
+                const __m256 albedo_factor = _mm256_set1_ps(setup.factors.x());
+                r = _mm256_mul_ps(_mm256_fmadd_ps(lit, _mm256_set1_ps(setup.light_color.x()), ambient), _mm256_mul_ps(map(MaterialMap::Albedo, 0), albedo_factor));
+                g = _mm256_mul_ps(_mm256_fmadd_ps(lit, _mm256_set1_ps(setup.light_color.y()), ambient), _mm256_mul_ps(map(MaterialMap::Albedo, 1), albedo_factor));
+                b = _mm256_mul_ps(_mm256_fmadd_ps(lit, _mm256_set1_ps(setup.light_color.z()), ambient), _mm256_mul_ps(map(MaterialMap::Albedo, 2), albedo_factor));
+                a = _mm256_mul_ps(_mm256_fmadd_ps(n_dot_l, _mm256_set1_ps(0.9f), ambient), _mm256_mul_ps(map(MaterialMap::Albedo, 3), albedo_factor));
+            }
+        }
+
+        return pack_color_avx2(gamma_avx2(r), gamma_avx2(g), gamma_avx2(b), a);
+    }
+
+    //Two rows of four pixels in lane order and back, the permutation is its
+    //own inverse
+    DEMO_TARGET_AVX2 inline __m256i block_order_avx2()
+    {
+        return _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    }
+
+    DEMO_TARGET_AVX2 inline __m256 load_block_avx2(const float* row0, const float* row1)
+    {
+        const __m256 rows = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(row0)), _mm_loadu_ps(row1), 1);
+        return _mm256_permutevar8x32_ps(rows, block_order_avx2());
+    }
+
+    DEMO_TARGET_AVX2 inline void store_block_avx2(float* row0, float* row1, __m256 lanes)
+    {
+        const __m256 rows = _mm256_permutevar8x32_ps(lanes, block_order_avx2());
+        _mm_storeu_ps(row0, _mm256_castps256_ps128(rows));
+        _mm_storeu_ps(row1, _mm256_extractf128_ps(rows, 1));
+    }
+
+    DEMO_TARGET_AVX2 std::size_t rasterize_avx2(const Triangle& triangle, const Vertex* vertices, const ShadeSetup& setup, const TileTarget& target)
+    {
+        Vector2i begin, end;
+        if (!block_range(triangle, target, begin, end))
+        {
+            return 0;
+        }
+
+        const Vertex* v[3]{ &vertices[triangle.vertices[0]], &vertices[triangle.vertices[1]], &vertices[triangle.vertices[2]] };
+        const __m256 lane_x = _mm256_setr_ps(0.5f, 1.5f, 0.5f, 1.5f, 2.5f, 3.5f, 2.5f, 3.5f);
+        const __m256 lane_y = _mm256_setr_ps(0.5f, 0.5f, 1.5f, 1.5f, 0.5f, 0.5f, 1.5f, 1.5f);
+
+        std::size_t shaded = 0;
+        for (Int by = begin.y(); by < end.y(); by += 2)
+        {
+            const __m256 py = _mm256_add_ps(_mm256_set1_ps(float(by)), lane_y);
+            float* depth_row0 = target.depth + std::size_t(by) * target.stride;
+            float* depth_row1 = depth_row0 + target.stride;
+            std::uint32_t* color_row0 = target.color + std::size_t(by) * target.stride;
+            std::uint32_t* color_row1 = color_row0 + target.stride;
+
+            for (Int bx = begin.x(); bx < end.x(); bx += 4)
+            {
+                const __m256 px = _mm256_add_ps(_mm256_set1_ps(float(bx)), lane_x);
+
+                __m256 e[3];
+                __m256 covered = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                for (int i = 0; i != 3; ++i)
+                {
+                    e[i] = _mm256_fmadd_ps(_mm256_set1_ps(triangle.edge_x[i]), px,
+                        _mm256_fmadd_ps(_mm256_set1_ps(triangle.edge_y[i]), py, _mm256_set1_ps(triangle.edge_c[i])));
+                    covered = _mm256_and_ps(covered, triangle.top_left[i]
+                        ? _mm256_cmp_ps(e[i], _mm256_setzero_ps(), _CMP_GE_OQ) : _mm256_cmp_ps(e[i], _mm256_setzero_ps(), _CMP_GT_OQ));
+                }
+                if (!_mm256_movemask_ps(covered))
+                {
+                    continue;
+                }
+
+                const __m256 z = _mm256_fmadd_ps(e[0], _mm256_set1_ps(v[0]->depth),
+                    _mm256_fmadd_ps(e[1], _mm256_set1_ps(v[1]->depth), _mm256_mul_ps(e[2], _mm256_set1_ps(v[2]->depth))));
+                const __m256 old_depth = load_block_avx2(depth_row0 + bx, depth_row1 + bx);
+                covered = _mm256_and_ps(covered, _mm256_cmp_ps(z, old_depth, _CMP_LT_OQ));
+                if (!_mm256_movemask_ps(covered))
+                {
+                    continue;
+                }
+                ++shaded;
+
+                __m256 p[3];
+                for (int i = 0; i != 3; ++i)
+                {
+                    p[i] = _mm256_mul_ps(e[i], _mm256_set1_ps(v[i]->inv_w));
+                }
+                const __m256 scale = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_add_ps(_mm256_add_ps(p[0], p[1]), p[2]));
+                for (__m256& weight : p)
+                {
+                    weight = _mm256_mul_ps(weight, scale);
+                }
+
+                const __m256 color = _mm256_castsi256_ps(shade_block_avx2(setup, v, p));
+                const __m256 old_color = _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(_mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(color_row0 + bx))),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(color_row1 + bx)), 1), block_order_avx2()));
+
+                store_block_avx2(depth_row0 + bx, depth_row1 + bx, _mm256_blendv_ps(old_depth, z, covered));
+                store_block_avx2(reinterpret_cast<float*>(color_row0 + bx), reinterpret_cast<float*>(color_row1 + bx),
+                    _mm256_blendv_ps(old_color, color, covered));
+            }
+        }
+
+        return shaded;
+    }
+#endif
+
+    RasterKernel select_kernel()
+    {
+        switch (simd_level())
+        {
+#ifdef DEMO_SIMD_X86
+            case SimdLevel::AVX2:
+                return rasterize_avx2;
+#endif
+            default:
+                return rasterize_scalar;
+        }
+    }
+}
+
+Containers::Optional<SoftwareMaterial> software_material(MaterialLayout layout,
+    std::vector<Containers::Optional<Trade::ImageData2D>>&& images, ThreadPool& pool)
+{
+    const std::size_t expected = layout == MaterialLayout::Packed ? 3 : PBRShader::MaterialMapCount;
+    if (images.size() != expected)
+    {
+        spdlog::error("Expected {} material maps, got {}", expected, images.size());
+        return Containers::NullOpt;
+    }
+
+    SoftwareMaterial material;
+    for (std::size_t i = 0; i != images.size(); ++i)
+    {
+        Containers::Optional<Trade::ImageData2D>& image = images[i];
+        if (!image || image->isCompressed() || !supports_mip_generation(image->format()))
+        {
+            spdlog::error("Can't render an unsupported image on the CPU");
+            return Containers::NullOpt;
+        }
+
+        //RGBA8 with the defaults GL fills missing channels with
+        const Vector2i size = image->size();
+        const std::size_t channels = image->pixelSize();
+        const std::size_t row_size = std::size_t(size.x()) * channels;
+        const std::size_t alignment = std::size_t(image->storage().alignment());
+        const std::size_t row_stride = (row_size + alignment - 1) / alignment * alignment;
+        Containers::Array<char> rgba{ Containers::NoInit, std::size_t(size.product()) * 4 };
+        for (Int y = 0; y < size.y(); ++y)
+        {
+            const unsigned char* src = reinterpret_cast<const unsigned char*>(image->data().data()) + y * row_stride;
+            unsigned char* dst = reinterpret_cast<unsigned char*>(rgba.data()) + std::size_t(y) * size.x() * 4;
+            for (Int x = 0; x < size.x(); ++x, src += channels, dst += 4)
+            {
+                for (std::size_t c = 0; c != 4; ++c)
+                {
+                    dst[c] = c < channels ? src[c] : c == 3 ? 255 : 0;
+                }
+            }
+        }
+        image = Containers::NullOpt;
+
+        SoftwareTexture texture;
+        texture.srgb = i == 0;
+        const std::vector<MipLevel> levels = generate_mip_chain(ImageView2D{ PixelFormat::RGBA8Unorm, size, rgba },
+            texture.srgb ? MipFilter::Srgb : MipFilter::Linear, pool);
+        for (const MipLevel& level : levels)
+        {
+            texture.sizes.push_back(level.size);
+            texture.offsets.push_back(std::uint32_t(texture.texels.size()));
+            texture.texels.resize(texture.texels.size() + std::size_t(level.size.product()));
+            std::memcpy(texture.texels.data() + texture.offsets.back(), level.data.data(), level.data.size());
+        }
+        material.textures.push_back(std::move(texture));
+    }
+
+    const auto assign = [&](MaterialMap map, std::size_t texture, std::size_t channel)
+    {
+        material.map_texture[std::size_t(map)] = texture;
+        material.map_channel[std::size_t(map)] = channel;
+    };
+    if (layout == MaterialLayout::Packed)
+    {
+        assign(MaterialMap::Albedo, 0, 0);
+        assign(MaterialMap::Normal, 1, 0);
+        assign(MaterialMap::AO, 2, 0);
+        assign(MaterialMap::Roughness, 2, 1);
+        assign(MaterialMap::Metallic, 2, 2);
+        assign(MaterialMap::Height, 2, 3);
+    }
+    else
+    {
+        assign(MaterialMap::Albedo, 0, 0);
+        assign(MaterialMap::AO, 1, 0);
+        assign(MaterialMap::Metallic, 2, 0);
+        assign(MaterialMap::Normal, 3, 0);
+        assign(MaterialMap::Roughness, 4, 0);
+        assign(MaterialMap::Height, 5, 0);
+    }
+
+    return material;
+}
+
+SoftwareRasterizer::SoftwareRasterizer(ThreadPool& pool, const Vector2i& size):
+    pool{ pool },
+    image_size{ size },
+    tile_count{ (size + Vector2i{ TileSize - 1 }) / TileSize },
+    stride{ tile_count.x() * TileSize },
+    color(std::size_t(tile_count.product()) * TileSize * TileSize),
+    depth(color.size())
+{
+}
+
+void SoftwareRasterizer::draw(const MeshGeometry& mesh, const SoftwareMaterial& material, const SoftwareView& view)
+{
+    ProfileZone zone{ "software draw" };
+    render_stats = {};
+    const auto start = Clock::now();
+
+    transform_vertices(mesh, material, view);
+    render_stats.vertex_ms = elapsed_ms(start);
+
+    const auto binning_start = Clock::now();
+    bin_triangles(mesh);
+    render_stats.binning_ms = elapsed_ms(binning_start);
+
+    const auto raster_start = Clock::now();
+    rasterize_tiles(material, view);
+    render_stats.raster_ms = elapsed_ms(raster_start);
+    render_stats.total_ms = elapsed_ms(start);
+}
+
+void SoftwareRasterizer::transform_vertices(const MeshGeometry& mesh, const SoftwareMaterial& material, const SoftwareView& view)
+{
+    ProfileZone zone{ "software vertices" };
+    vertices.resize(mesh.positions.size());
+
+    const SoftwareTexture& height = material.textures[material.map_texture[std::size_t(MaterialMap::Height)]];
+    const unsigned height_channel = unsigned(material.map_channel[std::size_t(MaterialMap::Height)]);
+    const float* srgb_table = srgb_to_linear_table().data();
+    const Vector2 half_size = Vector2{ image_size } * 0.5f;
+
+    pool.parallel_for(vertices.size(), VertexGrain, [&](std::size_t begin, std::size_t end, std::size_t)
+    {
+        for (std::size_t i = begin; i != end; ++i)
+        {
+            Vertex& vertex = vertices[i];
+            const Vector4& tangent = mesh.tangents[i];
+            vertex.normal = (view.normal_matrix * mesh.normals[i]).normalized();
+            vertex.tangent = (view.normal_matrix * tangent.xyz()).normalized();
+            vertex.bitangent = (tangent.w() * Math::cross(vertex.normal, vertex.tangent)).normalized();
+            vertex.tex_coord = mesh.tex_coords[i];
+
+            float sample[4];
+            sample_level(height, 0, vertex.tex_coord.x(), vertex.tex_coord.y(), 1u << height_channel, srgb_table, sample);
+            const Vector3 position = (view.model_view * Vector4{ mesh.positions[i], 1.0f }).xyz()
+                + vertex.normal * sample[height_channel] * view.height_factor;
+
+            const Vector4 clip = view.projection * Vector4{ position, 1.0f };
+            vertex.visible = clip.w() > 0.0f && clip.z() >= -clip.w() && clip.z() <= clip.w();
+            vertex.inv_w = 1.0f / clip.w();
+            vertex.window = (clip.xy() * vertex.inv_w + Vector2{ 1.0f }) * half_size;
+            vertex.depth = clip.z() * vertex.inv_w * 0.5f + 0.5f;
+        }
+    });
+}
+
+void SoftwareRasterizer::bin_triangles(const MeshGeometry& mesh)
+{
+    ProfileZone zone{ "software binning" };
+    const std::size_t triangle_count = mesh.indices.size() / 3;
+    const std::size_t tiles = std::size_t(tile_count.product());
+    triangles.resize(triangle_count);
+    bin_chunks = (triangle_count + BinGrain - 1) / BinGrain;
+    if (bins.size() < bin_chunks * tiles)
+    {
+        bins.resize(bin_chunks * tiles);
+    }
+
+    std::atomic<std::size_t> front_facing{ 0 };
+    std::atomic<std::size_t> tile_triangles{ 0 };
+    pool.parallel_for(triangle_count, BinGrain, [&](std::size_t begin, std::size_t end, std::size_t)
+    {
+        std::vector<std::uint32_t>* chunk_bins = bins.data() + begin / BinGrain * tiles;
+        for (std::size_t tile = 0; tile != tiles; ++tile)
+        {
+            chunk_bins[tile].clear();
+        }
+
+        std::size_t chunk_triangles = 0;
+        std::size_t chunk_tile_triangles = 0;
+        for (std::size_t t = begin; t != end; ++t)
+        {
+            Triangle& triangle = triangles[t];
+            const Vertex* v[3];
+            bool visible = true;
+            for (std::size_t i = 0; i != 3; ++i)
+            {
+                triangle.vertices[i] = mesh.indices[3 * t + i];
+                v[i] = &vertices[triangle.vertices[i]];
+                visible = visible && v[i]->visible;
+            }
+            if (!visible)
+            {
+                continue;
+            }
+
+            //Counterclockwise is front facing with y up
+            const Vector2 a = v[0]->window;
+            const Vector2 b = v[1]->window;
+            const Vector2 c = v[2]->window;
+            const float area = (b.x() - a.x()) * (c.y() - a.y()) - (c.x() - a.x()) * (b.y() - a.y());
+            if (!(area > 0.0f))
+            {
+                continue;
+            }
+
+            const Vector2 lower = Math::min(Math::min(a, b), c);
+            const Vector2 upper = Math::max(Math::max(a, b), c);
+            triangle.min = Math::max(Vector2i{ Math::floor(lower) }, Vector2i{ 0 });
+            triangle.max = Math::min(Vector2i{ Math::ceil(upper) }, image_size);
+            if (triangle.min.x() >= triangle.max.x() || triangle.min.y() >= triangle.max.y())
+            {
+                continue;
+            }
+
+            const float inv_area = 1.0f / area;
+            for (std::size_t i = 0; i != 3; ++i)
+            {
+                const Vector2 p = v[(i + 1) % 3]->window;
+                const Vector2 q = v[(i + 2) % 3]->window;
+                triangle.edge_x[i] = (p.y() - q.y()) * inv_area;
+                triangle.edge_y[i] = (q.x() - p.x()) * inv_area;
+                triangle.edge_c[i] = (p.x() * q.y() - q.x() * p.y()) * inv_area;
+                //Shared edges face opposite ways, exactly one side owns them
+                triangle.top_left[i] = triangle.edge_x[i] > 0.0f || (triangle.edge_x[i] == 0.0f && triangle.edge_y[i] > 0.0f);
+            }
+
+            const Vector2i first_tile = triangle.min / TileSize;
+            const Vector2i last_tile = (triangle.max - Vector2i{ 1 }) / TileSize;
+            for (Int y = first_tile.y(); y <= last_tile.y(); ++y)
+            {
+                for (Int x = first_tile.x(); x <= last_tile.x(); ++x)
+                {
+                    chunk_bins[std::size_t(y) * tile_count.x() + x].push_back(std::uint32_t(t));
+                }
+            }
+
+            ++chunk_triangles;
+            chunk_tile_triangles += std::size_t(last_tile.x() - first_tile.x() + 1) * (last_tile.y() - first_tile.y() + 1);
+        }
+
+        front_facing += chunk_triangles;
+        tile_triangles += chunk_tile_triangles;
+    });
+
+    render_stats.triangles = front_facing;
+    render_stats.tile_triangles = tile_triangles;
+}
+
+void SoftwareRasterizer::rasterize_tiles(const SoftwareMaterial& material, const SoftwareView& view)
+{
+    ProfileZone zone{ "software tiles" };
+    const std::size_t tiles = std::size_t(tile_count.product());
+    const ShadeSetup setup = shade_setup(material, view);
+    const RasterKernel kernel = select_kernel();
+
+    //Grain 1: whoever is idle takes the next tile, so busy tiles around
+    //the sphere's silhouette don't hold up a fixed share of threads
+    std::vector<std::size_t> shaded_blocks(pool.size() + 1, 0);
+    pool.parallel_for(tiles, 1, [&](std::size_t begin, std::size_t end, std::size_t worker)
+    {
+        for (std::size_t tile = begin; tile != end; ++tile)
+        {
+            TileTarget target;
+            target.min = Vector2i{ Int(tile % tile_count.x()), Int(tile / tile_count.x()) } * TileSize;
+            target.max = target.min + Vector2i{ TileSize };
+            target.stride = stride;
+            target.color = color.data();
+            target.depth = depth.data();
+
+            for (Int y = target.min.y(); y < target.max.y(); ++y)
+            {
+                const std::size_t row = std::size_t(y) * stride + target.min.x();
+                std::fill_n(color.data() + row, TileSize, 0u);
+                std::fill_n(depth.data() + row, TileSize, 1.0f);
+            }
+
+            for (std::size_t chunk = 0; chunk != bin_chunks; ++chunk)
+            {
+                for (std::uint32_t index : bins[chunk * tiles + tile])
+                {
+                    shaded_blocks[worker] += kernel(triangles[index], vertices.data(), setup, target);
+                }
+            }
+        }
+    });
+
+    for (std::size_t count : shaded_blocks)
+    {
+        render_stats.shaded_blocks += count;
+    }
+}
+
+Image2D SoftwareRasterizer::image() const
+{
+    const std::size_t row_size = std::size_t(image_size.x()) * 4;
+    Containers::Array<char> data{ Containers::NoInit, row_size * image_size.y() };
+    for (Int y = 0; y < image_size.y(); ++y)
+    {
+        std::memcpy(data.data() + y * row_size, color.data() + std::size_t(y) * stride, row_size);
+    }
+    return Image2D{ PixelFormat::RGBA8Unorm, image_size, std::move(data) };
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/Image.h>
+#include <Magnum/Math/Matrix3.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/Math/Vector2.h>
+#include <Magnum/Math/Vector3.h>
+#include <Magnum/Trade/ImageData.h>
+#include <Corrade/Containers/Optional.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "material_packer.hpp"
+#include "mesh_packing.hpp"
+#include "pbr_shader.hpp"
+#include "thread_pool.hpp"
+
+using namespace Magnum;
+
+//RGBA8 mip chain sampled like the GL textures: clamped to the edge,
+//trilinear, but without anisotropic filtering. Red is in the low byte.
+struct SoftwareTexture
+{
+    std::vector<std::uint32_t> texels; //every level, finest first
+    std::vector<Vector2i> sizes;
+    std::vector<std::uint32_t> offsets; //of each level into texels
+    bool srgb = false; //RGB decoded to linear before filtering
+};
+
+//PBRShader's six maps, each a texture and the channel it's read from. The
+//separate layout has a texture per map, the packed one shares ORMH.
+struct SoftwareMaterial
+{
+    std::vector<SoftwareTexture> textures; //in material spec order
+    std::size_t map_texture[PBRShader::MaterialMapCount];
+    std::size_t map_channel[PBRShader::MaterialMapCount];
+};
+
+//From the decoded images in material spec order, see DemoScene. Albedo is
+//the sRGB one. Mips are box filtered on the pool, albedo in linear space
+//like glGenerateMipmap() does for sRGB textures.
+Containers::Optional<SoftwareMaterial> software_material(MaterialLayout layout,
+    std::vector<Containers::Optional<Trade::ImageData2D>>&& images, ThreadPool& pool);
+
+//What PBRShader gets for a single object lit by the directional light, no
+//image-based lighting and no local lights
+struct SoftwareView
+{
+    Matrix4 model_view;
+    Matrix3x3 normal_matrix; //of model_view
+    Matrix4 projection;
+    Vector3 light_direction{ 0.0f, -0.5f, -0.5f }; //view space
+    Vector3 light_color{ 1.0f };
+    Vector3 material_factors{ 1.0f }; //albedo, roughness, metallic
+    float height_factor = 0.5f;
+    int render_mode = 0;
+};
+
+//Filled by every draw()
+struct SoftwareRenderStats
+{
+    double vertex_ms = 0.0;
+    double binning_ms = 0.0;
+    double raster_ms = 0.0; //coverage, depth test and shading
+    double total_ms = 0.0;
+    std::size_t triangles = 0; //front facing and inside the viewport
+    std::size_t tile_triangles = 0; //binned triangle and tile pairs
+    std::size_t shaded_blocks = 0; //4x2 pixel blocks with a pixel passing the depth test
+};
+
+//PBRShader's vertex displacement and fragment stage on the CPU. Vertices
+//are transformed on the pool, triangles are set up and binned into tiles
+//by chunks of the index buffer, then idle threads pick the next tile off
+//a shared counter and rasterize its triangles in submission order. Pixels
+//are shaded in 4x2 blocks of two 2x2 quads, eight lanes of AVX2 with the
+//quads' differences as texture derivatives, or one pixel at a time
+//without AVX2. Triangles crossing the near or far plane are dropped, not
+//clipped, and back faces are culled, which the closed sphere never shows.
+class SoftwareRasterizer
+{
+public:
+    //Stage outputs, public for the pixel kernels
+    struct Vertex
+    {
+        Vector2 window; //pixels, y up
+        float depth; //window depth, 0 to 1
+        bool visible; //in front of the camera, between the near and far plane
+        float inv_w;
+        Vector3 tangent;
+        Vector3 bitangent;
+        Vector3 normal;
+        Vector2 tex_coord;
+    };
+
+    //Edge functions scaled so they are the barycentrics of the vertex
+    //opposite the edge
+    struct Triangle
+    {
+        std::uint32_t vertices[3];
+        float edge_x[3];
+        float edge_y[3];
+        float edge_c[3];
+        bool top_left[3]; //owns pixels exactly on the edge
+        Vector2i min; //pixel bounds, max exclusive
+        Vector2i max;
+    };
+
+    explicit SoftwareRasterizer(ThreadPool& pool, const Vector2i& size);
+
+    //Clears to transparent black and the far plane first
+    void draw(const MeshGeometry& mesh, const SoftwareMaterial& material, const SoftwareView& view);
+
+    //RGBA8, bottom row first like a GL readback
+    Image2D image() const;
+
+    Vector2i size() const
+    {
+        return image_size;
+    }
+
+    const SoftwareRenderStats& stats() const
+    {
+        return render_stats;
+    }
+
+private:
+    void transform_vertices(const MeshGeometry& mesh, const SoftwareMaterial& material, const SoftwareView& view);
+    void bin_triangles(const MeshGeometry& mesh);
+    void rasterize_tiles(const SoftwareMaterial& material, const SoftwareView& view);
+
+    ThreadPool& pool;
+    Vector2i image_size;
+    Vector2i tile_count;
+    Int stride; //padded to whole tiles
+    std::vector<std::uint32_t> color;
+    std::vector<float> depth;
+
+    std::vector<Vertex> vertices;
+    std::vector<Triangle> triangles; //one per index triple, culled ones never binned
+    std::vector<std::vector<std::uint32_t>> bins; //per binning chunk and tile, chunk-major
+    std::size_t bin_chunks = 0;
+
+    SoftwareRenderStats render_stats;
+};
@@ -0,0 +1,149 @@
+#include "staging_ring.hpp"
+#include <Corrade/Containers/ArrayView.h>
+#include <Corrade/Utility/Assert.h>
+#include <algorithm>
+
+namespace
+{
+    std::size_t align_up(std::size_t value, std::size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+StagingRing::StagingRing(std::size_t capacity):
+    ring_buffer{ GL::Buffer::TargetHint::PixelUnpack },
+    ring_capacity{ align_up(capacity, Alignment) }
+{
+    ring_buffer.setStorage({ nullptr, ring_capacity },
+        GL::Buffer::StorageFlag::MapWrite | GL::Buffer::StorageFlag::MapPersistent | GL::Buffer::StorageFlag::MapCoherent);
+
+    mapped = ring_buffer.map(0, ring_capacity,
+        GL::Buffer::MapFlag::Write | GL::Buffer::MapFlag::Persistent | GL::Buffer::MapFlag::Coherent).data();
+    CORRADE_INTERNAL_ASSERT(mapped);
+    memory = TrackedAllocation{ MemoryCategory::Buffer, "texture staging ring", ring_capacity };
+}
+
+StagingRing::~StagingRing()
+{
+    finish();
+    ring_buffer.unmap();
+}
+
+bool StagingRing::acquire(std::size_t size, Region& region)
+{
+    size = align_up(std::max<std::size_t>(size, 1), Alignment);
+    if (size > ring_capacity)
+    {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    std::size_t offset = 0;
+    condition.wait(lock, [&] { return try_allocate(size, offset); });
+
+    region.id = next_id++;
+    region.offset = offset;
+    region.size = size;
+    region.data = mapped + offset;
+    in_flight.push_back({ region.id, offset, size, nullptr });
+    return true;
+}
+
+void StagingRing::fence(const Region& region)
+{
+    GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& slot : in_flight)
+    {
+        if (slot.id == region.id)
+        {
+            slot.fence = sync;
+            return;
+        }
+    }
+
+    glDeleteSync(sync);
+    CORRADE_INTERNAL_ASSERT_UNREACHABLE();
+}
+
+void StagingRing::retire()
+{
+    bool freed = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!in_flight.empty() && in_flight.front().fence)
+        {
+            const GLenum status = glClientWaitSync(in_flight.front().fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            {
+                break;
+            }
+
+            glDeleteSync(in_flight.front().fence);
+            in_flight.pop_front();
+            freed = true;
+        }
+    }
+
+    if (freed)
+    {
+        condition.notify_all();
+    }
+}
+
+void StagingRing::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!in_flight.empty() && in_flight.front().fence)
+        {
+            glClientWaitSync(in_flight.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(in_flight.front().fence);
+            in_flight.pop_front();
+        }
+    }
+    condition.notify_all();
+}
+
+bool StagingRing::try_allocate(std::size_t size, std::size_t& offset)
+{
+    if (in_flight.empty())
+    {
+        head = 0;
+    }
+
+    const std::size_t tail = in_flight.empty() ? 0 : in_flight.front().offset;
+
+    //Used bytes are [tail, head), possibly wrapping around the end
+    if (in_flight.empty() || head > tail)
+    {
+        if (head + size <= ring_capacity)
+        {
+            offset = head;
+            head += size;
+            return true;
+        }
+
+        if (size <= tail)
+        {
+            offset = 0;
+            head = size;
+            return true;
+        }
+
+        return false;
+    }
+
+    if (head + size <= tail)
+    {
+        offset = head;
+        head += size;
+        return true;
+    }
+
+    return false;
+}
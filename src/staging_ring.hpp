@@ -0,0 +1,80 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/OpenGL.h>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include "memory_tracker.hpp"
+
+using namespace Magnum;
+
+//Persistently mapped pixel unpack buffer used as a ring of staging regions.
+//Any thread may acquire() a region and write into it, only the GL thread may
+//fence() and retire() regions.
+class StagingRing
+{
+public:
+    struct Region
+    {
+        std::uint64_t id = 0;
+        std::size_t offset = 0;
+        std::size_t size = 0;
+        char* data = nullptr;
+    };
+
+    static constexpr std::size_t Alignment = 256;
+
+    explicit StagingRing(std::size_t capacity);
+    ~StagingRing();
+
+    StagingRing(const StagingRing&) = delete;
+    StagingRing& operator=(const StagingRing&) = delete;
+
+    std::size_t capacity() const
+    {
+        return ring_capacity;
+    }
+
+    GL::Buffer& buffer()
+    {
+        return ring_buffer;
+    }
+
+    //Blocks until `size` bytes are free. Returns false if the request can
+    //never fit, in which case the caller has to upload some other way.
+    bool acquire(std::size_t size, Region& region);
+
+    //GL thread only: the region is free again once the GPU passes this point
+    void fence(const Region& region);
+
+    //GL thread only: frees regions whose fences have signaled
+    void retire();
+
+    //GL thread only: waits for every fenced region, e.g. before destruction
+    void finish();
+
+private:
+    struct Slot
+    {
+        std::uint64_t id;
+        std::size_t offset;
+        std::size_t size;
+        GLsync fence;
+    };
+
+    bool try_allocate(std::size_t size, std::size_t& offset);
+
+    GL::Buffer ring_buffer;
+    TrackedAllocation memory;
+    char* mapped = nullptr;
+    std::size_t ring_capacity = 0;
+
+    std::deque<Slot> in_flight;
+    std::size_t head = 0;
+    std::uint64_t next_id = 1;
+    std::mutex mutex;
+    std::condition_variable condition;
+};
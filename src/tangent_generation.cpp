@@ -0,0 +1,213 @@
+#include "tangent_generation.hpp"
+#include <Magnum/Math/Functions.h>
+#include <Corrade/Utility/Assert.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace
+{
+    //Triangles or vertices per parallel_for chunk
+    constexpr std::size_t Grain = 16384;
+
+    struct FaceTangent
+    {
+        Vector3 tangent; //unit length or zero for degenerate UVs
+        bool positive = true; //UV winding, the bitangent sign
+        bool degenerate = false; //no UV area, takes the space of its neighbours
+    };
+
+    //Any unit vector perpendicular to the normal
+    Vector3 perpendicular(const Vector3& normal)
+    {
+        const Vector3 axis = std::abs(normal.x()) < 0.9f ? Vector3::xAxis() : Vector3::yAxis();
+        return Math::cross(normal, axis).normalized();
+    }
+
+    Vector3 project(const Vector3& vector, const Vector3& normal)
+    {
+        return vector - normal * Math::dot(normal, vector);
+    }
+
+    float corner_angle(const Vector3& a, const Vector3& b, const Vector3& normal)
+    {
+        const Vector3 edge_a = project(a, normal);
+        const Vector3 edge_b = project(b, normal);
+        const float lengths = std::sqrt(edge_a.dot() * edge_b.dot());
+        if (lengths <= 0.0f)
+        {
+            return 0.0f;
+        }
+        return std::acos(Math::clamp(Math::dot(edge_a, edge_b) / lengths, -1.0f, 1.0f));
+    }
+}
+
+void generate_tangents(MeshGeometry& geometry, ThreadPool& pool)
+{
+    const std::size_t vertex_count = geometry.positions.size();
+    const std::size_t triangle_count = geometry.indices.size() / 3;
+    CORRADE_INTERNAL_ASSERT(geometry.normals.size() == vertex_count && geometry.tex_coords.size() == vertex_count);
+
+    const std::vector<Vector3>& positions = geometry.positions;
+    const std::vector<Vector3>& normals = geometry.normals;
+    const std::vector<Vector2>& tex_coords = geometry.tex_coords;
+    std::vector<UnsignedInt>& indices = geometry.indices;
+
+    //Face tangents from the UV gradients
+    std::vector<FaceTangent> faces(triangle_count);
+    pool.parallel_for(triangle_count, Grain, [&](std::size_t begin, std::size_t end, std::size_t)
+    {
+        for (std::size_t t = begin; t != end; ++t)
+        {
+            const UnsignedInt* corner = indices.data() + 3 * t;
+            const Vector3 edge1 = positions[corner[1]] - positions[corner[0]];
+            const Vector3 edge2 = positions[corner[2]] - positions[corner[0]];
+            const Vector2 uv1 = tex_coords[corner[1]] - tex_coords[corner[0]];
+            const Vector2 uv2 = tex_coords[corner[2]] - tex_coords[corner[0]];
+
+            const float signed_area = uv1.x() * uv2.y() - uv1.y() * uv2.x();
+            const Vector3 tangent = edge1 * uv2.y() - edge2 * uv1.y();
+
+            FaceTangent& face = faces[t];
+            face.degenerate = signed_area == 0.0f || tangent.isZero();
+            face.positive = signed_area > 0.0f;
+            face.tangent = face.degenerate ? Vector3{} : (face.positive ? tangent : -tangent).normalized();
+        }
+    });
+
+    //Corners grouped by vertex, counting sort
+    std::vector<UnsignedInt> corner_offsets(vertex_count + 1, 0);
+    for (UnsignedInt index : indices)
+    {
+        ++corner_offsets[index + 1];
+    }
+    for (std::size_t i = 0; i != vertex_count; ++i)
+    {
+        corner_offsets[i + 1] += corner_offsets[i];
+    }
+    std::vector<UnsignedInt> corners(indices.size());
+    {
+        std::vector<UnsignedInt> cursor(corner_offsets.begin(), corner_offsets.end() - 1);
+        for (std::size_t c = 0; c != indices.size(); ++c)
+        {
+            corners[cursor[indices[c]]++] = UnsignedInt(c);
+        }
+    }
+
+    //Angle-weighted sum per vertex and winding
+    std::vector<Vector4> tangents(vertex_count);
+    std::vector<Vector3> split_tangents(vertex_count);
+    std::vector<std::uint8_t> split(vertex_count, 0);
+    pool.parallel_for(vertex_count, Grain, [&](std::size_t begin, std::size_t end, std::size_t)
+    {
+        for (std::size_t v = begin; v != end; ++v)
+        {
+            const Vector3& normal = normals[v];
+            Vector3 sums[2]{}; //negative, positive
+            bool used[2]{ false, false };
+
+            for (UnsignedInt k = corner_offsets[v]; k != corner_offsets[v + 1]; ++k)
+            {
+                const UnsignedInt c = corners[k];
+                const std::size_t t = c / 3;
+                const UnsignedInt* triangle = indices.data() + 3 * t;
+                const std::size_t at = c % 3;
+                const Vector3& position = positions[triangle[at]];
+
+                const FaceTangent& face = faces[t];
+                if (face.degenerate)
+                {
+                    continue;
+                }
+                used[face.positive] = true;
+                const Vector3 tangent = project(face.tangent, normal);
+                if (tangent.isZero())
+                {
+                    continue;
+                }
+
+                const float angle = corner_angle(positions[triangle[(at + 1) % 3]] - position,
+                    positions[triangle[(at + 2) % 3]] - position, normal);
+                sums[face.positive] += tangent.normalized() * angle;
+            }
+
+            const auto resolve = [&](const Vector3& sum)
+            {
+                return sum.isZero() ? perpendicular(normal) : sum.normalized();
+            };
+
+            //A vertex on a mirrored UV seam keeps the positive space, the
+            //negative one goes to a copy
+            const bool positive = used[1] || !used[0];
+            tangents[v] = Vector4{ resolve(sums[positive]), positive ? 1.0f : -1.0f };
+            if (used[0] && used[1])
+            {
+                split[v] = 1;
+                split_tangents[v] = resolve(sums[0]);
+            }
+        }
+    });
+
+    std::vector<UnsignedInt> split_index(vertex_count, 0);
+    std::size_t split_count = 0;
+    for (std::size_t v = 0; v != vertex_count; ++v)
+    {
+        if (split[v])
+        {
+            split_index[v] = UnsignedInt(vertex_count + split_count++);
+        }
+    }
+
+    if (split_count != 0)
+    {
+        geometry.positions.resize(vertex_count + split_count);
+        geometry.normals.resize(vertex_count + split_count);
+        geometry.tex_coords.resize(vertex_count + split_count);
+        tangents.resize(vertex_count + split_count);
+        for (std::size_t v = 0; v != vertex_count; ++v)
+        {
+            if (split[v])
+            {
+                const UnsignedInt copy = split_index[v];
+                geometry.positions[copy] = geometry.positions[v];
+                geometry.normals[copy] = geometry.normals[v];
+                geometry.tex_coords[copy] = geometry.tex_coords[v];
+                tangents[copy] = Vector4{ split_tangents[v], -1.0f };
+            }
+        }
+
+        pool.parallel_for(triangle_count, Grain, [&](std::size_t begin, std::size_t end, std::size_t)
+        {
+            for (std::size_t t = begin; t != end; ++t)
+            {
+                //A degenerate face goes with the winding of its vertices,
+                //the way MikkTSpace copies the space of a neighbour
+                bool positive = faces[t].positive;
+                if (faces[t].degenerate)
+                {
+                    positive = true;
+                    for (std::size_t c = 3 * t; c != 3 * t + 3; ++c)
+                    {
+                        if (indices[c] < vertex_count && !split[indices[c]] && tangents[indices[c]].w() < 0.0f)
+                        {
+                            positive = false;
+                        }
+                    }
+                }
+                if (positive)
+                {
+                    continue;
+                }
+                for (std::size_t c = 3 * t; c != 3 * t + 3; ++c)
+                {
+                    if (indices[c] < vertex_count && split[indices[c]])
+                    {
+                        indices[c] = split_index[indices[c]];
+                    }
+                }
+            }
+        });
+    }
+
+    geometry.tangents = std::move(tangents);
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "mesh_packing.hpp"
+#include "thread_pool.hpp"
+
+//Per-vertex tangents and bitangent signs the way MikkTSpace derives them:
+//face tangents from the UV gradients, projected into the tangent plane of
+//the vertex normal and weighted by the corner angle, with triangles of
+//opposite UV winding kept in separate tangent spaces. A vertex used by
+//both windings is split in two, so the vertex count can grow. Triangles
+//without UV area don't contribute and share the space of their vertices.
+//Needs positions, normals and texture coordinates, overwrites `tangents`.
+void generate_tangents(MeshGeometry& geometry, ThreadPool& pool);
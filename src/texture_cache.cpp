@@ -0,0 +1,681 @@
+#include "texture_cache.hpp"
+#include "hash.hpp"
+#include "mip_chain.hpp"
+#include <Magnum/ImageView.h>
+#include <Magnum/GL/Context.h>
+#include <Magnum/GL/Extensions.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/GL/TextureFormat.h>
+#include <Magnum/Math/Functions.h>
+#include <Corrade/Containers/ArrayView.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double elapsed_ms(Clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+
+    constexpr char Magic[8]{ 'P', 'B', 'R', 'T', 'E', 'X', 'C', '\0' };
+    constexpr std::uint32_t Version = 3;
+    constexpr std::size_t MaxLevels = 16;
+    constexpr std::size_t PathLength = 256;
+    constexpr std::size_t LevelAlignment = 256;
+
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t entry_count;
+        double bake_ms; //how long the last bake took, i.e. the cold start cost
+    };
+
+    struct FileEntry
+    {
+        char source[PathLength];
+        std::uint64_t source_size;
+        std::int64_t source_mtime;
+        std::uint64_t source_hash;
+        std::uint32_t format; //Magnum::PixelFormat, only if not compressed
+        std::uint32_t usage; //TextureUsage
+        std::uint32_t compression; //0 or BlockFormat + 1
+        std::uint32_t quality; //CompressionQuality the blocks were encoded with, 0 if not compressed
+        std::int32_t width;
+        std::int32_t height;
+        std::uint32_t level_count;
+        std::uint64_t level_offset[MaxLevels];
+        std::uint64_t level_size[MaxLevels];
+    };
+
+    static_assert(std::is_trivially_copyable<FileEntry>::value, "FileEntry is written as-is");
+
+    MipFilter spec_filter(const TextureSpec& spec)
+    {
+        switch (spec.usage)
+        {
+            case TextureUsage::Color:
+                return MipFilter::Srgb;
+            case TextureUsage::Normal:
+                return MipFilter::Normal;
+            default:
+                return MipFilter::Linear;
+        }
+    }
+
+    std::uint32_t entry_compression(const TextureSpec& spec, const TextureCompression& compression)
+    {
+        if (!compression.enabled)
+        {
+            return 0;
+        }
+
+        switch (spec.usage)
+        {
+            case TextureUsage::Color:
+                return std::uint32_t(compression.color_format) + 1;
+            case TextureUsage::Scalar:
+                return std::uint32_t(BlockFormat::BC4) + 1;
+            case TextureUsage::Normal:
+                return std::uint32_t(BlockFormat::BC5) + 1;
+            case TextureUsage::Data:
+            default:
+                return std::uint32_t(BlockFormat::BC7) + 1;
+        }
+    }
+
+    std::uint32_t entry_quality(const TextureSpec& spec, const TextureCompression& compression)
+    {
+        return entry_compression(spec, compression) != 0 ? std::uint32_t(compression.quality) : 0;
+    }
+
+    //Same map, usage, block format and encoder quality
+    bool entry_matches(const FileEntry& entry, const TextureSpec& spec, const TextureCompression& compression)
+    {
+        return spec.path == entry.source && std::uint32_t(spec.usage) == entry.usage
+            && entry_compression(spec, compression) == entry.compression && entry_quality(spec, compression) == entry.quality;
+    }
+
+    CompressedPixelFormat compressed_pixel_format(BlockFormat format, bool srgb)
+    {
+        switch (format)
+        {
+            case BlockFormat::BC1:
+                return srgb ? CompressedPixelFormat::Bc1RGBSrgb : CompressedPixelFormat::Bc1RGBUnorm;
+            case BlockFormat::BC4:
+                return CompressedPixelFormat::Bc4RUnorm;
+            case BlockFormat::BC5:
+                return CompressedPixelFormat::Bc5RGUnorm;
+            case BlockFormat::BC7:
+            default:
+                return srgb ? CompressedPixelFormat::Bc7RGBASrgb : CompressedPixelFormat::Bc7RGBAUnorm;
+        }
+    }
+
+    //Channels the shader actually reads, for uncompressed storage
+    std::size_t used_channels(TextureUsage usage, std::size_t channels)
+    {
+        switch (usage)
+        {
+            case TextureUsage::Scalar:
+                return 1;
+            case TextureUsage::Normal:
+                return std::min<std::size_t>(channels, 2);
+            default:
+                return channels;
+        }
+    }
+
+    PixelFormat unorm8_format(std::size_t channels)
+    {
+        switch (channels)
+        {
+            case 1:
+                return PixelFormat::R8Unorm;
+            case 2:
+                return PixelFormat::RG8Unorm;
+            case 3:
+                return PixelFormat::RGB8Unorm;
+            default:
+                return PixelFormat::RGBA8Unorm;
+        }
+    }
+
+    bool source_key(const std::string& path, std::uint64_t& size, std::int64_t& mtime)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error)
+        {
+            return false;
+        }
+
+        mtime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        return !error;
+    }
+
+    bool source_hash(const std::string& path, std::uint64_t& hash)
+    {
+        const auto data = Utility::Directory::mapRead(path);
+        if (!data && !Utility::Directory::exists(path))
+        {
+            return false;
+        }
+
+        hash = fnv1a64(data.data(), data.size());
+        return true;
+    }
+
+    const FileHeader* header_of(Containers::ArrayView<const char> data)
+    {
+        if (data.size() < sizeof(FileHeader))
+        {
+            return nullptr;
+        }
+
+        const auto* header = reinterpret_cast<const FileHeader*>(data.data());
+        if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != Version
+            || data.size() < sizeof(FileHeader) + header->entry_count * sizeof(FileEntry))
+        {
+            return nullptr;
+        }
+
+        return header;
+    }
+
+    //Bytes a level of the entry has to have, 0 for an unknown format
+    std::uint64_t expected_level_size(const FileEntry& entry, std::uint32_t level)
+    {
+        const int width = std::max(entry.width >> level, 1);
+        const int height = std::max(entry.height >> level, 1);
+        if (entry.compression != 0)
+        {
+            return entry.compression <= std::uint32_t(BlockFormat::BC7) + 1
+                ? compressed_size(BlockFormat(entry.compression - 1), width, height) : 0;
+        }
+
+        switch (PixelFormat(entry.format))
+        {
+            case PixelFormat::R8Unorm:
+            case PixelFormat::RG8Unorm:
+            case PixelFormat::RGB8Unorm:
+            case PixelFormat::RGBA8Unorm:
+                return std::uint64_t(width) * std::uint64_t(height) * pixelSize(PixelFormat(entry.format));
+            default:
+                return 0;
+        }
+    }
+
+    //Don't trust a corrupted or foreign file: level counts beyond the table,
+    //sizes that don't match the format and offsets outside of a truncated file
+    bool entry_is_valid(const FileEntry& entry, std::size_t data_size)
+    {
+        if (entry.level_count == 0 || entry.level_count > MaxLevels || entry.width <= 0 || entry.height <= 0
+            || std::memchr(entry.source, '\0', PathLength) == nullptr)
+        {
+            return false;
+        }
+
+        for (std::uint32_t level = 0; level < entry.level_count; ++level)
+        {
+            const std::uint64_t size = entry.level_size[level];
+            if (size == 0 || size != expected_level_size(entry, level) || entry.level_offset[level] > data_size
+                || size > data_size - entry.level_offset[level])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    const FileEntry* file_entries(Containers::ArrayView<const char> data)
+    {
+        return reinterpret_cast<const FileEntry*>(data.data() + sizeof(FileHeader));
+    }
+
+    const FileEntry* find_entry(Containers::ArrayView<const char> data, const TextureSpec& spec, const TextureCompression& compression)
+    {
+        const FileHeader* header = header_of(data);
+        if (!header)
+        {
+            return nullptr;
+        }
+
+        const FileEntry* entries = file_entries(data);
+        for (std::uint32_t i = 0; i < header->entry_count; ++i)
+        {
+            const FileEntry& entry = entries[i];
+            if (entry_is_valid(entry, data.size()) && entry_matches(entry, spec, compression))
+            {
+                return &entry;
+            }
+        }
+
+        return nullptr;
+    }
+
+    bool entry_is_fresh(const FileEntry& entry)
+    {
+        std::uint64_t size;
+        std::int64_t mtime;
+        if (!source_key(entry.source, size, mtime) || size != entry.source_size)
+        {
+            return false;
+        }
+
+        if (mtime == entry.source_mtime)
+        {
+            return true;
+        }
+
+        //Touched but possibly unchanged, e.g. after a checkout
+        std::uint64_t hash;
+        return source_hash(entry.source, hash) && hash == entry.source_hash;
+    }
+
+    std::uint64_t align_up(std::uint64_t value, std::uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+TextureCache::TextureCache(std::string path, TextureLoader& loader, ThreadPool& pool,
+    const TextureCompression& compression):
+    path{ std::move(path) },
+    loader{ loader },
+    pool{ pool },
+    compression{ compression }
+{
+}
+
+void TextureCache::bake_levels(const TextureSpec& spec, std::vector<MipLevel>& levels, std::size_t channels) const
+{
+    const std::uint32_t block_format = entry_compression(spec, compression);
+    const std::size_t used = used_channels(spec.usage, channels);
+
+    for (MipLevel& level : levels)
+    {
+        const std::size_t texel_count = std::size_t(level.size.product());
+        Containers::Array<char> data;
+
+        if (block_format)
+        {
+            const auto format = BlockFormat(block_format - 1);
+            data = Containers::Array<char>{ Containers::NoInit, compressed_size(format, level.size.x(), level.size.y()) };
+            compress_image(reinterpret_cast<const unsigned char*>(level.data.data()), level.size.x(), level.size.y(),
+                channels, format, compression.quality, reinterpret_cast<unsigned char*>(data.data()), pool);
+        }
+        else if (used != channels)
+        {
+            data = Containers::Array<char>{ Containers::NoInit, texel_count * used };
+            for (std::size_t i = 0; i < texel_count; ++i)
+            {
+                std::memcpy(data.data() + i * used, level.data.data() + i * channels, used);
+            }
+        }
+        else
+        {
+            continue;
+        }
+
+        level.data = std::move(data);
+    }
+}
+
+bool TextureCache::map()
+{
+    unmap();
+    if (!Utility::Directory::exists(path))
+    {
+        return false;
+    }
+
+    mapping = Utility::Directory::mapRead(path);
+    mapping_memory = TrackedAllocation{ MemoryCategory::Staging, path, mapping.size() };
+    return header_of(mapping);
+}
+
+void TextureCache::unmap()
+{
+    mapping = {};
+    mapping_memory = {};
+}
+
+double TextureCache::bake_ms() const
+{
+    const FileHeader* header = header_of(mapping);
+    return header ? header->bake_ms : 0.0;
+}
+
+bool TextureCache::is_fresh(const std::vector<TextureSpec>& specs) const
+{
+    for (const TextureSpec& spec : specs)
+    {
+        const FileEntry* entry = find_entry(mapping, spec, compression);
+        if (!entry || !entry_is_fresh(*entry))
+        {
+            spdlog::info("Texture cache entry for {} is missing or stale", spec.path);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool TextureCache::bake(const std::vector<TextureSpec>& specs, bool force)
+{
+    const auto start = Clock::now();
+
+    for (const TextureSpec& spec : specs)
+    {
+        if (spec.path.size() >= PathLength)
+        {
+            spdlog::error("Texture path {} is too long for the cache", spec.path);
+            return false;
+        }
+    }
+
+    map();
+
+    //Entries that are still fresh are copied over from the old container
+    std::vector<const FileEntry*> reused(specs.size(), nullptr);
+    std::vector<TextureSpec> stale;
+    std::vector<std::size_t> stale_index;
+    for (std::size_t i = 0; i != specs.size(); ++i)
+    {
+        const FileEntry* entry = force ? nullptr : find_entry(mapping, specs[i], compression);
+        if (entry && entry_is_fresh(*entry))
+        {
+            reused[i] = entry;
+        }
+        else
+        {
+            stale.push_back(specs[i]);
+            stale_index.push_back(i);
+        }
+    }
+
+    //Fresh entries of other layouts and compression settings stay, so A/B
+    //runs sharing the file don't rebake on every switch
+    if (const FileHeader* header = header_of(mapping))
+    {
+        const FileEntry* old_entries = file_entries(mapping);
+        for (std::uint32_t e = 0; e < header->entry_count; ++e)
+        {
+            const FileEntry& entry = old_entries[e];
+            if (!entry_is_valid(entry, mapping.size()))
+            {
+                continue;
+            }
+
+            const bool requested = std::any_of(specs.begin(), specs.end(), [&](const TextureSpec& spec)
+            {
+                return entry_matches(entry, spec, compression);
+            });
+            if (!requested && entry_is_fresh(entry))
+            {
+                reused.push_back(&entry);
+            }
+        }
+    }
+    const std::size_t kept = reused.size() - specs.size();
+
+    std::vector<Containers::Optional<Trade::ImageData2D>> images = loader.decode(stale);
+
+    std::vector<FileEntry> entries(reused.size());
+    std::vector<std::vector<MipLevel>> chains(specs.size());
+
+    for (std::size_t s = 0; s != stale.size(); ++s)
+    {
+        const TextureSpec& spec = stale[s];
+        const std::size_t i = stale_index[s];
+        auto& image = images[s];
+
+        if (!image)
+        {
+            return false;
+        }
+
+        if (image->isCompressed() || !supports_mip_generation(image->format()))
+        {
+            spdlog::error("Can't bake {}: unsupported pixel format", spec.path);
+            return false;
+        }
+
+        const std::size_t channels = pixelSize(image->format());
+        chains[i] = generate_mip_chain(*image, spec_filter(spec), pool);
+        image = Containers::NullOpt;
+        bake_levels(spec, chains[i], channels);
+
+        FileEntry& entry = entries[i];
+        entry = {};
+        std::strncpy(entry.source, spec.path.c_str(), PathLength - 1);
+        if (!source_key(spec.path, entry.source_size, entry.source_mtime) || !source_hash(spec.path, entry.source_hash))
+        {
+            spdlog::error("Can't stat {}", spec.path);
+            return false;
+        }
+
+        entry.format = UnsignedInt(unorm8_format(used_channels(spec.usage, channels)));
+        entry.usage = std::uint32_t(spec.usage);
+        entry.compression = entry_compression(spec, compression);
+        entry.quality = entry_quality(spec, compression);
+        entry.width = chains[i][0].size.x();
+        entry.height = chains[i][0].size.y();
+        entry.level_count = std::uint32_t(std::min(chains[i].size(), MaxLevels));
+    }
+
+    for (std::size_t i = 0; i != entries.size(); ++i)
+    {
+        if (reused[i])
+        {
+            entries[i] = *reused[i];
+        }
+    }
+
+    //Lay out level data after the header and the entry table
+    std::uint64_t offset = sizeof(FileHeader) + entries.size() * sizeof(FileEntry);
+    for (FileEntry& entry : entries)
+    {
+        const std::size_t i = std::size_t(&entry - entries.data());
+        for (std::uint32_t level = 0; level < entry.level_count; ++level)
+        {
+            const std::uint64_t size = reused[i] ? reused[i]->level_size[level] : chains[i][level].data.size();
+            offset = align_up(offset, LevelAlignment);
+            entry.level_offset[level] = offset;
+            entry.level_size[level] = size;
+            offset += size;
+        }
+    }
+
+    const std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream out{ temporary_path, std::ios::binary | std::ios::trunc };
+        if (!out)
+        {
+            spdlog::error("Can't write {}", temporary_path);
+            return false;
+        }
+
+        FileHeader header{};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.entry_count = std::uint32_t(entries.size());
+        header.bake_ms = elapsed_ms(start);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(FileEntry));
+
+        for (std::size_t i = 0; i != entries.size(); ++i)
+        {
+            for (std::uint32_t level = 0; level < entries[i].level_count; ++level)
+            {
+                const std::uint64_t position = std::uint64_t(out.tellp());
+                for (std::uint64_t pad = position; pad < entries[i].level_offset[level]; ++pad)
+                {
+                    out.put('\0');
+                }
+
+                if (reused[i])
+                {
+                    out.write(mapping.data() + reused[i]->level_offset[level], reused[i]->level_size[level]);
+                }
+                else
+                {
+                    out.write(chains[i][level].data.data(), chains[i][level].data.size());
+                }
+            }
+        }
+
+        if (!out)
+        {
+            spdlog::error("Can't write {}", temporary_path);
+            return false;
+        }
+    }
+
+    unmap();
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path, error);
+    if (error)
+    {
+        spdlog::error("Can't replace {}: {}", path, error.message());
+        return false;
+    }
+
+    spdlog::info("Baked {} of {} textures into {} ({:.1f} MiB, {} entries of other settings kept) in {:.1f} ms",
+        stale.size(), specs.size(), path, offset / double(1 << 20), kept, elapsed_ms(start));
+    return true;
+}
+
+GL::TextureFormat storage_format(const CachedTexture& texture)
+{
+    return texture.compressed ? GL::textureFormat(texture.compressed_format) : texture_format(texture.format, texture.srgb);
+}
+
+Vector2i level_size(const Vector2i& size, Int level)
+{
+    return Math::max(size >> level, Vector2i{ 1 });
+}
+
+void upload_level(GL::Texture2D& texture, Int level, const CachedTexture& source, Int source_level,
+    Containers::ArrayView<const char> data)
+{
+    const Vector2i size = level_size(source.size, source_level);
+    if (source.compressed)
+    {
+        texture.setCompressedSubImage(level, {}, CompressedImageView2D{ source.compressed_format, size, data });
+    }
+    else
+    {
+        texture.setSubImage(level, {}, ImageView2D{ PixelStorage{}.setAlignment(1), source.format, size, data });
+    }
+}
+
+Containers::Optional<std::vector<CachedTexture>> TextureCache::open(const std::vector<TextureSpec>& specs)
+{
+    //S3TC isn't core GL, BPTC and RGTC are
+    if (compression.enabled && compression.color_format == BlockFormat::BC1
+        && !GL::Context::current().isExtensionSupported<GL::Extensions::EXT::texture_compression_s3tc>())
+    {
+        spdlog::warn("S3TC isn't supported, using BC7 for color maps");
+        compression.color_format = BlockFormat::BC7;
+    }
+
+    cold = false;
+    if (!map() || !is_fresh(specs))
+    {
+        cold = true;
+        if (!bake(specs) || !map())
+        {
+            return Containers::NullOpt;
+        }
+    }
+
+    std::vector<CachedTexture> textures;
+    textures.reserve(specs.size());
+    for (const TextureSpec& spec : specs)
+    {
+        const FileEntry* entry = find_entry(mapping, spec, compression);
+        CORRADE_INTERNAL_ASSERT(entry);
+
+        CachedTexture texture;
+        texture.path = spec.path;
+        texture.size = Vector2i{ entry->width, entry->height };
+        texture.srgb = spec.srgb();
+        texture.compressed = entry->compression != 0;
+        if (texture.compressed)
+        {
+            texture.compressed_format = compressed_pixel_format(BlockFormat(entry->compression - 1), spec.srgb());
+        }
+        else
+        {
+            texture.format = PixelFormat(entry->format);
+        }
+        for (std::uint32_t level = 0; level < entry->level_count; ++level)
+        {
+            texture.levels.emplace_back(mapping.data() + entry->level_offset[level], std::size_t(entry->level_size[level]));
+        }
+        textures.push_back(std::move(texture));
+    }
+
+    return std::move(textures);
+}
+
+Containers::Optional<std::vector<GL::Texture2D>> TextureCache::load(const std::vector<TextureSpec>& specs)
+{
+    const auto start = Clock::now();
+
+    Containers::Optional<std::vector<CachedTexture>> cached = open(specs);
+    if (!cached)
+    {
+        return Containers::NullOpt;
+    }
+
+    const auto upload_start = Clock::now();
+    std::size_t bytes = 0;
+    std::size_t uncompressed_bytes = 0;
+
+    std::vector<GL::Texture2D> textures;
+    textures.reserve(cached->size());
+    for (const CachedTexture& source : *cached)
+    {
+        GL::Texture2D texture;
+        setup_sampler(texture, source.srgb);
+        texture.setStorage(Int(source.levels.size()), storage_format(source), source.size)
+            .setLabel(source.path);
+
+        for (std::size_t level = 0; level != source.levels.size(); ++level)
+        {
+            upload_level(texture, Int(level), source, Int(level), source.levels[level]);
+            bytes += source.levels[level].size();
+        }
+
+        //What the same chain would take as plain RGBA8
+        uncompressed_bytes += std::size_t(source.size.product()) * 4 * 4 / 3;
+
+        textures.push_back(std::move(texture));
+    }
+
+    const double upload_ms = elapsed_ms(upload_start);
+    const double total_ms = elapsed_ms(start);
+
+    spdlog::info("Loaded {} textures ({:.1f} MiB, {:.1f}x smaller than RGBA8) from {} in {:.1f} ms ({} start, upload {:.1f} ms), cold bake took {:.1f} ms",
+        specs.size(), bytes / double(1 << 20), uncompressed_bytes / double(std::max<std::size_t>(bytes, 1)), path,
+        total_ms, cold ? "cold" : "warm", upload_ms, bake_ms());
+
+    //Everything is on the GPU, the mapped pages would only stay resident
+    cached = Containers::NullOpt;
+    unmap();
+
+    return std::move(textures);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/GL/Texture.h>
+#include <Magnum/GL/TextureFormat.h>
+#include <Corrade/Containers/ArrayView.h>
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Containers/Optional.h>
+#include <Corrade/Utility/Directory.h>
+#include <string>
+#include <vector>
+#include "block_compression.hpp"
+#include "memory_tracker.hpp"
+#include "mip_chain.hpp"
+#include "texture_loader.hpp"
+#include "thread_pool.hpp"
+
+using namespace Magnum;
+
+//Scalar maps become BC4, normals BC5, color maps BC1 or BC7 and any other
+//data BC7. Without compression scalar and normal maps still drop to R8/RG8.
+struct TextureCompression
+{
+    bool enabled = true;
+    BlockFormat color_format = BlockFormat::BC7;
+    CompressionQuality quality = CompressionQuality::Normal;
+};
+
+//One map in the mapped container. The level views point into the mapping and
+//stay valid until the next bake(), open() or load().
+struct CachedTexture
+{
+    std::string path; //of the source image
+    Vector2i size;
+    bool srgb = false;
+    bool compressed = false;
+    PixelFormat format = PixelFormat::RGBA8Unorm; //uncompressed only
+    CompressedPixelFormat compressed_format = CompressedPixelFormat::Bc7RGBAUnorm; //compressed only
+    std::vector<Containers::ArrayView<const char>> levels;
+};
+
+GL::TextureFormat storage_format(const CachedTexture& texture);
+Vector2i level_size(const Vector2i& size, Int level);
+
+//Uploads `data`, which holds level `source_level` of the cached texture, into
+//level `level` of a texture with storage_format() storage
+void upload_level(GL::Texture2D& texture, Int level, const CachedTexture& source, Int source_level,
+    Containers::ArrayView<const char> data);
+
+//Binary container with the full, pre-filtered mip chain of every map, keyed
+//by source size, mtime and content hash. Loading it is a mmap plus one
+//upload per level, no decoding and no GPU mip generation.
+class TextureCache
+{
+public:
+    explicit TextureCache(std::string path, TextureLoader& loader, ThreadPool& pool,
+        const TextureCompression& compression = {});
+
+    //Rebakes stale or missing entries (or all of them with `force`) and
+    //rewrites the container. Doesn't need a GL context.
+    bool bake(const std::vector<TextureSpec>& specs, bool force = false);
+
+    //Transparently rebakes if any source changed, then maps the container
+    //without uploading anything, e.g. for a TextureStreamer
+    Containers::Optional<std::vector<CachedTexture>> open(const std::vector<TextureSpec>& specs);
+
+    //open(), then uploads every level and unmaps the container
+    Containers::Optional<std::vector<GL::Texture2D>> load(const std::vector<TextureSpec>& specs);
+
+    //Whether the last open() had to bake
+    bool was_cold() const
+    {
+        return cold;
+    }
+
+    //How long the bake that wrote the mapped container took
+    double bake_ms() const;
+
+private:
+    bool map();
+    void unmap();
+    void bake_levels(const TextureSpec& spec, std::vector<MipLevel>& levels, std::size_t channels) const;
+    bool is_fresh(const std::vector<TextureSpec>& specs) const;
+
+    std::string path;
+    TextureLoader& loader;
+    ThreadPool& pool;
+    TextureCompression compression;
+    Containers::Array<const char, Utility::Directory::MapDeleter> mapping;
+    TrackedAllocation mapping_memory;
+    bool cold = false;
+};
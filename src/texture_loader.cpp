@@ -0,0 +1,289 @@
+#include "texture_loader.hpp"
+#include "concurrent_queue.hpp"
+#include "memory_tracker.hpp"
+#include "profiler.hpp"
+#include "staging_ring.hpp"
+#include <Magnum/GL/Context.h>
+#include <Magnum/GL/OpenGL.h>
+#include <Magnum/GL/PixelFormat.h>
+#include <Magnum/GL/Sampler.h>
+#include <Magnum/GL/TimeQuery.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Trade/ImageData.h>
+#include <Corrade/Utility/Assert.h>
+#include <spdlog/spdlog.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double elapsed_ms(Clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+
+    struct UploadJob
+    {
+        std::size_t texture = 0;
+        bool failed = false;
+        PixelFormat format{};
+        Vector2i size;
+        std::size_t bytes = 0;
+
+        bool staged = false;
+        StagingRing::Region region;
+
+        //Only set when the image didn't fit into the staging ring
+        Containers::Optional<Trade::ImageData2D> image;
+        TrackedAllocation image_memory;
+    };
+}
+
+GL::TextureFormat texture_format(PixelFormat format, bool srgb)
+{
+    if (srgb)
+    {
+        switch (format)
+        {
+            case PixelFormat::RGB8Unorm:
+                return GL::textureFormat(PixelFormat::RGB8Srgb);
+            case PixelFormat::RGBA8Unorm:
+                return GL::textureFormat(PixelFormat::RGBA8Srgb);
+            default:
+                break;
+        }
+    }
+
+    return GL::textureFormat(format);
+}
+
+Int mip_level_count(const Vector2i& size)
+{
+    return Math::log2(size.max()) + 1;
+}
+
+void setup_sampler(GL::Texture2D& texture, bool srgb)
+{
+    texture.setWrapping(GL::SamplerWrapping::ClampToEdge)
+        .setMagnificationFilter(GL::SamplerFilter::Linear)
+        .setMinificationFilter(GL::SamplerFilter::Linear, GL::SamplerMipmap::Linear)
+        .setMaxAnisotropy(GL::Sampler::maxMaxAnisotropy())
+        .setSrgbDecode(srgb);
+}
+
+TextureLoader::TextureLoader(PluginManager::Manager<Trade::AbstractImporter>& manager, ThreadPool& pool,
+    std::size_t staging_size):
+    pool{ pool },
+    staging_size{ staging_size }
+{
+    //Importers aren't thread-safe, so every worker gets its own instance
+    importers.reserve(pool.size());
+    for (std::size_t i = 0; i < pool.size(); ++i)
+    {
+        importers.push_back(manager.instantiate("StbImageImporter"));
+        CORRADE_INTERNAL_ASSERT(importers.back());
+    }
+}
+
+Containers::Optional<Trade::ImageData2D> TextureLoader::decode_image(std::size_t worker, const TextureSpec& spec)
+{
+    ProfileZone zone{ "decode image" };
+    Trade::AbstractImporter& importer = *importers[worker];
+    Containers::Optional<Trade::ImageData2D> image;
+    if (importer.openFile(spec.path))
+    {
+        image = importer.image2D(0);
+        importer.close();
+    }
+
+    return image;
+}
+
+Containers::Optional<std::vector<GL::Texture2D>> TextureLoader::load(const std::vector<TextureSpec>& specs)
+{
+    load_stats = {};
+    const auto start = Clock::now();
+
+    StagingRing ring{ staging_size };
+    ConcurrentQueue<UploadJob> uploads;
+    std::atomic<long long> decode_cpu_ns{ 0 };
+
+    for (std::size_t i = 0; i != specs.size(); ++i)
+    {
+        pool.submit([this, &specs, &ring, &uploads, &decode_cpu_ns, i](std::size_t worker)
+        {
+            const auto decode_start = Clock::now();
+
+            UploadJob job;
+            job.texture = i;
+
+            Containers::Optional<Trade::ImageData2D> image = decode_image(worker, specs[i]);
+            if (!image || image->isCompressed())
+            {
+                job.failed = true;
+                uploads.push(std::move(job));
+                return;
+            }
+
+            job.format = image->format();
+            job.size = image->size();
+            TrackedAllocation image_memory{ MemoryCategory::Staging, specs[i].path + " decoded", image->data().size() };
+
+            const std::size_t row_size = std::size_t(image->size().x()) * image->pixelSize();
+            const std::size_t alignment = std::size_t(image->storage().alignment());
+            const std::size_t row_stride = (row_size + alignment - 1) / alignment * alignment;
+            job.bytes = row_size * std::size_t(image->size().y());
+
+            //Rows are repacked tightly, the upload uses an unpack alignment of 1
+            if (ring.acquire(job.bytes, job.region))
+            {
+                const char* src = image->data().data();
+                for (Int y = 0; y < image->size().y(); ++y)
+                {
+                    std::memcpy(job.region.data + y * row_size, src + y * row_stride, row_size);
+                }
+
+                job.staged = true;
+            }
+            else
+            {
+                job.image = std::move(image);
+                job.image_memory = std::move(image_memory);
+            }
+
+            decode_cpu_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - decode_start).count();
+            uploads.push(std::move(job));
+        });
+    }
+
+    std::vector<GL::Texture2D> textures;
+    textures.reserve(specs.size());
+    for (std::size_t i = 0; i != specs.size(); ++i)
+    {
+        textures.emplace_back();
+    }
+
+    std::vector<GL::TimeQuery> mipmap_queries;
+    bool failed = false;
+
+    for (std::size_t remaining = specs.size(); remaining != 0;)
+    {
+        ring.retire();
+
+        UploadJob job;
+        if (!uploads.pop_for(job, std::chrono::milliseconds(1)))
+        {
+            continue;
+        }
+
+        --remaining;
+        if (remaining == 0)
+        {
+            load_stats.decode_ms = elapsed_ms(start);
+        }
+
+        if (job.failed)
+        {
+            spdlog::error("Can't load {}", specs[job.texture].path);
+            failed = true;
+            continue;
+        }
+
+        const auto upload_start = Clock::now();
+
+        const TextureSpec& spec = specs[job.texture];
+        GL::Texture2D& texture = textures[job.texture];
+        setup_sampler(texture, spec.srgb());
+        texture.setStorage(mip_level_count(job.size), texture_format(job.format, spec.srgb()), job.size)
+            .setLabel(spec.path);
+
+        if (job.staged)
+        {
+            GL::Context::current().resetState(GL::Context::State::EnterExternal);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.buffer().id());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            glTextureSubImage2D(texture.id(), 0, 0, 0, job.size.x(), job.size.y(),
+                GLenum(GL::pixelFormat(job.format)), GLenum(GL::pixelType(job.format)),
+                reinterpret_cast<const void*>(job.region.offset));
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            GL::Context::current().resetState(GL::Context::State::ExitExternal);
+
+            ring.fence(job.region);
+            ++load_stats.staged_count;
+        }
+        else
+        {
+            texture.setSubImage(0, {}, *job.image);
+            job.image = Containers::NullOpt;
+            job.image_memory = {};
+            ++load_stats.direct_count;
+        }
+
+        load_stats.upload_ms += elapsed_ms(upload_start);
+        load_stats.bytes += job.bytes;
+
+        const auto mipmap_start = Clock::now();
+        mipmap_queries.emplace_back(GL::TimeQuery::Target::TimeElapsed);
+        mipmap_queries.back().begin();
+        texture.generateMipmap();
+        mipmap_queries.back().end();
+        load_stats.mipmap_ms += elapsed_ms(mipmap_start);
+    }
+
+    ring.finish();
+
+    for (auto& query : mipmap_queries)
+    {
+        load_stats.mipmap_gpu_ms += query.result<UnsignedLong>() / 1.0e6;
+    }
+
+    load_stats.decode_cpu_ms = decode_cpu_ns.load() / 1.0e6;
+    load_stats.total_ms = elapsed_ms(start);
+
+    if (failed)
+    {
+        return Containers::NullOpt;
+    }
+
+    spdlog::info("Loaded {} textures ({:.1f} MiB, {} staged, {} direct) in {:.1f} ms",
+        specs.size(), load_stats.bytes / double(1 << 20), load_stats.staged_count, load_stats.direct_count,
+        load_stats.total_ms);
+    spdlog::info("  decode {:.1f} ms wall / {:.1f} ms cpu on {} threads, upload {:.1f} ms, mipmaps {:.1f} ms cpu / {:.2f} ms gpu",
+        load_stats.decode_ms, load_stats.decode_cpu_ms, pool.size(), load_stats.upload_ms,
+        load_stats.mipmap_ms, load_stats.mipmap_gpu_ms);
+
+    return std::move(textures);
+}
+
+std::vector<Containers::Optional<Trade::ImageData2D>> TextureLoader::decode(const std::vector<TextureSpec>& specs)
+{
+    std::vector<std::future<Containers::Optional<Trade::ImageData2D>>> pending;
+    pending.reserve(specs.size());
+
+    for (const TextureSpec& spec : specs)
+    {
+        pending.push_back(pool.submit([this, &spec](std::size_t worker)
+        {
+            Containers::Optional<Trade::ImageData2D> image = decode_image(worker, spec);
+            if (!image)
+            {
+                spdlog::error("Can't load {}", spec.path);
+            }
+
+            return image;
+        }));
+    }
+
+    std::vector<Containers::Optional<Trade::ImageData2D>> images;
+    images.reserve(specs.size());
+    for (auto& image : pending)
+    {
+        images.push_back(image.get());
+    }
+
+    return images;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Texture.h>
+#include <Magnum/GL/TextureFormat.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/Trade/AbstractImporter.h>
+#include <Magnum/Trade/ImageData.h>
+#include <Corrade/Containers/Optional.h>
+#include <Corrade/Containers/Pointer.h>
+#include <Corrade/PluginManager/Manager.h>
+#include <string>
+#include <vector>
+#include "thread_pool.hpp"
+
+using namespace Magnum;
+
+enum class TextureUsage : UnsignedInt
+{
+    Data, //generic linear data
+    Color, //sRGB encoded color
+    Scalar, //only the red channel is sampled
+    Normal //tangent space normal, the shader reconstructs Z from XY
+};
+
+struct TextureSpec
+{
+    std::string path;
+    TextureUsage usage = TextureUsage::Data;
+
+    bool srgb() const
+    {
+        return usage == TextureUsage::Color;
+    }
+};
+
+struct TextureLoadStats
+{
+    double decode_ms = 0.0; //wall time until the last image was decoded
+    double decode_cpu_ms = 0.0; //summed over all workers
+    double upload_ms = 0.0; //GL thread time spent issuing uploads
+    double mipmap_ms = 0.0; //GL thread time spent in generateMipmap()
+    double mipmap_gpu_ms = 0.0;
+    double total_ms = 0.0;
+    std::size_t bytes = 0;
+    std::size_t staged_count = 0; //went through the staging ring
+    std::size_t direct_count = 0; //too big for the ring, uploaded from client memory
+};
+
+GL::TextureFormat texture_format(PixelFormat format, bool srgb);
+Int mip_level_count(const Vector2i& size);
+void setup_sampler(GL::Texture2D& texture, bool srgb);
+
+//Decodes images on a ThreadPool (one importer per worker) and streams the
+//pixels through a persistently mapped StagingRing. The calling thread owns
+//the GL context and only issues uploads and mipmap generation.
+class TextureLoader
+{
+public:
+    explicit TextureLoader(PluginManager::Manager<Trade::AbstractImporter>& manager, ThreadPool& pool,
+        std::size_t staging_size = std::size_t{ 64 } << 20);
+
+    Containers::Optional<std::vector<GL::Texture2D>> load(const std::vector<TextureSpec>& specs);
+
+    //Decodes on the pool without touching GL, failed images are NullOpt
+    std::vector<Containers::Optional<Trade::ImageData2D>> decode(const std::vector<TextureSpec>& specs);
+
+    const TextureLoadStats& stats() const
+    {
+        return load_stats;
+    }
+
+private:
+    Containers::Optional<Trade::ImageData2D> decode_image(std::size_t worker, const TextureSpec& spec);
+
+    ThreadPool& pool;
+    std::vector<Containers::Pointer<Trade::AbstractImporter>> importers;
+    std::size_t staging_size;
+    TextureLoadStats load_stats;
+};
@@ -0,0 +1,295 @@
+#include "texture_streamer.hpp"
+#include <Magnum/GL/OpenGL.h>
+#include <Magnum/Math/Functions.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include "profiler.hpp"
+#include "texture_loader.hpp"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double elapsed_ms(Clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+}
+
+TextureStreamer::TextureStreamer(std::vector<CachedTexture>&& textures, ThreadPool& pool, const TextureStreamingOptions& options):
+    pool{ pool },
+    options{ options }
+{
+    streaming_stats.budget_bytes = options.budget_bytes;
+
+    std::size_t full_bytes = 0;
+    entries.reserve(textures.size());
+    for (CachedTexture& source : textures)
+    {
+        CORRADE_INTERNAL_ASSERT(!source.levels.empty());
+
+        Entry entry;
+        entry.source = std::move(source);
+        entry.level_count = Int(entry.source.levels.size());
+        entry.tail_first = entry.level_count - 1;
+        for (Int level = 0; level != entry.level_count; ++level)
+        {
+            if (level_size(entry.source.size, level).max() <= options.tail_size)
+            {
+                entry.tail_first = level;
+                break;
+            }
+        }
+        entry.resident_first = entry.tail_first;
+        entry.wanted_first = entry.tail_first;
+
+        setup_sampler(entry.texture, entry.source.srgb);
+        entry.texture.setStorage(entry.level_count - entry.tail_first, storage_format(entry.source),
+            level_size(entry.source.size, entry.tail_first))
+            .setLabel(entry.source.path);
+        for (Int level = entry.tail_first; level != entry.level_count; ++level)
+        {
+            upload_level(entry.texture, level - entry.tail_first, entry.source, level, entry.source.levels[level]);
+        }
+
+        entry.memory = TrackedAllocation{ MemoryCategory::Texture, "streamed " + entry.source.path, bytes_from(entry, entry.tail_first) };
+        streaming_stats.resident_bytes += entry.memory.bytes();
+        full_bytes += bytes_from(entry, 0);
+        entries.push_back(std::move(entry));
+    }
+
+    spdlog::info("Streaming {} textures: {:.1f} MiB of tails resident, {:.1f} MiB of full chains, {:.1f} MiB budget",
+        entries.size(), streaming_stats.resident_bytes / double(1 << 20), full_bytes / double(1 << 20),
+        options.budget_bytes / double(1 << 20));
+    if (streaming_stats.resident_bytes > options.budget_bytes)
+    {
+        spdlog::warn("The tails alone exceed the texture streaming budget, nothing finer will stream in");
+    }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    //The reads capture this
+    Read read;
+    while (reads_in_flight != 0)
+    {
+        if (completed.pop_for(read, std::chrono::milliseconds(10)))
+        {
+            --reads_in_flight;
+        }
+    }
+}
+
+std::size_t TextureStreamer::level_bytes(const Entry& entry, Int level) const
+{
+    return entry.source.levels[level].size();
+}
+
+std::size_t TextureStreamer::bytes_from(const Entry& entry, Int first) const
+{
+    std::size_t bytes = 0;
+    for (Int level = first; level != entry.level_count; ++level)
+    {
+        bytes += level_bytes(entry, level);
+    }
+    return bytes;
+}
+
+void TextureStreamer::request(std::size_t index, float pixels_per_uv)
+{
+    Entry& entry = entries[index];
+    entry.demand = std::max(entry.demand, pixels_per_uv);
+}
+
+void TextureStreamer::reallocate(Entry& entry, Int first)
+{
+    GL::Texture2D texture;
+    setup_sampler(texture, entry.source.srgb);
+    texture.setStorage(entry.level_count - first, storage_format(entry.source), level_size(entry.source.size, first))
+        .setLabel(entry.source.path);
+
+    //Levels both textures have are copied on the GPU, whole levels so block
+    //compressed ones don't need block-aligned sizes
+    for (Int level = std::max(first, entry.resident_first); level != entry.level_count; ++level)
+    {
+        const Vector2i size = level_size(entry.source.size, level);
+        glCopyImageSubData(entry.texture.id(), GL_TEXTURE_2D, level - entry.resident_first, 0, 0, 0,
+            texture.id(), GL_TEXTURE_2D, level - first, 0, 0, 0, size.x(), size.y(), 1);
+    }
+
+    entry.texture = std::move(texture);
+    entry.memory.resize(bytes_from(entry, first));
+    entry.resident_first = first;
+}
+
+bool TextureStreamer::make_room(std::size_t bytes, std::size_t requester)
+{
+    const std::size_t used = streaming_stats.resident_bytes + reserved_bytes;
+    if (used + bytes <= options.budget_bytes)
+    {
+        return true;
+    }
+    const std::size_t needed = used + bytes - options.budget_bytes;
+
+    //Only levels finer than their texture's demand, least recently used
+    //textures first. A texture nobody asked for wants just its tail.
+    std::vector<std::size_t> victims;
+    std::size_t evictable = 0;
+    for (std::size_t i = 0; i != entries.size(); ++i)
+    {
+        const Entry& entry = entries[i];
+        if (i != requester && entry.resident_first < entry.wanted_first)
+        {
+            victims.push_back(i);
+            evictable += bytes_from(entry, entry.resident_first) - bytes_from(entry, entry.wanted_first);
+        }
+    }
+    if (evictable < needed)
+    {
+        return false;
+    }
+
+    std::sort(victims.begin(), victims.end(), [&](std::size_t a, std::size_t b)
+    {
+        return entries[a].last_used < entries[b].last_used;
+    });
+
+    std::size_t freed = 0;
+    for (std::size_t i : victims)
+    {
+        Entry& entry = entries[i];
+        Int first = entry.resident_first;
+        std::size_t entry_freed = 0;
+        while (first < entry.wanted_first && freed + entry_freed < needed)
+        {
+            entry_freed += level_bytes(entry, first);
+            ++first;
+        }
+
+        streaming_stats.evicted_levels += std::size_t(first - entry.resident_first);
+        reallocate(entry, first);
+        freed += entry_freed;
+        if (freed >= needed)
+        {
+            break;
+        }
+    }
+
+    streaming_stats.resident_bytes -= freed;
+    return true;
+}
+
+void TextureStreamer::issue(std::size_t index)
+{
+    Entry& entry = entries[index];
+    const Int level = entry.resident_first - 1;
+    const Containers::ArrayView<const char> source = entry.source.levels[level];
+
+    entry.loading = level;
+    reserved_bytes += source.size();
+    ++reads_in_flight;
+
+    pool.submit([this, index, level, source](std::size_t)
+    {
+        ProfileZone zone{ "stream level read" };
+        //The copy is what pages the level in from disk, off the GL thread
+        Containers::Array<char> data{ Containers::NoInit, source.size() };
+        std::memcpy(data.data(), source.data(), source.size());
+        TrackedAllocation memory{ MemoryCategory::Staging, "streamed level read", data.size() };
+        completed.push(Read{ index, level, std::move(data), std::move(memory) });
+    });
+}
+
+bool TextureStreamer::update()
+{
+    ProfileZone zone{ "texture streaming" };
+    const auto start = Clock::now();
+    ++frame;
+
+    //Level with about one texel per pixel, rounded to the finer one
+    for (Entry& entry : entries)
+    {
+        if (entry.demand > 0.0f)
+        {
+            const float texels = float(entry.source.size.max());
+            const float level = std::log2(texels / entry.demand) + options.lod_bias;
+            entry.wanted_first = Math::clamp(Int(std::floor(level)), 0, entry.tail_first);
+            entry.last_used = frame;
+            if (entry.wanted_first < entry.resident_first)
+            {
+                ++streaming_stats.stalls;
+            }
+        }
+        else
+        {
+            entry.wanted_first = entry.tail_first;
+        }
+        entry.demand = 0.0f;
+    }
+
+    const std::size_t evicted_before = streaming_stats.evicted_levels;
+    bool changed = false;
+
+    Read read;
+    while (completed.try_pop(read))
+    {
+        --reads_in_flight;
+        arrived.push_back(std::move(read));
+    }
+
+    std::size_t uploaded = 0;
+    while (!arrived.empty() && uploaded < options.upload_bytes_per_frame)
+    {
+        Read next = std::move(arrived.front());
+        arrived.pop_front();
+
+        Entry& entry = entries[next.index];
+        entry.loading = -1;
+        reserved_bytes -= next.data.size();
+
+        //Evicted in the meantime or no longer wanted
+        if (next.level != entry.resident_first - 1 || next.level < entry.wanted_first)
+        {
+            continue;
+        }
+
+        reallocate(entry, next.level);
+        upload_level(entry.texture, 0, entry.source, next.level, next.data);
+        streaming_stats.resident_bytes += next.data.size();
+        ++streaming_stats.uploaded_levels;
+        streaming_stats.uploaded_bytes += next.data.size();
+        uploaded += next.data.size();
+        changed = true;
+    }
+
+    //Biggest shortfall first
+    std::vector<std::size_t> wanting;
+    for (std::size_t i = 0; i != entries.size(); ++i)
+    {
+        if (entries[i].loading < 0 && entries[i].wanted_first < entries[i].resident_first)
+        {
+            wanting.push_back(i);
+        }
+    }
+    std::sort(wanting.begin(), wanting.end(), [&](std::size_t a, std::size_t b)
+    {
+        return entries[a].resident_first - entries[a].wanted_first > entries[b].resident_first - entries[b].wanted_first;
+    });
+
+    for (std::size_t i : wanting)
+    {
+        if (!make_room(level_bytes(entries[i], entries[i].resident_first - 1), i))
+        {
+            ++streaming_stats.budget_stalls;
+            continue;
+        }
+        issue(i);
+    }
+
+    streaming_stats.pending_requests = reads_in_flight + arrived.size();
+    streaming_stats.update_ms = elapsed_ms(start);
+    return changed || streaming_stats.evicted_levels != evicted_before;
+}
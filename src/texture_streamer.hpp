@@ -0,0 +1,127 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/GL/Texture.h>
+#include <Corrade/Containers/Array.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "concurrent_queue.hpp"
+#include "memory_tracker.hpp"
+#include "texture_cache.hpp"
+#include "thread_pool.hpp"
+
+using namespace Magnum;
+
+struct TextureStreamingOptions
+{
+    std::size_t budget_bytes = std::size_t{ 32 } << 20; //all streamed textures together, the tails included
+    Int tail_size = 128; //levels this size and smaller are loaded up front and never evicted
+    std::size_t upload_bytes_per_frame = std::size_t{ 4 } << 20; //caps the GL thread time of update()
+    float lod_bias = 0.0f; //added to the wanted level, positive streams less
+};
+
+struct TextureStreamingStats
+{
+    std::size_t resident_bytes = 0;
+    std::size_t budget_bytes = 0;
+    std::size_t pending_requests = 0; //levels read on the pool or waiting for upload
+    //Totals since creation
+    std::size_t uploaded_levels = 0;
+    std::size_t uploaded_bytes = 0;
+    std::size_t evicted_levels = 0;
+    std::size_t stalls = 0; //texture-frames drawn coarser than the demand asked for
+    std::size_t budget_stalls = 0; //wanted levels that didn't fit even after evicting
+    double update_ms = 0.0; //GL thread time of the last update()
+};
+
+//Streams mip levels out of the texture cache under a byte budget. Every
+//texture starts with its tail (the levels up to tail_size) resident and the
+//scene reports per frame how many pixels a unit of UV covers; the level that
+//maps about one texel to a pixel is read from the mapped container on the
+//pool and uploaded in a later update(). When the budget is full, textures
+//holding levels finer than their demand give them up, least recently used
+//first.
+//
+//Without sparse textures a driver commits the whole storage of an immutable
+//texture, so the storage only covers the resident levels. Streaming a level
+//in or out allocates a texture of the new size and copies the levels both
+//have on the GPU, hence texture() objects change in update().
+class TextureStreamer
+{
+public:
+    //The level views of `textures` have to outlive the streamer. Uploads
+    //the tails, needs a current GL context.
+    explicit TextureStreamer(std::vector<CachedTexture>&& textures, ThreadPool& pool, const TextureStreamingOptions& options = {});
+
+    //Waits for reads still running on the pool
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    std::size_t size() const
+    {
+        return entries.size();
+    }
+
+    //Valid until the next update()
+    GL::Texture2D& texture(std::size_t index)
+    {
+        return entries[index].texture;
+    }
+
+    //Pixels one unit of UV covers where the texture is sampled most densely
+    //this frame, the maximum over all calls counts
+    void request(std::size_t index, float pixels_per_uv);
+
+    //GL thread, once per frame before drawing: turns the requests since the
+    //last call into wanted levels, uploads arrived levels, evicts and issues
+    //new reads. Returns true if any texture() object changed, anything
+    //caching texture bindings has to drop them.
+    bool update();
+
+    const TextureStreamingStats& stats() const
+    {
+        return streaming_stats;
+    }
+
+private:
+    struct Entry
+    {
+        CachedTexture source;
+        GL::Texture2D texture;
+        TrackedAllocation memory; //resident levels
+        Int level_count = 0;
+        Int tail_first = 0; //first level of the tail
+        Int resident_first = 0; //finest resident level, texture() level 0
+        Int wanted_first = 0;
+        Int loading = -1; //level being read, -1 for none
+        float demand = 0.0f; //since the last update()
+        std::uint64_t last_used = 0; //frame
+    };
+
+    struct Read
+    {
+        std::size_t index;
+        Int level;
+        Containers::Array<char> data;
+        TrackedAllocation memory;
+    };
+
+    std::size_t level_bytes(const Entry& entry, Int level) const;
+    std::size_t bytes_from(const Entry& entry, Int first) const;
+    void reallocate(Entry& entry, Int first);
+    bool make_room(std::size_t bytes, std::size_t requester);
+    void issue(std::size_t index);
+
+    ThreadPool& pool;
+    TextureStreamingOptions options;
+    std::vector<Entry> entries;
+    ConcurrentQueue<Read> completed;
+    std::deque<Read> arrived; //popped but over the upload limit
+    std::size_t reads_in_flight = 0;
+    std::size_t reserved_bytes = 0; //levels being read
+    std::uint64_t frame = 0;
+    TextureStreamingStats streaming_stats;
+};
@@ -0,0 +1,126 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include "profiler.hpp"
+
+ThreadPool::ThreadPool(std::size_t thread_count)
+{
+    if (thread_count == 0)
+    {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    workers.reserve(thread_count);
+    for (std::size_t i = 0; i < thread_count; ++i)
+    {
+        workers.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallel_for(std::size_t count, std::size_t grain,
+    const std::function<void(std::size_t begin, std::size_t end, std::size_t worker)>& fn)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    grain = std::max<std::size_t>(grain, 1);
+
+    struct State
+    {
+        std::atomic<std::size_t> next{ 0 };
+        std::atomic<std::size_t> done{ 0 };
+        std::size_t chunk_count = 0;
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+
+    auto state = std::make_shared<State>();
+    state->chunk_count = (count + grain - 1) / grain;
+
+    //Helpers that start after everything is done simply find no chunks left,
+    //so the caller only waits for chunk completion, never for the helpers
+    auto run = [state, count, grain, &fn](std::size_t worker)
+    {
+        for (;;)
+        {
+            const std::size_t chunk = state->next.fetch_add(1);
+            if (chunk >= state->chunk_count)
+            {
+                return;
+            }
+
+            const std::size_t begin = chunk * grain;
+            fn(begin, std::min(begin + grain, count), worker);
+
+            if (state->done.fetch_add(1) + 1 == state->chunk_count)
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->condition.notify_all();
+            }
+        }
+    };
+
+    const std::size_t helper_count = std::min(size(), state->chunk_count - 1);
+    for (std::size_t i = 0; i < helper_count; ++i)
+    {
+        //fn is only touched while chunks are left, i.e. before we return
+        enqueue(run);
+    }
+
+    run(size());
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock, [&] { return state->done.load() == state->chunk_count; });
+}
+
+void ThreadPool::enqueue(std::function<void(std::size_t)> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push(std::move(job));
+    }
+    condition.notify_one();
+}
+
+void ThreadPool::worker_loop(std::size_t index)
+{
+    set_profile_thread_name("worker " + std::to_string(index));
+
+    for (;;)
+    {
+        std::function<void(std::size_t)> job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+            if (stopping && jobs.empty())
+            {
+                return;
+            }
+
+            job = std::move(jobs.front());
+            jobs.pop();
+        }
+
+        ProfileZone zone{ "pool task" };
+        job(index);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    //0 -> std::thread::hardware_concurrency()
+    explicit ThreadPool(std::size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t size() const
+    {
+        return workers.size();
+    }
+
+    //f(worker_index) where worker_index is in [0, size())
+    template<class F>
+    auto submit(F&& f) -> std::future<std::invoke_result_t<F, std::size_t>>
+    {
+        using Result = std::invoke_result_t<F, std::size_t>;
+
+        auto task = std::make_shared<std::packaged_task<Result(std::size_t)>>(std::forward<F>(f));
+        std::future<Result> result = task->get_future();
+        enqueue([task](std::size_t worker) { (*task)(worker); });
+        return result;
+    }
+
+    //Splits [0, count) into chunks of `grain` items and blocks until all of them
+    //are processed. The calling thread takes part in the work and gets
+    //worker index size(), so per-worker scratch should be sized size() + 1.
+    //Safe to call from inside a pool task.
+    void parallel_for(std::size_t count, std::size_t grain,
+        const std::function<void(std::size_t begin, std::size_t end, std::size_t worker)>& fn);
+
+private:
+    void enqueue(std::function<void(std::size_t)> job);
+    void worker_loop(std::size_t index);
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void(std::size_t)>> jobs;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+};
@@ -0,0 +1,229 @@
+#include "turntable.hpp"
+#include <Magnum/GL/Renderer.h>
+#include <Magnum/GL/TimeQuery.h>
+#include <Magnum/ImageView.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/Trade/AbstractImageConverter.h>
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Containers/Pointer.h>
+#include <Corrade/PluginManager/Manager.h>
+#include <Corrade/Utility/Directory.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <utility>
+#include "memory_tracker.hpp"
+#include "offscreen_target.hpp"
+#include "readback_ring.hpp"
+
+using namespace Corrade;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double elapsed_ms(Clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+
+    const char* const render_mode_names[PBRShader::RENDER_MODE_COUNT]{ "basic", "albedo", "roughness", "metallic", "normal", "ao" };
+
+    //Timer queries are read back this many frames late, like in the benchmark
+    constexpr std::size_t QueryLatency = 3;
+
+    struct EncodeResult
+    {
+        bool written;
+        double ms;
+    };
+}
+
+const std::vector<TurntableMaterial>& turntable_materials()
+{
+    static const std::vector<TurntableMaterial> materials{
+        { "default", Vector3{ 1.0f } },
+        { "glossy", Vector3{ 1.0f, 0.35f, 1.0f } },
+        { "rough", Vector3{ 1.0f, 1.6f, 1.0f } },
+        { "dielectric", Vector3{ 1.0f, 1.0f, 0.0f } }
+    };
+    return materials;
+}
+
+bool render_turntable(DemoScene& scene, ThreadPool& pool, const TurntableConfig& config)
+{
+    const char* const plugin = config.format == "tga" ? "TgaImageConverter" : "PngImageConverter";
+    if (!Utility::Directory::mkpath(config.output_directory))
+    {
+        spdlog::error("Can't create {}", config.output_directory);
+        return false;
+    }
+
+    //Converter instances aren't thread-safe, every worker gets its own
+    PluginManager::Manager<Trade::AbstractImageConverter> manager;
+    std::vector<Containers::Pointer<Trade::AbstractImageConverter>> converters;
+    for (std::size_t i = 0; i != pool.size(); ++i)
+    {
+        converters.push_back(manager.loadAndInstantiate(plugin));
+        if (!converters.back())
+        {
+            spdlog::error("Can't load {}", plugin);
+            return false;
+        }
+    }
+
+    OffscreenTarget target{ config.resolution };
+    if (!target.bind())
+    {
+        return false;
+    }
+
+    Containers::Optional<PostProcess> post;
+    if (config.post_process)
+    {
+        post.emplace(config.resolution, *config.post_process);
+    }
+
+    ReadbackRing readback{ config.resolution, config.readback_slots };
+
+    std::vector<GL::TimeQuery> queries;
+    for (std::size_t i = 0; i != QueryLatency; ++i)
+    {
+        queries.push_back(GL::TimeQuery{ GL::TimeQuery::Target::TimeElapsed });
+    }
+
+    const std::size_t frames_per_material = config.angles * config.render_modes.size();
+    const std::size_t frame_count = frames_per_material * config.materials.size();
+
+    const auto frame_path = [&](std::size_t frame)
+    {
+        char angle[16];
+        std::snprintf(angle, sizeof(angle), "%03zu", frame % config.angles);
+        const std::string name = config.materials[frame / frames_per_material].name + "_"
+            + render_mode_names[config.render_modes[frame / config.angles % config.render_modes.size()]] + "_" + angle + "." + config.format;
+        return Utility::Directory::join(config.output_directory, name);
+    };
+
+    std::deque<std::future<EncodeResult>> encodes;
+    std::size_t written = 0;
+    std::size_t failed = 0;
+    double encode_ms = 0.0;
+    double encode_wait_ms = 0.0;
+    double copy_ms = 0.0;
+
+    const auto retire_oldest = [&]
+    {
+        const auto start = Clock::now();
+        const EncodeResult result = encodes.front().get();
+        encodes.pop_front();
+        encode_wait_ms += elapsed_ms(start);
+        encode_ms += result.ms;
+        ++(result.written ? written : failed);
+    };
+
+    //Copies the pixels out so the slot is free for the next readback right
+    //away. Bounded so a slow encoder can't pile up frames in memory.
+    const std::size_t max_encodes = std::max<std::size_t>(2 * pool.size(), 1);
+    const ReadbackRing::Consumer encode = [&](std::uint64_t frame, Containers::ArrayView<const char> pixels)
+    {
+        while (encodes.size() >= max_encodes)
+        {
+            retire_oldest();
+        }
+
+        const auto copy_start = Clock::now();
+        Containers::Array<char> image{ Containers::NoInit, pixels.size() };
+        std::memcpy(image.data(), pixels.data(), pixels.size());
+        TrackedAllocation image_memory{ MemoryCategory::Staging, "turntable frame", pixels.size() };
+        copy_ms += elapsed_ms(copy_start);
+
+        encodes.push_back(pool.submit([&converters, size = config.resolution, path = frame_path(std::size_t(frame)),
+            image = std::move(image), image_memory = std::move(image_memory)](std::size_t worker)
+        {
+            const auto start = Clock::now();
+            const bool exported = converters[worker]->exportToFile(ImageView2D{ PixelFormat::RGBA8Unorm, size, image }, path);
+            if (!exported)
+            {
+                spdlog::error("Can't write {}", path);
+            }
+            return EncodeResult{ exported, elapsed_ms(start) };
+        }));
+    };
+
+    spdlog::info("Turntable: {} materials x {} render modes x {} angles = {} frames at {}x{} into {}", config.materials.size(),
+        config.render_modes.size(), config.angles, frame_count, config.resolution.x(), config.resolution.y(), config.output_directory);
+
+    double submit_ms = 0.0;
+    double gpu_ms = 0.0;
+    const auto run_start = Clock::now();
+    for (std::size_t frame = 0; frame != frame_count; ++frame)
+    {
+        if (frame >= QueryLatency)
+        {
+            gpu_ms += queries[frame % QueryLatency].result<UnsignedLong>() / 1.0e6;
+        }
+
+        const std::size_t angle = frame % config.angles;
+        SceneFrame scene_frame;
+        scene_frame.time = 360.0 * double(angle) / double(config.angles) / SceneRotationSpeed;
+        //The window's light with the cursor in the middle
+        scene_frame.light_direction = Vector3{ 0.0f, 0.0f, -1.0f };
+        scene_frame.render_mode = config.render_modes[frame / config.angles % config.render_modes.size()];
+        scene_frame.material_factors = config.materials[frame / frames_per_material].factors;
+
+        const auto submit_start = Clock::now();
+        queries[frame % QueryLatency].begin();
+        if (post)
+        {
+            //Another mode or material, nothing to accumulate from
+            if (angle == 0)
+            {
+                post->reset_history();
+            }
+
+            post->begin_frame();
+            scene_frame.jitter = post->jitter();
+            scene.draw(scene_frame, post->render_size());
+            post->end_frame(target.framebuffer, scene.reprojection());
+        }
+        else
+        {
+            target.framebuffer.clear(GL::FramebufferClear::Color | GL::FramebufferClear::Depth);
+            scene.draw(scene_frame, config.resolution);
+        }
+        queries[frame % QueryLatency].end();
+        submit_ms += elapsed_ms(submit_start);
+
+        readback.read(target.framebuffer, frame, encode);
+        readback.poll(encode);
+    }
+
+    readback.finish(encode);
+    for (std::size_t frame = frame_count > QueryLatency ? frame_count - QueryLatency : 0; frame != frame_count; ++frame)
+    {
+        gpu_ms += queries[frame % QueryLatency].result<UnsignedLong>() / 1.0e6;
+    }
+    while (!encodes.empty())
+    {
+        retire_oldest();
+    }
+
+    const double total_ms = elapsed_ms(run_start);
+    const double frames = double(std::max<std::size_t>(frame_count, 1));
+    spdlog::info("  {} frames written in {:.2f} s, {:.1f} fps", written, total_ms / 1000.0,
+        total_ms > 0.0 ? frame_count * 1000.0 / total_ms : 0.0);
+    spdlog::info("  per frame: submit {:.2f} ms, GPU {:.2f} ms, readback wait {:.2f} ms, copy {:.2f} ms, encode {:.2f} ms on {} threads",
+        submit_ms / frames, gpu_ms / frames, readback.wait_ms() / frames, copy_ms / frames, encode_ms / frames, pool.size());
+    spdlog::info("  {:.2f} ms waiting for encoders in total", encode_wait_ms);
+
+    if (failed != 0)
+    {
+        spdlog::error("{} frames couldn't be written", failed);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector2.h>
+#include <Magnum/Math/Vector3.h>
+#include <Corrade/Containers/Optional.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "demo_scene.hpp"
+#include "post_process.hpp"
+#include "thread_pool.hpp"
+
+using namespace Magnum;
+
+//Variation of the loaded material maps, SceneFrame::material_factors
+struct TurntableMaterial
+{
+    std::string name;
+    Vector3 factors{ 1.0f }; //albedo, roughness, metallic
+};
+
+//default, glossy, rough, dielectric
+const std::vector<TurntableMaterial>& turntable_materials();
+
+struct TurntableConfig
+{
+    std::size_t angles = 36; //evenly spaced over a full turn
+    std::vector<int> render_modes{ 0 };
+    std::vector<TurntableMaterial> materials{ TurntableMaterial{ "default" } };
+    Vector2i resolution{ 1024, 1024 };
+    std::string output_directory = "turntable";
+    std::string format = "png"; //png or tga
+    std::size_t readback_slots = 4;
+    Containers::Optional<PostProcessOptions> post_process;
+};
+
+//Renders every material, render mode and angle offscreen and writes one
+//image per frame, named <material>_<mode>_<angle>.<format>. Frames are read
+//back asynchronously and encoded on the pool while the next ones render,
+//the log shows the throughput and where the time went. Needs a current GL
+//context.
+bool render_turntable(DemoScene& scene, ThreadPool& pool, const TurntableConfig& config);
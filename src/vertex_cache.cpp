@@ -0,0 +1,220 @@
+#include "vertex_cache.hpp"
+#include <Corrade/Utility/Assert.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace
+{
+    constexpr int CacheSize = 32;
+    constexpr float LastTriangleScore = 0.75f;
+    constexpr float CacheDecayPower = 1.5f;
+    constexpr float ValenceBoostScale = 2.0f;
+    constexpr float ValenceBoostPower = -0.5f;
+
+    float vertex_score(int cache_position, UnsignedInt remaining_triangles)
+    {
+        if (remaining_triangles == 0)
+        {
+            return -1.0f;
+        }
+
+        float score = 0.0f;
+        if (cache_position >= 0)
+        {
+            //The last triangle's vertices get a fixed score so the next one
+            //doesn't just reuse the same edge
+            score = cache_position < 3 ? LastTriangleScore
+                : std::pow(1.0f - float(cache_position - 3) / (CacheSize - 3), CacheDecayPower);
+        }
+
+        return score + ValenceBoostScale * std::pow(float(remaining_triangles), ValenceBoostPower);
+    }
+}
+
+void optimize_vertex_cache(Containers::ArrayView<UnsignedInt> indices, std::size_t vertex_count)
+{
+    CORRADE_INTERNAL_ASSERT(indices.size() % 3 == 0);
+    const std::size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+    {
+        return;
+    }
+
+    //Triangles of every vertex, CSR style
+    std::vector<UnsignedInt> remaining(vertex_count, 0);
+    for (UnsignedInt index : indices)
+    {
+        ++remaining[index];
+    }
+
+    std::vector<std::size_t> offsets(vertex_count + 1, 0);
+    for (std::size_t v = 0; v != vertex_count; ++v)
+    {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+
+    std::vector<UnsignedInt> vertex_triangles(indices.size());
+    std::vector<std::size_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i != indices.size(); ++i)
+    {
+        vertex_triangles[cursor[indices[i]]++] = UnsignedInt(i / 3);
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> score(vertex_count);
+    for (std::size_t v = 0; v != vertex_count; ++v)
+    {
+        score[v] = vertex_score(-1, remaining[v]);
+    }
+
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    for (std::size_t t = 0; t != triangle_count; ++t)
+    {
+        triangle_score[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+    }
+
+    std::vector<UnsignedInt> output;
+    output.reserve(indices.size());
+
+    //LRU, three extra slots for the vertices pushed out by the newest triangle
+    std::vector<UnsignedInt> cache;
+    cache.reserve(CacheSize + 3);
+    std::vector<UnsignedInt> next_cache;
+    next_cache.reserve(CacheSize + 3);
+
+    std::size_t best = std::numeric_limits<std::size_t>::max();
+    std::size_t scan_start = 0;
+    for (std::size_t emitted_count = 0; emitted_count != triangle_count; ++emitted_count)
+    {
+        //No candidate next to the cache, take the best remaining one
+        if (best == std::numeric_limits<std::size_t>::max())
+        {
+            float best_score = -std::numeric_limits<float>::max();
+            while (emitted[scan_start])
+            {
+                ++scan_start;
+            }
+            for (std::size_t t = scan_start; t != triangle_count; ++t)
+            {
+                if (!emitted[t] && triangle_score[t] > best_score)
+                {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        emitted[best] = true;
+        const UnsignedInt* const triangle = indices.data() + best * 3;
+
+        next_cache.clear();
+        for (std::size_t c = 0; c != 3; ++c)
+        {
+            const UnsignedInt v = triangle[c];
+            output.push_back(v);
+            next_cache.push_back(v);
+
+            //Drop the triangle from the vertex's list of remaining ones
+            UnsignedInt* const begin = vertex_triangles.data() + offsets[v];
+            UnsignedInt* const end = begin + remaining[v];
+            std::iter_swap(std::find(begin, end, UnsignedInt(best)), end - 1);
+            --remaining[v];
+        }
+
+        for (UnsignedInt v : cache)
+        {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+            {
+                next_cache.push_back(v);
+            }
+        }
+        std::swap(cache, next_cache);
+
+        for (UnsignedInt v : next_cache)
+        {
+            cache_position[v] = -1;
+        }
+
+        //Rescore the cached vertices and their triangles, the best of
+        //those is the next candidate
+        best = std::numeric_limits<std::size_t>::max();
+        float best_score = -std::numeric_limits<float>::max();
+        for (std::size_t i = 0; i != cache.size(); ++i)
+        {
+            const UnsignedInt v = cache[i];
+            cache_position[v] = i < std::size_t(CacheSize) ? int(i) : -1;
+
+            const float new_score = vertex_score(cache_position[v], remaining[v]);
+            const float delta = new_score - score[v];
+            score[v] = new_score;
+
+            for (std::size_t k = offsets[v]; k != offsets[v] + remaining[v]; ++k)
+            {
+                const UnsignedInt t = vertex_triangles[k];
+                triangle_score[t] += delta;
+                if (triangle_score[t] > best_score)
+                {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        if (cache.size() > std::size_t(CacheSize))
+        {
+            cache.resize(CacheSize);
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void optimize_vertex_fetch(Containers::ArrayView<UnsignedInt> indices, Containers::ArrayView<UnsignedInt> remap)
+{
+    constexpr UnsignedInt Unused = ~UnsignedInt{};
+    std::fill(remap.begin(), remap.end(), Unused);
+
+    UnsignedInt next = 0;
+    for (UnsignedInt& index : indices)
+    {
+        if (remap[index] == Unused)
+        {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+
+    //Vertices no triangle references go last
+    for (UnsignedInt& target : remap)
+    {
+        if (target == Unused)
+        {
+            target = next++;
+        }
+    }
+}
+
+float average_cache_miss_ratio(Containers::ArrayView<const UnsignedInt> indices, std::size_t vertex_count, std::size_t cache_size)
+{
+    if (indices.size() < 3)
+    {
+        return 0.0f;
+    }
+
+    //FIFO: a hit doesn't move the entry. Each vertex remembers when it
+    //entered, it's still cached while fewer than cache_size misses followed.
+    std::vector<std::size_t> entered(vertex_count, std::numeric_limits<std::size_t>::max());
+    std::size_t misses = 0;
+    for (UnsignedInt index : indices)
+    {
+        if (entered[index] == std::numeric_limits<std::size_t>::max() || misses - entered[index] >= cache_size)
+        {
+            entered[index] = misses++;
+        }
+    }
+
+    return float(misses) / float(indices.size() / 3);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <Magnum/Magnum.h>
+#include <Corrade/Containers/ArrayView.h>
+#include <cstddef>
+
+using namespace Magnum;
+
+//Reorders triangles for the post-transform vertex cache with Forsyth's
+//linear-speed algorithm: greedily emits the triangle whose vertices score
+//highest, favouring ones already in a simulated LRU cache and ones with
+//few remaining triangles so no vertex is left stranded.
+void optimize_vertex_cache(Containers::ArrayView<UnsignedInt> indices, std::size_t vertex_count);
+
+//Renumbers vertices in order of first use so vertex fetch walks memory
+//linearly. remap[old] is the new index, the caller moves the vertex data.
+void optimize_vertex_fetch(Containers::ArrayView<UnsignedInt> indices, Containers::ArrayView<UnsignedInt> remap);
+
+//Average cache miss ratio, transformed vertices per triangle with a FIFO
+//cache like most GPUs have. 0.5 is the ideal for large regular meshes, 3
+//the worst case.
+float average_cache_miss_ratio(Containers::ArrayView<const UnsignedInt> indices, std::size_t vertex_count, std::size_t cache_size = 32);